@@ -0,0 +1,70 @@
+#include "backoff.h"
+#include <time.h>
+
+void backoff_init(Backoff *backoff, uint64_t min_ns, uint64_t max_ns, uint64_t seed)
+{
+    if (!backoff)
+    {
+        return;
+    }
+
+    if (seed == 0)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        seed = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    backoff->min_ns = min_ns > 0 ? min_ns : 1;
+    backoff->max_ns = max_ns > backoff->min_ns ? max_ns : backoff->min_ns;
+    backoff->attempts = 0;
+
+    // splitmix64 spreads close seeds apart; xorshift must never start from zero
+    seed += 0x9E3779B97F4A7C15ull;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+    seed ^= seed >> 31;
+    backoff->seed = seed ? seed : 1;
+}
+
+// xorshift64*, plenty for jitter
+static uint64_t backoff_random(Backoff *backoff)
+{
+    backoff->seed ^= backoff->seed >> 12;
+    backoff->seed ^= backoff->seed << 25;
+    backoff->seed ^= backoff->seed >> 27;
+    return backoff->seed * 0x2545F4914F6CDD1Dull;
+}
+
+uint64_t backoff_next(Backoff *backoff)
+{
+    if (!backoff)
+    {
+        return 0;
+    }
+
+    uint64_t ceiling = backoff->min_ns;
+    for (unsigned i = 0; i < backoff->attempts && ceiling < backoff->max_ns; i++)
+    {
+        ceiling = ceiling > backoff->max_ns / 2 ? backoff->max_ns : ceiling * 2;
+    }
+    if (ceiling > backoff->max_ns)
+    {
+        ceiling = backoff->max_ns;
+    }
+    if (ceiling < backoff->max_ns)
+    {
+        backoff->attempts++;
+    }
+
+    uint64_t half = ceiling / 2;
+    return ceiling - half + backoff_random(backoff) % (half + 1);
+}
+
+void backoff_reset(Backoff *backoff)
+{
+    if (backoff)
+    {
+        backoff->attempts = 0;
+    }
+}
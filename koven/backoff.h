@@ -0,0 +1,27 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+// Delays between the attempts to restore a lost connection
+// The ceiling doubles with every failed attempt, from min_ns up to max_ns, and each delay is
+// drawn uniformly between half the ceiling and the ceiling: connections lost together, within
+// one emulator or across a fleet of them, spread their attempts instead of hitting the broker
+// all at once
+typedef struct {
+    uint64_t min_ns;
+    uint64_t max_ns;
+    unsigned attempts;
+    uint64_t seed;
+} Backoff;
+
+// seed makes the jitter of each connection different, 0 picks one from the clock
+void backoff_init(Backoff *backoff, uint64_t min_ns, uint64_t max_ns, uint64_t seed);
+
+// Delay to wait before the next attempt, counting one more failed attempt
+uint64_t backoff_next(Backoff *backoff);
+
+// Starts over from min_ns, once the connection is back
+void backoff_reset(Backoff *backoff);
+
+#endif /* BACKOFF_H */
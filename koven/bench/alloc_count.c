@@ -0,0 +1,43 @@
+#include "alloc_count.h"
+#include <stddef.h>
+
+#ifdef KOVEN_BENCH_COUNT_ALLOCATIONS
+static uint64_t allocations;
+static uint64_t allocated_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    allocated_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocations++;
+    allocated_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    allocated_bytes += size;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+void alloc_count_read(AllocCount *out)
+{
+#ifdef KOVEN_BENCH_COUNT_ALLOCATIONS
+    out->count = allocations;
+    out->bytes = allocated_bytes;
+#else
+    out->count = 0;
+    out->bytes = 0;
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stdint.h>
+
+// Allocation counters of the benchmarks, fed by the --wrap=malloc/calloc/realloc wrappers when
+// the linker supports them (KOVEN_BENCH_COUNT_ALLOCATIONS)
+typedef struct {
+    uint64_t count;
+    uint64_t bytes;
+} AllocCount;
+
+// Reads the allocations made since the process started; both are 0 when they are not counted
+void alloc_count_read(AllocCount *out);
+
+#endif /* ALLOC_COUNT_H */
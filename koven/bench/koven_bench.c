@@ -0,0 +1,628 @@
+// Headless throughput benchmark of the emulator, without a broker
+// Every simulated tick runs the loop of the MQTT client entirely in process: the command frames
+// received by the ovens are decoded with unmarshall_command_frame and executed, then every oven
+// is ticked and its event encoded with marshall_event_frame
+// With --replay, a capture log of the emulator is replayed instead (see replay.h)
+// Results are printed as text, or as a single JSON object with --json
+
+#include "../fleet.h"
+#include "../koven.h"
+#include "../protocol.h"
+#include "../recording.h"
+#include "../replay.h"
+#include "alloc_count.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef KOVEN_VERSION
+#define KOVEN_VERSION "unknown"
+#endif
+
+#define NS_PER_SECOND 1000000000ull
+
+// Number of distinct command frames the commands are drawn from
+#define COMMAND_POOL_SIZE 256
+
+typedef struct {
+    size_t ovens;
+    unsigned ticks;
+    unsigned warmup;
+    uint32_t seed;
+    int batch;
+    int json;
+    const char *replay;
+
+    // Probability that an oven receives a command on a given tick
+    double command_rate;
+
+    // Relative weights of the START, STOP and corrupted (bad CRC) command frames
+    unsigned start_weight;
+    unsigned stop_weight;
+    unsigned invalid_weight;
+} BenchConfig;
+
+typedef struct {
+    uint64_t elapsed_ns;
+    uint64_t oven_ticks;
+    uint64_t event_frames;
+    uint64_t event_bytes;
+    uint64_t command_frames;
+    uint64_t rejected_frames;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+
+    // Per tick of the whole fleet, divided by the number of ovens
+    double ns_per_op_mean;
+    double ns_per_op_p50;
+    double ns_per_op_p90;
+    double ns_per_op_p99;
+    double ns_per_op_max;
+
+    // Folded over the CRC of every event frame so that the encoding cannot be optimized away
+    uint32_t checksum;
+} BenchResult;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+// xorshift32: cheap enough to run once per oven and tick inside the timed loop
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Encodes a command frame; invalid frames get a corrupted CRC
+static void encode_command_frame(const CommandPayload *cmd, int invalid, uint8_t *frame)
+{
+    frame[0] = MSG_TYPE_COMMAND;
+    frame[1] = (uint8_t)sizeof(CommandPayload);
+    frame[2] = 0;
+    frame[3] = cmd->action;
+    frame[4] = (uint8_t)((uint16_t)cmd->temperature & 0xFF);
+    frame[5] = (uint8_t)((uint16_t)cmd->temperature >> 8);
+    frame[6] = (uint8_t)((uint16_t)cmd->duration & 0xFF);
+    frame[7] = (uint8_t)((uint16_t)cmd->duration >> 8);
+
+    uint16_t crc = crc16_usb(frame, 3 + sizeof(CommandPayload));
+    if (invalid)
+    {
+        crc ^= 0xFFFF;
+    }
+    frame[8] = (uint8_t)(crc & 0xFF);
+    frame[9] = (uint8_t)(crc >> 8);
+}
+
+// Draws the pool of command frames following the weights of the command mix
+static void build_command_pool(const BenchConfig *config, uint8_t pool[][COMMAND_FRAME_SIZE])
+{
+    uint32_t state = config->seed ^ 0x9E3779B9u;
+    unsigned total = config->start_weight + config->stop_weight + config->invalid_weight;
+
+    for (size_t i = 0; i < COMMAND_POOL_SIZE; i++)
+    {
+        unsigned pick = next_random(&state) % total;
+
+        CommandPayload cmd;
+        cmd.action = pick < config->start_weight ? ACTION_START : ACTION_STOP;
+        cmd.temperature = (int16_t)(150 + next_random(&state) % 100);
+        cmd.duration = (int16_t)(60 + next_random(&state) % 3600);
+
+        encode_command_frame(&cmd, pick >= config->start_weight + config->stop_weight, pool[i]);
+    }
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, size_t n, double p)
+{
+    size_t rank = (size_t)(p * (double)n + 0.999999);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    return sorted[(rank > n ? n : rank) - 1];
+}
+
+// Runs one simulated tick of the whole fleet and returns its duration
+// The scalar path keeps one Koven per oven and goes through koven_tick and marshall_event_frame,
+// the batch path ticks the fleet table with koven_tick_batch and marshall_event_frames
+static uint64_t run_tick(const BenchConfig *config,
+                         uint8_t pool[][COMMAND_FRAME_SIZE],
+                         uint32_t command_threshold,
+                         uint32_t *random_state,
+                         Koven *ovens,
+                         KovenFleet *fleet,
+                         EventPayload *events,
+                         uint8_t *out,
+                         BenchResult *result)
+{
+    uint64_t start = now_ns();
+
+    for (size_t i = 0; i < config->ovens; i++)
+    {
+        uint32_t r = next_random(random_state);
+        if (r >= command_threshold)
+        {
+            continue;
+        }
+
+        CommandPayload cmd;
+        if (unmarshall_command_frame(pool[r % COMMAND_POOL_SIZE], COMMAND_FRAME_SIZE, &cmd) != 0)
+        {
+            result->rejected_frames++;
+            continue;
+        }
+        result->command_frames++;
+
+        if (config->batch)
+        {
+            fleet_execute(fleet, (uint32_t)i, &cmd);
+        }
+        else
+        {
+            koven_execute(&ovens[i], &cmd);
+        }
+    }
+
+    if (config->batch)
+    {
+        koven_tick_batch(fleet, config->ovens, events);
+        marshall_event_frames(events, config->ovens, out, config->ovens * EVENT_FRAME_SIZE, NULL);
+        result->event_frames += config->ovens;
+        result->event_bytes += config->ovens * EVENT_FRAME_SIZE;
+    }
+    else
+    {
+        for (size_t i = 0; i < config->ovens; i++)
+        {
+            EventPayload event;
+            koven_tick(&ovens[i], &event);
+            int len = marshall_event_frame(&event, &out[i * EVENT_FRAME_SIZE], EVENT_FRAME_SIZE);
+            if (len > 0)
+            {
+                result->event_frames++;
+                result->event_bytes += (uint64_t)len;
+            }
+        }
+    }
+
+    uint64_t elapsed = now_ns() - start;
+
+    // Outside of the timed section: one CRC byte of every frame is enough to keep the work live
+    for (size_t i = 0; i < config->ovens; i++)
+    {
+        const uint8_t *frame = &out[i * EVENT_FRAME_SIZE];
+        result->checksum = result->checksum * 31u + frame[EVENT_FRAME_SIZE - 1];
+    }
+
+    return elapsed;
+}
+
+// Runs the benchmark described by config
+// Returns 0 on success, -1 if the buffers could not be allocated
+static int run_bench(const BenchConfig *config, BenchResult *result)
+{
+    static uint8_t pool[COMMAND_POOL_SIZE][COMMAND_FRAME_SIZE];
+    build_command_pool(config, pool);
+
+    Koven *ovens = NULL;
+    KovenFleet fleet;
+    memset(&fleet, 0, sizeof(fleet));
+
+    if (config->batch)
+    {
+        if (fleet_init(&fleet, 0, config->ovens) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        ovens = malloc(config->ovens * sizeof(Koven));
+        if (!ovens)
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < config->ovens; i++)
+        {
+            koven_init(&ovens[i]);
+        }
+    }
+
+    EventPayload *events = malloc(config->ovens * sizeof(EventPayload));
+    uint8_t *out = malloc(config->ovens * EVENT_FRAME_SIZE);
+    double *samples = malloc((config->ticks > 0 ? config->ticks : 1) * sizeof(double));
+    if (!events || !out || !samples)
+    {
+        free(events);
+        free(out);
+        free(samples);
+        free(ovens);
+        fleet_free(&fleet);
+        return -1;
+    }
+
+    // A command arrives when a 32-bit random number falls under the threshold
+    uint32_t command_threshold = (uint32_t)(config->command_rate * 4294967295.0);
+    uint32_t random_state = config->seed ? config->seed : 1;
+
+    BenchResult warmup;
+    memset(&warmup, 0, sizeof(warmup));
+    for (unsigned t = 0; t < config->warmup; t++)
+    {
+        run_tick(
+            config, pool, command_threshold, &random_state, ovens, &fleet, events, out, &warmup);
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->checksum = warmup.checksum;
+
+    AllocCount allocations_before;
+    alloc_count_read(&allocations_before);
+
+    for (unsigned t = 0; t < config->ticks; t++)
+    {
+        uint64_t ns = run_tick(
+            config, pool, command_threshold, &random_state, ovens, &fleet, events, out, result);
+        result->elapsed_ns += ns;
+        samples[t] = (double)ns / (double)config->ovens;
+    }
+
+    AllocCount allocations_after;
+    alloc_count_read(&allocations_after);
+    result->allocations = allocations_after.count - allocations_before.count;
+    result->allocated_bytes = allocations_after.bytes - allocations_before.bytes;
+
+    result->oven_ticks = (uint64_t)config->ticks * config->ovens;
+    if (config->ticks > 0)
+    {
+        qsort(samples, config->ticks, sizeof(double), compare_doubles);
+        result->ns_per_op_mean = (double)result->elapsed_ns / (double)result->oven_ticks;
+        result->ns_per_op_p50 = percentile(samples, config->ticks, 0.50);
+        result->ns_per_op_p90 = percentile(samples, config->ticks, 0.90);
+        result->ns_per_op_p99 = percentile(samples, config->ticks, 0.99);
+        result->ns_per_op_max = samples[config->ticks - 1];
+    }
+
+    free(events);
+    free(out);
+    free(samples);
+    free(ovens);
+    fleet_free(&fleet);
+    return 0;
+}
+
+static double per_second(uint64_t count, uint64_t elapsed_ns)
+{
+    return elapsed_ns > 0 ? (double)count * NS_PER_SECOND / (double)elapsed_ns : 0;
+}
+
+static void print_text(const BenchConfig *config, const BenchResult *result)
+{
+    double seconds = (double)result->elapsed_ns / NS_PER_SECOND;
+    uint64_t frames = result->event_frames + result->command_frames + result->rejected_frames;
+
+    printf("koven_bench %s (%s tick, crc %s)\n",
+           KOVEN_VERSION,
+           config->batch ? "batch" : "scalar",
+           crc16_usb_fast_name());
+    printf("  ovens %zu, ticks %u, command rate %g, mix %u:%u:%u\n",
+           config->ovens,
+           config->ticks,
+           config->command_rate,
+           config->start_weight,
+           config->stop_weight,
+           config->invalid_weight);
+    printf("  elapsed      %.3f s\n", seconds);
+    printf("  oven ticks/s %.0f\n", per_second(result->oven_ticks, result->elapsed_ns));
+    printf("  fleet ticks/s %.1f\n", per_second(config->ticks, result->elapsed_ns));
+    printf("  frames/s     %.0f (%llu events, %llu commands, %llu rejected)\n",
+           per_second(frames, result->elapsed_ns),
+           (unsigned long long)result->event_frames,
+           (unsigned long long)result->command_frames,
+           (unsigned long long)result->rejected_frames);
+    printf("  ns/op        mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+           result->ns_per_op_mean,
+           result->ns_per_op_p50,
+           result->ns_per_op_p90,
+           result->ns_per_op_p99,
+           result->ns_per_op_max);
+#ifdef KOVEN_BENCH_COUNT_ALLOCATIONS
+    printf("  allocations  %llu (%llu bytes)\n",
+           (unsigned long long)result->allocations,
+           (unsigned long long)result->allocated_bytes);
+#else
+    printf("  allocations  not counted on this platform\n");
+#endif
+}
+
+static void print_json(const BenchConfig *config, const BenchResult *result)
+{
+    uint64_t frames = result->event_frames + result->command_frames + result->rejected_frames;
+
+    printf("{\"benchmark\":\"koven\",\"version\":\"%s\",\"tick\":\"%s\",\"crc\":\"%s\",",
+           KOVEN_VERSION,
+           config->batch ? "batch" : "scalar",
+           crc16_usb_fast_name());
+    printf("\"ovens\":%zu,\"ticks\":%u,\"warmup\":%u,\"seed\":%u,",
+           config->ovens,
+           config->ticks,
+           config->warmup,
+           config->seed);
+    printf("\"mix\":{\"command_rate\":%g,\"start\":%u,\"stop\":%u,\"invalid\":%u},",
+           config->command_rate,
+           config->start_weight,
+           config->stop_weight,
+           config->invalid_weight);
+    printf("\"elapsed_ns\":%llu,\"oven_ticks_per_s\":%.1f,\"fleet_ticks_per_s\":%.3f,",
+           (unsigned long long)result->elapsed_ns,
+           per_second(result->oven_ticks, result->elapsed_ns),
+           per_second(config->ticks, result->elapsed_ns));
+    printf("\"frames_per_s\":%.1f,\"event_frames\":%llu,\"event_bytes\":%llu,",
+           per_second(frames, result->elapsed_ns),
+           (unsigned long long)result->event_frames,
+           (unsigned long long)result->event_bytes);
+    printf("\"command_frames\":%llu,\"rejected_frames\":%llu,",
+           (unsigned long long)result->command_frames,
+           (unsigned long long)result->rejected_frames);
+    printf("\"ns_per_op\":{\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},",
+           result->ns_per_op_mean,
+           result->ns_per_op_p50,
+           result->ns_per_op_p90,
+           result->ns_per_op_p99,
+           result->ns_per_op_max);
+#ifdef KOVEN_BENCH_COUNT_ALLOCATIONS
+    printf("\"allocations\":{\"count\":%llu,\"bytes\":%llu},",
+           (unsigned long long)result->allocations,
+           (unsigned long long)result->allocated_bytes);
+#else
+    printf("\"allocations\":null,");
+#endif
+    printf("\"checksum\":%u}\n", result->checksum);
+}
+
+static void print_replay(const BenchConfig *config, const ReplayResult *result)
+{
+    uint64_t frames = result->events + result->commands;
+
+    if (config->json)
+    {
+        printf("{\"benchmark\":\"koven_replay\",\"version\":\"%s\",\"crc\":\"%s\",",
+               KOVEN_VERSION,
+               crc16_usb_fast_name());
+        printf("\"ovens\":%llu,\"ticks\":%llu,\"elapsed_ns\":%llu,",
+               (unsigned long long)result->ovens,
+               (unsigned long long)result->ticks,
+               (unsigned long long)result->elapsed_ns);
+        printf("\"oven_ticks_per_s\":%.1f,\"frames_per_s\":%.1f,",
+               per_second(result->ovens * result->ticks, result->elapsed_ns),
+               per_second(frames, result->elapsed_ns));
+        printf("\"command_frames\":%llu,\"rejected_frames\":%llu,\"event_frames\":%llu,",
+               (unsigned long long)result->commands,
+               (unsigned long long)result->rejected,
+               (unsigned long long)result->events);
+        printf("\"mismatches\":%llu}\n", (unsigned long long)result->mismatches);
+        return;
+    }
+
+    printf("koven_bench %s replay of %s (crc %s)\n",
+           KOVEN_VERSION,
+           config->replay,
+           crc16_usb_fast_name());
+    printf("  ovens %llu, ticks %llu\n",
+           (unsigned long long)result->ovens,
+           (unsigned long long)result->ticks);
+    printf("  elapsed      %.3f s\n", (double)result->elapsed_ns / NS_PER_SECOND);
+    printf("  oven ticks/s %.0f\n",
+           per_second(result->ovens * result->ticks, result->elapsed_ns));
+    printf("  frames/s     %.0f (%llu events, %llu commands, %llu rejected)\n",
+           per_second(frames, result->elapsed_ns),
+           (unsigned long long)result->events,
+           (unsigned long long)result->commands,
+           (unsigned long long)result->rejected);
+    if (result->mismatches > 0)
+    {
+        printf("  mismatches   %llu, first on tick %llu of oven %u\n",
+               (unsigned long long)result->mismatches,
+               (unsigned long long)result->first_mismatch_tick,
+               result->first_mismatch_id);
+    }
+    else
+    {
+        printf("  mismatches   none\n");
+    }
+}
+
+// Replays the capture log of config
+// Returns EXIT_SUCCESS when every recorded event was reproduced
+static int run_replay(const BenchConfig *config)
+{
+    uint8_t *data;
+    size_t len;
+    if (recording_load(config->replay, &data, &len) != 0)
+    {
+        fprintf(stderr, "Failed to read %s\n", config->replay);
+        return EXIT_FAILURE;
+    }
+
+    ReplayResult result;
+    int status = replay_recording(data, len, &result);
+    free(data);
+    if (status != 0)
+    {
+        fprintf(stderr, "%s is not a valid capture log\n", config->replay);
+        return EXIT_FAILURE;
+    }
+
+    print_replay(config, &result);
+    return result.mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --ovens N           Number of simulated ovens (default 10000)\n"
+            "  --ticks N           Timed ticks of the whole fleet (default 1000)\n"
+            "  --warmup N          Untimed ticks run first (default 10)\n"
+            "  --command-rate P    Chance that an oven gets a command on a tick (default 0.01)\n"
+            "  --mix S:T:I         Weights of START, STOP and corrupted commands (default 8:2:0)\n"
+            "  --seed N            Seed of the command generator (default 1)\n"
+            "  --batch             Tick the fleet table with koven_tick_batch\n"
+            "  --replay FILE       Replay a capture log (KOVEN_RECORD_PATH) and check its events\n"
+            "  --json              Print the results as one JSON object\n",
+            program);
+}
+
+// Parses an unsigned integer argument, returning -1 if it is not a plain number
+static int parse_ulong(const char *value, unsigned long *out)
+{
+    char *end;
+    if (!value || *value == '\0')
+    {
+        return -1;
+    }
+    *out = strtoul(value, &end, 10);
+    return *end == '\0' ? 0 : -1;
+}
+
+// Parses the command line into config
+// Returns 0 on success, -1 on an invalid option
+static int parse_args(int argc, char *argv[], BenchConfig *config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        unsigned long number;
+
+        if (strcmp(arg, "--batch") == 0)
+        {
+            config->batch = 1;
+            continue;
+        }
+        if (strcmp(arg, "--json") == 0)
+        {
+            config->json = 1;
+            continue;
+        }
+        if (!value)
+        {
+            return -1;
+        }
+        i++;
+
+        if (strcmp(arg, "--ovens") == 0 && parse_ulong(value, &number) == 0 && number > 0)
+        {
+            config->ovens = number;
+        }
+        else if (strcmp(arg, "--ticks") == 0 && parse_ulong(value, &number) == 0 && number > 0 &&
+                 number <= UINT32_MAX)
+        {
+            config->ticks = (unsigned)number;
+        }
+        else if (strcmp(arg, "--warmup") == 0 && parse_ulong(value, &number) == 0 &&
+                 number <= UINT32_MAX)
+        {
+            config->warmup = (unsigned)number;
+        }
+        else if (strcmp(arg, "--replay") == 0)
+        {
+            config->replay = value;
+        }
+        else if (strcmp(arg, "--seed") == 0 && parse_ulong(value, &number) == 0)
+        {
+            config->seed = (uint32_t)number;
+        }
+        else if (strcmp(arg, "--command-rate") == 0)
+        {
+            char *end;
+            config->command_rate = strtod(value, &end);
+            if (*end != '\0' || !(config->command_rate >= 0) || config->command_rate > 1)
+            {
+                return -1;
+            }
+        }
+        else if (strcmp(arg, "--mix") == 0)
+        {
+            if (sscanf(value,
+                       "%u:%u:%u",
+                       &config->start_weight,
+                       &config->stop_weight,
+                       &config->invalid_weight) != 3 ||
+                config->start_weight + config->stop_weight + config->invalid_weight == 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    config.ovens = 10000;
+    config.ticks = 1000;
+    config.warmup = 10;
+    config.seed = 1;
+    config.batch = 0;
+    config.json = 0;
+    config.replay = NULL;
+    config.command_rate = 0.01;
+    config.start_weight = 8;
+    config.stop_weight = 2;
+    config.invalid_weight = 0;
+
+    if (parse_args(argc, argv, &config) != 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (config.replay)
+    {
+        return run_replay(&config);
+    }
+
+    BenchResult result;
+    if (run_bench(&config, &result) != 0)
+    {
+        fprintf(stderr, "Failed to allocate a benchmark of %zu ovens\n", config.ovens);
+        return EXIT_FAILURE;
+    }
+
+    if (config.json)
+    {
+        print_json(&config, &result);
+    }
+    else
+    {
+        print_text(&config, &result);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,771 @@
+// Microbenchmarks of the codec and state-machine primitives
+// Every primitive is timed on batches of items (frames, commands or ovens) of each size given
+// with --batch-sizes, the command frames being drawn from the START, STOP and corrupted mix of
+// --mix. Each case reports ns, cycles and allocations per item and, for the primitives that go
+// through bytes, cycles per byte
+// Cycles are read from the time stamp counter on x86-64, which counts at the nominal frequency
+// of the CPU whatever its current clock; they are not reported on other architectures
+// shard_pool_tick_idle runs whole rounds of a mostly idle fleet of n ovens with the changes
+// event mode, one busy oven in IDLE_FLEET_STRIDE, so that its cost per oven is what the idle
+// ones still cost
+// Results are printed as a table, or as a single JSON object with --json
+
+#include "../event_tracker.h"
+#include "../fleet.h"
+#include "../koven.h"
+#include "../protocol.h"
+#include "../shard_pool.h"
+#include "alloc_count.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#else
+#define HAVE_CYCLES 0
+#endif
+
+#ifndef KOVEN_VERSION
+#define KOVEN_VERSION "unknown"
+#endif
+
+#define NS_PER_SECOND 1000000000ull
+#define NS_PER_MS 1000000ull
+
+// Largest batch and most batch sizes accepted by --batch-sizes
+#define MAX_BATCH_SIZE 65536
+#define MAX_BATCH_SIZES 16
+
+// Items per timed chunk: small batches are run several times in a row so that reading the
+// clocks stays negligible; every chunk starts from the same fleet state
+#define CHUNK_ITEMS 4096
+
+// Ovens per busy oven of the idle fleet, and its heartbeat interval, the emulator's default
+#define IDLE_FLEET_STRIDE 4096
+#define IDLE_FLEET_HEARTBEAT 30
+
+typedef struct {
+    size_t batch_sizes[MAX_BATCH_SIZES];
+    size_t batch_count;
+    uint64_t min_time_ns;
+    uint32_t seed;
+    int json;
+    const char *filter;
+
+    // Relative weights of the START, STOP and corrupted (bad CRC) command frames
+    unsigned start_weight;
+    unsigned stop_weight;
+    unsigned invalid_weight;
+} MicroConfig;
+
+// Inputs and outputs of the benchmarks, sized for the largest batch
+typedef struct {
+    size_t capacity;
+
+    // Command frames drawn from the mix, and their payloads for koven_execute
+    uint8_t *command_frames;
+    CommandPayload *commands;
+
+    // Ovens spread over every state, as one Koven each and as a fleet table, with the copies
+    // every chunk starts from
+    Koven *ovens;
+    Koven *initial_ovens;
+    KovenFleet fleet;
+    uint8_t *initial_table;
+
+    EventPayload *events;
+    uint8_t *event_frames;
+    CommandPayload *decoded;
+
+    // Event frames as independent buffers, for crc16_usb_multi
+    const uint8_t **frame_data;
+    size_t *frame_lengths;
+    uint16_t *crcs;
+
+    // Mostly idle fleet of idle_ovens ovens ticked by a pool of one shard, built by the first
+    // run of shard_pool_tick_idle for each batch size
+    size_t idle_ovens;
+    KovenFleet idle_fleet;
+    EventTracker idle_tracker;
+    ShardPool idle_pool;
+    EventPayload *idle_events;
+    uint8_t *idle_fields;
+
+    // Folded over the outputs so that the work cannot be optimized away
+    uint32_t sink;
+} Fixture;
+
+typedef struct {
+    const char *name;
+
+    // Bytes of input each item goes through, 0 for the state-machine primitives
+    size_t bytes_per_item;
+
+    void (*run)(Fixture *fixture, size_t n);
+
+    // Returns 0 when the primitive cannot run on this CPU, NULL if it always can
+    int (*supported)(void);
+} Benchmark;
+
+typedef struct {
+    uint64_t items;
+    uint64_t elapsed_ns;
+    uint64_t cycles;
+    uint64_t allocations;
+} MicroResult;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#if HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// xorshift32, as in koven_bench
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Fills the fixture: command frames following the mix, and ovens brought to every state by
+// running those commands for a random number of ticks
+static void build_fixture(const MicroConfig *config, Fixture *f)
+{
+    uint32_t state = config->seed ? config->seed : 1;
+    unsigned total = config->start_weight + config->stop_weight + config->invalid_weight;
+
+    for (size_t i = 0; i < f->capacity; i++)
+    {
+        unsigned pick = next_random(&state) % total;
+
+        CommandPayload cmd;
+        cmd.action = pick < config->start_weight ? ACTION_START : ACTION_STOP;
+        cmd.temperature = (int16_t)(150 + next_random(&state) % 100);
+        cmd.duration = (int16_t)(60 + next_random(&state) % 3600);
+        f->commands[i] = cmd;
+
+        uint8_t *frame = &f->command_frames[i * COMMAND_FRAME_SIZE];
+        marshall_command_frame(&cmd, frame, COMMAND_FRAME_SIZE);
+        if (pick >= config->start_weight + config->stop_weight)
+        {
+            frame[COMMAND_FRAME_SIZE - 1] ^= 0xFF;
+        }
+
+        Koven *oven = &f->ovens[i];
+        koven_init(oven);
+        CommandPayload start = cmd;
+        start.action = ACTION_START;
+        koven_execute(oven, &start);
+        unsigned ticks = next_random(&state) % 600;
+        for (unsigned t = 0; t < ticks; t++)
+        {
+            EventPayload event;
+            koven_tick(oven, &event);
+        }
+        fleet_set(&f->fleet, i, oven);
+        koven_tick(oven, &f->events[i]);
+        f->initial_ovens[i] = *oven;
+    }
+
+    memcpy(f->ovens, f->initial_ovens, f->capacity * sizeof(Koven));
+    memcpy(f->initial_table, f->fleet.state, fleet_table_size(&f->fleet));
+    marshall_event_frames(
+        f->events, f->capacity, f->event_frames, f->capacity * EVENT_FRAME_SIZE, NULL);
+    for (size_t i = 0; i < f->capacity; i++)
+    {
+        f->frame_data[i] = &f->event_frames[i * EVENT_FRAME_SIZE];
+        f->frame_lengths[i] = EVENT_FRAME_SIZE - 2;
+    }
+}
+
+// Releases the idle fleet of shard_pool_tick_idle, if any
+static void free_idle_fleet(Fixture *f)
+{
+    if (f->idle_ovens == 0)
+    {
+        return;
+    }
+
+    shard_pool_free(&f->idle_pool);
+    event_tracker_free(&f->idle_tracker);
+    fleet_free(&f->idle_fleet);
+    f->idle_ovens = 0;
+}
+
+static void free_fixture(Fixture *f)
+{
+    free_idle_fleet(f);
+    free(f->command_frames);
+    free(f->commands);
+    free(f->ovens);
+    free(f->initial_ovens);
+    free(f->initial_table);
+    free(f->events);
+    free(f->event_frames);
+    free(f->decoded);
+    free(f->frame_data);
+    free(f->frame_lengths);
+    free(f->crcs);
+    free(f->idle_events);
+    free(f->idle_fields);
+    fleet_free(&f->fleet);
+}
+
+// Allocates a fixture for batches of up to capacity items
+// Returns 0 on success, -1 if the buffers could not be allocated
+static int init_fixture(const MicroConfig *config, size_t capacity, Fixture *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->capacity = capacity;
+    if (fleet_init(&f->fleet, 0, capacity) != 0)
+    {
+        return -1;
+    }
+    f->command_frames = malloc(capacity * COMMAND_FRAME_SIZE);
+    f->commands = malloc(capacity * sizeof(CommandPayload));
+    f->ovens = malloc(capacity * sizeof(Koven));
+    f->initial_ovens = malloc(capacity * sizeof(Koven));
+    f->initial_table = malloc(fleet_table_size(&f->fleet));
+    f->events = malloc(capacity * sizeof(EventPayload));
+    f->event_frames = malloc(capacity * EVENT_FRAME_SIZE);
+    f->decoded = malloc(capacity * sizeof(CommandPayload));
+    f->frame_data = malloc(capacity * sizeof(*f->frame_data));
+    f->frame_lengths = malloc(capacity * sizeof(*f->frame_lengths));
+    f->crcs = malloc(capacity * sizeof(*f->crcs));
+    f->idle_events = malloc(capacity * sizeof(EventPayload));
+    f->idle_fields = malloc(capacity);
+    if (!f->command_frames || !f->commands || !f->ovens || !f->initial_ovens ||
+        !f->initial_table || !f->events || !f->event_frames || !f->decoded || !f->frame_data ||
+        !f->frame_lengths || !f->crcs || !f->idle_events || !f->idle_fields)
+    {
+        free_fixture(f);
+        return -1;
+    }
+
+    build_fixture(config, f);
+    return 0;
+}
+
+// Brings the first n ovens back to the state every chunk starts from
+static void reset_fixture(Fixture *f, size_t n)
+{
+    memcpy(f->ovens, f->initial_ovens, n * sizeof(Koven));
+    memcpy(f->fleet.state, f->initial_table, fleet_table_size(&f->fleet));
+}
+
+// CRC of every event frame, as the codec computes it: one call per frame
+static void run_crc16_usb(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        f->sink += crc16_usb(f->frame_data[i], EVENT_FRAME_SIZE - 2);
+    }
+}
+
+static void run_crc16_usb_table(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        f->sink += crc16_usb_table(f->frame_data[i], EVENT_FRAME_SIZE - 2);
+    }
+}
+
+static void run_crc16_usb_slice8(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        f->sink += crc16_usb_slice8(f->frame_data[i], EVENT_FRAME_SIZE - 2);
+    }
+}
+
+static void run_crc16_usb_clmul(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        f->sink += crc16_usb_clmul(f->frame_data[i], EVENT_FRAME_SIZE - 2);
+    }
+}
+
+static void run_crc16_usb_fast(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        f->sink += crc16_usb_fast(f->frame_data[i], EVENT_FRAME_SIZE - 2);
+    }
+}
+
+static void run_crc16_usb_multi(Fixture *f, size_t n)
+{
+    crc16_usb_multi(f->frame_data, f->frame_lengths, n, f->crcs);
+    f->sink += f->crcs[n - 1];
+}
+
+// CRC of the n frames as one buffer, as for a batch frame
+static void run_crc16_usb_fast_buffer(Fixture *f, size_t n)
+{
+    f->sink += crc16_usb_fast(f->event_frames, n * EVENT_FRAME_SIZE);
+}
+
+static void run_marshall_event_frame(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        marshall_event_frame(
+            &f->events[i], &f->event_frames[i * EVENT_FRAME_SIZE], EVENT_FRAME_SIZE);
+    }
+    f->sink += f->event_frames[n * EVENT_FRAME_SIZE - 1];
+}
+
+static void run_marshall_event_frames(Fixture *f, size_t n)
+{
+    marshall_event_frames(f->events, n, f->event_frames, n * EVENT_FRAME_SIZE, NULL);
+    f->sink += f->event_frames[n * EVENT_FRAME_SIZE - 1];
+}
+
+static void run_unmarshall_command_frame(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        f->sink += (uint32_t)unmarshall_command_frame(
+            &f->command_frames[i * COMMAND_FRAME_SIZE], COMMAND_FRAME_SIZE, &f->decoded[i]);
+    }
+}
+
+static void run_koven_execute(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        koven_execute(&f->ovens[i], &f->commands[i]);
+    }
+    f->sink += (uint32_t)f->ovens[n - 1].state;
+}
+
+static void run_koven_tick(Fixture *f, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        koven_tick(&f->ovens[i], &f->events[i]);
+    }
+    f->sink += (uint32_t)f->events[n - 1].current_temperature;
+}
+
+static void run_koven_tick_batch(Fixture *f, size_t n)
+{
+    koven_tick_batch(&f->fleet, n, f->events);
+    f->sink += (uint32_t)f->events[n - 1].current_temperature;
+}
+
+// Idle fleet of n ovens, replacing the one of another batch size
+// Returns 0 on success, -1 on error
+static int build_idle_fleet(Fixture *f, size_t n)
+{
+    free_idle_fleet(f);
+
+    EventPolicy policy = {EVENT_MODE_CHANGES, IDLE_FLEET_HEARTBEAT};
+    if (fleet_init(&f->idle_fleet, 0, n) != 0)
+    {
+        return -1;
+    }
+    if (event_tracker_init(&f->idle_tracker, &policy, n) != 0)
+    {
+        fleet_free(&f->idle_fleet);
+        return -1;
+    }
+    if (shard_pool_init(&f->idle_pool, &f->idle_fleet, 1, 1, 0, &f->idle_tracker) != 0)
+    {
+        event_tracker_free(&f->idle_tracker);
+        fleet_free(&f->idle_fleet);
+        return -1;
+    }
+    f->idle_ovens = n;
+    return 0;
+}
+
+// One round of the idle fleet, keeping its busy ovens busy
+static void run_shard_pool_tick_idle(Fixture *f, size_t n)
+{
+    if (f->idle_ovens != n && build_idle_fleet(f, n) != 0)
+    {
+        fprintf(stderr, "Failed to allocate an idle fleet of %zu ovens\n", n);
+        exit(EXIT_FAILURE);
+    }
+
+    CommandPayload start;
+    start.action = ACTION_START;
+    start.temperature = 200;
+    start.duration = 3600;
+    for (size_t i = 0; i < n; i += IDLE_FLEET_STRIDE)
+    {
+        shard_pool_submit(&f->idle_pool, 0, i, &start);
+    }
+    shard_pool_tick(&f->idle_pool, 1, f->idle_events, f->idle_fields);
+    f->sink += (uint32_t)f->idle_events[0].current_temperature;
+}
+
+static const Benchmark benchmarks[] = {
+    {"crc16_usb", EVENT_FRAME_SIZE - 2, run_crc16_usb, NULL},
+    {"crc16_usb_table", EVENT_FRAME_SIZE - 2, run_crc16_usb_table, NULL},
+    {"crc16_usb_slice8", EVENT_FRAME_SIZE - 2, run_crc16_usb_slice8, NULL},
+    {"crc16_usb_clmul", EVENT_FRAME_SIZE - 2, run_crc16_usb_clmul, crc16_usb_clmul_supported},
+    {"crc16_usb_fast", EVENT_FRAME_SIZE - 2, run_crc16_usb_fast, NULL},
+    {"crc16_usb_multi", EVENT_FRAME_SIZE - 2, run_crc16_usb_multi, NULL},
+    {"crc16_usb_fast_buffer", EVENT_FRAME_SIZE, run_crc16_usb_fast_buffer, NULL},
+    {"marshall_event_frame", EVENT_FRAME_SIZE, run_marshall_event_frame, NULL},
+    {"marshall_event_frames", EVENT_FRAME_SIZE, run_marshall_event_frames, NULL},
+    {"unmarshall_command_frame", COMMAND_FRAME_SIZE, run_unmarshall_command_frame, NULL},
+    {"koven_execute", 0, run_koven_execute, NULL},
+    {"koven_tick", 0, run_koven_tick, NULL},
+    {"koven_tick_batch", 0, run_koven_tick_batch, NULL},
+    {"shard_pool_tick_idle", 0, run_shard_pool_tick_idle, NULL},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// Times chunks of batches of n items until config->min_time_ns has passed, after one untimed
+// chunk
+static void run_case(const MicroConfig *config,
+                     const Benchmark *benchmark,
+                     Fixture *f,
+                     size_t n,
+                     MicroResult *result)
+{
+    size_t passes = n < CHUNK_ITEMS ? CHUNK_ITEMS / n : 1;
+
+    memset(result, 0, sizeof(*result));
+    reset_fixture(f, n);
+    benchmark->run(f, n);
+
+    AllocCount allocations_before;
+    alloc_count_read(&allocations_before);
+
+    while (result->elapsed_ns < config->min_time_ns)
+    {
+        reset_fixture(f, n);
+
+        uint64_t start = now_ns();
+        uint64_t start_cycles = now_cycles();
+        for (size_t p = 0; p < passes; p++)
+        {
+            benchmark->run(f, n);
+        }
+        result->cycles += now_cycles() - start_cycles;
+        result->elapsed_ns += now_ns() - start;
+        result->items += (uint64_t)passes * n;
+    }
+
+    AllocCount allocations_after;
+    alloc_count_read(&allocations_after);
+    result->allocations = allocations_after.count - allocations_before.count;
+}
+
+static double per_item(uint64_t total, const MicroResult *result)
+{
+    return (double)total / (double)result->items;
+}
+
+static double per_byte(uint64_t total, const MicroResult *result, size_t bytes_per_item)
+{
+    return (double)total / ((double)result->items * (double)bytes_per_item);
+}
+
+static void print_row(const Benchmark *benchmark, size_t n, const MicroResult *result)
+{
+    printf("%-26s %6zu %10.2f", benchmark->name, n, per_item(result->elapsed_ns, result));
+    if (HAVE_CYCLES)
+    {
+        printf(" %10.2f", per_item(result->cycles, result));
+        if (benchmark->bytes_per_item > 0)
+        {
+            printf(" %11.3f", per_byte(result->cycles, result, benchmark->bytes_per_item));
+        }
+        else
+        {
+            printf(" %11s", "-");
+        }
+    }
+    else
+    {
+        printf(" %10s %11s", "-", "-");
+    }
+#ifdef KOVEN_BENCH_COUNT_ALLOCATIONS
+    printf(" %10.4f\n", per_item(result->allocations, result));
+#else
+    printf(" %10s\n", "-");
+#endif
+}
+
+static void print_json_result(const Benchmark *benchmark, size_t n, const MicroResult *result)
+{
+    printf("{\"name\":\"%s\",\"batch\":%zu,\"items\":%llu,\"bytes_per_item\":%zu,",
+           benchmark->name,
+           n,
+           (unsigned long long)result->items,
+           benchmark->bytes_per_item);
+    printf("\"ns_per_op\":%.4f,", per_item(result->elapsed_ns, result));
+    if (HAVE_CYCLES)
+    {
+        printf("\"cycles_per_op\":%.4f,", per_item(result->cycles, result));
+        if (benchmark->bytes_per_item > 0)
+        {
+            printf("\"cycles_per_byte\":%.4f,",
+                   per_byte(result->cycles, result, benchmark->bytes_per_item));
+        }
+        else
+        {
+            printf("\"cycles_per_byte\":null,");
+        }
+    }
+    else
+    {
+        printf("\"cycles_per_op\":null,\"cycles_per_byte\":null,");
+    }
+#ifdef KOVEN_BENCH_COUNT_ALLOCATIONS
+    printf("\"allocs_per_op\":%.6f}", per_item(result->allocations, result));
+#else
+    printf("\"allocs_per_op\":null}");
+#endif
+}
+
+// Runs every benchmark selected by --filter on every batch size
+// Returns 0 on success, -1 if the fixture could not be allocated
+static int run_all(const MicroConfig *config)
+{
+    size_t capacity = 0;
+    for (size_t i = 0; i < config->batch_count; i++)
+    {
+        capacity = config->batch_sizes[i] > capacity ? config->batch_sizes[i] : capacity;
+    }
+
+    Fixture fixture;
+    if (init_fixture(config, capacity, &fixture) != 0)
+    {
+        return -1;
+    }
+
+    if (config->json)
+    {
+        printf("{\"benchmark\":\"koven_micro\",\"version\":\"%s\",\"crc\":\"%s\",",
+               KOVEN_VERSION,
+               crc16_usb_fast_name());
+        printf("\"cycles\":%s,\"min_time_ns\":%llu,\"seed\":%u,",
+               HAVE_CYCLES ? "\"tsc\"" : "null",
+               (unsigned long long)config->min_time_ns,
+               config->seed);
+        printf("\"mix\":{\"start\":%u,\"stop\":%u,\"invalid\":%u},\"results\":[",
+               config->start_weight,
+               config->stop_weight,
+               config->invalid_weight);
+    }
+    else
+    {
+        printf("koven_microbench %s (crc %s, cycles %s), mix %u:%u:%u\n",
+               KOVEN_VERSION,
+               crc16_usb_fast_name(),
+               HAVE_CYCLES ? "tsc" : "not measured",
+               config->start_weight,
+               config->stop_weight,
+               config->invalid_weight);
+        printf("%-26s %6s %10s %10s %11s %10s\n",
+               "benchmark",
+               "batch",
+               "ns/op",
+               "cycles/op",
+               "cycles/byte",
+               "allocs/op");
+    }
+
+    int first = 1;
+    for (size_t b = 0; b < BENCHMARK_COUNT; b++)
+    {
+        const Benchmark *benchmark = &benchmarks[b];
+        if (config->filter && !strstr(benchmark->name, config->filter))
+        {
+            continue;
+        }
+        if (benchmark->supported && !benchmark->supported())
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < config->batch_count; i++)
+        {
+            size_t n = config->batch_sizes[i];
+            MicroResult result;
+            run_case(config, benchmark, &fixture, n, &result);
+
+            if (config->json)
+            {
+                printf("%s", first ? "" : ",");
+                print_json_result(benchmark, n, &result);
+            }
+            else
+            {
+                print_row(benchmark, n, &result);
+            }
+            first = 0;
+        }
+    }
+
+    if (config->json)
+    {
+        printf("],\"checksum\":%u}\n", fixture.sink);
+    }
+
+    free_fixture(&fixture);
+    return 0;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --batch-sizes LIST  Items per batch, comma separated (default 1,16,256,4096)\n"
+            "  --mix S:T:I         Weights of START, STOP and corrupted commands (default 8:2:0)\n"
+            "  --min-time MS       Shortest timed run of every case (default 200)\n"
+            "  --filter NAME       Only run the benchmarks whose name contains NAME\n"
+            "  --seed N            Seed of the commands and oven states (default 1)\n"
+            "  --json              Print the results as one JSON object\n",
+            program);
+}
+
+// Parses an unsigned integer argument, returning -1 if it is not a plain number
+static int parse_ulong(const char *value, unsigned long *out)
+{
+    char *end;
+    if (!value || *value == '\0')
+    {
+        return -1;
+    }
+    *out = strtoul(value, &end, 10);
+    return *end == '\0' ? 0 : -1;
+}
+
+// Parses a comma separated list of batch sizes
+// Returns 0 on success, -1 on an invalid list
+static int parse_batch_sizes(const char *value, MicroConfig *config)
+{
+    config->batch_count = 0;
+    while (*value != '\0')
+    {
+        char *end;
+        unsigned long n = strtoul(value, &end, 10);
+        if (end == value || n == 0 || n > MAX_BATCH_SIZE ||
+            config->batch_count == MAX_BATCH_SIZES || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+        config->batch_sizes[config->batch_count++] = n;
+        value = *end == ',' ? end + 1 : end;
+    }
+    return config->batch_count > 0 ? 0 : -1;
+}
+
+// Parses the command line into config
+// Returns 0 on success, -1 on an invalid option
+static int parse_args(int argc, char *argv[], MicroConfig *config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        unsigned long number;
+
+        if (strcmp(arg, "--json") == 0)
+        {
+            config->json = 1;
+            continue;
+        }
+        if (!value)
+        {
+            return -1;
+        }
+        i++;
+
+        if (strcmp(arg, "--batch-sizes") == 0)
+        {
+            if (parse_batch_sizes(value, config) != 0)
+            {
+                return -1;
+            }
+        }
+        else if (strcmp(arg, "--min-time") == 0 && parse_ulong(value, &number) == 0 &&
+                 number > 0)
+        {
+            config->min_time_ns = (uint64_t)number * NS_PER_MS;
+        }
+        else if (strcmp(arg, "--filter") == 0)
+        {
+            config->filter = value;
+        }
+        else if (strcmp(arg, "--seed") == 0 && parse_ulong(value, &number) == 0)
+        {
+            config->seed = (uint32_t)number;
+        }
+        else if (strcmp(arg, "--mix") == 0)
+        {
+            if (sscanf(value,
+                       "%u:%u:%u",
+                       &config->start_weight,
+                       &config->stop_weight,
+                       &config->invalid_weight) != 3 ||
+                config->start_weight + config->stop_weight + config->invalid_weight == 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    MicroConfig config;
+    memset(&config, 0, sizeof(config));
+    config.batch_sizes[0] = 1;
+    config.batch_sizes[1] = 16;
+    config.batch_sizes[2] = 256;
+    config.batch_sizes[3] = 4096;
+    config.batch_count = 4;
+    config.min_time_ns = 200 * NS_PER_MS;
+    config.seed = 1;
+    config.start_weight = 8;
+    config.stop_weight = 2;
+    config.invalid_weight = 0;
+
+    if (parse_args(argc, argv, &config) != 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (run_all(&config) != 0)
+    {
+        fprintf(stderr, "Failed to allocate the benchmark fixture\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include "command_queue.h"
+#include <stdlib.h>
+
+int command_queue_init(CommandQueue *queue, size_t capacity)
+{
+    if (!queue || capacity == 0 || capacity > (SIZE_MAX >> 1) / sizeof(QueuedCommand))
+    {
+        return -1;
+    }
+
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    queue->entries = malloc(size * sizeof(QueuedCommand));
+    if (!queue->entries)
+    {
+        return -1;
+    }
+
+    queue->capacity = size;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->dropped, 0);
+    return 0;
+}
+
+void command_queue_free(CommandQueue *queue)
+{
+    if (!queue)
+    {
+        return;
+    }
+
+    free(queue->entries);
+    queue->entries = NULL;
+    queue->capacity = 0;
+}
+
+int command_queue_push(CommandQueue *queue, uint32_t id, const CommandPayload *cmd)
+{
+    if (!queue || !cmd)
+    {
+        return -1;
+    }
+
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head >= queue->capacity)
+    {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    QueuedCommand *entry = &queue->entries[tail & (queue->capacity - 1)];
+    entry->id = id;
+    entry->cmd = *cmd;
+
+    // Publishes the entry to the consumer
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+int command_queue_pop(CommandQueue *queue, QueuedCommand *out)
+{
+    if (!queue || !out)
+    {
+        return 0;
+    }
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail)
+    {
+        return 0;
+    }
+
+    *out = queue->entries[head & (queue->capacity - 1)];
+
+    // Hands the slot back to the producer
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+int command_queue_empty(CommandQueue *queue)
+{
+    if (!queue)
+    {
+        return 1;
+    }
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return head == tail;
+}
@@ -0,0 +1,48 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include "koven.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Command for one oven, as routed to the thread that owns the oven
+typedef struct {
+    uint32_t id;
+    CommandPayload cmd;
+} QueuedCommand;
+
+// Bounded lock-free queue with exactly one producer thread and one consumer thread
+// The producer only writes tail and the consumer only writes head, each on its own cache line,
+// so neither side ever waits for the other: a full queue rejects the push instead
+typedef struct {
+    size_t capacity;
+    QueuedCommand *entries;
+
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+
+    // Counters
+    _Alignas(64) atomic_uint_fast64_t dropped;
+} CommandQueue;
+
+// Allocates a queue of capacity entries, rounded up to a power of two
+// Returns 0 on success, -1 on error
+int command_queue_init(CommandQueue *queue, size_t capacity);
+
+// Releases the memory owned by the queue
+void command_queue_free(CommandQueue *queue);
+
+// Appends a command; only ever called by the producer thread
+// Returns 0 on success, -1 when the queue is full (counted as dropped)
+int command_queue_push(CommandQueue *queue, uint32_t id, const CommandPayload *cmd);
+
+// Takes the oldest command; only ever called by the consumer thread
+// Returns 1 when a command was taken, 0 when the queue is empty
+int command_queue_pop(CommandQueue *queue, QueuedCommand *out);
+
+// Reports whether the queue is empty; only ever called by the consumer thread
+// Returns 1 when there is no command to take, 0 otherwise
+int command_queue_empty(CommandQueue *queue);
+
+#endif /* COMMAND_QUEUE_H */
@@ -0,0 +1,474 @@
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    OPTION_LOG_LEVEL,
+    OPTION_SHARD_ID,
+    OPTION_OVENS,
+    OPTION_FLEET_SIZE,
+    OPTION_FIRST_ID,
+    OPTION_WORKERS,
+    OPTION_CONNECTIONS,
+    OPTION_BATCH_SIZE,
+    OPTION_BACKLOG,
+    OPTION_TICK_RATE,
+    OPTION_ACCELERATION,
+    OPTION_MAX_CATCH_UP,
+    OPTION_EVENT_MODE,
+    OPTION_HEARTBEAT,
+    OPTION_TRANSPORT,
+    OPTION_ADDRESS,
+    OPTION_CLIENT_ID,
+    OPTION_QOS,
+    OPTION_EVENT_QOS,
+    OPTION_MQTT_TIMEOUT,
+    OPTION_RECONNECT_MIN,
+    OPTION_RECONNECT_MAX,
+    OPTION_SPOOL_POLICY,
+    OPTION_SPOOL_CAPACITY,
+    OPTION_SNAPSHOT_PATH,
+    OPTION_SNAPSHOT_INTERVAL,
+    OPTION_SNAPSHOT_CATCH_UP,
+    OPTION_RECORD_PATH,
+    OPTION_METRICS_ADDRESS
+} OptionId;
+
+typedef struct {
+    OptionId id;
+    // Command-line flag without its leading dashes, NULL for an environment-only alias
+    const char *flag;
+    const char *env;
+    const char *value_name;
+    const char *help;
+} Option;
+
+// Read from the environment in this order, so that an alias is overridden by the variable it
+// stands for
+static const Option options[] = {
+    {OPTION_LOG_LEVEL, "log-level", "KOVEN_LOG_LEVEL", "LEVEL",
+     "debug, info, warn, error or off (default info)"},
+    {OPTION_SHARD_ID, "shard-id", "KOVEN_SHARD_ID", "N",
+     "Replica of the fleet, naming its client ids and command group (default 0)"},
+    {OPTION_FLEET_SIZE, "fleet-size", "KOVEN_FLEET_SIZE", "N",
+     "Number of simulated ovens (default 0, the single oven)"},
+    {OPTION_FIRST_ID, "first-id", "KOVEN_FLEET_FIRST_ID", "ID",
+     "Id of the first oven of the fleet (default 0)"},
+    {OPTION_OVENS, "ovens", "KOVEN_OVENS", "FIRST-LAST",
+     "Ids of the ovens of the fleet, as --first-id and --fleet-size"},
+    {OPTION_WORKERS, "workers", "KOVEN_FLEET_SHARDS", "N",
+     "Worker threads ticking the fleet (default 0, one per CPU)"},
+    {OPTION_CONNECTIONS, "connections", "KOVEN_FLEET_CONNECTIONS", "N",
+     "Connections shared by the fleet (default 4)"},
+    {OPTION_BATCH_SIZE, "batch-size", "KOVEN_FLEET_BATCH_SIZE", "N",
+     "Ovens per event batch frame (default 1024, 0 for one frame per oven)"},
+    {OPTION_BACKLOG, "backlog", "KOVEN_COMMAND_BACKLOG", "N",
+     "Commands waiting for the workers (default 16384)"},
+    {OPTION_TICK_RATE, "tick-rate", "KOVEN_TICK_RATE", "HZ",
+     "Wakeups (and publishes) per second (default 1)"},
+    {OPTION_ACCELERATION, "acceleration", "KOVEN_ACCELERATION", "X",
+     "Simulated seconds per wall-clock second (default 1)"},
+    {OPTION_MAX_CATCH_UP, "max-catch-up", "KOVEN_MAX_CATCH_UP", "N",
+     "Most ticks run by one wakeup after a stall (default 0, four wakeups' worth)"},
+    {OPTION_EVENT_MODE, "event-mode", "KOVEN_EVENT_MODE", "MODE",
+     "full, changes or delta (default full)"},
+    {OPTION_HEARTBEAT, "heartbeat", "KOVEN_HEARTBEAT_INTERVAL", "TICKS",
+     "Ticks between full refreshes of unchanged ovens (default 30, 0 for never)"},
+    {OPTION_TRANSPORT, "transport", "KOVEN_TRANSPORT", "NAME",
+     "mqtt (broker) or unix (local socket) (default mqtt)"},
+    {OPTION_ADDRESS, NULL, "MQTT_BROKER", NULL, NULL},
+    {OPTION_ADDRESS, "address", "KOVEN_TRANSPORT_ADDRESS", "ADDRESS",
+     "Broker URL or socket path (default " TRANSPORT_MQTT_DEFAULT_ADDRESS " or "
+     TRANSPORT_UNIX_DEFAULT_ADDRESS ")"},
+    {OPTION_CLIENT_ID, "client-id", "KOVEN_CLIENT_ID", "ID",
+     "Client id of the oven, or prefix of those of the fleet (default " MQTT_CLIENT_ID
+     " or " MQTT_FLEET_CLIENT_ID_PREFIX ")"},
+    {OPTION_QOS, "qos", "KOVEN_MQTT_QOS", "0-2",
+     "QoS of the publishes and of the subscription (default 1)"},
+    {OPTION_EVENT_QOS, "event-qos", "KOVEN_EVENT_QOS", "MODE",
+     "uniform, tiered (telemetry at QoS 0) or retained (tiered, transitions retained), "
+     "the last two without delta events (default uniform)"},
+    {OPTION_MQTT_TIMEOUT, "mqtt-timeout", "KOVEN_MQTT_TIMEOUT_MS", "MS",
+     "Time given to a disconnect from the broker (default 10000)"},
+    {OPTION_RECONNECT_MIN, "reconnect-min", "KOVEN_RECONNECT_MIN_MS", "MS",
+     "Shortest delay before a reconnect attempt (default 100)"},
+    {OPTION_RECONNECT_MAX, "reconnect-max", "KOVEN_RECONNECT_MAX_MS", "MS",
+     "Longest delay between two reconnect attempts (default 30000)"},
+    {OPTION_SPOOL_POLICY, "spool-policy", "KOVEN_SPOOL_POLICY", "POLICY",
+     "latest or oldest (default latest)"},
+    {OPTION_SPOOL_CAPACITY, "spool-capacity", "KOVEN_SPOOL_CAPACITY", "N",
+     "Events the oldest spool holds (default 65536)"},
+    {OPTION_SNAPSHOT_PATH, "snapshot-path", "KOVEN_SNAPSHOT_PATH", "FILE",
+     "Snapshot file of the fleet, restored on start"},
+    {OPTION_SNAPSHOT_INTERVAL, "snapshot-interval", "KOVEN_SNAPSHOT_INTERVAL", "SECONDS",
+     "Seconds between two snapshots (default 10, 0 for every tick)"},
+    {OPTION_SNAPSHOT_CATCH_UP, "snapshot-catch-up", "KOVEN_SNAPSHOT_CATCH_UP", "0|1",
+     "Jump restored ovens over the downtime (default 0)"},
+    {OPTION_RECORD_PATH, "record-path", "KOVEN_RECORD_PATH", "FILE",
+     "Capture log of commands and events"},
+    {OPTION_METRICS_ADDRESS, "metrics-address", "KOVEN_METRICS_ADDRESS", "ADDRESS",
+     "host:port or port of the /metrics endpoint"},
+};
+
+#define OPTION_COUNT (sizeof(options) / sizeof(options[0]))
+
+// Parses a non-negative integer of at most max
+// Returns 0 on success, -1 on error
+static int parse_ulong(const char *value, unsigned long max, unsigned long *out)
+{
+    char *end;
+    if (*value < '0' || *value > '9')
+    {
+        return -1;
+    }
+    unsigned long parsed = strtoul(value, &end, 10);
+    if (*end != '\0' || parsed > max)
+    {
+        return -1;
+    }
+    *out = parsed;
+    return 0;
+}
+
+// Parses a positive number
+// Returns 0 on success, -1 on error
+static int parse_positive(const char *value, double *out)
+{
+    char *end;
+    double parsed = strtod(value, &end);
+    if (*end != '\0' || !(parsed > 0))
+    {
+        return -1;
+    }
+    *out = parsed;
+    return 0;
+}
+
+// Parses an oven id range FIRST-LAST, both included
+// Returns 0 on success, -1 on error
+static int parse_range(const char *value, uint32_t *first, size_t *count)
+{
+    char *end;
+    if (*value < '0' || *value > '9')
+    {
+        return -1;
+    }
+    unsigned long low = strtoul(value, &end, 10);
+    if (*end != '-' || end[1] < '0' || end[1] > '9')
+    {
+        return -1;
+    }
+    unsigned long high = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || high > UINT32_MAX || low > high)
+    {
+        return -1;
+    }
+    *first = (uint32_t)low;
+    *count = (size_t)(high - low) + 1;
+    return 0;
+}
+
+// Sets one option of config from its textual value, leaving config unchanged on error
+// Returns 0 on success, -1 on an invalid value
+static int config_set(KovenConfig *config, OptionId id, const char *value)
+{
+    unsigned long number;
+
+    switch (id)
+    {
+    case OPTION_LOG_LEVEL:
+        return log_level_from_string(value, &config->log_level);
+    case OPTION_SHARD_ID:
+        if (parse_ulong(value, UINT32_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->transport.shard_id = (uint32_t)number;
+        return 0;
+    case OPTION_OVENS:
+        return parse_range(value, &config->first_id, &config->fleet_size);
+    case OPTION_FLEET_SIZE:
+        if (parse_ulong(value, UINT32_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->fleet_size = number;
+        return 0;
+    case OPTION_FIRST_ID:
+        if (parse_ulong(value, UINT32_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->first_id = (uint32_t)number;
+        return 0;
+    case OPTION_WORKERS:
+        if (parse_ulong(value, SIZE_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->workers = number;
+        return 0;
+    case OPTION_CONNECTIONS:
+        if (parse_ulong(value, MQTT_FLEET_MAX_CONNECTIONS, &number) != 0 || number == 0)
+        {
+            return -1;
+        }
+        config->connections = number;
+        return 0;
+    case OPTION_BATCH_SIZE:
+        if (parse_ulong(value, EVENT_BATCH_MAX_EVENTS, &number) != 0)
+        {
+            return -1;
+        }
+        config->batch_size = number;
+        return 0;
+    case OPTION_BACKLOG:
+        if (parse_ulong(value, SIZE_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->backlog = number;
+        return 0;
+    case OPTION_TICK_RATE:
+        return parse_positive(value, &config->schedule.tick_rate);
+    case OPTION_ACCELERATION:
+        return parse_positive(value, &config->schedule.acceleration);
+    case OPTION_MAX_CATCH_UP:
+        if (parse_ulong(value, UINT32_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->schedule.max_batch = (unsigned)number;
+        return 0;
+    case OPTION_EVENT_MODE:
+        return event_mode_from_string(value, &config->policy.mode);
+    case OPTION_HEARTBEAT:
+        if (parse_ulong(value, UINT32_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->policy.heartbeat_interval = (unsigned)number;
+        return 0;
+    case OPTION_TRANSPORT:
+        return transport_kind_from_string(value, &config->transport.kind);
+    case OPTION_ADDRESS:
+        config->transport.address = value;
+        return 0;
+    case OPTION_CLIENT_ID:
+        if (*value == '\0')
+        {
+            return -1;
+        }
+        config->transport.client_id = value;
+        return 0;
+    case OPTION_QOS:
+        if (parse_ulong(value, 2, &number) != 0)
+        {
+            return -1;
+        }
+        config->transport.qos = (int)number;
+        return 0;
+    case OPTION_EVENT_QOS:
+        return transport_qos_mode_from_string(value, &config->transport.qos_mode);
+    case OPTION_MQTT_TIMEOUT:
+        if (parse_ulong(value, 3600000, &number) != 0 || number == 0)
+        {
+            return -1;
+        }
+        config->transport.timeout_ms = (long)number;
+        return 0;
+    case OPTION_RECONNECT_MIN:
+        if (parse_ulong(value, 3600000, &number) != 0)
+        {
+            return -1;
+        }
+        config->reconnect.backoff_min_ns = number * 1000000ull;
+        return 0;
+    case OPTION_RECONNECT_MAX:
+        if (parse_ulong(value, 3600000, &number) != 0)
+        {
+            return -1;
+        }
+        config->reconnect.backoff_max_ns = number * 1000000ull;
+        return 0;
+    case OPTION_SPOOL_POLICY:
+        return spool_policy_from_string(value, &config->reconnect.spool_policy);
+    case OPTION_SPOOL_CAPACITY:
+        if (parse_ulong(value, SIZE_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->reconnect.spool_capacity = number;
+        return 0;
+    case OPTION_SNAPSHOT_PATH:
+        config->snapshot_path = value;
+        return 0;
+    case OPTION_SNAPSHOT_INTERVAL:
+        if (parse_ulong(value, UINT32_MAX, &number) != 0)
+        {
+            return -1;
+        }
+        config->snapshot_interval_ns = number * 1000000000ull;
+        return 0;
+    case OPTION_SNAPSHOT_CATCH_UP:
+        if (parse_ulong(value, 1, &number) != 0)
+        {
+            return -1;
+        }
+        config->snapshot_catch_up = (int)number;
+        return 0;
+    case OPTION_RECORD_PATH:
+        config->record_path = value;
+        return 0;
+    case OPTION_METRICS_ADDRESS:
+        config->metrics_address = value;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static void config_init(KovenConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->log_level = LOG_LEVEL_INFO;
+    config->policy.mode = EVENT_MODE_FULL;
+    config->policy.heartbeat_interval = CONFIG_DEFAULT_HEARTBEAT_INTERVAL;
+    config->schedule.tick_rate = 1.0;
+    config->schedule.acceleration = 1.0;
+    config->transport.kind = TRANSPORT_MQTT;
+    config->transport.qos = MQTT_QOS;
+    config->transport.qos_mode = TRANSPORT_QOS_UNIFORM;
+    config->transport.timeout_ms = MQTT_TIMEOUT;
+    config->reconnect.backoff_min_ns = CONFIG_DEFAULT_RECONNECT_MIN_MS * 1000000ull;
+    config->reconnect.backoff_max_ns = CONFIG_DEFAULT_RECONNECT_MAX_MS * 1000000ull;
+    config->reconnect.spool_policy = SPOOL_LATEST_PER_OVEN;
+    config->reconnect.spool_capacity = MQTT_SPOOL_CAPACITY;
+    config->connections = CONFIG_DEFAULT_FLEET_CONNECTIONS;
+    config->batch_size = CONFIG_DEFAULT_FLEET_BATCH_SIZE;
+    config->snapshot_interval_ns = CONFIG_DEFAULT_SNAPSHOT_INTERVAL * 1000000000ull;
+}
+
+static const Option *find_flag(const char *flag)
+{
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        if (options[i].flag && strcmp(options[i].flag, flag) == 0)
+        {
+            return &options[i];
+        }
+    }
+    return NULL;
+}
+
+int config_load(KovenConfig *config, int argc, char *argv[])
+{
+    config_init(config);
+
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        const char *value = getenv(options[i].env);
+        if (value && *value != '\0' && config_set(config, options[i].id, value) != 0)
+        {
+            log_warn("Ignoring invalid %s=%s", options[i].env, value);
+        }
+    }
+
+    // Flags are --name value or --name=value
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+        {
+            return 1;
+        }
+        if (strncmp(arg, "--", 2) != 0)
+        {
+            fprintf(stderr, "Unexpected argument: %s\n", arg);
+            return -1;
+        }
+
+        char name[32];
+        const char *value;
+        const char *equals = strchr(arg + 2, '=');
+        size_t len = equals ? (size_t)(equals - (arg + 2)) : strlen(arg + 2);
+        if (len >= sizeof(name))
+        {
+            fprintf(stderr, "Unknown flag: %s\n", arg);
+            return -1;
+        }
+        memcpy(name, arg + 2, len);
+        name[len] = '\0';
+
+        const Option *option = find_flag(name);
+        if (!option)
+        {
+            fprintf(stderr, "Unknown flag: %s\n", arg);
+            return -1;
+        }
+        if (equals)
+        {
+            value = equals + 1;
+        }
+        else if (i + 1 < argc)
+        {
+            value = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Missing value for --%s\n", name);
+            return -1;
+        }
+
+        if (config_set(config, option->id, value) != 0)
+        {
+            fprintf(stderr, "Invalid value for --%s: %s\n", name, value);
+            return -1;
+        }
+    }
+
+    ReconnectPolicy *reconnect = &config->reconnect;
+    if (reconnect->spool_policy == SPOOL_DROP_OLDEST && reconnect->spool_capacity == 0)
+    {
+        log_warn("Ignoring a spool capacity of 0");
+        reconnect->spool_capacity = MQTT_SPOOL_CAPACITY;
+    }
+    if ((uint64_t)config->first_id + config->fleet_size > (uint64_t)UINT32_MAX + 1)
+    {
+        fprintf(stderr,
+                "The fleet of %zu ovens from id %u runs past the last oven id\n",
+                config->fleet_size,
+                config->first_id);
+        return -1;
+    }
+    // A delta only applies over the previous event of its oven: QoS 0 telemetry that is lost
+    // leaves the platform with a wrong state until the next full event, and a retained delta has
+    // nothing to apply over for a new subscriber
+    if (config->transport.qos_mode != TRANSPORT_QOS_UNIFORM &&
+        config->policy.mode == EVENT_MODE_DELTA)
+    {
+        fprintf(stderr, "The tiered and retained event QoS modes do not work with delta events\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void config_usage(FILE *out, const char *program)
+{
+    fprintf(out, "Usage: %s [--flag value]...\n", program);
+    fprintf(out, "Every flag can also be set by its environment variable; flags win\n");
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        const Option *option = &options[i];
+        if (!option->flag)
+        {
+            continue;
+        }
+
+        char flag[64];
+        snprintf(flag, sizeof(flag), "--%s %s", option->flag, option->value_name);
+        fprintf(out, "  %-30s %s\n", flag, option->env);
+        fprintf(out, "  %-30s   %s\n", "", option->help);
+    }
+}
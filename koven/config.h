@@ -0,0 +1,58 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "event_tracker.h"
+#include "log.h"
+#include "mqtt_client.h"
+#include "scheduler.h"
+#include "transport.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CONFIG_DEFAULT_FLEET_CONNECTIONS 4
+#define CONFIG_DEFAULT_FLEET_BATCH_SIZE 1024
+#define CONFIG_DEFAULT_HEARTBEAT_INTERVAL 30
+#define CONFIG_DEFAULT_SNAPSHOT_INTERVAL 10
+#define CONFIG_DEFAULT_RECONNECT_MIN_MS 100
+#define CONFIG_DEFAULT_RECONNECT_MAX_MS 30000
+
+// Runtime settings of the emulator, so that one binary runs as any replica of a sharded fleet
+// Every setting has an environment variable and a command-line flag (see config_usage); flags
+// win over the environment, which wins over the defaults
+// Strings point into the environment or argv and live as long as the process
+typedef struct {
+    LogLevel log_level;
+    EventPolicy policy;
+    TickSchedule schedule;
+    TransportConfig transport;
+    ReconnectPolicy reconnect;
+
+    // Ovens first_id to first_id + fleet_size - 1, or the single oven with fleet_size 0
+    size_t fleet_size;
+    uint32_t first_id;
+
+    // Fleet connections, ovens per event batch frame (0 for one frame per oven), worker threads
+    // ticking the fleet (0 for one per CPU) and commands waiting for them (0 for the default)
+    size_t connections;
+    size_t batch_size;
+    size_t workers;
+    size_t backlog;
+
+    // NULL when unset
+    const char *snapshot_path;
+    uint64_t snapshot_interval_ns;
+    int snapshot_catch_up;
+    const char *record_path;
+    const char *metrics_address;
+} KovenConfig;
+
+// Loads the configuration: defaults, then the environment, then the flags of argv
+// Invalid environment variables are logged and ignored; an invalid flag is reported on stderr
+// Returns 0 on success, 1 when --help was given and -1 on an invalid flag
+int config_load(KovenConfig *config, int argc, char *argv[]);
+
+// Prints every flag with its environment variable
+void config_usage(FILE *out, const char *program);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,185 @@
+#include "event_spool.h"
+#include <stdlib.h>
+#include <string.h>
+
+int spool_policy_from_string(const char *name, SpoolPolicy *policy)
+{
+    if (!name || !policy)
+    {
+        return -1;
+    }
+
+    if (strcmp(name, "oldest") == 0)
+    {
+        *policy = SPOOL_DROP_OLDEST;
+    }
+    else if (strcmp(name, "latest") == 0)
+    {
+        *policy = SPOOL_LATEST_PER_OVEN;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *spool_policy_to_string(SpoolPolicy policy)
+{
+    switch (policy)
+    {
+    case SPOOL_DROP_OLDEST:
+        return "oldest";
+    case SPOOL_LATEST_PER_OVEN:
+        return "latest";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+int spool_init(EventSpool *spool,
+               SpoolPolicy policy,
+               size_t capacity,
+               uint32_t first_id,
+               size_t ovens)
+{
+    if (!spool || ovens == 0)
+    {
+        return -1;
+    }
+
+    memset(spool, 0, sizeof(*spool));
+    spool->policy = policy;
+    spool->first_id = first_id;
+    spool->ovens = ovens;
+
+    if (policy == SPOOL_LATEST_PER_OVEN)
+    {
+        spool->capacity = ovens;
+        spool->latest = malloc(ovens * sizeof(EventPayload));
+        spool->spooled = calloc(ovens, 1);
+    }
+    else if (policy == SPOOL_DROP_OLDEST && capacity > 0)
+    {
+        spool->capacity = capacity;
+        spool->events = malloc(capacity * sizeof(EventPayload));
+    }
+    else
+    {
+        return -1;
+    }
+
+    spool->ids = malloc(spool->capacity * sizeof(uint32_t));
+    if (!spool->ids || (policy == SPOOL_LATEST_PER_OVEN ? !spool->latest || !spool->spooled
+                                                         : !spool->events))
+    {
+        spool_free(spool);
+        return -1;
+    }
+
+    return 0;
+}
+
+void spool_free(EventSpool *spool)
+{
+    if (!spool)
+    {
+        return;
+    }
+
+    free(spool->ids);
+    free(spool->events);
+    free(spool->latest);
+    free(spool->spooled);
+    spool->ids = NULL;
+    spool->events = NULL;
+    spool->latest = NULL;
+    spool->spooled = NULL;
+    spool->count = 0;
+}
+
+int spool_push(EventSpool *spool, uint32_t id, const EventPayload *event)
+{
+    if (!spool || !spool->ids || !event || id < spool->first_id ||
+        id - spool->first_id >= spool->ovens)
+    {
+        return -1;
+    }
+
+    spool->pushed++;
+
+    if (spool->policy == SPOOL_LATEST_PER_OVEN)
+    {
+        // An oven already spooled keeps its place in the ring: only its event is replaced
+        size_t index = id - spool->first_id;
+        spool->latest[index] = *event;
+        if (spool->spooled[index])
+        {
+            spool->dropped++;
+            return 0;
+        }
+        spool->spooled[index] = 1;
+        spool->ids[(spool->head + spool->count) % spool->capacity] = id;
+        spool->count++;
+        return 0;
+    }
+
+    if (spool->count == spool->capacity)
+    {
+        spool->head = (spool->head + 1) % spool->capacity;
+        spool->count--;
+        spool->dropped++;
+    }
+
+    size_t tail = (spool->head + spool->count) % spool->capacity;
+    spool->ids[tail] = id;
+    spool->events[tail] = *event;
+    spool->count++;
+    return 0;
+}
+
+size_t spool_peek(const EventSpool *spool, uint32_t *ids, EventPayload *events, size_t max)
+{
+    if (!spool || !spool->ids || !ids || !events)
+    {
+        return 0;
+    }
+
+    size_t n = spool->count < max ? spool->count : max;
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t slot = (spool->head + i) % spool->capacity;
+        ids[i] = spool->ids[slot];
+        events[i] = spool->policy == SPOOL_LATEST_PER_OVEN
+                        ? spool->latest[spool->ids[slot] - spool->first_id]
+                        : spool->events[slot];
+    }
+
+    return n;
+}
+
+void spool_pop(EventSpool *spool, size_t n)
+{
+    if (!spool || !spool->ids)
+    {
+        return;
+    }
+
+    if (n > spool->count)
+    {
+        n = spool->count;
+    }
+
+    if (spool->policy == SPOOL_LATEST_PER_OVEN)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            spool->spooled[spool->ids[(spool->head + i) % spool->capacity] - spool->first_id] = 0;
+        }
+    }
+
+    spool->head = (spool->head + n) % spool->capacity;
+    spool->count -= n;
+    spool->flushed += n;
+}
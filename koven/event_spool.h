@@ -0,0 +1,78 @@
+#ifndef EVENT_SPOOL_H
+#define EVENT_SPOOL_H
+
+#include "protocol.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// What the spool keeps when events cannot be published
+// SPOOL_DROP_OLDEST keeps every event, in order, up to the capacity of the spool, after which
+// each new event evicts the oldest one. SPOOL_LATEST_PER_OVEN keeps only the latest event of
+// every oven, in the order the ovens first spooled one: the backlog never outgrows the fleet,
+// and an outage costs intermediate states but never the current one
+typedef enum {
+    SPOOL_DROP_OLDEST = 0,
+    SPOOL_LATEST_PER_OVEN = 1
+} SpoolPolicy;
+
+// Bounded in-memory spool of the events that could not be published, for instance while the
+// connection is down, until they can be flushed; only the tick loop uses it
+// Spooled events are always full events, whatever the event mode: the deltas in between may be
+// lost, so the platform must get whole states again
+typedef struct {
+    SpoolPolicy policy;
+    uint32_t first_id;
+    size_t ovens;
+
+    // Ring of the spooled ovens, oldest first
+    size_t capacity;
+    size_t head;
+    size_t count;
+    uint32_t *ids;
+    // SPOOL_DROP_OLDEST: the event of every entry of the ring
+    EventPayload *events;
+    // SPOOL_LATEST_PER_OVEN: the latest event of every oven, and whether it is spooled
+    EventPayload *latest;
+    uint8_t *spooled;
+
+    // Counters
+    uint64_t pushed;
+    // Evicted by SPOOL_DROP_OLDEST, or superseded by a later event of the oven
+    uint64_t dropped;
+    uint64_t flushed;
+} EventSpool;
+
+// Parses a spool policy name ("oldest" or "latest")
+// Returns 0 on success, -1 on error
+int spool_policy_from_string(const char *name, SpoolPolicy *policy);
+
+const char *spool_policy_to_string(SpoolPolicy policy);
+
+// Creates a spool for the ovens first_id to first_id + ovens - 1
+// capacity bounds SPOOL_DROP_OLDEST; SPOOL_LATEST_PER_OVEN holds one event per oven
+// Returns 0 on success, -1 on error
+int spool_init(EventSpool *spool,
+               SpoolPolicy policy,
+               size_t capacity,
+               uint32_t first_id,
+               size_t ovens);
+
+void spool_free(EventSpool *spool);
+
+// Spools the event of oven id, evicting or replacing an older event as the policy says
+// Returns 0 on success, -1 for an oven outside the spool
+int spool_push(EventSpool *spool, uint32_t id, const EventPayload *event);
+
+// Copies up to max of the oldest events, and their oven ids, without removing them
+// Returns the number of events copied
+size_t spool_peek(const EventSpool *spool, uint32_t *ids, EventPayload *events, size_t max);
+
+// Removes the n oldest events, once they were published
+void spool_pop(EventSpool *spool, size_t n);
+
+static inline size_t spool_count(const EventSpool *spool)
+{
+    return spool->count;
+}
+
+#endif /* EVENT_SPOOL_H */
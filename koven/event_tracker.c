@@ -0,0 +1,174 @@
+#include "event_tracker.h"
+#include "fleet.h"
+#include "protocol.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+int event_tracker_init(EventTracker *tracker, const EventPolicy *policy, size_t count)
+{
+    if (!tracker || !policy || count == 0)
+    {
+        return -1;
+    }
+
+    tracker->policy = *policy;
+    tracker->count = count;
+    tracker->last = calloc(count, sizeof(EventPayload));
+    tracker->age = calloc(count, sizeof(unsigned));
+    tracker->published = calloc(count, sizeof(uint8_t));
+    tracker->transition = calloc(count, sizeof(uint8_t));
+    if (!tracker->last || !tracker->age || !tracker->published || !tracker->transition)
+    {
+        event_tracker_free(tracker);
+        return -1;
+    }
+
+    // Stagger the heartbeats so that a fleet started at once does not refresh all at once, a
+    // whole block at a time so that the other blocks have nothing due
+    if (policy->heartbeat_interval > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            tracker->age[i] = (unsigned)(i / FLEET_BLOCK_SIZE % policy->heartbeat_interval);
+        }
+    }
+
+    return 0;
+}
+
+void event_tracker_free(EventTracker *tracker)
+{
+    if (!tracker)
+    {
+        return;
+    }
+
+    free(tracker->last);
+    free(tracker->age);
+    free(tracker->published);
+    free(tracker->transition);
+    tracker->last = NULL;
+    tracker->age = NULL;
+    tracker->published = NULL;
+    tracker->transition = NULL;
+    tracker->count = 0;
+}
+
+uint8_t event_tracker_update(EventTracker *tracker, size_t index, const EventPayload *event)
+{
+    if (!tracker || !event || index >= tracker->count)
+    {
+        return 0;
+    }
+
+    uint8_t fields = EVENT_FIELDS_ALL;
+    unsigned interval = tracker->policy.heartbeat_interval;
+
+    if (tracker->policy.mode != EVENT_MODE_FULL && tracker->published[index] &&
+        (interval == 0 || tracker->age[index] + 1 < interval))
+    {
+        fields = event_changed_fields(&tracker->last[index], event);
+        if (fields && tracker->policy.mode == EVENT_MODE_CHANGES)
+        {
+            fields = EVENT_FIELDS_ALL;
+        }
+    }
+
+    // The first event keeps the staggered age, later full events restart the heartbeat
+    if (tracker->published[index])
+    {
+        tracker->age[index] = fields == EVENT_FIELDS_ALL ? 0 : tracker->age[index] + 1;
+    }
+
+    tracker->transition[index] =
+        !tracker->published[index] || tracker->last[index].state != event->state;
+    tracker->last[index] = *event;
+    tracker->published[index] = 1;
+    return fields;
+}
+
+uint8_t event_tracker_unchanged(EventTracker *tracker, size_t index)
+{
+    if (!tracker || index >= tracker->count || !tracker->published[index])
+    {
+        return 0;
+    }
+
+    // Nothing changed, so only full events are ever due
+    tracker->transition[index] = 0;
+    unsigned interval = tracker->policy.heartbeat_interval;
+    if (tracker->policy.mode == EVENT_MODE_FULL ||
+        (interval > 0 && tracker->age[index] + 1 >= interval))
+    {
+        tracker->age[index] = 0;
+        return EVENT_FIELDS_ALL;
+    }
+
+    tracker->age[index]++;
+    return 0;
+}
+
+unsigned event_tracker_quiet_rounds(const EventTracker *tracker, size_t first, size_t end)
+{
+    if (!tracker || tracker->policy.mode == EVENT_MODE_FULL)
+    {
+        return 0;
+    }
+
+    unsigned interval = tracker->policy.heartbeat_interval;
+    unsigned quiet = UINT_MAX;
+    for (size_t i = first; interval > 0 && i < end && i < tracker->count; i++)
+    {
+        if (tracker->published[i])
+        {
+            unsigned left = tracker->age[i] + 1 >= interval ? 0 : interval - 1 - tracker->age[i];
+            quiet = left < quiet ? left : quiet;
+        }
+    }
+    return quiet;
+}
+
+void event_tracker_skip(EventTracker *tracker, size_t first, size_t end, unsigned rounds)
+{
+    if (!tracker || rounds == 0)
+    {
+        return;
+    }
+
+    for (size_t i = first; i < end && i < tracker->count; i++)
+    {
+        if (tracker->published[i])
+        {
+            tracker->age[i] += rounds;
+            tracker->transition[i] = 0;
+        }
+    }
+}
+
+int event_mode_from_string(const char *name, EventMode *mode)
+{
+    if (!name || !mode)
+    {
+        return -1;
+    }
+
+    if (strcmp(name, "full") == 0)
+    {
+        *mode = EVENT_MODE_FULL;
+    }
+    else if (strcmp(name, "changes") == 0)
+    {
+        *mode = EVENT_MODE_CHANGES;
+    }
+    else if (strcmp(name, "delta") == 0)
+    {
+        *mode = EVENT_MODE_DELTA;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef EVENT_TRACKER_H
+#define EVENT_TRACKER_H
+
+#include "koven.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// How events are published
+// EVENT_MODE_FULL publishes every event of every tick, EVENT_MODE_CHANGES publishes full events
+// only when a field changed and EVENT_MODE_DELTA publishes only the fields that changed
+typedef enum {
+    EVENT_MODE_FULL = 0,
+    EVENT_MODE_CHANGES = 1,
+    EVENT_MODE_DELTA = 2
+} EventMode;
+
+typedef struct {
+    EventMode mode;
+    // Ticks after which an unchanged oven publishes its full state again, 0 to never do so
+    unsigned heartbeat_interval;
+} EventPolicy;
+
+// Remembers the last published event of each oven, to decide what the next tick publishes
+typedef struct {
+    EventPolicy policy;
+    size_t count;
+    EventPayload *last;
+    // Ticks since each oven last published its full state
+    unsigned *age;
+    uint8_t *published;
+    // Whether the last update of each oven changed its state, its first update included
+    uint8_t *transition;
+} EventTracker;
+
+// Allocates a tracker for count ovens
+// The heartbeats of the ovens are spread over the interval instead of all falling on one tick,
+// by blocks of FLEET_BLOCK_SIZE ovens that share their heartbeat tick
+// Returns 0 on success, -1 on error
+int event_tracker_init(EventTracker *tracker, const EventPolicy *policy, size_t count);
+
+// Releases the memory owned by the tracker
+void event_tracker_free(EventTracker *tracker);
+
+// Records the new event of the oven at index and returns the EVENT_FIELD_* bits to publish
+// Returns 0 when nothing needs to be published, EVENT_FIELDS_ALL for a full event: always in
+// EVENT_MODE_FULL, on the first event of an oven and on heartbeats
+uint8_t event_tracker_update(EventTracker *tracker, size_t index, const EventPayload *event);
+
+// Same as event_tracker_update for an oven whose event is the one it was last updated with, e.g.
+// an idle oven that was not ticked; the event to publish, if any, is tracker->last[index]
+// The oven must have been updated at least once
+uint8_t event_tracker_unchanged(EventTracker *tracker, size_t index);
+
+// Whether the last update of the oven at index was a state transition, that is the state of its
+// event differs from the previous one, or it was its first event; never after
+// event_tracker_unchanged
+static inline int event_tracker_transition(const EventTracker *tracker, size_t index)
+{
+    return tracker->transition[index];
+}
+
+// Number of calls to event_tracker_unchanged that publish nothing for any oven from first to
+// end, e.g. the rounds an idle block can be left alone until one of its heartbeats is due
+// Returns UINT_MAX when none of them is ever due, 0 in EVENT_MODE_FULL
+unsigned event_tracker_quiet_rounds(const EventTracker *tracker, size_t first, size_t end);
+
+// Same as rounds calls to event_tracker_unchanged for every oven from first to end, as long as
+// rounds is at most event_tracker_quiet_rounds for them
+void event_tracker_skip(EventTracker *tracker, size_t first, size_t end, unsigned rounds);
+
+// Parses an event mode name ("full", "changes" or "delta")
+// Returns 0 on success, -1 if the name is unknown
+int event_mode_from_string(const char *name, EventMode *mode);
+
+#endif /* EVENT_TRACKER_H */
@@ -0,0 +1,417 @@
+#include "fleet.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The field arrays are padded to a multiple of this many ovens and aligned to its size in
+// bytes, which covers the widest vector the batch kernel uses
+#define FLEET_ALIGNMENT 32
+#define FLEET_FIELDS 5
+
+// Vector primitives for the batch kernel, one set per instruction set
+// Comparisons produce lane masks of all ones (-1) or all zeros
+// vec_andnot(m, a) computes ~m & a and vec_select(m, a, b) computes m ? a : b
+// vec_is_zero(a) is true when every lane is 0
+#if defined(__AVX2__)
+typedef __m256i vec16;
+#define VEC_LANES 16
+#define vec_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vec_store(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+#define vec_set1(x) _mm256_set1_epi16(x)
+#define vec_eq(a, b) _mm256_cmpeq_epi16((a), (b))
+#define vec_gt(a, b) _mm256_cmpgt_epi16((a), (b))
+#define vec_and(a, b) _mm256_and_si256((a), (b))
+#define vec_or(a, b) _mm256_or_si256((a), (b))
+#define vec_andnot(m, a) _mm256_andnot_si256((m), (a))
+#define vec_add(a, b) _mm256_add_epi16((a), (b))
+#define vec_sub(a, b) _mm256_sub_epi16((a), (b))
+#define vec_select(m, a, b) _mm256_blendv_epi8((b), (a), (m))
+#define vec_is_zero(a) _mm256_testz_si256((a), (a))
+#elif defined(__SSE2__)
+typedef __m128i vec16;
+#define VEC_LANES 8
+#define vec_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define vec_set1(x) _mm_set1_epi16(x)
+#define vec_eq(a, b) _mm_cmpeq_epi16((a), (b))
+#define vec_gt(a, b) _mm_cmpgt_epi16((a), (b))
+#define vec_and(a, b) _mm_and_si128((a), (b))
+#define vec_or(a, b) _mm_or_si128((a), (b))
+#define vec_andnot(m, a) _mm_andnot_si128((m), (a))
+#define vec_add(a, b) _mm_add_epi16((a), (b))
+#define vec_sub(a, b) _mm_sub_epi16((a), (b))
+#define vec_select(m, a, b) vec_or(vec_and((m), (a)), vec_andnot((m), (b)))
+#define vec_is_zero(a) (_mm_movemask_epi8(_mm_cmpeq_epi16((a), _mm_setzero_si128())) == 0xFFFF)
+#elif defined(__ARM_NEON)
+typedef int16x8_t vec16;
+#define VEC_LANES 8
+#define vec_load(p) vld1q_s16(p)
+#define vec_store(p, v) vst1q_s16((p), (v))
+#define vec_set1(x) vdupq_n_s16(x)
+#define vec_eq(a, b) vreinterpretq_s16_u16(vceqq_s16((a), (b)))
+#define vec_gt(a, b) vreinterpretq_s16_u16(vcgtq_s16((a), (b)))
+#define vec_and(a, b) vandq_s16((a), (b))
+#define vec_or(a, b) vorrq_s16((a), (b))
+#define vec_andnot(m, a) vbicq_s16((a), (m))
+#define vec_add(a, b) vaddq_s16((a), (b))
+#define vec_sub(a, b) vsubq_s16((a), (b))
+#define vec_select(m, a, b) vbslq_s16(vreinterpretq_u16_s16(m), (a), (b))
+#define vec_is_zero(a)                                                                             \
+    ((vgetq_lane_u64(vreinterpretq_u64_s16(a), 0) |                                                \
+      vgetq_lane_u64(vreinterpretq_u64_s16(a), 1)) == 0)
+#endif
+
+// Rounds an oven count up to the padding of the field arrays
+static size_t fleet_padded_count(size_t count)
+{
+    size_t lanes = FLEET_ALIGNMENT / sizeof(int16_t);
+    return (count + lanes - 1) / lanes * lanes;
+}
+
+// Allocates a fleet of count ovens, each initialized with koven_init
+// Returns 0 on success, -1 on error
+int fleet_init(KovenFleet *fleet, uint32_t first_id, size_t count)
+{
+    if (!fleet || count == 0 || count - 1 > UINT32_MAX - first_id)
+    {
+        return -1;
+    }
+
+    size_t stride = fleet_padded_count(count);
+    if (stride > SIZE_MAX / (FLEET_FIELDS * sizeof(int16_t)))
+    {
+        return -1;
+    }
+
+    // All fields live in a single allocation, one padded array after the other
+    int16_t *table = aligned_alloc(FLEET_ALIGNMENT, FLEET_FIELDS * stride * sizeof(int16_t));
+    if (!table)
+    {
+        return -1;
+    }
+
+    fleet->first_id = first_id;
+    fleet->count = count;
+    fleet->state = table;
+    fleet->current_temperature = table + stride;
+    fleet->remaining_time = table + 2 * stride;
+    fleet->programmed_duration = table + 3 * stride;
+    fleet->programmed_temperature = table + 4 * stride;
+
+    Koven initial;
+    koven_init(&initial);
+    for (size_t i = 0; i < stride; i++)
+    {
+        fleet_set(fleet, i, &initial);
+    }
+
+    return 0;
+}
+
+// Releases the memory owned by the fleet
+void fleet_free(KovenFleet *fleet)
+{
+    if (!fleet)
+    {
+        return;
+    }
+
+    free(fleet->state);
+    memset(fleet, 0, sizeof(*fleet));
+}
+
+size_t fleet_table_size(const KovenFleet *fleet)
+{
+    return FLEET_FIELDS * fleet_padded_count(fleet->count) * sizeof(int16_t);
+}
+
+int fleet_slice(const KovenFleet *fleet, size_t first, size_t count, KovenFleet *slice)
+{
+    if (!fleet || !slice || count == 0 || first > fleet->count || count > fleet->count - first)
+    {
+        return -1;
+    }
+
+    slice->first_id = fleet->first_id + (uint32_t)first;
+    slice->count = count;
+    slice->state = fleet->state + first;
+    slice->current_temperature = fleet->current_temperature + first;
+    slice->remaining_time = fleet->remaining_time + first;
+    slice->programmed_duration = fleet->programmed_duration + first;
+    slice->programmed_temperature = fleet->programmed_temperature + first;
+    return 0;
+}
+
+// Resolves an oven id to its index in the fleet table
+// Returns 0 on success, -1 if the id is not part of the fleet
+int fleet_index(const KovenFleet *fleet, uint32_t id, size_t *index)
+{
+    if (!fleet || !index || id < fleet->first_id || id - fleet->first_id >= fleet->count)
+    {
+        return -1;
+    }
+
+    *index = id - fleet->first_id;
+    return 0;
+}
+
+// Copies the state of the oven at the given index into koven
+void fleet_get(const KovenFleet *fleet, size_t index, Koven *koven)
+{
+    if (!fleet || !koven || index >= fleet->count)
+    {
+        return;
+    }
+
+    koven->state = (State)fleet->state[index];
+    koven->current_temperature = fleet->current_temperature[index];
+    koven->remaining_time = fleet->remaining_time[index];
+    koven->programmed_duration = fleet->programmed_duration[index];
+    koven->programmed_temperature = fleet->programmed_temperature[index];
+}
+
+// Overwrites the state of the oven at the given index with koven
+// fleet_init also uses it on the padding past count, which is why the bound is the padded size
+void fleet_set(KovenFleet *fleet, size_t index, const Koven *koven)
+{
+    if (!fleet || !koven || index >= fleet_padded_count(fleet->count))
+    {
+        return;
+    }
+
+    fleet->state[index] = (int16_t)koven->state;
+    fleet->current_temperature[index] = koven->current_temperature;
+    fleet->remaining_time[index] = koven->remaining_time;
+    fleet->programmed_duration[index] = koven->programmed_duration;
+    fleet->programmed_temperature[index] = koven->programmed_temperature;
+}
+
+// Executes a command on the oven with the given id
+// Returns 0 on success, -1 if the id is not part of the fleet
+int fleet_execute(KovenFleet *fleet, uint32_t id, const CommandPayload *cmd)
+{
+    size_t index;
+    if (!cmd || fleet_index(fleet, id, &index) != 0)
+    {
+        return -1;
+    }
+
+    Koven koven;
+    fleet_get(fleet, index, &koven);
+    koven_execute(&koven, cmd);
+    fleet_set(fleet, index, &koven);
+    return 0;
+}
+
+// Advances every oven of the fleet by ticks in closed form
+void fleet_advance(KovenFleet *fleet, uint32_t ticks)
+{
+    if (!fleet || ticks == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < fleet->count; i++)
+    {
+        if (fleet->state[i] == STATE_IDLE)
+        {
+            continue;
+        }
+
+        Koven koven;
+        fleet_get(fleet, i, &koven);
+        koven_state_at(&koven, ticks, &koven);
+        fleet_set(fleet, i, &koven);
+    }
+}
+
+// Scalar form of the batch kernel for a single oven
+// Every branch of koven_tick becomes a mask of all ones (-1) or all zeros, so the update is a
+// fixed sequence of and/or/add operations whatever the state is
+// Returns the new state, which is 0 (STATE_IDLE) only for an idle oven
+static int16_t tick_one(KovenFleet *fleet, size_t i)
+{
+    int16_t s = fleet->state[i];
+    int16_t t = fleet->current_temperature[i];
+    int16_t r = fleet->remaining_time[i];
+    int16_t pd = fleet->programmed_duration[i];
+    int16_t pt = fleet->programmed_temperature[i];
+
+    int16_t is_preheating = (int16_t)-(s == STATE_PREHEATING);
+    int16_t is_baking = (int16_t)-(s == STATE_BAKING);
+    int16_t is_cooling = (int16_t)-(s == STATE_COOLING_DOWN);
+    int16_t hot = (int16_t)-(t > ROOM_TEMPERATURE);
+
+    int16_t heat = is_preheating & (int16_t)-(pt > t);
+    int16_t preheat_done = is_preheating & ~heat;
+    int16_t count_down = is_baking & (int16_t)-(r > 0);
+    int16_t bake_done = is_baking & ~count_down;
+    int16_t bake_to_cooling = bake_done & hot;
+    int16_t cool = is_cooling & hot;
+    int16_t to_idle = (bake_done | is_cooling) & ~hot;
+    int16_t clear_program = bake_to_cooling | to_idle;
+
+    s = (int16_t)((preheat_done & STATE_BAKING) | (bake_to_cooling & STATE_COOLING_DOWN) |
+                  (~(preheat_done | bake_to_cooling | to_idle) & s));
+    t = (int16_t)((to_idle & ROOM_TEMPERATURE) | (~to_idle & (t - heat + cool)));
+    r = (int16_t)((preheat_done & pd) | (~preheat_done & (r + count_down)));
+    r = (int16_t)(to_idle | r);
+
+    fleet->state[i] = s;
+    fleet->current_temperature[i] = t;
+    fleet->remaining_time[i] = r;
+    fleet->programmed_duration[i] = pd | clear_program;
+    fleet->programmed_temperature[i] = pt | clear_program;
+    return s;
+}
+
+#ifdef VEC_LANES
+// Vector form of tick_one, VEC_LANES ovens starting at index i
+// Returns the new states
+static vec16 tick_vector(KovenFleet *fleet, size_t i)
+{
+    const vec16 idle = vec_set1(STATE_IDLE);
+    const vec16 preheating = vec_set1(STATE_PREHEATING);
+    const vec16 baking = vec_set1(STATE_BAKING);
+    const vec16 cooling_down = vec_set1(STATE_COOLING_DOWN);
+    const vec16 room = vec_set1(ROOM_TEMPERATURE);
+    const vec16 zero = vec_set1(0);
+
+    vec16 s = vec_load(&fleet->state[i]);
+    vec16 t = vec_load(&fleet->current_temperature[i]);
+    vec16 r = vec_load(&fleet->remaining_time[i]);
+    vec16 pd = vec_load(&fleet->programmed_duration[i]);
+    vec16 pt = vec_load(&fleet->programmed_temperature[i]);
+
+    vec16 is_preheating = vec_eq(s, preheating);
+    vec16 is_baking = vec_eq(s, baking);
+    vec16 is_cooling = vec_eq(s, cooling_down);
+    vec16 hot = vec_gt(t, room);
+
+    vec16 heat = vec_and(is_preheating, vec_gt(pt, t));
+    vec16 preheat_done = vec_andnot(heat, is_preheating);
+    vec16 count_down = vec_and(is_baking, vec_gt(r, zero));
+    vec16 bake_done = vec_andnot(count_down, is_baking);
+    vec16 bake_to_cooling = vec_and(bake_done, hot);
+    vec16 cool = vec_and(is_cooling, hot);
+    vec16 to_idle = vec_andnot(hot, vec_or(bake_done, is_cooling));
+    vec16 clear_program = vec_or(bake_to_cooling, to_idle);
+
+    s = vec_select(preheat_done, baking, s);
+    s = vec_select(bake_to_cooling, cooling_down, s);
+    s = vec_select(to_idle, idle, s);
+    t = vec_select(to_idle, room, vec_add(vec_sub(t, heat), cool));
+    r = vec_select(preheat_done, pd, vec_add(r, count_down));
+    r = vec_or(r, to_idle);
+
+    vec_store(&fleet->state[i], s);
+    vec_store(&fleet->current_temperature[i], t);
+    vec_store(&fleet->remaining_time[i], r);
+    vec_store(&fleet->programmed_duration[i], vec_or(pd, clear_program));
+    vec_store(&fleet->programmed_temperature[i], vec_or(pt, clear_program));
+    return s;
+}
+#endif
+
+// Ticks the ovens from index first to end - 1 and writes their events to out
+// Returns 0 when all of them are idle after the tick
+static int tick_range(KovenFleet *fleet, size_t first, size_t end, EventPayload *out)
+{
+    size_t i = first;
+    int16_t busy = 0;
+#ifdef VEC_LANES
+    vec16 states = vec_set1(0);
+    for (; i + VEC_LANES <= end; i += VEC_LANES)
+    {
+        states = vec_or(states, tick_vector(fleet, i));
+    }
+    busy = (int16_t)!vec_is_zero(states);
+#endif
+    for (; i < end; i++)
+    {
+        busy |= tick_one(fleet, i);
+    }
+
+    for (i = first; i < end; i++)
+    {
+        out[i].state = (uint8_t)fleet->state[i];
+        out[i].current_temperature = fleet->current_temperature[i];
+        out[i].remaining_time = fleet->remaining_time[i];
+        out[i].programmed_duration = fleet->programmed_duration[i];
+        out[i].programmed_temperature = fleet->programmed_temperature[i];
+    }
+
+    return busy != 0;
+}
+
+// Ticks the first n ovens of the fleet in a single pass over the table
+// Gives the same result as calling koven_tick on every oven, without branching on the state
+// out must have room for n entries; out[i] belongs to the oven at index i
+void koven_tick_batch(KovenFleet *fleet, size_t n, EventPayload *out)
+{
+    if (!fleet || !out)
+    {
+        return;
+    }
+
+    if (n > fleet->count)
+    {
+        n = fleet->count;
+    }
+
+    tick_range(fleet, 0, n, out);
+}
+
+size_t fleet_active_words(const KovenFleet *fleet)
+{
+    size_t blocks = (fleet->count + FLEET_BLOCK_SIZE - 1) / FLEET_BLOCK_SIZE;
+    return (blocks + 63) / 64;
+}
+
+void fleet_mark_all_active(const KovenFleet *fleet, uint64_t *active)
+{
+    size_t blocks = (fleet->count + FLEET_BLOCK_SIZE - 1) / FLEET_BLOCK_SIZE;
+    for (size_t w = 0; w < fleet_active_words(fleet); w++)
+    {
+        size_t left = blocks - 64 * w;
+        active[w] = left >= 64 ? ~0ull : (1ull << left) - 1;
+    }
+}
+
+size_t koven_tick_active(KovenFleet *fleet, uint64_t *active, EventPayload *out)
+{
+    if (!fleet || !active || !out)
+    {
+        return 0;
+    }
+
+    size_t ticked = 0;
+    for (size_t w = 0; w < fleet_active_words(fleet); w++)
+    {
+        // Only the set bits are visited, so a mostly idle fleet costs a word per 4096 ovens
+        uint64_t bits = active[w];
+        while (bits)
+        {
+            size_t block = 64 * w + (size_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            size_t first = block * FLEET_BLOCK_SIZE;
+            size_t n = fleet->count - first < FLEET_BLOCK_SIZE ? fleet->count - first
+                                                               : FLEET_BLOCK_SIZE;
+            ticked += n;
+            if (!tick_range(fleet, first, first + n, out))
+            {
+                active[w] &= ~(1ull << (block % 64));
+            }
+        }
+    }
+
+    return ticked;
+}
@@ -0,0 +1,87 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "koven.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Fleet of Koven instances kept in one contiguous table
+// The table is stored as a structure of arrays so that a tick touches each field as a dense
+// int16_t array that the batch kernel can update several ovens at a time
+// Oven ids are contiguous: the oven at index i has id first_id + i
+typedef struct {
+    uint32_t first_id;
+    size_t count;
+    int16_t *state;
+    int16_t *current_temperature;
+    int16_t *remaining_time;
+    int16_t *programmed_duration;
+    int16_t *programmed_temperature;
+} KovenFleet;
+
+// Allocates a fleet of count ovens, each initialized with koven_init
+// Returns 0 on success, -1 on error
+int fleet_init(KovenFleet *fleet, uint32_t first_id, size_t count);
+
+// Releases the memory owned by the fleet
+void fleet_free(KovenFleet *fleet);
+
+// Size in bytes of the table of a fleet made by fleet_init: every field array with its padding,
+// one after the other from fleet->state
+size_t fleet_table_size(const KovenFleet *fleet);
+
+// Makes slice a view of the count ovens of fleet starting at index first
+// The view shares the table of the fleet: it owns no memory and must not be passed to fleet_free
+// Returns 0 on success, -1 on error
+int fleet_slice(const KovenFleet *fleet, size_t first, size_t count, KovenFleet *slice);
+
+// Resolves an oven id to its index in the fleet table
+// Returns 0 on success, -1 if the id is not part of the fleet
+int fleet_index(const KovenFleet *fleet, uint32_t id, size_t *index);
+
+// Copies the state of the oven at the given index into koven
+void fleet_get(const KovenFleet *fleet, size_t index, Koven *koven);
+
+// Overwrites the state of the oven at the given index with koven
+void fleet_set(KovenFleet *fleet, size_t index, const Koven *koven);
+
+// Executes a command on the oven with the given id
+// Returns 0 on success, -1 if the id is not part of the fleet
+int fleet_execute(KovenFleet *fleet, uint32_t id, const CommandPayload *cmd);
+
+// Advances every oven of the fleet by ticks, as if koven_tick_batch had run that many times
+// Each oven is evaluated in closed form with koven_state_at, whatever the number of ticks
+void fleet_advance(KovenFleet *fleet, uint32_t ticks);
+
+// Ticks the first n ovens of the fleet in a single pass over the table
+// Gives the same result as calling koven_tick on every oven, without branching on the state
+// out must have room for n entries; out[i] belongs to the oven at index i
+void koven_tick_batch(KovenFleet *fleet, size_t n, EventPayload *out);
+
+// Ovens per block of an active mask
+// An idle oven is left unchanged by a tick, so only the blocks holding at least one oven that is
+// not idle need ticking. Bit b of word w of the mask covers the block of the ovens
+// FLEET_BLOCK_SIZE * (64 * w + b) onwards
+#define FLEET_BLOCK_SIZE 64
+
+// Words of an active mask covering every oven of the fleet
+size_t fleet_active_words(const KovenFleet *fleet);
+
+// Marks every block of the fleet as active, e.g. when the table was written behind the mask
+// active must have fleet_active_words(fleet) words
+void fleet_mark_all_active(const KovenFleet *fleet, uint64_t *active);
+
+// Marks the block of the oven at index as active, e.g. after a command was executed on it
+static inline void fleet_mark_active(uint64_t *active, size_t index)
+{
+    size_t block = index / FLEET_BLOCK_SIZE;
+    active[block / 64] |= 1ull << (block % 64);
+}
+
+// Ticks the blocks of the fleet marked in active with the batch kernel, and skips the others
+// The bits of the blocks left with only idle ovens are cleared. out[i] only receives the event
+// of the oven at index i when its block was ticked; the ovens of skipped blocks keep their state
+// Returns the number of ovens ticked
+size_t koven_tick_active(KovenFleet *fleet, uint64_t *active, EventPayload *out);
+
+#endif /* FLEET_H */
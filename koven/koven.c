@@ -2,7 +2,6 @@
 #include <stdio.h>
 #include <string.h>
 
-#define ROOM_TEMPERATURE 25
 // Initialize the Koven state to default values
 // Starts in IDLE state at room temperature (25°C)
 // No programmed temperature or duration (-1)
@@ -114,6 +113,128 @@ void koven_tick(Koven *koven, EventPayload *event)
     event->programmed_temperature = koven->programmed_temperature;
 }
 
+// Evaluate the Koven ticks_ahead seconds later without simulating every tick
+// out ends up exactly as if koven_tick had been called ticks_ahead times on a copy of koven
+// Each phase lasts a number of ticks known from the state, plus one tick for its transition:
+// - PREHEATING heats until the programmed temperature, then starts BAKING
+// - BAKING counts the remaining time down to zero, then cools down or goes back to IDLE
+// - COOLING_DOWN cools until room temperature, then goes back to IDLE
+// koven and out may be the same Koven
+void koven_state_at(const Koven *koven, uint32_t ticks_ahead, Koven *out)
+{
+    if (!koven || !out)
+    {
+        return;
+    }
+
+    Koven k = *koven;
+    uint32_t left = ticks_ahead;
+
+    if (left > 0 && k.state == STATE_PREHEATING)
+    {
+        uint32_t heating = k.current_temperature < k.programmed_temperature
+                               ? (uint32_t)(k.programmed_temperature - k.current_temperature)
+                               : 0;
+        if (left <= heating)
+        {
+            k.current_temperature = (int16_t)(k.current_temperature + (int32_t)left);
+            left = 0;
+        }
+        else
+        {
+            k.current_temperature = (int16_t)(k.current_temperature + (int32_t)heating);
+            k.state = STATE_BAKING;
+            k.remaining_time = k.programmed_duration;
+            left -= heating + 1;
+        }
+    }
+
+    if (left > 0 && k.state == STATE_BAKING)
+    {
+        uint32_t counting = k.remaining_time > 0 ? (uint32_t)k.remaining_time : 0;
+        if (left <= counting)
+        {
+            k.remaining_time = (int16_t)(k.remaining_time - (int32_t)left);
+            left = 0;
+        }
+        else
+        {
+            k.remaining_time = (int16_t)(k.remaining_time - (int32_t)counting);
+            if (k.current_temperature > ROOM_TEMPERATURE)
+            {
+                k.state = STATE_COOLING_DOWN;
+                k.programmed_temperature = -1;
+                k.programmed_duration = -1;
+            }
+            else
+            {
+                koven_init(&k);
+            }
+            left -= counting + 1;
+        }
+    }
+
+    if (left > 0 && k.state == STATE_COOLING_DOWN)
+    {
+        uint32_t cooling = k.current_temperature > ROOM_TEMPERATURE
+                               ? (uint32_t)(k.current_temperature - ROOM_TEMPERATURE)
+                               : 0;
+        if (left <= cooling)
+        {
+            k.current_temperature = (int16_t)(k.current_temperature - (int32_t)left);
+        }
+        else
+        {
+            koven_init(&k);
+        }
+    }
+
+    *out = k;
+}
+
+// Number of ticks until the Koven is back in IDLE, 0 when it already is
+// The Koven is in IDLE after koven_state_at with that many ticks, and not one tick before
+uint32_t koven_ticks_until_idle(const Koven *koven)
+{
+    if (!koven || koven->state == STATE_IDLE)
+    {
+        return 0;
+    }
+
+    uint32_t ticks = 0;
+    int16_t temperature = koven->current_temperature;
+    int16_t remaining = koven->remaining_time;
+    State state = koven->state;
+
+    if (state == STATE_PREHEATING)
+    {
+        if (temperature < koven->programmed_temperature)
+        {
+            ticks += (uint32_t)(koven->programmed_temperature - temperature);
+            temperature = koven->programmed_temperature;
+        }
+        ticks += 1;
+        remaining = koven->programmed_duration;
+        state = STATE_BAKING;
+    }
+
+    if (state == STATE_BAKING)
+    {
+        ticks += (remaining > 0 ? (uint32_t)remaining : 0) + 1;
+        if (temperature <= ROOM_TEMPERATURE)
+        {
+            return ticks;
+        }
+    }
+
+    // Cooling down, from the temperature the oven baked at
+    if (temperature > ROOM_TEMPERATURE)
+    {
+        ticks += (uint32_t)(temperature - ROOM_TEMPERATURE);
+    }
+    return ticks + 1;
+}
+
 const char *state_to_string(State state)
 {
     switch (state)
@@ -1,8 +1,11 @@
 #ifndef KOVEN_H
 #define KOVEN_H
 
+#include "messages.h"
 #include <stdint.h>
 
+#define ROOM_TEMPERATURE 25
+
 // Oven state
 typedef enum {
     STATE_IDLE = 0,
@@ -17,26 +20,6 @@ typedef enum {
     ACTION_STOP = 2,
 } Action;
 
-// Command payload structure
-// It always contains the action to perform, target temperature, and duration
-// The temperature and duration fields are ignored for ACTION_STOP
-// The temperature is in degrees Celsius and duration in seconds.
-typedef struct __attribute__((packed)) {
-    uint8_t action;
-    int16_t temperature;
-    int16_t duration;
-} CommandPayload;
-
-// Event payload structure sent by the oven
-// -1 value indicates that the field is not applicable for the current state
-typedef struct __attribute__((packed)) {
-    uint8_t state;
-    int16_t current_temperature;
-    int16_t remaining_time;
-    int16_t programmed_duration;
-    int16_t programmed_temperature;
-} EventPayload;
-
 // Internal Koven state structure
 typedef struct {
     State state;
@@ -49,6 +32,8 @@ typedef struct {
 void koven_init(Koven *koven);
 void koven_execute(Koven *koven, const CommandPayload *cmd);
 void koven_tick(Koven *koven, EventPayload *event);
+void koven_state_at(const Koven *koven, uint32_t ticks_ahead, Koven *out);
+uint32_t koven_ticks_until_idle(const Koven *koven);
 
 const char* state_to_string(State state);
 const char* action_to_string(Action action);
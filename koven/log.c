@@ -0,0 +1,356 @@
+#include "log.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SECOND 1000000000ull
+
+// Pause of the drain thread when the ring is empty
+#define LOG_DRAIN_INTERVAL_NS 5000000L
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of 2");
+
+// Slot of the ring
+// The sequence number tells whose turn it is: a producer may fill the slot of position pos when
+// sequence == pos, the drain thread may read it when sequence == pos + 1
+typedef struct {
+    atomic_size_t sequence;
+    LogLevel level;
+    size_t len;
+    char text[LOG_LINE_SIZE];
+} LogSlot;
+
+static LogSlot ring[LOG_RING_SIZE];
+static atomic_size_t enqueue_pos;
+static size_t dequeue_pos;
+
+static atomic_int log_level = LOG_LEVEL_INFO;
+static atomic_int started;
+static atomic_int draining;
+static atomic_uint_fast64_t dropped;
+static uint64_t reported_dropped;
+
+static pthread_t drain_thread;
+static FILE *out_stream;
+static FILE *err_stream;
+
+static const char *level_prefix(LogLevel level)
+{
+    switch (level)
+    {
+    case LOG_LEVEL_DEBUG:
+        return "debug: ";
+    case LOG_LEVEL_WARN:
+        return "warning: ";
+    case LOG_LEVEL_ERROR:
+        return "error: ";
+    default:
+        return "";
+    }
+}
+
+static void write_line(FILE *out, FILE *err, LogLevel level, const char *text, size_t len)
+{
+    FILE *stream = level >= LOG_LEVEL_WARN ? err : out;
+    fputs(level_prefix(level), stream);
+    fwrite(text, 1, len, stream);
+    fputc('\n', stream);
+}
+
+// Hands a formatted message to the ring, or writes it straight away when the drain thread is not
+// running
+static void log_emit(LogLevel level, const char *text, size_t len)
+{
+    if (!atomic_load_explicit(&started, memory_order_acquire))
+    {
+        write_line(stdout, stderr, level, text, len);
+        return;
+    }
+
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    LogSlot *slot;
+    for (;;)
+    {
+        slot = &ring[pos & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(
+                    &enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The slot still holds a message of the previous lap: the ring is full
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->len = len;
+    memcpy(slot->text, text, len);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+// Writes out every message ready in the ring
+// Returns the number of messages written
+static size_t log_drain(void)
+{
+    size_t count = 0;
+    for (;;)
+    {
+        LogSlot *slot = &ring[dequeue_pos & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != dequeue_pos + 1)
+        {
+            break;
+        }
+
+        write_line(out_stream, err_stream, slot->level, slot->text, slot->len);
+        atomic_store_explicit(&slot->sequence, dequeue_pos + LOG_RING_SIZE, memory_order_release);
+        dequeue_pos++;
+        count++;
+    }
+
+    uint64_t total = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (total != reported_dropped)
+    {
+        fprintf(err_stream,
+                "warning: %llu log messages dropped\n",
+                (unsigned long long)(total - reported_dropped));
+        reported_dropped = total;
+        count++;
+    }
+
+    return count;
+}
+
+// Drain thread: writes out batches of messages and flushes the streams whenever the ring is
+// empty, so that each burst of messages costs one write per stream
+static void *log_drain_loop(void *arg)
+{
+    (void)arg;
+    struct timespec pause = {0, LOG_DRAIN_INTERVAL_NS};
+
+    while (atomic_load_explicit(&draining, memory_order_acquire))
+    {
+        if (log_drain() == 0)
+        {
+            nanosleep(&pause, NULL);
+        }
+        else if (dequeue_pos == atomic_load_explicit(&enqueue_pos, memory_order_relaxed))
+        {
+            fflush(out_stream);
+            fflush(err_stream);
+        }
+    }
+
+    return NULL;
+}
+
+int log_start(FILE *out, FILE *err)
+{
+    if (!out || !err || atomic_load(&started))
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+    {
+        atomic_store_explicit(&ring[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store(&enqueue_pos, 0);
+    dequeue_pos = 0;
+    reported_dropped = atomic_load(&dropped);
+
+    out_stream = out;
+    err_stream = err;
+    atomic_store(&draining, 1);
+    if (pthread_create(&drain_thread, NULL, log_drain_loop, NULL) != 0)
+    {
+        atomic_store(&draining, 0);
+        return -1;
+    }
+
+    atomic_store_explicit(&started, 1, memory_order_release);
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!atomic_load(&started))
+    {
+        return;
+    }
+
+    atomic_store_explicit(&started, 0, memory_order_release);
+    atomic_store_explicit(&draining, 0, memory_order_release);
+    pthread_join(drain_thread, NULL);
+
+    log_drain();
+    fflush(out_stream);
+    fflush(err_stream);
+}
+
+void log_set_level(LogLevel level) { atomic_store(&log_level, (int)level); }
+
+LogLevel log_get_level(void) { return (LogLevel)atomic_load(&log_level); }
+
+int log_level_from_string(const char *name, LogLevel *level)
+{
+    static const char *names[] = {"debug", "info", "warn", "error", "off"};
+
+    if (!name || !level)
+    {
+        return -1;
+    }
+
+    for (int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_OFF; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            *level = (LogLevel)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+uint64_t log_dropped(void) { return atomic_load(&dropped); }
+
+uint64_t log_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static int log_enabled(LogLevel level)
+{
+    return level < LOG_LEVEL_OFF &&
+           (int)level >= atomic_load_explicit(&log_level, memory_order_relaxed);
+}
+
+// Formats a message into text, truncating it to LOG_LINE_SIZE
+// Returns the length of the formatted message
+static size_t log_format(char *text, const char *format, va_list args)
+{
+    int len = vsnprintf(text, LOG_LINE_SIZE, format, args);
+    if (len < 0)
+    {
+        return 0;
+    }
+    return (size_t)len < LOG_LINE_SIZE ? (size_t)len : LOG_LINE_SIZE - 1;
+}
+
+void log_write(LogLevel level, const char *format, ...)
+{
+    if (!log_enabled(level))
+    {
+        return;
+    }
+
+    char text[LOG_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    size_t len = log_format(text, format, args);
+    va_end(args);
+
+    log_emit(level, text, len);
+}
+
+int log_limit_allow(LogLimit *limit, uint64_t interval_ns, uint64_t now_ns, uint64_t *suppressed)
+{
+    uint_fast64_t next = atomic_load_explicit(&limit->next_ns, memory_order_relaxed);
+    if (now_ns < next || !atomic_compare_exchange_strong_explicit(&limit->next_ns,
+                                                                  &next,
+                                                                  now_ns + interval_ns,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed))
+    {
+        atomic_fetch_add_explicit(&limit->suppressed, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    uint64_t count = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+    if (suppressed)
+    {
+        *suppressed = count;
+    }
+    return 1;
+}
+
+void log_write_limited(
+    LogLimit *limit, uint64_t interval_ns, LogLevel level, const char *format, ...)
+{
+    uint64_t suppressed;
+    if (!log_enabled(level) || !log_limit_allow(limit, interval_ns, log_now_ns(), &suppressed))
+    {
+        return;
+    }
+
+    char text[LOG_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    size_t len = log_format(text, format, args);
+    va_end(args);
+
+    if (suppressed > 0 && len < LOG_LINE_SIZE - 1)
+    {
+        int extra = snprintf(&text[len],
+                             LOG_LINE_SIZE - len,
+                             " (%llu similar messages suppressed)",
+                             (unsigned long long)suppressed);
+        if (extra > 0)
+        {
+            len += (size_t)extra < LOG_LINE_SIZE - len ? (size_t)extra : LOG_LINE_SIZE - 1 - len;
+        }
+    }
+
+    log_emit(level, text, len);
+}
+
+void log_write_hex(LogLevel level, const char *label, const uint8_t *data, size_t len)
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    if (!log_enabled(level) || !label || (!data && len > 0))
+    {
+        return;
+    }
+
+    char text[LOG_LINE_SIZE];
+    int header = snprintf(text, sizeof(text), "%s (%zu bytes): ", label, len);
+    if (header < 0)
+    {
+        return;
+    }
+
+    // Bytes that do not fit are elided, keeping room for the "..." marker
+    size_t limit = sizeof(text) - 4;
+    size_t pos = (size_t)header < limit ? (size_t)header : limit;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (pos + 2 > limit)
+        {
+            memcpy(&text[pos], "...", 3);
+            pos += 3;
+            break;
+        }
+        text[pos++] = digits[data[i] >> 4];
+        text[pos++] = digits[data[i] & 0x0F];
+    }
+
+    log_emit(level, text, pos);
+}
@@ -0,0 +1,108 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Log levels, from the most to the least verbose
+typedef enum {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO = 1,
+    LOG_LEVEL_WARN = 2,
+    LOG_LEVEL_ERROR = 3,
+    LOG_LEVEL_OFF = 4
+} LogLevel;
+
+// Number of messages the ring holds before new ones are dropped
+#define LOG_RING_SIZE 1024
+
+// Longest message, longer ones are truncated
+#define LOG_LINE_SIZE 256
+
+// Non-blocking logger
+// Messages are formatted by the calling thread into a slot of a lock-free ring that accepts any
+// number of producers; a background thread drains the ring into buffered streams, so logging
+// never issues a write syscall on the tick loop or on the MQTT callback threads. When the ring
+// is full the message is dropped and counted rather than waited for
+// Before log_start (and after log_stop) messages are written straight to the streams
+
+// Starts the drain thread, writing messages below LOG_LEVEL_WARN to out and the others to err
+// Returns 0 on success, -1 on error
+int log_start(FILE *out, FILE *err);
+
+// Drains the ring and stops the drain thread
+void log_stop(void);
+
+void log_set_level(LogLevel level);
+LogLevel log_get_level(void);
+
+// Parses "debug", "info", "warn", "error" or "off"
+// Returns 0 on success, -1 on error
+int log_level_from_string(const char *name, LogLevel *level);
+
+// Messages dropped because the ring was full
+uint64_t log_dropped(void);
+
+// Logs a printf-style message at the given level
+void log_write(LogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Rate limit of one log call site: at most one message per interval, the others are counted
+// and reported with the next message that gets through
+typedef struct {
+    atomic_uint_fast64_t next_ns;
+    atomic_uint_fast64_t suppressed;
+} LogLimit;
+
+// Returns 1 if a message may be logged at now_ns under the limit, 0 if it is suppressed
+// *suppressed receives the number of messages suppressed since the previous one
+int log_limit_allow(LogLimit *limit, uint64_t interval_ns, uint64_t now_ns, uint64_t *suppressed);
+
+// Logs at most one message per interval_ns from the call site
+void log_write_limited(LogLimit *limit,
+                       uint64_t interval_ns,
+                       LogLevel level,
+                       const char *format,
+                       ...) __attribute__((format(printf, 4, 5)));
+
+// Current time of the monotonic clock, as used by the rate limits
+uint64_t log_now_ns(void);
+
+#define log_info(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warn(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_error(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Logs at most once per interval_ns from this call site
+#define log_limited(interval_ns, level, ...)                                                       \
+    do                                                                                             \
+    {                                                                                              \
+        static LogLimit log_call_site_limit;                                                       \
+        log_write_limited(&log_call_site_limit, (interval_ns), (level), __VA_ARGS__);              \
+    } while (0)
+
+// Logs every n-th message of this call site, starting with the first
+#define log_sampled(n, level, ...)                                                                 \
+    do                                                                                             \
+    {                                                                                              \
+        static atomic_uint_fast64_t log_call_site_count;                                           \
+        if (atomic_fetch_add_explicit(&log_call_site_count, 1, memory_order_relaxed) % (n) == 0)   \
+        {                                                                                          \
+            log_write((level), __VA_ARGS__);                                                       \
+        }                                                                                          \
+    } while (0)
+
+// Debug messages and hex dumps are only compiled in with KOVEN_LOG_DEBUG, so that release
+// builds do not even evaluate their arguments
+#ifdef KOVEN_LOG_DEBUG
+#define log_debug(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_debug_hex(label, data, len) log_write_hex(LOG_LEVEL_DEBUG, (label), (data), (len))
+#else
+#define log_debug(...) ((void)0)
+#define log_debug_hex(label, data, len) ((void)0)
+#endif
+
+// Logs label followed by the bytes of data in hex, as one message
+void log_write_hex(LogLevel level, const char *label, const uint8_t *data, size_t len);
+
+#endif /* LOG_H */
@@ -1,30 +1,207 @@
+#include "config.h"
+#include "event_tracker.h"
+#include "fleet.h"
 #include "koven.h"
+#include "log.h"
+#include "metrics.h"
 #include "mqtt_client.h"
+#include "recording.h"
+#include "snapshot.h"
+#include "transport.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+// Opens the capture log at path for the ovens of fleet, or for the single oven with id 0 when
+// fleet is NULL, and records the state the ovens start from
+// Returns the recorder, or NULL when there is no capture
+static Recorder *open_recorder(Recorder *recorder, const char *path, const KovenFleet *fleet)
+{
+    if (!path || *path == '\0')
+    {
+        return NULL;
+    }
+
+    if (recorder_open(recorder, path, fleet ? fleet->first_id : 0, fleet ? fleet->count : 1) != 0 ||
+        (fleet && recorder_initial_state(recorder, fleet) != 0))
+    {
+        log_warn("Failed to create capture log %s, running without capture", path);
+        recorder_close(recorder);
+        return NULL;
+    }
+
+    log_info("Capturing commands and events to %s", path);
+    return recorder;
+}
+
+static void close_recorder(Recorder *recorder)
+{
+    if (!recorder)
+    {
+        return;
+    }
+
+    uint64_t commands = recorder->commands;
+    uint64_t events = recorder->events;
+    if (recorder_close(recorder) != 0)
+    {
+        log_error("Capture log is incomplete: writing it failed");
+        return;
+    }
+    log_info("Captured %llu commands and %llu events",
+             (unsigned long long)commands,
+             (unsigned long long)events);
+}
+
+// Serves the metrics on address
+// Returns the server, or NULL when the metrics are not served; they are recorded regardless
+static MetricsServer *open_metrics(MetricsServer *server, const char *address)
+{
+    if (!address || *address == '\0')
+    {
+        return NULL;
+    }
+
+    if (metrics_server_start(server, address) != 0)
+    {
+        log_warn("Failed to serve metrics on %s, running without the endpoint", address);
+        return NULL;
+    }
+
+    log_info("Serving metrics on port %u at /metrics", (unsigned)server->port);
+    return server;
+}
+
+static void close_metrics(MetricsServer *server)
+{
+    if (!server)
+    {
+        return;
+    }
+
+    metrics_server_stop(server);
+    log_info("Metrics scraped %llu times", (unsigned long long)atomic_load(&server->scrapes));
+}
+
 int main(int argc, char *argv[])
 {
-    (void)argc;
-    (void)argv;
+    KovenConfig config;
+    int loaded = config_load(&config, argc, argv);
+    if (loaded != 0)
+    {
+        config_usage(loaded > 0 ? stdout : stderr, argv[0]);
+        return loaded > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Output stays buffered: the drain thread of the logger flushes it after every burst of
+    // messages, which is soon enough for the logs of a Docker container
+    log_set_level(config.log_level);
+    log_start(stdout, stderr);
+
+    log_info("Starting Koven...");
+
+    MetricsServer metrics;
+    MetricsServer *exporter = open_metrics(&metrics, config.metrics_address);
+
+    int result;
+    if (config.fleet_size > 0)
+    {
+        KovenFleet fleet;
+        if (fleet_init(&fleet, config.first_id, config.fleet_size) != 0)
+        {
+            log_error("Failed to create a fleet of %zu ovens", config.fleet_size);
+            close_metrics(exporter);
+            log_stop();
+            return EXIT_FAILURE;
+        }
 
-    // Disable stdout buffering for Docker container compatibility
-    setbuf(stdout, NULL);
-    setbuf(stderr, NULL);
+        // With a snapshot file, the fleet resumes where the previous run left it
+        FleetSnapshot snapshot;
+        FleetSnapshot *snapshots = NULL;
+        const char *snapshot_path = config.snapshot_path;
+        if (snapshot_path && *snapshot_path != '\0')
+        {
+            if (snapshot_open(&snapshot, snapshot_path, &fleet, config.snapshot_interval_ns) == 0)
+            {
+                uint64_t start = log_now_ns();
+                uint64_t sequence = snapshot_restore(&snapshot, &fleet);
+                if (sequence > 0)
+                {
+                    log_info("Restored %zu ovens from snapshot %llu of %s in %.3f ms",
+                             fleet.count,
+                             (unsigned long long)sequence,
+                             snapshot_path,
+                             (double)(log_now_ns() - start) / 1e6);
 
-    printf("Starting Koven...\n");
+                    // Optionally, the ovens also live through the time the emulator was down
+                    if (config.snapshot_catch_up)
+                    {
+                        double ticks = (double)snapshot_downtime_ns(&snapshot) / 1e9 *
+                                       config.schedule.acceleration;
+                        uint32_t ahead = ticks < (double)UINT32_MAX ? (uint32_t)ticks : UINT32_MAX;
+                        start = log_now_ns();
+                        fleet_advance(&fleet, ahead);
+                        log_info("Advanced the fleet by %u ticks of downtime in %.3f ms",
+                                 ahead,
+                                 (double)(log_now_ns() - start) / 1e6);
+                    }
+                }
+                else
+                {
+                    log_info("No snapshot to restore in %s, starting from idle ovens",
+                             snapshot_path);
+                }
+                snapshots = &snapshot;
+            }
+            else
+            {
+                log_warn("Running without snapshots");
+            }
+        }
 
-    Koven koven;
-    koven_init(&koven);
+        Recorder recorder;
+        Recorder *capture = open_recorder(&recorder, config.record_path, &fleet);
 
-    int result = mqtt_client_run(&koven);
+        result = mqtt_client_run_fleet(&fleet,
+                                       &config.transport,
+                                       &config.reconnect,
+                                       config.connections,
+                                       config.batch_size,
+                                       config.workers,
+                                       config.backlog,
+                                       snapshots,
+                                       capture,
+                                       &config.policy,
+                                       &config.schedule);
+        close_recorder(capture);
+        snapshot_close(snapshots);
+        fleet_free(&fleet);
+    }
+    else
+    {
+        Koven koven;
+        koven_init(&koven);
+
+        Recorder recorder;
+        Recorder *capture = open_recorder(&recorder, config.record_path, NULL);
+
+        result = mqtt_client_run(&koven,
+                                 &config.transport,
+                                 &config.reconnect,
+                                 capture,
+                                 &config.policy,
+                                 &config.schedule);
+        close_recorder(capture);
+    }
 
+    close_metrics(exporter);
     if (result != 0)
     {
-        fprintf(stderr, "Koven exited with error code: %d\n", result);
+        log_error("Koven exited with error code: %d", result);
+        log_stop();
         return EXIT_FAILURE;
     }
 
-    printf("Koven stopped successfully\n");
+    log_info("Koven stopped successfully");
+    log_stop();
     return EXIT_SUCCESS;
 }
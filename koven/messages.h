@@ -0,0 +1,199 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Structs and codecs of the messages of messages.def, expanded from the schema at compile time
+// For each MESSAGE(type, prefix) this defines:
+// - type, a packed struct with the fields of the message in schema order
+// - prefix_field_<name>, the index of each field, and prefix_field_count
+// - prefix_wire_size, the size of the payload on the wire
+// - prefix_encode() and prefix_decode(), which convert a whole payload
+// - prefix_encode_fields(), which writes only the fields of a field mask, in schema order
+// - prefix_changed_fields(), the field mask of the fields that differ between two messages
+
+// C type and wire size of each wire type of the schema
+#define MESSAGE_CTYPE_U8  uint8_t
+#define MESSAGE_CTYPE_U16 uint16_t
+#define MESSAGE_CTYPE_I16 int16_t
+#define MESSAGE_CTYPE_U32 uint32_t
+#define MESSAGE_CTYPE_I32 int32_t
+
+#define MESSAGE_SIZE_U8  1
+#define MESSAGE_SIZE_U16 2
+#define MESSAGE_SIZE_I16 2
+#define MESSAGE_SIZE_U32 4
+#define MESSAGE_SIZE_I32 4
+
+// On little-endian hosts the packed structs have exactly their wire layout, so whole payloads
+// are copied with a single memcpy and the per-field byte order conversion compiles out
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MESSAGES_LITTLE_ENDIAN 1
+#endif
+
+// Little-endian stores and loads of each wire type
+static inline void message_store_u8(uint8_t *out, uint8_t value) { out[0] = value; }
+
+static inline void message_store_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static inline void message_store_u32(uint8_t *out, uint32_t value)
+{
+    message_store_u16(out, (uint16_t)(value & 0xFFFF));
+    message_store_u16(&out[2], (uint16_t)(value >> 16));
+}
+
+static inline uint8_t message_load_u8(const uint8_t *in) { return in[0]; }
+
+static inline uint16_t message_load_u16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | ((uint16_t)in[1] << 8));
+}
+
+static inline uint32_t message_load_u32(const uint8_t *in)
+{
+    return (uint32_t)message_load_u16(in) | ((uint32_t)message_load_u16(&in[2]) << 16);
+}
+
+#define MESSAGE_STORE_U8(out, value)  message_store_u8((out), (value))
+#define MESSAGE_STORE_U16(out, value) message_store_u16((out), (value))
+#define MESSAGE_STORE_I16(out, value) message_store_u16((out), (uint16_t)(value))
+#define MESSAGE_STORE_U32(out, value) message_store_u32((out), (value))
+#define MESSAGE_STORE_I32(out, value) message_store_u32((out), (uint32_t)(value))
+
+#define MESSAGE_LOAD_U8(in)  message_load_u8(in)
+#define MESSAGE_LOAD_U16(in) message_load_u16(in)
+#define MESSAGE_LOAD_I16(in) ((int16_t)message_load_u16(in))
+#define MESSAGE_LOAD_U32(in) message_load_u32(in)
+#define MESSAGE_LOAD_I32(in) ((int32_t)message_load_u32(in))
+
+// Bit of a field in the field masks of its message
+#define MESSAGE_FIELD_BIT(prefix, name) ((uint8_t)(1u << prefix##_field_##name))
+
+// Structs
+#define MESSAGE(type, prefix) typedef struct __attribute__((packed)) {
+#define FIELD(prefix, name, wire) MESSAGE_CTYPE_##wire name;
+#define END_MESSAGE(type, prefix)                                                                  \
+    }                                                                                              \
+    type;
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+
+// Field indices
+#define MESSAGE(type, prefix) enum {
+#define FIELD(prefix, name, wire) prefix##_field_##name,
+#define END_MESSAGE(type, prefix)                                                                  \
+    prefix##_field_count                                                                           \
+    }                                                                                              \
+    ;                                                                                              \
+    _Static_assert(prefix##_field_count <= 8, #type " has more fields than a field mask holds");
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+
+// Wire sizes, which the packed structs must match for the copies to be valid
+#define MESSAGE(type, prefix) enum { prefix##_wire_size = 0
+#define FIELD(prefix, name, wire) +MESSAGE_SIZE_##wire
+#define END_MESSAGE(type, prefix)                                                                  \
+    }                                                                                              \
+    ;                                                                                              \
+    _Static_assert(sizeof(type) == prefix##_wire_size, #type " must match its wire layout");
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+
+// Whole payload codecs: prefix_encode writes prefix_wire_size bytes to out and prefix_decode
+// reads them back from in
+#ifdef MESSAGES_LITTLE_ENDIAN
+#define MESSAGE(type, prefix)                                                                      \
+    static inline void prefix##_encode(const type *message, uint8_t *out)                         \
+    {                                                                                              \
+        memcpy(out, message, sizeof(type));                                                        \
+    }                                                                                              \
+    static inline void prefix##_decode(const uint8_t *in, type *message)                          \
+    {                                                                                              \
+        memcpy(message, in, sizeof(type));                                                         \
+    }
+#define FIELD(prefix, name, wire)
+#define END_MESSAGE(type, prefix)
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+#else
+#define MESSAGE(type, prefix)                                                                      \
+    static inline void prefix##_encode(const type *message, uint8_t *out)                         \
+    {                                                                                              \
+        size_t pos = 0;
+#define FIELD(prefix, name, wire)                                                                  \
+    MESSAGE_STORE_##wire(&out[pos], message->name);                                                \
+    pos += MESSAGE_SIZE_##wire;
+#define END_MESSAGE(type, prefix)                                                                  \
+    (void)pos;                                                                                     \
+    }
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+
+#define MESSAGE(type, prefix)                                                                      \
+    static inline void prefix##_decode(const uint8_t *in, type *message)                          \
+    {                                                                                              \
+        size_t pos = 0;
+#define FIELD(prefix, name, wire)                                                                  \
+    message->name = MESSAGE_LOAD_##wire(&in[pos]);                                                 \
+    pos += MESSAGE_SIZE_##wire;
+#define END_MESSAGE(type, prefix)                                                                  \
+    (void)pos;                                                                                     \
+    }
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+#endif
+
+// Writes the fields of message selected by fields, in schema order
+// Returns the number of bytes written, at most prefix_wire_size
+#define MESSAGE(type, prefix)                                                                      \
+    static inline size_t prefix##_encode_fields(const type *message, uint8_t fields, uint8_t *out) \
+    {                                                                                              \
+        size_t len = 0;
+#define FIELD(prefix, name, wire)                                                                  \
+    if (fields & MESSAGE_FIELD_BIT(prefix, name))                                                  \
+    {                                                                                              \
+        MESSAGE_STORE_##wire(&out[len], message->name);                                            \
+        len += MESSAGE_SIZE_##wire;                                                                \
+    }
+#define END_MESSAGE(type, prefix)                                                                  \
+    return len;                                                                                    \
+    }
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+
+// Returns the field mask of the fields that differ between previous and current
+#define MESSAGE(type, prefix)                                                                      \
+    static inline uint8_t prefix##_changed_fields(const type *previous, const type *current)      \
+    {                                                                                              \
+        uint8_t fields = 0;
+#define FIELD(prefix, name, wire)                                                                  \
+    fields |= previous->name != current->name ? MESSAGE_FIELD_BIT(prefix, name) : 0;
+#define END_MESSAGE(type, prefix)                                                                  \
+    return fields;                                                                                 \
+    }
+#include "messages.def"
+#undef MESSAGE
+#undef FIELD
+#undef END_MESSAGE
+
+#endif /* MESSAGES_H */
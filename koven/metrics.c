@@ -0,0 +1,556 @@
+#include "metrics.h"
+#include "log.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Prometheus buckets: every power of two of nanoseconds from 64 ns to about 69 s
+#define METRICS_EXPORT_FIRST_POWER 6
+#define METRICS_EXPORT_LAST_POWER 36
+
+// Longest request read by the endpoint, and the longest time spent on one client
+#define METRICS_REQUEST_SIZE 2048
+#define METRICS_CLIENT_TIMEOUT_S 1
+
+typedef struct {
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t buckets[METRICS_BUCKETS];
+} MetricsSlotHistogram;
+
+// Everything one thread records, on cache lines of its own
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t counters[METRIC_COUNTERS];
+    MetricsSlotHistogram histograms[METRIC_HISTOGRAMS];
+} MetricsSlot;
+
+static MetricsSlot metrics_slots[METRICS_MAX_THREADS];
+static atomic_size_t metrics_slots_taken;
+static _Thread_local MetricsSlot *metrics_self;
+
+static const struct {
+    const char *name;
+    const char *help;
+} counter_names[METRIC_COUNTERS] = {
+    {"koven_commands_received_total", "Command frames decoded"},
+    {"koven_commands_dropped_total", "Commands dropped on full queues or over the backlog"},
+    {"koven_events_published_total", "Events handed to the transport"},
+    {"koven_transitions_total", "Events that changed the state of their oven"},
+    {"koven_events_spooled_total", "Events spooled while they could not be published"},
+    {"koven_events_dropped_total", "Events dropped or superseded in the spool"},
+    {"koven_ticks_total", "Simulated ticks run"},
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} histogram_names[METRIC_HISTOGRAMS] = {
+    {"koven_command_decode_seconds", "Decoding of one command frame"},
+    {"koven_command_to_event_seconds", "From a command reaching its oven to the next publish"},
+    {"koven_tick_duration_seconds", "One wakeup of the tick loop, publishes included"},
+    {"koven_tick_jitter_seconds", "Lateness of a wakeup against the schedule"},
+    {"koven_publish_rtt_seconds", "From a publish to its delivery being acknowledged"},
+};
+
+// Slot of the calling thread, taken on its first record
+static MetricsSlot *metrics_slot(void)
+{
+    if (!metrics_self)
+    {
+        size_t taken = atomic_fetch_add(&metrics_slots_taken, 1);
+        metrics_self =
+            &metrics_slots[taken < METRICS_MAX_THREADS ? taken : METRICS_MAX_THREADS - 1];
+    }
+    return metrics_self;
+}
+
+// Slots that may hold records
+static size_t metrics_slots_used(void)
+{
+    size_t taken = atomic_load(&metrics_slots_taken);
+    return taken < METRICS_MAX_THREADS ? taken : METRICS_MAX_THREADS;
+}
+
+void metrics_count(MetricCounter counter, uint64_t n)
+{
+    if ((unsigned)counter >= METRIC_COUNTERS)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&metrics_slot()->counters[counter], n, memory_order_relaxed);
+}
+
+void metrics_observe_n(MetricHistogram histogram, uint64_t value_ns, uint64_t count)
+{
+    if ((unsigned)histogram >= METRIC_HISTOGRAMS || count == 0)
+    {
+        return;
+    }
+
+    MetricsSlotHistogram *h = &metrics_slot()->histograms[histogram];
+    atomic_fetch_add_explicit(&h->count, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value_ns * count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[metrics_bucket(value_ns)], count, memory_order_relaxed);
+}
+
+void metrics_observe(MetricHistogram histogram, uint64_t value_ns)
+{
+    metrics_observe_n(histogram, value_ns, 1);
+}
+
+size_t metrics_bucket(uint64_t value)
+{
+    if (value < METRICS_SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+
+    // The highest bit picks the power of two, the next ones the linear bucket within it
+    unsigned power = 63u - (unsigned)__builtin_clzll(value);
+    unsigned sub = (unsigned)(value >> (power - METRICS_SUB_BUCKET_BITS)) - METRICS_SUB_BUCKETS;
+    return (size_t)(power - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS + sub;
+}
+
+uint64_t metrics_bucket_floor(size_t bucket)
+{
+    if (bucket < METRICS_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    unsigned power = (unsigned)(bucket / METRICS_SUB_BUCKETS) + METRICS_SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % METRICS_SUB_BUCKETS;
+    return (METRICS_SUB_BUCKETS + sub) << (power - METRICS_SUB_BUCKET_BITS);
+}
+
+uint64_t metrics_counter(MetricCounter counter)
+{
+    if ((unsigned)counter >= METRIC_COUNTERS)
+    {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    size_t used = metrics_slots_used();
+    for (size_t s = 0; s < used; s++)
+    {
+        total += atomic_load_explicit(&metrics_slots[s].counters[counter], memory_order_relaxed);
+    }
+    return total;
+}
+
+void metrics_histogram(MetricHistogram histogram, MetricsHistogram *out)
+{
+    if (!out)
+    {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)histogram >= METRIC_HISTOGRAMS)
+    {
+        return;
+    }
+
+    size_t used = metrics_slots_used();
+    for (size_t s = 0; s < used; s++)
+    {
+        MetricsSlotHistogram *h = &metrics_slots[s].histograms[histogram];
+        out->count += atomic_load_explicit(&h->count, memory_order_relaxed);
+        out->sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+        for (size_t b = 0; b < METRICS_BUCKETS; b++)
+        {
+            out->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t metrics_quantile(const MetricsHistogram *histogram, double q)
+{
+    if (!histogram || histogram->count == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the quantile among the recorded values, from 1 to count
+    double rank = q * (double)histogram->count;
+    uint64_t target = rank < 1 ? 1 : (uint64_t)rank;
+    if (target > histogram->count)
+    {
+        target = histogram->count;
+    }
+
+    uint64_t seen = 0;
+    for (size_t b = 0; b < METRICS_BUCKETS; b++)
+    {
+        seen += histogram->buckets[b];
+        if (seen >= target)
+        {
+            return metrics_bucket_floor(b);
+        }
+    }
+    return metrics_bucket_floor(METRICS_BUCKETS - 1);
+}
+
+void metrics_reset(void)
+{
+    size_t used = metrics_slots_used();
+    for (size_t s = 0; s < used; s++)
+    {
+        for (size_t c = 0; c < METRIC_COUNTERS; c++)
+        {
+            atomic_store(&metrics_slots[s].counters[c], 0);
+        }
+        for (size_t h = 0; h < METRIC_HISTOGRAMS; h++)
+        {
+            MetricsSlotHistogram *histogram = &metrics_slots[s].histograms[h];
+            atomic_store(&histogram->count, 0);
+            atomic_store(&histogram->sum, 0);
+            for (size_t b = 0; b < METRICS_BUCKETS; b++)
+            {
+                atomic_store(&histogram->buckets[b], 0);
+            }
+        }
+    }
+}
+
+// Appends to a text that keeps counting its length once the buffer is full, as snprintf does
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} MetricsText;
+
+__attribute__((format(printf, 2, 3))) static void metrics_printf(MetricsText *text,
+                                                                 const char *format,
+                                                                 ...)
+{
+    va_list args;
+    va_start(args, format);
+    size_t room = text->len < text->size ? text->size - text->len : 0;
+    int n = vsnprintf(room ? text->buf + text->len : NULL, room, format, args);
+    va_end(args);
+    if (n > 0)
+    {
+        text->len += (size_t)n;
+    }
+}
+
+static void metrics_format_counter(MetricsText *text,
+                                   const char *name,
+                                   const char *help,
+                                   uint64_t value)
+{
+    metrics_printf(text, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    metrics_printf(text, "%s %llu\n", name, (unsigned long long)value);
+}
+
+// A histogram in seconds, whose le bounds are powers of two of nanoseconds
+static void metrics_format_histogram(MetricsText *text, MetricHistogram histogram)
+{
+    const char *name = histogram_names[histogram].name;
+    MetricsHistogram h;
+    metrics_histogram(histogram, &h);
+
+    metrics_printf(text,
+                   "# HELP %s %s\n# TYPE %s histogram\n",
+                   name,
+                   histogram_names[histogram].help,
+                   name);
+
+    // Cumulative counts of the values below each bound
+    uint64_t below = 0;
+    size_t b = 0;
+    for (unsigned power = METRICS_EXPORT_FIRST_POWER; power <= METRICS_EXPORT_LAST_POWER; power++)
+    {
+        size_t end = metrics_bucket(1ull << power);
+        while (b < end)
+        {
+            below += h.buckets[b++];
+        }
+        metrics_printf(text,
+                       "%s_bucket{le=\"%.9g\"} %llu\n",
+                       name,
+                       (double)(1ull << power) / 1e9,
+                       (unsigned long long)below);
+    }
+    metrics_printf(text, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h.count);
+    metrics_printf(text, "%s_sum %.9f\n", name, (double)h.sum / 1e9);
+    metrics_printf(text, "%s_count %llu\n", name, (unsigned long long)h.count);
+}
+
+size_t metrics_format(char *buf, size_t size)
+{
+    MetricsText text = {buf, buf ? size : 0, 0};
+    if (text.size > 0)
+    {
+        buf[0] = '\0';
+    }
+
+    for (size_t c = 0; c < METRIC_COUNTERS; c++)
+    {
+        metrics_format_counter(
+            &text, counter_names[c].name, counter_names[c].help, metrics_counter((MetricCounter)c));
+    }
+
+    // Errors of the frame codec, CRC failures included, are counted by the codec itself
+    ProtocolErrors errors;
+    protocol_errors(&errors);
+    const char *errors_name = "koven_protocol_errors_total";
+    metrics_printf(&text,
+                   "# HELP %s Frames rejected by the codec\n# TYPE %s counter\n",
+                   errors_name,
+                   errors_name);
+    metrics_printf(&text,
+                   "%s{kind=\"invalid_type\"} %llu\n"
+                   "%s{kind=\"invalid_size\"} %llu\n"
+                   "%s{kind=\"truncated\"} %llu\n"
+                   "%s{kind=\"crc_mismatch\"} %llu\n"
+                   "%s{kind=\"buffer_too_small\"} %llu\n"
+                   "%s{kind=\"too_many_events\"} %llu\n",
+                   errors_name,
+                   (unsigned long long)errors.invalid_type,
+                   errors_name,
+                   (unsigned long long)errors.invalid_size,
+                   errors_name,
+                   (unsigned long long)errors.truncated,
+                   errors_name,
+                   (unsigned long long)errors.crc_mismatch,
+                   errors_name,
+                   (unsigned long long)errors.buffer_too_small,
+                   errors_name,
+                   (unsigned long long)errors.too_many_events);
+
+    metrics_format_counter(&text,
+                           "koven_log_messages_dropped_total",
+                           "Log messages dropped on a full ring",
+                           log_dropped());
+
+    for (size_t h = 0; h < METRIC_HISTOGRAMS; h++)
+    {
+        metrics_format_histogram(&text, (MetricHistogram)h);
+    }
+
+    return text.len;
+}
+
+// Writes all of data, giving up on errors and timeouts
+static void metrics_send(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void metrics_respond(int fd, const char *status, const char *body, size_t len)
+{
+    char header[256];
+    int n = snprintf(header,
+                     sizeof(header),
+                     "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status,
+                     len);
+    metrics_send(fd, header, (size_t)n);
+    metrics_send(fd, body, len);
+}
+
+// Answers the request of one client, which is closed afterwards
+static void metrics_serve(MetricsServer *server, int fd)
+{
+    struct timeval timeout = {METRICS_CLIENT_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters, the rest of the headers are read and ignored
+    char request[METRICS_REQUEST_SIZE + 1];
+    size_t len = 0;
+    while (len < METRICS_REQUEST_SIZE)
+    {
+        ssize_t n = recv(fd, request + len, METRICS_REQUEST_SIZE - len, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        len += (size_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+        {
+            break;
+        }
+    }
+    request[len] = '\0';
+
+    if (strncmp(request, "GET ", 4) != 0)
+    {
+        const char *body = "Method not allowed\n";
+        metrics_respond(fd, "405 Method Not Allowed", body, strlen(body));
+        return;
+    }
+
+    const char *path = request + 4;
+    size_t path_len = strcspn(path, " ?\r\n");
+    if (path_len != strlen("/metrics") || strncmp(path, "/metrics", path_len) != 0)
+    {
+        const char *body = "Not found\n";
+        metrics_respond(fd, "404 Not Found", body, strlen(body));
+        return;
+    }
+
+    size_t size = metrics_format(NULL, 0) + 1;
+    char *body = malloc(size);
+    if (!body)
+    {
+        const char *error = "Out of memory\n";
+        metrics_respond(fd, "500 Internal Server Error", error, strlen(error));
+        return;
+    }
+
+    // Metrics may have moved on since the length was taken
+    size_t body_len = metrics_format(body, size);
+    metrics_respond(fd, "200 OK", body, body_len < size ? body_len : size - 1);
+    free(body);
+    atomic_fetch_add(&server->scrapes, 1);
+}
+
+static void *metrics_server_run(void *arg)
+{
+    MetricsServer *server = arg;
+
+    while (!atomic_load(&server->stopping))
+    {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // The listening socket was shut down by metrics_server_stop
+            break;
+        }
+
+        metrics_serve(server, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+// Splits "host:port" or "port" into an IPv4 socket address
+// Returns 0 on success, -1 on error
+static int metrics_parse_address(const char *address, struct sockaddr_in *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_ANY);
+
+    const char *colon = strrchr(address, ':');
+    const char *port = colon ? colon + 1 : address;
+    if (colon && colon != address)
+    {
+        char host[64];
+        size_t host_len = (size_t)(colon - address);
+        if (host_len >= sizeof(host))
+        {
+            return -1;
+        }
+        memcpy(host, address, host_len);
+        host[host_len] = '\0';
+        if (strcmp(host, "localhost") == 0)
+        {
+            addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        else if (inet_pton(AF_INET, host, &addr->sin_addr) != 1)
+        {
+            return -1;
+        }
+    }
+
+    char *end;
+    unsigned long value = strtoul(port, &end, 10);
+    if (*port == '\0' || *end != '\0' || value > 65535)
+    {
+        return -1;
+    }
+    addr->sin_port = htons((uint16_t)value);
+    return 0;
+}
+
+int metrics_server_start(MetricsServer *server, const char *address)
+{
+    struct sockaddr_in addr;
+    if (!server || !address || metrics_parse_address(address, &addr) != 0)
+    {
+        return -1;
+    }
+
+    memset(server, 0, sizeof(*server));
+    server->fd = -1;
+    atomic_init(&server->stopping, 0);
+    atomic_init(&server->scrapes, 0);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    socklen_t addr_len = sizeof(addr);
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0)
+    {
+        log_error("Failed to listen for metrics on %s", address);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    server->fd = fd;
+    server->port = ntohs(addr.sin_port);
+    if (pthread_create(&server->thread, NULL, metrics_server_run, server) != 0)
+    {
+        log_error("Failed to start the metrics thread");
+        close(fd);
+        server->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void metrics_server_stop(MetricsServer *server)
+{
+    if (!server || server->fd < 0)
+    {
+        return;
+    }
+
+    // Shutting the socket down makes the blocked accept return
+    atomic_store(&server->stopping, 1);
+    shutdown(server->fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    server->fd = -1;
+}
@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Always-on counters and latency histograms of the hot paths
+// Every thread records into a slot of its own, taken on its first record, so the relaxed atomic
+// adds of one thread never contend with those of another; reads sum the slots of all threads.
+// Threads past METRICS_MAX_THREADS share one last slot, which the atomics keep exact
+#define METRICS_MAX_THREADS 128
+
+// Histograms are HDR-style: values below METRICS_SUB_BUCKETS have a bucket each, and every
+// power of two above is split into METRICS_SUB_BUCKETS linear buckets, so a value and the lower
+// bound of its bucket differ by less than 1 / METRICS_SUB_BUCKETS (12.5%)
+#define METRICS_SUB_BUCKET_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_BUCKETS ((64 - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS)
+
+typedef enum {
+    METRIC_COMMANDS_RECEIVED,
+    METRIC_COMMANDS_DROPPED,
+    METRIC_EVENTS_PUBLISHED,
+    METRIC_TRANSITIONS,
+    METRIC_EVENTS_SPOOLED,
+    METRIC_EVENTS_DROPPED,
+    METRIC_TICKS,
+    METRIC_COUNTERS
+} MetricCounter;
+
+// Every histogram records nanoseconds
+typedef enum {
+    // Decoding of one command frame
+    METRIC_COMMAND_DECODE,
+    // From the command reaching its oven to the publish of the event that follows
+    METRIC_COMMAND_TO_EVENT,
+    // Ticks, event selection and publishes of one wakeup of the tick loop
+    METRIC_TICK_DURATION,
+    // Lateness of a wakeup against the schedule
+    METRIC_TICK_JITTER,
+    // From a publish to the broker acknowledging its delivery
+    METRIC_PUBLISH_RTT,
+    METRIC_HISTOGRAMS
+} MetricHistogram;
+
+// Sum of the slots of one histogram
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t buckets[METRICS_BUCKETS];
+} MetricsHistogram;
+
+// Adds n to a counter
+void metrics_count(MetricCounter counter, uint64_t n);
+
+// Records value_ns once, or count times
+void metrics_observe(MetricHistogram histogram, uint64_t value_ns);
+void metrics_observe_n(MetricHistogram histogram, uint64_t value_ns, uint64_t count);
+
+// Bucket of a value, and the lowest value of a bucket
+size_t metrics_bucket(uint64_t value);
+uint64_t metrics_bucket_floor(size_t bucket);
+
+// Sum of a counter over all threads
+uint64_t metrics_counter(MetricCounter counter);
+
+// Sums a histogram over all threads into out
+void metrics_histogram(MetricHistogram histogram, MetricsHistogram *out);
+
+// Lowest value of the bucket holding the q-quantile (0 <= q <= 1) of a histogram
+// Returns 0 for an empty histogram
+uint64_t metrics_quantile(const MetricsHistogram *histogram, double q);
+
+// Forgets everything recorded so far; only meant for tests, while nothing records
+void metrics_reset(void);
+
+// Formats every metric in the Prometheus text exposition format, as snprintf does
+// Returns the length of the whole text, which was truncated if it is not below size
+size_t metrics_format(char *buf, size_t size);
+
+// Embedded HTTP endpoint serving GET /metrics from its own thread
+typedef struct {
+    int fd;
+    uint16_t port;
+    pthread_t thread;
+    atomic_int stopping;
+
+    // Counters
+    atomic_uint_fast64_t scrapes;
+} MetricsServer;
+
+// Listens on address, "host:port" or a port alone for every interface; port 0 picks a free one,
+// which is stored in server->port
+// Returns 0 on success, -1 on error
+int metrics_server_start(MetricsServer *server, const char *address);
+
+// Stops serving and closes the socket
+void metrics_server_stop(MetricsServer *server);
+
+#endif /* METRICS_H */
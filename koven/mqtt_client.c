@@ -1,10 +1,18 @@
 #include "mqtt_client.h"
+#include "backoff.h"
+#include "command_queue.h"
+#include "log.h"
+#include "metrics.h"
+#include "pending_command.h"
 #include "protocol.h"
-#include <MQTTClient.h>
+#include "shard_pool.h"
+#include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 static volatile int running = 1;
@@ -16,141 +24,1226 @@ void handle_signal(int sig)
     running = 0;
 }
 
-// Callback for incoming MQTT messages on the subscribed topics
-int message_arrived(void *context, char *topicName, int topicLen, MQTTClient_message *message)
+static const ReconnectPolicy default_reconnect = {
+    MQTT_RECONNECT_MIN_NS,
+    MQTT_RECONNECT_MAX_NS,
+    SPOOL_LATEST_PER_OVEN,
+    MQTT_SPOOL_CAPACITY,
+};
+
+// One connection of the client, restored by the reconnect thread after a loss
+// The lost handler clears connected on the thread of the transport, and the reconnect thread
+// sets it again once the transport is back; meanwhile the tick loop publishes nothing through it
+typedef struct {
+    Transport transport;
+    atomic_int connected;
+    atomic_uint losses;
+    char name[32];
+
+    // Owned by the reconnect thread
+    Backoff backoff;
+    uint64_t retry_ns;
+    unsigned attempts;
+} Link;
+
+static void link_init(Link *link, const char *name, const ReconnectPolicy *reconnect, size_t k)
 {
-    (void)topicLen;
-    Koven *koven = (Koven *)context;
+    snprintf(link->name, sizeof(link->name), "%s", name);
+    atomic_init(&link->connected, 1);
+    atomic_init(&link->losses, 0);
+    link->retry_ns = 0;
+    link->attempts = 0;
 
-    if (!message->payload || message->payloadlen == 0)
+    // Emulators started together, and the links of each one, draw different delays
+    uint64_t seed = log_now_ns() ^ ((uint64_t)getpid() << 32) ^ (k + 1) * 0x9E3779B97F4A7C15ull;
+    backoff_init(&link->backoff, reconnect->backoff_min_ns, reconnect->backoff_max_ns, seed);
+}
+
+// Called by the lost handlers: the link is left to the reconnect thread
+static void link_lost(Link *link, const char *cause)
+{
+    atomic_fetch_add(&link->losses, 1);
+    atomic_store(&link->connected, 0);
+    log_warn("Connection %s lost: %s", link->name, cause);
+}
+
+// First link that is up, starting from link k
+static Link *link_up(Link **links, size_t count, size_t k)
+{
+    for (size_t i = 0; i < count; i++)
     {
-        MQTTClient_freeMessage(&message);
-        MQTTClient_free(topicName);
-        return 1;
+        Link *link = links[(k + i) % count];
+        if (atomic_load(&link->connected))
+        {
+            return link;
+        }
     }
+    return NULL;
+}
 
-    printf("Received binary command (%d bytes): ", message->payloadlen);
-    print_frame_hex((const uint8_t *)message->payload, message->payloadlen);
+// Thread restoring lost links, so that neither the tick loop nor the transports wait for it
+typedef struct {
+    Link **links;
+    size_t count;
+    pthread_t thread;
+    atomic_int stopping;
+    atomic_uint_fast64_t reconnects;
+} Reconnector;
 
-    CommandPayload cmd;
-    if (unmarshall_command_frame((const uint8_t *)message->payload, message->payloadlen, &cmd) == 0)
+// Tries to restore one lost link whose delay elapsed, scheduling the next attempt on failure
+static void reconnector_attempt(Reconnector *reconnector, Link *link)
+{
+    // The first delay runs from the loss, so that links lost together do not all come back at
+    // the same instant
+    if (link->retry_ns == 0)
     {
-        printf("Command parsed: action=%s, temperature=%d°C, duration=%ds\n",
-               action_to_string((Action)cmd.action),
-               cmd.temperature,
-               cmd.duration);
+        link->retry_ns = log_now_ns() + backoff_next(&link->backoff);
+        return;
+    }
+    if (log_now_ns() < link->retry_ns)
+    {
+        return;
+    }
 
-        koven_execute(koven, &cmd);
-        printf("Command executed successfully\n");
+    unsigned losses = atomic_load(&link->losses);
+    link->attempts++;
+    if (transport_reconnect(&link->transport) != 0)
+    {
+        uint64_t delay = backoff_next(&link->backoff);
+        link->retry_ns = log_now_ns() + delay;
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_WARN,
+                    "Failed to reconnect %s (attempt %u), retrying in %.3f s",
+                    link->name,
+                    link->attempts,
+                    (double)delay / 1e9);
+        return;
     }
-    else
+
+    log_info("Connection %s restored after %u attempts", link->name, link->attempts);
+    backoff_reset(&link->backoff);
+    link->retry_ns = 0;
+    link->attempts = 0;
+    atomic_fetch_add(&reconnector->reconnects, 1);
+
+    // A loss racing with the reconnect leaves the link down, for the next pass to restore
+    atomic_store(&link->connected, 1);
+    if (atomic_load(&link->losses) != losses)
     {
-        printf("Failed to parse command frame\n");
+        atomic_store(&link->connected, 0);
     }
+}
 
-    MQTTClient_freeMessage(&message);
-    MQTTClient_free(topicName);
+static void *reconnector_run(void *arg)
+{
+    Reconnector *reconnector = arg;
+    struct timespec poll = {0, MQTT_RECONNECT_POLL_NS};
+
+    while (!atomic_load(&reconnector->stopping))
+    {
+        for (size_t k = 0; k < reconnector->count; k++)
+        {
+            if (!atomic_load(&reconnector->links[k]->connected))
+            {
+                reconnector_attempt(reconnector, reconnector->links[k]);
+            }
+        }
+        nanosleep(&poll, NULL);
+    }
 
-    return 1;
+    return NULL;
 }
 
-// Callback for connection loss with the MQTT broker
-void connection_lost(void *context, char *cause)
+// Returns 0 on success, -1 on error
+static int reconnector_start(Reconnector *reconnector, Link **links, size_t count)
 {
-    (void)context;
-    printf("Connection lost: %s\n", cause ? cause : "unknown");
-    running = 0;
+    reconnector->links = links;
+    reconnector->count = count;
+    atomic_init(&reconnector->stopping, 0);
+    atomic_init(&reconnector->reconnects, 0);
+    return pthread_create(&reconnector->thread, NULL, reconnector_run, reconnector) == 0 ? 0
+                                                                                        : -1;
+}
+
+// Waits for an attempt in progress, after which no link changes anymore
+static void reconnector_stop(Reconnector *reconnector)
+{
+    atomic_store(&reconnector->stopping, 1);
+    pthread_join(reconnector->thread, NULL);
 }
 
-// Main function to run the MQTT client loop
-int mqtt_client_run(Koven *koven)
+// Spool of the events that could not be published, with the buffers to flush it
+typedef struct {
+    EventSpool spool;
+    size_t batch_size;
+    size_t next_link;
+    uint32_t *ids;
+    EventPayload *events;
+    uint8_t *frame;
+
+    // Counters of the spool already added to the metrics
+    uint64_t counted_pushed;
+    uint64_t counted_flushed;
+    uint64_t counted_dropped;
+} Outbox;
+
+// Returns 0 on success, -1 on error
+static int outbox_init(Outbox *outbox,
+                       const ReconnectPolicy *reconnect,
+                       uint32_t first_id,
+                       size_t ovens,
+                       size_t batch_size)
 {
-    MQTTClient client;
-    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-    int rc;
+    memset(outbox, 0, sizeof(*outbox));
+    outbox->batch_size = batch_size;
+    outbox->ids = malloc(batch_size * sizeof(uint32_t));
+    outbox->events = malloc(batch_size * sizeof(EventPayload));
+    outbox->frame = malloc(EVENT_BATCH_FRAME_SIZE(batch_size));
 
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+    if (!outbox->ids || !outbox->events || !outbox->frame ||
+        spool_init(&outbox->spool,
+                   reconnect->spool_policy,
+                   reconnect->spool_capacity,
+                   first_id,
+                   ovens) != 0)
+    {
+        free(outbox->ids);
+        free(outbox->events);
+        free(outbox->frame);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Adds what the spool went through since the previous call to the metrics
+static void outbox_count(Outbox *outbox)
+{
+    const EventSpool *spool = &outbox->spool;
+    metrics_count(METRIC_EVENTS_SPOOLED, spool->pushed - outbox->counted_pushed);
+    metrics_count(METRIC_EVENTS_PUBLISHED, spool->flushed - outbox->counted_flushed);
+    metrics_count(METRIC_EVENTS_DROPPED, spool->dropped - outbox->counted_dropped);
+    outbox->counted_pushed = spool->pushed;
+    outbox->counted_flushed = spool->flushed;
+    outbox->counted_dropped = spool->dropped;
+}
+
+static void outbox_free(Outbox *outbox)
+{
+    spool_free(&outbox->spool);
+    free(outbox->ids);
+    free(outbox->events);
+    free(outbox->frame);
+}
+
+// Publishes the oldest spooled events as event batch frames on topic, one frame per link that
+// is up in turn, so that the backlog drains through every connection at once. A link whose
+// publish fails is skipped for the rest of the wakeup and whatever is left stays spooled
+// Returns the number of events flushed
+static size_t outbox_flush(Outbox *outbox, Link **links, size_t count, const char *topic)
+{
+    size_t flushed = 0;
+    uint64_t skipped = 0;
+
+    for (size_t b = 0; b < MQTT_SPOOL_FLUSH_BATCHES && spool_count(&outbox->spool) > 0; b++)
+    {
+        // Next link that is up and did not fail yet
+        size_t k = 0;
+        Link *link = NULL;
+        for (size_t i = 0; i < count && !link; i++)
+        {
+            k = (outbox->next_link + i) % count;
+            if (!((skipped >> k) & 1) && atomic_load(&links[k]->connected))
+            {
+                link = links[k];
+            }
+        }
+        if (!link)
+        {
+            break;
+        }
+        outbox->next_link = (k + 1) % count;
+
+        size_t n = spool_peek(&outbox->spool, outbox->ids, outbox->events, outbox->batch_size);
+        int len = marshall_event_batch_frame(outbox->ids,
+                                             outbox->events,
+                                             n,
+                                             outbox->frame,
+                                             EVENT_BATCH_FRAME_SIZE(outbox->batch_size));
+        if (len <= 0)
+        {
+            log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to build event batch frame");
+            break;
+        }
+
+        // Spooled events may hold transitions, which must not be lost
+        if (transport_publish(
+                &link->transport, topic, outbox->frame, (size_t)len, TRANSPORT_TRANSITION) != 0)
+        {
+            skipped |= 1ull << k;
+            continue;
+        }
+
+        spool_pop(&outbox->spool, n);
+        flushed += n;
+    }
+
+    return flushed;
+}
+
+// Reports what the spool went through, if it was ever used
+static void log_spool_counters(const Outbox *outbox, const Reconnector *reconnector)
+{
+    const EventSpool *spool = &outbox->spool;
+    uint64_t reconnects = atomic_load(&reconnector->reconnects);
+
+    if (reconnects > 0)
+    {
+        log_info("Connections restored: %llu", (unsigned long long)reconnects);
+    }
+    if (spool->pushed > 0)
+    {
+        log_info("Events spooled (%s): %llu spooled, %llu flushed, %llu %s, %zu left",
+                 spool_policy_to_string(spool->policy),
+                 (unsigned long long)spool->pushed,
+                 (unsigned long long)spool->flushed,
+                 (unsigned long long)spool->dropped,
+                 spool->policy == SPOOL_LATEST_PER_OVEN ? "superseded" : "dropped",
+                 spool_count(spool));
+    }
+}
+
+// State shared with the callbacks of the single oven client
+// The callback thread only queues commands: the oven itself is only touched by the tick loop
+typedef struct {
+    Koven *koven;
+    CommandQueue commands;
+    Link link;
+} OvenContext;
+
+// Callback for incoming messages on the subscribed topics
+static void message_arrived(void *context, const char *topic, const uint8_t *payload, size_t len)
+{
+    (void)topic;
+    OvenContext *ctx = context;
+
+    log_debug_hex("Received binary command", payload, len);
+
+    // A message may carry any number of concatenated command frames
+    FrameDecoder decoder;
+    const CommandPayload *cmd;
+    frame_decoder_init(&decoder);
+    frame_decoder_feed(&decoder, payload, len);
 
-    char address[256];
-    snprintf(address, sizeof(address), "tcp://%s:%d", MQTT_BROKER, MQTT_PORT);
+    uint64_t start_ns = log_now_ns();
+    while (frame_decoder_next(&decoder, &cmd))
+    {
+        metrics_observe(METRIC_COMMAND_DECODE, log_now_ns() - start_ns);
+        metrics_count(METRIC_COMMANDS_RECEIVED, 1);
+        if (command_queue_push(&ctx->commands, 0, cmd) != 0)
+        {
+            metrics_count(METRIC_COMMANDS_DROPPED, 1);
+            log_limited(MQTT_LOG_INTERVAL_NS,
+                        LOG_LEVEL_WARN,
+                        "Dropping command: %zu commands already queued",
+                        ctx->commands.capacity);
+        }
+        start_ns = log_now_ns();
+    }
+
+    if (decoder.bytes_skipped > 0 || decoder.carry_len > 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_WARN,
+                    "Failed to parse command frame (%zu bytes discarded)",
+                    (size_t)decoder.bytes_skipped + decoder.carry_len);
+    }
+}
+
+// Reports the errors counted by the frame codec, if any
+static void log_protocol_errors(void)
+{
+    ProtocolErrors errors;
+    protocol_errors(&errors);
+
+    uint64_t total = errors.invalid_type + errors.invalid_size + errors.truncated +
+                     errors.crc_mismatch + errors.buffer_too_small + errors.too_many_events;
+    if (total > 0)
+    {
+        log_warn("Protocol errors: %llu invalid type, %llu invalid size, %llu truncated, %llu CRC "
+                 "mismatch, %llu buffer too small, %llu too many events",
+                 (unsigned long long)errors.invalid_type,
+                 (unsigned long long)errors.invalid_size,
+                 (unsigned long long)errors.truncated,
+                 (unsigned long long)errors.crc_mismatch,
+                 (unsigned long long)errors.buffer_too_small,
+                 (unsigned long long)errors.too_many_events);
+    }
+}
+
+// Reports the commands that never reached an oven
+static void log_command_counters(uint64_t dropped, uint64_t overflow, uint64_t coalesced)
+{
+    if (dropped > 0 || overflow > 0)
+    {
+        log_warn("Commands lost: %llu dropped on full queues, %llu over the backlog",
+                 (unsigned long long)dropped,
+                 (unsigned long long)overflow);
+    }
+    if (coalesced > 0)
+    {
+        log_info("Commands coalesced: %llu superseded before their tick",
+                 (unsigned long long)coalesced);
+    }
+}
+
+// Callback for connection loss of the single oven client
+static void connection_lost(void *context, const char *cause)
+{
+    link_lost(&((OvenContext *)context)->link, cause);
+}
+
+// Publishes the event of the single oven, or spools it when it cannot be published right away
+// While older events wait in the spool, new ones queue up behind them so that they stay in order
+// transition tells whether the event is a state transition, or telemetry (see TransportQosMode)
+static void publish_oven_event(OvenContext *ctx,
+                               Outbox *outbox,
+                               const EventPolicy *policy,
+                               const EventPayload *event,
+                               uint8_t fields,
+                               int transition)
+{
+    if (spool_count(&outbox->spool) > 0 || !atomic_load(&ctx->link.connected))
+    {
+        spool_push(&outbox->spool, 0, event);
+        return;
+    }
+
+    uint8_t frame_buffer[64];
+    int frame_size = policy->mode == EVENT_MODE_DELTA
+                         ? marshall_event_delta_frame(
+                               event, fields, frame_buffer, sizeof(frame_buffer))
+                         : marshall_event_frame(event, frame_buffer, sizeof(frame_buffer));
+
+    if (frame_size <= 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to build event frame");
+        return;
+    }
+
+    log_debug("Publishing event: state=%s, temp=%d°C, remaining=%ds, "
+              "programmed_temp=%d°C, programmed_duration=%ds",
+              state_to_string(event->state),
+              event->current_temperature,
+              event->remaining_time,
+              event->programmed_temperature,
+              event->programmed_duration);
+    log_debug_hex("Event frame", frame_buffer, (size_t)frame_size);
+
+    // The delivery is not waited for: the event is spooled when the transport cannot take it
+    // right away
+    if (transport_publish(&ctx->link.transport,
+                          MQTT_TOPIC_EVENTS,
+                          frame_buffer,
+                          (size_t)frame_size,
+                          transition ? TRANSPORT_STATE : TRANSPORT_TELEMETRY) != 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_WARN,
+                    "Spooling event: %zu publishes still in flight",
+                    transport_in_flight(&ctx->link.transport));
+        spool_push(&outbox->spool, 0, event);
+        return;
+    }
+    metrics_count(METRIC_EVENTS_PUBLISHED, 1);
+}
+
+// Main function to run the single oven client loop
+int mqtt_client_run(Koven *koven,
+                    const TransportConfig *transport,
+                    const ReconnectPolicy *reconnect,
+                    Recorder *recorder,
+                    const EventPolicy *policy,
+                    const TickSchedule *schedule)
+{
+    EventTracker tracker;
+    TickScheduler scheduler;
+
+    if (!reconnect)
+    {
+        reconnect = &default_reconnect;
+    }
+    if (!transport || scheduler_init(&scheduler, schedule) != 0 ||
+        event_tracker_init(&tracker, policy, 1) != 0)
+    {
+        return -1;
+    }
 
-    MQTTClient_create(&client, address, MQTT_CLIENT_ID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
-    MQTTClient_setCallbacks(client, koven, connection_lost, message_arrived, NULL);
+    OvenContext ctx;
+    Outbox outbox;
+    ctx.koven = koven;
+    if (command_queue_init(&ctx.commands, MQTT_COMMAND_QUEUE_CAPACITY) != 0)
+    {
+        event_tracker_free(&tracker);
+        return -1;
+    }
+    if (outbox_init(&outbox, reconnect, 0, 1, EVENT_BATCH_MAX_EVENTS) != 0)
+    {
+        log_error("Failed to allocate the event spool");
+        command_queue_free(&ctx.commands);
+        event_tracker_free(&tracker);
+        return -1;
+    }
+    const char *client_id = transport->client_id ? transport->client_id : MQTT_CLIENT_ID;
+    link_init(&ctx.link, client_id, reconnect, 0);
 
-    conn_opts.keepAliveInterval = 20;
-    conn_opts.cleansession = 1;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
 
-    printf("Connecting to MQTT broker at %s...\n", address);
-    if ((rc = MQTTClient_connect(client, &conn_opts)) != MQTTCLIENT_SUCCESS)
+    log_info("Connecting over %s to %s...",
+             transport_kind_to_string(transport->kind),
+             transport_address(transport));
+    if (transport_open(&ctx.link.transport,
+                       transport,
+                       client_id,
+                       MQTT_TOPIC_COMMANDS,
+                       message_arrived,
+                       connection_lost,
+                       &ctx) != 0)
     {
-        printf("Failed to connect to MQTT broker, return code %d\n", rc);
-        MQTTClient_destroy(&client);
+        outbox_free(&outbox);
+        command_queue_free(&ctx.commands);
+        event_tracker_free(&tracker);
         return -1;
     }
 
-    printf("Connected to MQTT broker\n");
-    printf("Subscribing to topic: %s\n", MQTT_TOPIC_COMMANDS);
-    if ((rc = MQTTClient_subscribe(client, MQTT_TOPIC_COMMANDS, MQTT_QOS)) != MQTTCLIENT_SUCCESS)
+    Link *links[1] = {&ctx.link};
+    Reconnector reconnector;
+    if (reconnector_start(&reconnector, links, 1) != 0)
     {
-        printf("Failed to subscribe, return code %d\n", rc);
-        MQTTClient_disconnect(client, MQTT_TIMEOUT);
-        MQTTClient_destroy(&client);
+        log_error("Failed to start the reconnect thread");
+        transport_close(&ctx.link.transport);
+        outbox_free(&outbox);
+        command_queue_free(&ctx.commands);
+        event_tracker_free(&tracker);
         return -1;
     }
 
-    printf("Subscribed to %s\n", MQTT_TOPIC_COMMANDS);
-    printf("Koven is running...\n");
+    log_info("Subscribed to %s", MQTT_TOPIC_COMMANDS);
+    log_info("Koven is running...");
+
+    PendingCommand pending = {0};
+    uint64_t coalesced = 0;
+    uint64_t tick = 0;
 
+    // The schedule starts once connected
+    scheduler_init(&scheduler, schedule);
     while (running)
     {
-        sleep(1);
+        // Every wakeup publishes the event of the last of its ticks
+        unsigned ticks = scheduler_wait(&scheduler);
+        if (ticks == 0)
+        {
+            continue;
+        }
+        uint64_t wakeup_ns = log_now_ns();
+        metrics_observe(METRIC_TICK_JITTER, scheduler.lateness_ns);
 
         EventPayload event;
-        koven_tick(koven, &event);
+        unsigned executed = 0;
+        for (unsigned t = 0; t < ticks; t++)
+        {
+            // Commands get in between the ticks of a batch, as they arrived, and those that are
+            // superseded before the tick never reach the oven
+            QueuedCommand queued;
+            while (command_queue_pop(&ctx.commands, &queued))
+            {
+                if (recorder && recorder_command(recorder, tick + t + 1, 0, &queued.cmd) != 0)
+                {
+                    log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to record command");
+                }
+                coalesced += (uint64_t)pending_command_add(&pending, &queued.cmd);
+                log_debug("Command received: action=%s, temperature=%d°C, duration=%ds",
+                          action_to_string((Action)queued.cmd.action),
+                          queued.cmd.temperature,
+                          queued.cmd.duration);
+            }
+            if (pending.flags & PENDING_STOP)
+            {
+                log_info("Command executed: action=%s", action_to_string(ACTION_STOP));
+            }
+            if (pending.flags & PENDING_START)
+            {
+                log_info("Command executed: action=%s, temperature=%d°C, duration=%ds",
+                         action_to_string((Action)pending.start.action),
+                         pending.start.temperature,
+                         pending.start.duration);
+            }
+            executed += (unsigned)pending_command_apply(&pending, koven);
+
+            // Without any command left to get in between, the rest of the batch is evaluated in
+            // closed form up to its last tick, which builds the event
+            if (t + 1 < ticks && command_queue_empty(&ctx.commands))
+            {
+                koven_state_at(koven, ticks - t - 1, koven);
+                t = ticks - 1;
+            }
+            koven_tick(koven, &event);
+        }
+        tick += ticks;
+
+        uint8_t fields = event_tracker_update(&tracker, 0, &event);
+        if (fields != 0)
+        {
+            if (recorder && recorder_event(recorder, tick, 0, &event) != 0)
+            {
+                log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to record event");
+            }
+            int transition = event_tracker_transition(&tracker, 0);
+            metrics_count(METRIC_TRANSITIONS, (uint64_t)transition);
+            publish_oven_event(&ctx, &outbox, policy, &event, fields, transition);
+        }
+        outbox_flush(&outbox, links, 1, MQTT_TOPIC_EVENTS);
+
+        // The commands of this wakeup reached the oven right after it started
+        uint64_t done_ns = log_now_ns();
+        metrics_observe_n(METRIC_COMMAND_TO_EVENT, done_ns - wakeup_ns, fields ? executed : 0);
+        metrics_observe(METRIC_TICK_DURATION, done_ns - wakeup_ns);
+        metrics_count(METRIC_TICKS, ticks);
+        outbox_count(&outbox);
+    }
+
+    log_info("Shutting down...");
+    reconnector_stop(&reconnector);
+    log_protocol_errors();
+    log_command_counters(atomic_load(&ctx.commands.dropped), 0, coalesced);
+    log_spool_counters(&outbox, &reconnector);
+    transport_close(&ctx.link.transport);
+    outbox_free(&outbox);
+    command_queue_free(&ctx.commands);
+    event_tracker_free(&tracker);
+
+    return 0;
+}
+
+// Shared state of the fleet mode
+// Commands arrive on the callback thread of every connection while the shards tick the fleet:
+// callbacks never touch the table, they route each command to the queue of its shard
+typedef struct {
+    KovenFleet *fleet;
+    ShardPool pool;
+} FleetContext;
+
+// Callback context of one fleet connection
+// The connection is the producer of its own command queue into every shard
+typedef struct {
+    FleetContext *fleet;
+    size_t index;
+    Link link;
+} FleetConnection;
+
+// Parses the oven id out of a cmds/koven/<id> topic
+// Returns 0 on success, -1 on error
+static int fleet_topic_id(const char *topic, uint32_t *id)
+{
+    size_t prefix_len = strlen(MQTT_FLEET_TOPIC_COMMANDS_PREFIX);
+    size_t len = strlen(topic);
 
-        uint8_t frame_buffer[64];
-        int frame_size = marshall_event_frame(&event, frame_buffer, sizeof(frame_buffer));
+    if (len <= prefix_len || len - prefix_len > 10 ||
+        strncmp(topic, MQTT_FLEET_TOPIC_COMMANDS_PREFIX, prefix_len) != 0)
+    {
+        return -1;
+    }
+
+    uint64_t value = 0;
+    for (size_t i = prefix_len; i < len; i++)
+    {
+        if (topic[i] < '0' || topic[i] > '9')
+        {
+            return -1;
+        }
+        value = value * 10 + (uint64_t)(topic[i] - '0');
+    }
+
+    if (value > UINT32_MAX)
+    {
+        return -1;
+    }
+
+    *id = (uint32_t)value;
+    return 0;
+}
+
+// Hands the commands of a command batch frame to the shards owning their ovens
+// The entries are decoded straight from the message, one at a time, without copying them out
+static void fleet_command_batch(FleetConnection *connection, const uint8_t *payload, size_t len)
+{
+    FleetContext *ctx = connection->fleet;
+    const uint8_t *entries;
+
+    uint64_t start_ns = log_now_ns();
+    int count = command_batch_frame_entries(payload, len, &entries);
+    if (count < 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_WARN, "Failed to parse command batch frame");
+        return;
+    }
+
+    size_t unknown = 0;
+    size_t dropped = 0;
+    for (size_t i = 0; i < (size_t)count; i++)
+    {
+        uint32_t id;
+        size_t index;
+        CommandPayload cmd;
+        command_batch_entry(entries, i, &id, &cmd);
+        metrics_observe(METRIC_COMMAND_DECODE, log_now_ns() - start_ns);
+        metrics_count(METRIC_COMMANDS_RECEIVED, 1);
+
+        if (fleet_index(ctx->fleet, id, &index) != 0)
+        {
+            unknown++;
+        }
+        else if (shard_pool_submit(&ctx->pool, connection->index, index, &cmd) != 0)
+        {
+            metrics_count(METRIC_COMMANDS_DROPPED, 1);
+            dropped++;
+        }
+        start_ns = log_now_ns();
+    }
+
+    // Replicas with other shard ids receive the same commands: those of their ovens are expected
+    if (unknown > 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_DEBUG,
+                    "Ignoring %zu commands of a batch for unknown ovens",
+                    unknown);
+    }
+    if (dropped > 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_WARN,
+                    "Dropping %zu commands of a batch: shard queues full",
+                    dropped);
+    }
+}
+
+// Callback for incoming messages on the fleet command subscription
+static void fleet_message_arrived(void *context,
+                                  const char *topic,
+                                  const uint8_t *payload,
+                                  size_t len)
+{
+    FleetConnection *connection = context;
+    FleetContext *ctx = connection->fleet;
+    uint32_t id;
+    size_t index;
+
+    if (strcmp(topic, MQTT_FLEET_TOPIC_COMMAND_BATCHES) == 0)
+    {
+        fleet_command_batch(connection, payload, len);
+    }
+    else if (fleet_topic_id(topic, &id) != 0)
+    {
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_WARN,
+                    "Ignoring message on unexpected topic: %s",
+                    topic);
+    }
+    else if (fleet_index(ctx->fleet, id, &index) != 0)
+    {
+        // Commands for the ovens of other replicas, as for batches
+        log_limited(
+            MQTT_LOG_INTERVAL_NS, LOG_LEVEL_DEBUG, "Ignoring command for unknown oven %u", id);
+    }
+    else
+    {
+        // A message may carry any number of concatenated command frames for its oven, which are
+        // handed to the shard owning the oven
+        FrameDecoder decoder;
+        const CommandPayload *cmd;
+        frame_decoder_init(&decoder);
+        frame_decoder_feed(&decoder, payload, len);
+
+        uint64_t start_ns = log_now_ns();
+        while (frame_decoder_next(&decoder, &cmd))
+        {
+            metrics_observe(METRIC_COMMAND_DECODE, log_now_ns() - start_ns);
+            metrics_count(METRIC_COMMANDS_RECEIVED, 1);
+            if (shard_pool_submit(&ctx->pool, connection->index, index, cmd) != 0)
+            {
+                metrics_count(METRIC_COMMANDS_DROPPED, 1);
+                log_limited(MQTT_LOG_INTERVAL_NS,
+                            LOG_LEVEL_WARN,
+                            "Dropping command for oven %u: shard queue full",
+                            id);
+            }
+            start_ns = log_now_ns();
+        }
+
+        if (decoder.frames == 0 || decoder.bytes_skipped > 0 || decoder.carry_len > 0)
+        {
+            log_limited(MQTT_LOG_INTERVAL_NS,
+                        LOG_LEVEL_WARN,
+                        "Failed to parse command frame for oven %u",
+                        id);
+        }
+    }
+}
+
+// Callback for connection loss of a fleet connection
+static void fleet_connection_lost(void *context, const char *cause)
+{
+    link_lost(&((FleetConnection *)context)->link, cause);
+}
+
+// Spools the events of ovens that could not be published
+static void spool_events(Outbox *outbox, const uint32_t *ids, const EventPayload *events, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        spool_push(&outbox->spool, ids[i], &events[i]);
+    }
+}
+
+// Moves the events of the ovens whose state changed in front of the others, in no particular
+// order, for transitions and telemetry to go in separate publishes
+// Returns the number of transitions
+static size_t partition_transitions(const EventTracker *tracker,
+                                    uint32_t first_id,
+                                    uint32_t *ids,
+                                    EventPayload *events,
+                                    uint8_t *fields,
+                                    size_t n)
+{
+    size_t front = 0;
+    size_t back = n;
+    while (front < back)
+    {
+        if (event_tracker_transition(tracker, ids[front] - first_id))
+        {
+            front++;
+            continue;
+        }
+
+        back--;
+        uint32_t id = ids[front];
+        EventPayload event = events[front];
+        uint8_t field = fields[front];
+        ids[front] = ids[back];
+        events[front] = events[back];
+        fields[front] = fields[back];
+        ids[back] = id;
+        events[back] = event;
+        fields[back] = field;
+    }
+    return front;
+}
+
+// Main function to run the fleet over a pool of connections
+int mqtt_client_run_fleet(KovenFleet *fleet,
+                          const TransportConfig *transport,
+                          const ReconnectPolicy *reconnect,
+                          size_t connections,
+                          size_t batch_size,
+                          size_t shards,
+                          size_t backlog,
+                          FleetSnapshot *snapshot,
+                          Recorder *recorder,
+                          const EventPolicy *policy,
+                          const TickSchedule *schedule)
+{
+    TickScheduler scheduler;
+    if (!reconnect)
+    {
+        reconnect = &default_reconnect;
+    }
+    if (!fleet || !transport || fleet->count == 0 || connections == 0 || !policy ||
+        scheduler_init(&scheduler, schedule) != 0)
+    {
+        return -1;
+    }
+
+    if (connections > MQTT_FLEET_MAX_CONNECTIONS)
+    {
+        connections = MQTT_FLEET_MAX_CONNECTIONS;
+    }
+    if (connections > fleet->count)
+    {
+        connections = fleet->count;
+    }
+
+    if (batch_size > EVENT_BATCH_MAX_EVENTS)
+    {
+        batch_size = EVENT_BATCH_MAX_EVENTS;
+    }
+
+    // One tick of the fleet is marshalled into a single wire buffer, either as one frame per
+    // oven or as batch frames of up to batch_size ovens each, plus one for a tick split into
+    // transitions and telemetry. Slots are sized for the largest frames of the event mode, delta
+    // frames being at most one byte larger than full ones
+    size_t batches = batch_size ? (fleet->count + batch_size - 1) / batch_size + 1 : 0;
+    size_t batch_frame_size = EVENT_DELTA_BATCH_FRAME_MAX_SIZE(batch_size);
+    size_t frame_size = policy->mode == EVENT_MODE_DELTA ? EVENT_DELTA_FRAME_MAX_SIZE
+                                                         : EVENT_FRAME_SIZE;
+    size_t wire_size = batch_size ? batches * batch_frame_size : fleet->count * frame_size;
+    EventPayload *events = malloc(fleet->count * sizeof(EventPayload));
+    uint32_t *ids = malloc(fleet->count * sizeof(uint32_t));
+    uint32_t *selected_ids = malloc(fleet->count * sizeof(uint32_t));
+    uint8_t *fields = malloc(fleet->count);
+    uint8_t *wire = malloc(wire_size);
+    EventTracker tracker;
+    Outbox outbox;
+    if (!events || !ids || !selected_ids || !fields || !wire ||
+        outbox_init(&outbox,
+                    reconnect,
+                    fleet->first_id,
+                    fleet->count,
+                    batch_size ? batch_size : EVENT_BATCH_MAX_EVENTS) != 0)
+    {
+        log_error("Failed to allocate event buffers for %zu ovens", fleet->count);
+        free(events);
+        free(ids);
+        free(selected_ids);
+        free(fields);
+        free(wire);
+        return -1;
+    }
+    if (event_tracker_init(&tracker, policy, fleet->count) != 0)
+    {
+        outbox_free(&outbox);
+        free(events);
+        free(ids);
+        free(selected_ids);
+        free(fields);
+        free(wire);
+        return -1;
+    }
 
-        if (frame_size > 0)
+    for (size_t i = 0; i < fleet->count; i++)
+    {
+        ids[i] = fleet->first_id + (uint32_t)i;
+    }
+
+    // Every connection is a producer of commands for the shards
+    FleetContext ctx;
+    ctx.fleet = fleet;
+    if (shard_pool_init(&ctx.pool,
+                        fleet,
+                        shards ? shards : shard_pool_default_count(fleet->count),
+                        connections,
+                        backlog,
+                        &tracker) != 0)
+    {
+        log_error("Failed to start the shards of the fleet");
+        event_tracker_free(&tracker);
+        outbox_free(&outbox);
+        free(events);
+        free(ids);
+        free(selected_ids);
+        free(fields);
+        free(wire);
+        return -1;
+    }
+
+    shard_pool_capture(&ctx.pool, recorder != NULL);
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    FleetConnection links[MQTT_FLEET_MAX_CONNECTIONS];
+    Link *link_list[MQTT_FLEET_MAX_CONNECTIONS];
+    Reconnector reconnector;
+    size_t connected = 0;
+    int result = 0;
+
+    char subscription[64];
+    snprintf(subscription,
+             sizeof(subscription),
+             "$share/%s%u/%s+",
+             MQTT_FLEET_SHARE_GROUP_PREFIX,
+             transport->shard_id,
+             MQTT_FLEET_TOPIC_COMMANDS_PREFIX);
+    const char *prefix = transport->client_id ? transport->client_id : MQTT_FLEET_CLIENT_ID_PREFIX;
+
+    log_info("Connecting %zu fleet connections of shard %u over %s to %s...",
+             connections,
+             transport->shard_id,
+             transport_kind_to_string(transport->kind),
+             transport_address(transport));
+    for (size_t k = 0; k < connections; k++)
+    {
+        char client_id[128];
+        snprintf(client_id, sizeof(client_id), "%s%u_%zu", prefix, transport->shard_id, k);
+
+        links[k].fleet = &ctx;
+        links[k].index = k;
+        link_init(&links[k].link, client_id, reconnect, k);
+        link_list[k] = &links[k].link;
+        if (transport_open(&links[k].link.transport,
+                           transport,
+                           client_id,
+                           subscription,
+                           fleet_message_arrived,
+                           fleet_connection_lost,
+                           &links[k]) != 0)
+        {
+            result = -1;
+            goto cleanup;
+        }
+        connected++;
+    }
+
+    if (reconnector_start(&reconnector, link_list, connections) != 0)
+    {
+        log_error("Failed to start the reconnect thread");
+        result = -1;
+        goto cleanup;
+    }
+
+    log_info("Subscribed to %s on %zu connections", subscription, connections);
+    log_info("Koven fleet of %zu ovens (ids %u-%u) is running on %zu shards...",
+             fleet->count,
+             fleet->first_id,
+             (unsigned)(fleet->first_id + fleet->count - 1),
+             ctx.pool.count);
+
+    // The schedule starts once connected
+    scheduler_init(&scheduler, schedule);
+    while (running)
+    {
+        unsigned ticks = scheduler_wait(&scheduler);
+        if (ticks == 0)
         {
-            printf("Publishing event: state=%s, temp=%d°C, remaining=%ds, programmed_temp=%d°C, "
-                   "programmed_duration=%ds\n",
-                   state_to_string(event.state),
-                   event.current_temperature,
-                   event.remaining_time,
-                   event.programmed_temperature,
-                   event.programmed_duration);
-            print_frame_hex(frame_buffer, frame_size);
+            continue;
+        }
+        uint64_t wakeup_ns = log_now_ns();
+        metrics_observe(METRIC_TICK_JITTER, scheduler.lateness_ns);
+
+        // The shards run the ticks and the event policy on their own slices, executing the
+        // commands queued for them first
+        uint64_t executed = shard_pool_executed(&ctx.pool);
+        shard_pool_tick(&ctx.pool, ticks, events, fields);
+        executed = shard_pool_executed(&ctx.pool) - executed;
+
+        // The workers are waiting for the next tick, so the table holds still while it is saved
+        if (snapshot && snapshot_save_due(snapshot, fleet, log_now_ns()) < 0)
+        {
+            log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to save fleet snapshot");
+        }
 
-            MQTTClient_message pubmsg = MQTTClient_message_initializer;
-            pubmsg.payload = frame_buffer;
-            pubmsg.payloadlen = frame_size;
-            pubmsg.qos = MQTT_QOS;
-            pubmsg.retained = 0;
+        // Keep only the ovens that publish this tick, compacting their events in place; the
+        // blocks that publish nothing are skipped whole, their fields were not even written
+        size_t selected = 0;
+        size_t transitions = 0;
+        for (size_t first = 0; first < fleet->count; first += FLEET_BLOCK_SIZE)
+        {
+            if (!shard_pool_block_publishes(&ctx.pool, first / FLEET_BLOCK_SIZE))
+            {
+                continue;
+            }
 
-            MQTTClient_deliveryToken token;
-            rc = MQTTClient_publishMessage(client, MQTT_TOPIC_EVENTS, &pubmsg, &token);
+            size_t end = first + FLEET_BLOCK_SIZE < fleet->count ? first + FLEET_BLOCK_SIZE
+                                                                 : fleet->count;
+            for (size_t i = first; i < end; i++)
+            {
+                if (fields[i])
+                {
+                    events[selected] = events[i];
+                    selected_ids[selected] = ids[i];
+                    fields[selected] = fields[i];
+                    transitions += (size_t)event_tracker_transition(&tracker, i);
+                    selected++;
+                }
+            }
+        }
 
-            if (rc == MQTTCLIENT_SUCCESS)
+        // Commands first: those of these ticks were applied before the events were emitted
+        if (recorder && shard_pool_record(&ctx.pool, recorder) != 0)
+        {
+            log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to record commands");
+        }
+        for (size_t i = 0; recorder && i < selected; i++)
+        {
+            if (recorder_event(recorder, ctx.pool.ticks_run, selected_ids[i], &events[i]) != 0)
             {
-                MQTTClient_waitForCompletion(client, token, MQTT_TIMEOUT);
+                log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to record events");
+                break;
             }
-            else
+        }
+
+        // The first reliable events are delivered as transitions, the others as telemetry; only
+        // a tiered transport tells them apart
+        size_t reliable = selected;
+        if (transport->qos_mode != TRANSPORT_QOS_UNIFORM)
+        {
+            reliable = partition_transitions(
+                &tracker, fleet->first_id, selected_ids, events, fields, selected);
+        }
+
+        size_t published = 0;
+        size_t spooled = 0;
+
+        // While older events wait in the spool, new ones queue up behind them, so that no oven
+        // ever publishes a state older than one the platform already got
+        if (spool_count(&outbox.spool) > 0)
+        {
+            spool_events(&outbox, selected_ids, events, selected);
+            spooled = selected;
+        }
+        // Deliveries are never waited for, so a slow broker cannot delay the next tick
+        else if (batch_size)
+        {
+            // Transitions and telemetry never share a batch
+            size_t b = 0;
+            for (size_t start = 0; start < selected; b++)
             {
-                printf("Failed to publish message, return code %d\n", rc);
+                size_t end = start < reliable ? reliable : selected;
+                size_t n = end - start < batch_size ? end - start : batch_size;
+                TransportStream stream =
+                    start < reliable ? TRANSPORT_TRANSITION : TRANSPORT_TELEMETRY;
+                uint8_t *frame = wire + b * batch_frame_size;
+                int len = policy->mode == EVENT_MODE_DELTA
+                              ? marshall_event_delta_batch_frame(&selected_ids[start],
+                                                                 &events[start],
+                                                                 &fields[start],
+                                                                 n,
+                                                                 frame,
+                                                                 batch_frame_size)
+                              : marshall_event_batch_frame(&selected_ids[start],
+                                                           &events[start],
+                                                           n,
+                                                           frame,
+                                                           batch_frame_size);
+
+                // The batches of a lost connection go through the next one that is up
+                Link *link = link_up(link_list, connections, b % connections);
+                if (len > 0 && link &&
+                    transport_publish(&link->transport,
+                                      MQTT_FLEET_TOPIC_EVENT_BATCHES,
+                                      frame,
+                                      (size_t)len,
+                                      stream) == 0)
+                {
+                    published += n;
+                }
+                else
+                {
+                    spool_events(&outbox, &selected_ids[start], &events[start], n);
+                    spooled += n;
+                }
+                start += n;
             }
         }
         else
         {
-            printf("Failed to build event frame\n");
+            int built = policy->mode == EVENT_MODE_DELTA ||
+                        marshall_event_frames(events, selected, wire, wire_size, NULL) >= 0;
+            if (!built)
+            {
+                // The events wait in the spool like those of a failed publish, and the rest of
+                // the wakeup still flushes it and counts the tick
+                log_limited(MQTT_LOG_INTERVAL_NS, LOG_LEVEL_ERROR, "Failed to build event frames");
+                spool_events(&outbox, selected_ids, events, selected);
+                spooled = selected;
+            }
+
+            for (size_t i = 0; built && i < selected; i++)
+            {
+                char topic[64];
+                snprintf(
+                    topic, sizeof(topic), "%s%u", MQTT_FLEET_TOPIC_EVENTS_PREFIX, selected_ids[i]);
+
+                uint8_t *frame = wire + i * frame_size;
+                int len = policy->mode == EVENT_MODE_DELTA
+                              ? marshall_event_delta_frame(&events[i], fields[i], frame, frame_size)
+                              : (int)EVENT_FRAME_SIZE;
+
+                Link *link = link_up(link_list, connections, i % connections);
+                if (len > 0 && link &&
+                    transport_publish(&link->transport,
+                                      topic,
+                                      frame,
+                                      (size_t)len,
+                                      i < reliable ? TRANSPORT_STATE : TRANSPORT_TELEMETRY) == 0)
+                {
+                    published++;
+                }
+                else
+                {
+                    spool_events(&outbox, &selected_ids[i], &events[i], 1);
+                    spooled++;
+                }
+            }
+        }
+
+        size_t flushed =
+            outbox_flush(&outbox, link_list, connections, MQTT_FLEET_TOPIC_EVENT_BATCHES);
+
+        uint64_t done_ns = log_now_ns();
+        metrics_observe_n(METRIC_COMMAND_TO_EVENT, done_ns - wakeup_ns, selected ? executed : 0);
+        metrics_observe(METRIC_TICK_DURATION, done_ns - wakeup_ns);
+        metrics_count(METRIC_EVENTS_PUBLISHED, published);
+        metrics_count(METRIC_TRANSITIONS, transitions);
+        metrics_count(METRIC_TICKS, ticks);
+        outbox_count(&outbox);
+
+        size_t in_flight = 0;
+        for (size_t k = 0; k < connections; k++)
+        {
+            in_flight += transport_in_flight(&links[k].link.transport);
         }
+
+        // At most one summary per interval, whatever the tick rate
+        log_limited(MQTT_LOG_INTERVAL_NS,
+                    LOG_LEVEL_INFO,
+                    "Fleet tick: %u ticks, published %zu events, %zu spooled, %zu flushed, %zu "
+                    "unchanged, %zu messages in flight, %zu events in the spool",
+                    ticks,
+                    published,
+                    spooled,
+                    flushed,
+                    fleet->count - selected,
+                    in_flight,
+                    spool_count(&outbox.spool));
+    }
+
+    log_info("Shutting down...");
+    reconnector_stop(&reconnector);
+    if (snapshot && snapshot_save(snapshot, fleet, log_now_ns()) == 0)
+    {
+        log_info("Saved snapshot %llu of %zu ovens",
+                 (unsigned long long)snapshot->sequence,
+                 fleet->count);
+    }
+    log_protocol_errors();
+    log_command_counters(shard_pool_dropped(&ctx.pool),
+                         shard_pool_overflow(&ctx.pool),
+                         shard_pool_coalesced(&ctx.pool));
+    if (ctx.pool.ticks_run > 0)
+    {
+        log_info("Ticked %llu ovens, %.1f%% of the fleet: idle blocks were skipped",
+                 (unsigned long long)shard_pool_oven_ticks(&ctx.pool),
+                 100.0 * (double)shard_pool_oven_ticks(&ctx.pool) /
+                     ((double)ctx.pool.ticks_run * (double)fleet->count));
     }
+    log_spool_counters(&outbox, &reconnector);
 
-    printf("\nShutting down...\n");
-    MQTTClient_unsubscribe(client, MQTT_TOPIC_COMMANDS);
-    MQTTClient_disconnect(client, MQTT_TIMEOUT);
-    MQTTClient_destroy(&client);
+cleanup:
+    for (size_t k = 0; k < connected; k++)
+    {
+        transport_close(&links[k].link.transport);
+    }
 
-    return 0;
+    shard_pool_free(&ctx.pool);
+    event_tracker_free(&tracker);
+    outbox_free(&outbox);
+    free(events);
+    free(ids);
+    free(selected_ids);
+    free(fields);
+    free(wire);
+
+    return result;
 }
@@ -1,16 +1,111 @@
 #ifndef MQTT_CLIENT_H
 #define MQTT_CLIENT_H
 
+#include "event_spool.h"
+#include "event_tracker.h"
+#include "fleet.h"
+#include "scheduler.h"
+#include "snapshot.h"
 #include "koven.h"
+#include "recording.h"
+#include "transport.h"
+#include <stddef.h>
 
-#define MQTT_BROKER "mqtt"
-#define MQTT_PORT 1883
 #define MQTT_CLIENT_ID "koven_client"
 #define MQTT_TOPIC_COMMANDS "cmds/koven"
 #define MQTT_TOPIC_EVENTS "events/koven"
 #define MQTT_QOS 1
 #define MQTT_TIMEOUT 10000L
 
-int mqtt_client_run(Koven *koven);
+// Publishes per connection that may wait for their delivery at once
+// Events that would exceed it are dropped rather than delaying the tick
+#define MQTT_PUBLISH_WINDOW 4096
+
+// Commands the single oven queues between two ticks before new ones are dropped
+#define MQTT_COMMAND_QUEUE_CAPACITY 1024
+
+// Shortest interval between two messages of a repeated log line (per-tick summaries, errors)
+#define MQTT_LOG_INTERVAL_NS 1000000000ull
+
+// Defaults of the reconnect policy
+#define MQTT_RECONNECT_MIN_NS 100000000ull
+#define MQTT_RECONNECT_MAX_NS 30000000000ull
+#define MQTT_SPOOL_CAPACITY 65536
+
+// Interval at which the reconnect thread looks for lost connections
+#define MQTT_RECONNECT_POLL_NS 10000000L
+
+// Event batch frames a wakeup may flush from the spool, so that a long backlog is drained over
+// several wakeups instead of delaying the next tick
+#define MQTT_SPOOL_FLUSH_BATCHES 64
+
+// What happens when a connection is lost
+// The emulator keeps ticking while a thread restores the connection in the background, waiting
+// a jittered exponential backoff between backoff_min_ns and backoff_max_ns before every attempt
+// (see backoff.h). Events that cannot be published meanwhile are spooled as spool_policy says,
+// SPOOL_DROP_OLDEST keeping up to spool_capacity of them (see event_spool.h), then flushed as
+// event batch frames over every connection that is up
+// The events that a full publish window would drop are spooled as well
+typedef struct {
+    uint64_t backoff_min_ns;
+    uint64_t backoff_max_ns;
+    SpoolPolicy spool_policy;
+    size_t spool_capacity;
+} ReconnectPolicy;
+
+// Fleet mode: every oven has its own topics, cmds/koven/<id> and events/koven/<id>
+// Commands are received through a shared subscription so that each one is delivered to
+// exactly one of the fleet connections. Every shard id is a group of its own: replicas of the
+// emulator with different shard ids each receive every command and keep those of their ovens
+#define MQTT_FLEET_CLIENT_ID_PREFIX "koven_fleet_"
+#define MQTT_FLEET_TOPIC_COMMANDS_PREFIX "cmds/koven/"
+#define MQTT_FLEET_TOPIC_EVENTS_PREFIX "events/koven/"
+#define MQTT_FLEET_TOPIC_EVENT_BATCHES "events/koven/batch"
+#define MQTT_FLEET_TOPIC_COMMAND_BATCHES "cmds/koven/batch"
+#define MQTT_FLEET_SHARE_GROUP_PREFIX "koven_fleet_"
+#define MQTT_FLEET_MAX_CONNECTIONS 64
+
+// Runs a single oven on the legacy topics, publishing its events as the policy says
+// The oven ticks and publishes at the pace of the schedule; commands received by the thread of
+// the transport are queued, coalesced and executed by the tick loop at the next tick
+// A lost connection is restored as reconnect says, NULL for the defaults; spooled events are
+// flushed as batch frames to events/koven, with oven id 0
+// With a recorder (NULL for none), made for oven id 0 alone, every command received and every
+// event published is appended to its log under the tick it belongs to
+int mqtt_client_run(Koven *koven,
+                    const TransportConfig *transport,
+                    const ReconnectPolicy *reconnect,
+                    Recorder *recorder,
+                    const EventPolicy *policy,
+                    const TickSchedule *schedule);
+
+// Runs the whole fleet over a small pool of connections of the transport
+// Connection k of shard id s has the client id <prefix><s>_<k> and subscribes to
+// $share/koven_fleet_<s>/cmds/koven/+; commands for ovens outside of the fleet are ignored
+// With batch_size 0, oven i publishes its events to events/koven/<id> through connection
+// i % connections. Otherwise the events of every batch_size ovens are published together as
+// one event batch frame to events/koven/batch, batch b through connection b % connections
+// Only the ovens selected by the event policy publish on a tick; in EVENT_MODE_DELTA their
+// events are sent as delta frames, or delta batch frames
+// The fleet is ticked by shards worker threads, 0 for one per available CPU (see shard_pool.h)
+// At most backlog commands wait for the shards, 0 for SHARD_DEFAULT_BACKLOG
+// With a snapshot (NULL for none), the table is saved between two ticks whenever the interval of
+// the snapshot elapsed, and once more on shutdown
+// Lost connections are restored as reconnect says, NULL for the defaults; meanwhile the events of
+// a lost connection go through the others, and are spooled when none is up. Spooled events are
+// flushed to events/koven/batch in frames of batch_size ovens, EVENT_BATCH_MAX_EVENTS with 0
+// With a recorder (NULL for none), made for the ovens of the fleet, every command drained by the
+// shards and every event selected by the event policy is appended to its log
+int mqtt_client_run_fleet(KovenFleet *fleet,
+                          const TransportConfig *transport,
+                          const ReconnectPolicy *reconnect,
+                          size_t connections,
+                          size_t batch_size,
+                          size_t shards,
+                          size_t backlog,
+                          FleetSnapshot *snapshot,
+                          Recorder *recorder,
+                          const EventPolicy *policy,
+                          const TickSchedule *schedule);
 
 #endif /* MQTT_CLIENT_H */
@@ -0,0 +1,240 @@
+#include "log.h"
+#include "metrics.h"
+#include "mqtt_client.h"
+#include "publish_window.h"
+#include "transport.h"
+#include <MQTTClient.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Send time of a publish in flight, for the round-trip time of its delivery
+// Slots are picked by token, which the client hands out in sequence; a delivery that completes
+// before its send time is stored finds another token in the slot and is not measured
+typedef struct {
+    atomic_int token;
+    atomic_uint_fast64_t sent_ns;
+} MqttSendTime;
+
+// Broker connection, with its window of publishes waiting for their delivery
+typedef struct {
+    MQTTClient client;
+    PublishWindow window;
+    char *subscription;
+    int qos;
+    long timeout_ms;
+    TransportQosMode qos_mode;
+    MqttSendTime sent[MQTT_PUBLISH_WINDOW];
+} MqttTransport;
+
+// Callback for incoming MQTT messages on the subscribed topic
+static int mqtt_transport_message_arrived(void *context,
+                                          char *topicName,
+                                          int topicLen,
+                                          MQTTClient_message *message)
+{
+    (void)topicLen;
+    Transport *transport = context;
+
+    if (message->payload && message->payloadlen > 0)
+    {
+        transport->on_message(transport->context,
+                              topicName,
+                              (const uint8_t *)message->payload,
+                              (size_t)message->payloadlen);
+    }
+
+    MQTTClient_freeMessage(&message);
+    MQTTClient_free(topicName);
+
+    return 1;
+}
+
+// Callback for completed deliveries, giving their slot of the window back
+static void mqtt_transport_delivery_complete(void *context, MQTTClient_deliveryToken token)
+{
+    MqttTransport *mqtt = ((Transport *)context)->impl;
+    publish_window_complete(&mqtt->window);
+
+    MqttSendTime *sent = &mqtt->sent[(unsigned)token % MQTT_PUBLISH_WINDOW];
+    if (atomic_load_explicit(&sent->token, memory_order_acquire) == token)
+    {
+        uint64_t sent_ns = atomic_load_explicit(&sent->sent_ns, memory_order_relaxed);
+        uint64_t now_ns = log_now_ns();
+        metrics_observe(METRIC_PUBLISH_RTT, now_ns > sent_ns ? now_ns - sent_ns : 0);
+    }
+}
+
+// Callback for connection loss with the MQTT broker
+static void mqtt_transport_connection_lost(void *context, char *cause)
+{
+    Transport *transport = context;
+    transport->on_lost(transport->context, cause ? cause : "unknown");
+}
+
+static int mqtt_transport_publish(Transport *transport,
+                                  const char *topic,
+                                  const uint8_t *payload,
+                                  size_t len,
+                                  TransportStream stream)
+{
+    MqttTransport *mqtt = transport->impl;
+    MQTTClient_message pubmsg = MQTTClient_message_initializer;
+    pubmsg.payload = (void *)payload;
+    pubmsg.payloadlen = (int)len;
+    pubmsg.qos = mqtt->qos_mode != TRANSPORT_QOS_UNIFORM && stream == TRANSPORT_TELEMETRY
+                     ? 0
+                     : mqtt->qos;
+    pubmsg.retained = mqtt->qos_mode == TRANSPORT_QOS_RETAINED && stream == TRANSPORT_STATE;
+
+    // QoS 0 publishes are never acknowledged, so they take no slot of the window
+    MQTTClient_deliveryToken token;
+    if (pubmsg.qos == 0)
+    {
+        return MQTTClient_publishMessage(mqtt->client, topic, &pubmsg, &token) == MQTTCLIENT_SUCCESS
+                   ? 0
+                   : -1;
+    }
+
+    // The delivery is not waited for: the delivery callback gives the slot back
+    if (publish_window_acquire(&mqtt->window) != 0)
+    {
+        return -1;
+    }
+
+    uint64_t sent_ns = log_now_ns();
+    if (MQTTClient_publishMessage(mqtt->client, topic, &pubmsg, &token) != MQTTCLIENT_SUCCESS)
+    {
+        publish_window_cancel(&mqtt->window);
+        return -1;
+    }
+
+    MqttSendTime *sent = &mqtt->sent[(unsigned)token % MQTT_PUBLISH_WINDOW];
+    atomic_store_explicit(&sent->sent_ns, sent_ns, memory_order_relaxed);
+    atomic_store_explicit(&sent->token, token, memory_order_release);
+    return 0;
+}
+
+static size_t mqtt_transport_in_flight(Transport *transport)
+{
+    MqttTransport *mqtt = transport->impl;
+    return publish_window_in_flight(&mqtt->window);
+}
+
+// Starts a clean session with the broker and subscribes it
+// Returns MQTTCLIENT_SUCCESS, or the return code of the step that failed; connected tells which
+static int mqtt_transport_connect(MqttTransport *mqtt, int *connected)
+{
+    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
+    conn_opts.keepAliveInterval = 20;
+    conn_opts.cleansession = 1;
+    // A reliable client allows a single publish in flight and makes the next one wait for its
+    // acknowledgement: the window is what bounds the publishes in flight instead
+    conn_opts.reliable = 0;
+    conn_opts.maxInflightMessages = MQTT_PUBLISH_WINDOW;
+
+    *connected = 0;
+    int rc = MQTTClient_connect(mqtt->client, &conn_opts);
+    if (rc != MQTTCLIENT_SUCCESS)
+    {
+        return rc;
+    }
+
+    *connected = 1;
+    rc = MQTTClient_subscribe(mqtt->client, mqtt->subscription, mqtt->qos);
+    if (rc != MQTTCLIENT_SUCCESS)
+    {
+        MQTTClient_disconnect(mqtt->client, mqtt->timeout_ms);
+    }
+    return rc;
+}
+
+// The client handle survives the loss: only the session is started again
+static int mqtt_transport_reconnect(Transport *transport)
+{
+    MqttTransport *mqtt = transport->impl;
+    int connected;
+
+    if (mqtt_transport_connect(mqtt, &connected) != MQTTCLIENT_SUCCESS)
+    {
+        return -1;
+    }
+
+    // The clean session dropped whatever was in flight: no delivery will give those slots back
+    publish_window_reset(&mqtt->window);
+    return 0;
+}
+
+static void mqtt_transport_close(Transport *transport)
+{
+    MqttTransport *mqtt = transport->impl;
+
+    MQTTClient_unsubscribe(mqtt->client, mqtt->subscription);
+    MQTTClient_disconnect(mqtt->client, mqtt->timeout_ms);
+    MQTTClient_destroy(&mqtt->client);
+    free(mqtt->subscription);
+    free(mqtt);
+    transport->impl = NULL;
+}
+
+static const TransportOps mqtt_transport_ops = {
+    mqtt_transport_publish,
+    mqtt_transport_in_flight,
+    mqtt_transport_reconnect,
+    mqtt_transport_close,
+};
+
+int mqtt_transport_open(Transport *transport,
+                        const TransportConfig *config,
+                        const char *client_id,
+                        const char *subscription)
+{
+    const char *address = transport_address(config);
+    MqttTransport *mqtt = calloc(1, sizeof(MqttTransport));
+    char *topic = malloc(strlen(subscription) + 1);
+    if (!mqtt || !topic)
+    {
+        free(mqtt);
+        free(topic);
+        return -1;
+    }
+    strcpy(topic, subscription);
+    mqtt->subscription = topic;
+    mqtt->qos = config->qos;
+    mqtt->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : MQTT_TIMEOUT;
+    mqtt->qos_mode = config->qos_mode;
+    publish_window_init(&mqtt->window, MQTT_PUBLISH_WINDOW);
+
+    transport->ops = &mqtt_transport_ops;
+    transport->impl = mqtt;
+
+    MQTTClient_create(&mqtt->client, address, client_id, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+    MQTTClient_setCallbacks(mqtt->client,
+                            transport,
+                            mqtt_transport_connection_lost,
+                            mqtt_transport_message_arrived,
+                            mqtt_transport_delivery_complete);
+
+    int connected;
+    int rc = mqtt_transport_connect(mqtt, &connected);
+    if (rc != MQTTCLIENT_SUCCESS)
+    {
+        if (connected)
+        {
+            log_error("Failed to subscribe %s to %s, return code %d", client_id, subscription, rc);
+        }
+        else
+        {
+            log_error("Failed to connect %s to MQTT broker at %s, return code %d",
+                      client_id,
+                      address,
+                      rc);
+        }
+        MQTTClient_destroy(&mqtt->client);
+        free(topic);
+        free(mqtt);
+        transport->impl = NULL;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "pending_command.h"
+
+int pending_command_add(PendingCommand *slot, const CommandPayload *cmd)
+{
+    if (!slot || !cmd)
+    {
+        return 0;
+    }
+
+    switch (cmd->action)
+    {
+    case ACTION_STOP:
+    {
+        // Replaces everything pending, a previous STOP included
+        int superseded = ((slot->flags & PENDING_STOP) != 0) + ((slot->flags & PENDING_START) != 0);
+        slot->flags = PENDING_STOP;
+        return superseded;
+    }
+
+    case ACTION_START:
+        // Only the first START can find the oven idle
+        if (slot->flags & PENDING_START)
+        {
+            return 1;
+        }
+        slot->flags |= PENDING_START;
+        slot->start = *cmd;
+        return 0;
+
+    default:
+        // Ignored by koven_execute anyway, so the slot is not touched
+        return 1;
+    }
+}
+
+int pending_command_apply(PendingCommand *slot, Koven *koven)
+{
+    if (!slot || !koven)
+    {
+        return 0;
+    }
+
+    int executed = 0;
+    if (slot->flags & PENDING_STOP)
+    {
+        CommandPayload stop = {ACTION_STOP, 0, 0};
+        koven_execute(koven, &stop);
+        executed++;
+    }
+    if (slot->flags & PENDING_START)
+    {
+        koven_execute(koven, &slot->start);
+        executed++;
+    }
+
+    slot->flags = 0;
+    return executed;
+}
@@ -0,0 +1,28 @@
+#ifndef PENDING_COMMAND_H
+#define PENDING_COMMAND_H
+
+#include "koven.h"
+#include <stdint.h>
+
+#define PENDING_STOP  0x01
+#define PENDING_START 0x02
+
+// Commands of one oven waiting for the next tick boundary, coalesced as they arrive
+// A STOP resets the oven whatever came before it and a START only applies to an idle oven, so
+// the commands received within one tick always reduce to an optional STOP followed by an
+// optional START: the first START after the last STOP. Applying the slot gives exactly the state
+// that executing every command in order would
+typedef struct {
+    uint8_t flags;
+    CommandPayload start;
+} PendingCommand;
+
+// Folds cmd into the slot; a command with an unknown action is rejected and leaves the slot as is
+// Returns the number of commands superseded by it, including cmd itself when it has no effect
+int pending_command_add(PendingCommand *slot, const CommandPayload *cmd);
+
+// Executes the pending commands on koven and empties the slot
+// Returns the number of commands executed
+int pending_command_apply(PendingCommand *slot, Koven *koven);
+
+#endif /* PENDING_COMMAND_H */
@@ -1,8 +1,22 @@
 #include "protocol.h"
 #include <arpa/inet.h>
-#include <stdio.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC16_HAVE_CLMUL 1
+#define CRC16_CLMUL_TARGET __attribute__((target("pclmul,sse2")))
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#include <arm_neon.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#define CRC16_HAVE_CLMUL 1
+#define CRC16_CLMUL_TARGET
+#endif
+
 /* CRC-16/USB implementation
  * Polynomial: 0x8005
  * Initial value: 0xFFFF
@@ -33,6 +47,228 @@ uint16_t crc16_usb(const uint8_t *data, size_t length)
     return crc ^ 0xFFFF;
 }
 
+#define CRC16_USB_POLY 0x18005u          /* x^16 + x^15 + x^2 + 1 */
+#define CRC16_USB_POLY_REFLECTED 0xA001u /* Low 16 bits of the polynomial, bit-reversed */
+
+// Slice-by-8 lookup tables: crc16_tables[k][i] is the CRC contribution of byte i followed by
+// k zero bytes, so crc16_tables[0] is the classic byte-at-a-time table
+static uint16_t crc16_tables[8][256];
+
+// Barrett constant for crc16_usb_clmul: floor(x^80 / P) without its x^64 term, bit-reversed
+static uint64_t crc16_clmul_mu;
+static int crc16_clmul_available;
+
+static uint16_t (*crc16_fast_impl)(const uint8_t *, size_t) = crc16_usb_slice8;
+static const char *crc16_fast_impl_name = "slice8";
+
+// Builds the lookup tables and selects the implementation behind crc16_usb_fast
+__attribute__((constructor)) static void crc16_init(void)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint16_t crc = (uint16_t)i;
+        for (int j = 0; j < 8; j++)
+        {
+            crc = (crc & 0x0001) ? (crc >> 1) ^ CRC16_USB_POLY_REFLECTED : crc >> 1;
+        }
+        crc16_tables[0][i] = crc;
+    }
+
+    for (int k = 1; k < 8; k++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            uint16_t prev = crc16_tables[k - 1][i];
+            crc16_tables[k][i] = (prev >> 8) ^ crc16_tables[0][prev & 0xFF];
+        }
+    }
+
+    // Long division of x^80 by P, keeping the 64 low quotient bits
+    uint32_t rem = 0;
+    uint64_t quotient = 0;
+    for (int bit = 80; bit >= 0; bit--)
+    {
+        rem = (rem << 1) | (bit == 80);
+        quotient <<= 1;
+        if (rem & 0x10000u)
+        {
+            rem ^= CRC16_USB_POLY;
+            quotient |= 1;
+        }
+    }
+
+    crc16_clmul_mu = 0;
+    for (int bit = 0; bit < 64; bit++)
+    {
+        crc16_clmul_mu |= ((quotient >> bit) & 1) << (63 - bit);
+    }
+
+#if defined(__x86_64__) && defined(CRC16_HAVE_CLMUL)
+    __builtin_cpu_init();
+    crc16_clmul_available = __builtin_cpu_supports("pclmul");
+#elif defined(__aarch64__) && defined(CRC16_HAVE_CLMUL)
+    crc16_clmul_available = (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#endif
+
+    if (crc16_clmul_available)
+    {
+        crc16_fast_impl = crc16_usb_clmul;
+        crc16_fast_impl_name = "clmul";
+    }
+}
+
+// Reads 8 bytes as a little-endian 64-bit word
+static uint64_t le_to_uint64(const uint8_t *bytes)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+// The update functions below work on the raw CRC register, without the initial value and the
+// output XOR, so that they can continue each other
+
+static uint16_t crc16_update_table(uint16_t crc, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = (crc >> 8) ^ crc16_tables[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+// Feeds 8 message bytes, loaded as a little-endian word, into the CRC register
+static uint16_t crc16_step8(uint16_t crc, uint64_t word)
+{
+    uint64_t x = word ^ crc;
+    return crc16_tables[7][x & 0xFF] ^ crc16_tables[6][(x >> 8) & 0xFF] ^
+           crc16_tables[5][(x >> 16) & 0xFF] ^ crc16_tables[4][(x >> 24) & 0xFF] ^
+           crc16_tables[3][(x >> 32) & 0xFF] ^ crc16_tables[2][(x >> 40) & 0xFF] ^
+           crc16_tables[1][(x >> 48) & 0xFF] ^ crc16_tables[0][x >> 56];
+}
+
+static uint16_t crc16_update_slice8(uint16_t crc, const uint8_t *data, size_t length)
+{
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        crc = crc16_step8(crc, le_to_uint64(data));
+    }
+    return crc16_update_table(crc, data, length);
+}
+
+#ifdef CRC16_HAVE_CLMUL
+// 64x64 -> 128 bit carry-less multiplication, returns the low half and stores the high half
+CRC16_CLMUL_TARGET static inline uint64_t clmul64(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#if defined(__x86_64__)
+    __m128i product =
+        _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0);
+    *hi = (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(product, product));
+    return (uint64_t)_mm_cvtsi128_si64(product);
+#else
+    uint64x2_t product = vreinterpretq_u64_p128(vmull_p64((poly64_t)a, (poly64_t)b));
+    *hi = vgetq_lane_u64(product, 1);
+    return vgetq_lane_u64(product, 0);
+#endif
+}
+
+// Reduces 8 message bytes at a time with a Barrett reduction instead of table lookups
+// In the bit-reflected domain, with X the next 8 bytes XORed with the register:
+//   q   = X + floor(X * mu / x^64)    (first multiplication, needs the low product half)
+//   crc = (q * P) mod x^16            (second multiplication, product bits 63..78)
+CRC16_CLMUL_TARGET static uint16_t crc16_update_clmul(uint16_t crc,
+                                                      const uint8_t *data,
+                                                      size_t length)
+{
+    uint64_t hi;
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t x = le_to_uint64(data) ^ crc;
+        uint64_t q = x ^ (clmul64(x, crc16_clmul_mu, &hi) << 1);
+        uint64_t lo = clmul64(q, CRC16_USB_POLY_REFLECTED, &hi);
+        crc = (uint16_t)((lo >> 63) | (hi << 1));
+    }
+    return crc16_update_table(crc, data, length);
+}
+#endif
+
+uint16_t crc16_usb_table(const uint8_t *data, size_t length)
+{
+    return crc16_update_table(0xFFFF, data, length) ^ 0xFFFF;
+}
+
+uint16_t crc16_usb_slice8(const uint8_t *data, size_t length)
+{
+    return crc16_update_slice8(0xFFFF, data, length) ^ 0xFFFF;
+}
+
+// Falls back to crc16_usb_slice8 when the CPU has no carry-less multiplication
+uint16_t crc16_usb_clmul(const uint8_t *data, size_t length)
+{
+#ifdef CRC16_HAVE_CLMUL
+    if (crc16_clmul_available)
+    {
+        return crc16_update_clmul(0xFFFF, data, length) ^ 0xFFFF;
+    }
+#endif
+    return crc16_usb_slice8(data, length);
+}
+
+int crc16_usb_clmul_supported(void) { return crc16_clmul_available != 0; }
+
+uint16_t crc16_usb_fast(const uint8_t *data, size_t length)
+{
+    return crc16_fast_impl(data, length);
+}
+
+const char *crc16_usb_fast_name(void) { return crc16_fast_impl_name; }
+
+// Computes the CRC of n independent buffers in one call
+// Groups of four buffers run their slice-by-8 steps interleaved over their common length, so
+// the four dependency chains overlap instead of waiting on each other
+void crc16_usb_multi(const uint8_t *const *data, const size_t *lengths, size_t n, uint16_t *crcs)
+{
+    if (!data || !lengths || !crcs)
+    {
+        return;
+    }
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint16_t crc[4] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
+        size_t common = lengths[i];
+        for (size_t lane = 1; lane < 4; lane++)
+        {
+            common = lengths[i + lane] < common ? lengths[i + lane] : common;
+        }
+
+        size_t offset = 0;
+        for (; offset + 8 <= common; offset += 8)
+        {
+            crc[0] = crc16_step8(crc[0], le_to_uint64(data[i] + offset));
+            crc[1] = crc16_step8(crc[1], le_to_uint64(data[i + 1] + offset));
+            crc[2] = crc16_step8(crc[2], le_to_uint64(data[i + 2] + offset));
+            crc[3] = crc16_step8(crc[3], le_to_uint64(data[i + 3] + offset));
+        }
+
+        for (size_t lane = 0; lane < 4; lane++)
+        {
+            const uint8_t *rest = offset ? data[i + lane] + offset : data[i + lane];
+            crcs[i + lane] =
+                crc16_update_slice8(crc[lane], rest, lengths[i + lane] - offset) ^ 0xFFFF;
+        }
+    }
+
+    for (; i < n; i++)
+    {
+        crcs[i] = crc16_usb_fast(data[i], lengths[i]);
+    }
+}
+
 // Helper functions for little-endian conversions
 
 // Convert uint16_t to little-endian byte array
@@ -48,11 +284,81 @@ static uint16_t le_to_uint16(const uint8_t *bytes)
     return (uint16_t)bytes[0] | ((uint16_t)bytes[1] << 8);
 }
 
-// Convert little-endian byte array to int16_t
-static int16_t le_to_int16(const uint8_t *bytes) { return (int16_t)le_to_uint16(bytes); }
+// Convert uint32_t to little-endian byte array
+static void uint32_to_le(uint32_t value, uint8_t *bytes)
+{
+    uint16_to_le((uint16_t)(value & 0xFFFF), bytes);
+    uint16_to_le((uint16_t)(value >> 16), &bytes[2]);
+}
+
+// Convert little-endian byte array to uint32_t
+static uint32_t le_to_uint32(const uint8_t *bytes)
+{
+    return (uint32_t)le_to_uint16(bytes) | ((uint32_t)le_to_uint16(&bytes[2]) << 16);
+}
+
+// Error counters of the codec, shared by every thread
+static struct {
+    atomic_uint_fast64_t invalid_type;
+    atomic_uint_fast64_t invalid_size;
+    atomic_uint_fast64_t truncated;
+    atomic_uint_fast64_t crc_mismatch;
+    atomic_uint_fast64_t buffer_too_small;
+    atomic_uint_fast64_t too_many_events;
+} protocol_error_counts;
 
-// Convert int16_t to little-endian byte array
-static void int16_to_le(int16_t value, uint8_t *bytes) { uint16_to_le((uint16_t)value, bytes); }
+#define count_error(field)                                                                         \
+    atomic_fetch_add_explicit(&protocol_error_counts.field, 1, memory_order_relaxed)
+
+void protocol_errors(ProtocolErrors *errors)
+{
+    if (!errors)
+    {
+        return;
+    }
+
+    errors->invalid_type = atomic_load(&protocol_error_counts.invalid_type);
+    errors->invalid_size = atomic_load(&protocol_error_counts.invalid_size);
+    errors->truncated = atomic_load(&protocol_error_counts.truncated);
+    errors->crc_mismatch = atomic_load(&protocol_error_counts.crc_mismatch);
+    errors->buffer_too_small = atomic_load(&protocol_error_counts.buffer_too_small);
+    errors->too_many_events = atomic_load(&protocol_error_counts.too_many_events);
+}
+
+void protocol_errors_reset(void)
+{
+    atomic_store(&protocol_error_counts.invalid_type, 0);
+    atomic_store(&protocol_error_counts.invalid_size, 0);
+    atomic_store(&protocol_error_counts.truncated, 0);
+    atomic_store(&protocol_error_counts.crc_mismatch, 0);
+    atomic_store(&protocol_error_counts.buffer_too_small, 0);
+    atomic_store(&protocol_error_counts.too_many_events, 0);
+}
+
+// Marshalls a command frame from command payload structure to raw bytes
+// Returns frame size on success, -1 on error
+int marshall_command_frame(const CommandPayload *cmd, uint8_t *buffer, size_t buffer_size)
+{
+    if (!cmd || !buffer)
+    {
+        return -1;
+    }
+
+    if (buffer_size < COMMAND_FRAME_SIZE)
+    {
+        count_error(buffer_too_small);
+        return -1;
+    }
+
+    buffer[0] = MSG_TYPE_COMMAND;
+    uint16_to_le((uint16_t)sizeof(CommandPayload), &buffer[1]);
+    command_payload_encode(cmd, &buffer[3]);
+
+    uint16_t crc = crc16_usb_fast(buffer, 3 + sizeof(CommandPayload));
+    uint16_to_le(crc, &buffer[3 + sizeof(CommandPayload)]);
+
+    return (int)COMMAND_FRAME_SIZE;
+}
 
 // Unmarshalls a command frame from raw bytes to a CommandPayload structure
 // Returns 0 on success, -1 on error
@@ -69,19 +375,13 @@ int unmarshall_command_frame(const uint8_t *data, size_t len, CommandPayload *cm
 
     if (msg_type != MSG_TYPE_COMMAND)
     {
-        fprintf(stderr,
-                "Invalid message type: 0x%02X (expected 0x%02X)\n",
-                msg_type,
-                MSG_TYPE_COMMAND);
+        count_error(invalid_type);
         return -1;
     }
 
     if (payload_size != sizeof(CommandPayload))
     {
-        fprintf(stderr,
-                "Invalid payload size: %u (expected %zu)\n",
-                payload_size,
-                sizeof(CommandPayload));
+        count_error(invalid_size);
         return -1;
     }
 
@@ -89,31 +389,36 @@ int unmarshall_command_frame(const uint8_t *data, size_t len, CommandPayload *cm
     size_t expected_len = 1 + 2 + payload_size + 2;
     if (len < expected_len)
     {
-        fprintf(stderr, "Frame too short: %zu bytes (expected %zu)\n", len, expected_len);
+        count_error(truncated);
         return -1;
     }
 
     // Verify CRC
     uint16_t received_crc = le_to_uint16(&data[3 + payload_size]);
-    uint16_t calculated_crc = crc16_usb(data, 3 + payload_size);
+    uint16_t calculated_crc = crc16_usb_fast(data, 3 + payload_size);
     if (received_crc != calculated_crc)
     {
-        fprintf(stderr,
-                "CRC mismatch: received 0x%04X, calculated 0x%04X\n",
-                received_crc,
-                calculated_crc);
+        count_error(crc_mismatch);
         return -1;
     }
 
-    // Extract payload: action (1), temperature (2), duration (2)
-    const uint8_t *payload = &data[3];
-    cmd->action = payload[0];
-    cmd->temperature = le_to_int16(&payload[1]);
-    cmd->duration = le_to_int16(&payload[3]);
+    command_payload_decode(&data[3], cmd);
 
     return 0;
 }
 
+// Writes the header and payload of an event frame, everything but the CRC
+// The caller guarantees that buffer has room for EVENT_FRAME_SIZE bytes
+static void encode_event_frame(const EventPayload *event, uint8_t *buffer)
+{
+    // Build frame header
+    buffer[0] = MSG_TYPE_EVENT;
+    uint16_to_le((uint16_t)sizeof(EventPayload), &buffer[1]);
+
+    // Build payload
+    event_payload_encode(event, &buffer[3]);
+}
+
 // Marshalls an event frame from event payload structure to raw bytes
 // Returns frame size on success, -1 on error
 int marshall_event_frame(const EventPayload *event, uint8_t *buffer, size_t buffer_size)
@@ -124,40 +429,572 @@ int marshall_event_frame(const EventPayload *event, uint8_t *buffer, size_t buff
     }
 
     size_t payload_size = sizeof(EventPayload);
-    size_t frame_size = 1 + 2 + payload_size + 2; // msg_type + size + payload + crc
+    size_t frame_size = EVENT_FRAME_SIZE; // msg_type + size + payload + crc
     if (buffer_size < frame_size)
     {
-        fprintf(stderr, "Buffer too small: %zu bytes (need %zu)\n", buffer_size, frame_size);
+        count_error(buffer_too_small);
+        return -1;
+    }
+
+    encode_event_frame(event, buffer);
+
+    // Calculate and append CRC
+    uint16_t crc = crc16_usb_fast(buffer, 3 + payload_size);
+    uint16_to_le(crc, &buffer[3 + payload_size]);
+
+    return (int)frame_size;
+}
+
+// Number of frames whose CRCs are computed together by marshall_event_frames
+#define MARSHALL_CRC_CHUNK 64
+
+// Marshalls n event frames back-to-back into one buffer
+// Returns the total size on success, -1 on error
+int marshall_event_frames(
+    const EventPayload *events, size_t n, uint8_t *buffer, size_t buffer_size, size_t *offsets)
+{
+    if (!events || !buffer || n > (size_t)INT_MAX / EVENT_FRAME_SIZE)
+    {
+        return -1;
+    }
+
+    // The only capacity check: every frame has the same size
+    size_t total_size = n * EVENT_FRAME_SIZE;
+    if (buffer_size < total_size)
+    {
+        count_error(buffer_too_small);
+        return -1;
+    }
+
+    const uint8_t *frames[MARSHALL_CRC_CHUNK];
+    size_t lengths[MARSHALL_CRC_CHUNK];
+    uint16_t crcs[MARSHALL_CRC_CHUNK];
+
+    for (size_t i = 0; i < MARSHALL_CRC_CHUNK; i++)
+    {
+        lengths[i] = EVENT_FRAME_SIZE - 2;
+    }
+
+    for (size_t start = 0; start < n; start += MARSHALL_CRC_CHUNK)
+    {
+        size_t chunk = n - start < MARSHALL_CRC_CHUNK ? n - start : MARSHALL_CRC_CHUNK;
+
+        for (size_t i = 0; i < chunk; i++)
+        {
+            uint8_t *frame = buffer + (start + i) * EVENT_FRAME_SIZE;
+            encode_event_frame(&events[start + i], frame);
+            frames[i] = frame;
+        }
+
+        crc16_usb_multi(frames, lengths, chunk, crcs);
+
+        for (size_t i = 0; i < chunk; i++)
+        {
+            uint16_to_le(crcs[i], (uint8_t *)frames[i] + EVENT_FRAME_SIZE - 2);
+        }
+    }
+
+    if (offsets)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            offsets[i] = i * EVENT_FRAME_SIZE;
+        }
+    }
+
+    return (int)total_size;
+}
+
+// Marshalls the events of n ovens into a single event batch frame
+// Returns frame size on success, -1 on error
+int marshall_event_batch_frame(
+    const uint32_t *ids, const EventPayload *events, size_t n, uint8_t *buffer, size_t buffer_size)
+{
+    if ((n > 0 && (!ids || !events)) || !buffer)
+    {
+        return -1;
+    }
+
+    if (n > EVENT_BATCH_MAX_EVENTS)
+    {
+        count_error(too_many_events);
+        return -1;
+    }
+
+    size_t payload_size = 2 + n * EVENT_BATCH_ENTRY_SIZE;
+    size_t frame_size = EVENT_BATCH_FRAME_SIZE(n);
+    if (buffer_size < frame_size)
+    {
+        count_error(buffer_too_small);
         return -1;
     }
 
     // Build frame header
-    buffer[0] = MSG_TYPE_EVENT;
+    buffer[0] = MSG_TYPE_EVENT_BATCH;
     uint16_to_le((uint16_t)payload_size, &buffer[1]);
 
-    // Build payload: state (1), current_temperature (2), remaining_time (2),
-    // programmed_duration (2), programmed_temperature (2)
+    // Build payload: count (2), then one entry per oven
     uint8_t *payload = &buffer[3];
-    payload[0] = event->state;
-    int16_to_le(event->current_temperature, &payload[1]);
-    int16_to_le(event->remaining_time, &payload[3]);
-    int16_to_le(event->programmed_duration, &payload[5]);
-    int16_to_le(event->programmed_temperature, &payload[7]);
+    uint16_to_le((uint16_t)n, payload);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t *entry = &payload[2 + i * EVENT_BATCH_ENTRY_SIZE];
+        uint32_to_le(ids[i], entry);
+        event_payload_encode(&events[i], &entry[4]);
+    }
 
     // Calculate and append CRC
-    uint16_t crc = crc16_usb(buffer, 3 + payload_size);
+    uint16_t crc = crc16_usb_fast(buffer, 3 + payload_size);
     uint16_to_le(crc, &buffer[3 + payload_size]);
 
     return (int)frame_size;
 }
 
-// Helper to print frame in hex format (for debugging)
-void print_frame_hex(const uint8_t *data, size_t len)
+// Unmarshalls an event batch frame into ids and events
+// Returns the number of events on success, -1 on error
+int unmarshall_event_batch_frame(
+    const uint8_t *data, size_t len, uint32_t *ids, EventPayload *events, size_t max_events)
 {
-    printf("Frame (%zu bytes): ", len);
-    for (size_t i = 0; i < len; i++)
+    if (!data || !ids || !events || len < EVENT_BATCH_FRAME_SIZE(0))
     {
-        printf("%02X", data[i]);
+        return -1;
     }
-    printf("\n");
+
+    // Extract frame header
+    uint8_t msg_type = data[0];
+    uint16_t payload_size = le_to_uint16(&data[1]);
+    uint16_t count = le_to_uint16(&data[3]);
+
+    if (msg_type != MSG_TYPE_EVENT_BATCH)
+    {
+        count_error(invalid_type);
+        return -1;
+    }
+
+    if (count > EVENT_BATCH_MAX_EVENTS || payload_size != 2 + count * EVENT_BATCH_ENTRY_SIZE)
+    {
+        count_error(invalid_size);
+        return -1;
+    }
+
+    size_t expected_len = 1 + 2 + (size_t)payload_size + 2;
+    if (len < expected_len)
+    {
+        count_error(truncated);
+        return -1;
+    }
+
+    if (count > max_events)
+    {
+        count_error(too_many_events);
+        return -1;
+    }
+
+    // Verify CRC
+    uint16_t received_crc = le_to_uint16(&data[3 + payload_size]);
+    uint16_t calculated_crc = crc16_usb_fast(data, 3 + (size_t)payload_size);
+    if (received_crc != calculated_crc)
+    {
+        count_error(crc_mismatch);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t *entry = &data[5 + i * EVENT_BATCH_ENTRY_SIZE];
+        ids[i] = le_to_uint32(entry);
+        event_payload_decode(&entry[4], &events[i]);
+    }
+
+    return (int)count;
+}
+
+// Marshalls the commands of n ovens into a single command batch frame
+// Returns frame size on success, -1 on error
+int marshall_command_batch_frame(const uint32_t *ids,
+                                 const CommandPayload *cmds,
+                                 size_t n,
+                                 uint8_t *buffer,
+                                 size_t buffer_size)
+{
+    if ((n > 0 && (!ids || !cmds)) || !buffer)
+    {
+        return -1;
+    }
+
+    if (n > COMMAND_BATCH_MAX_COMMANDS)
+    {
+        count_error(too_many_events);
+        return -1;
+    }
+
+    size_t payload_size = 2 + n * COMMAND_BATCH_ENTRY_SIZE;
+    size_t frame_size = COMMAND_BATCH_FRAME_SIZE(n);
+    if (buffer_size < frame_size)
+    {
+        count_error(buffer_too_small);
+        return -1;
+    }
+
+    // Build frame header
+    buffer[0] = MSG_TYPE_COMMAND_BATCH;
+    uint16_to_le((uint16_t)payload_size, &buffer[1]);
+
+    // Build payload: count (2), then one entry per oven
+    uint8_t *payload = &buffer[3];
+    uint16_to_le((uint16_t)n, payload);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t *entry = &payload[2 + i * COMMAND_BATCH_ENTRY_SIZE];
+        uint32_to_le(ids[i], entry);
+        command_payload_encode(&cmds[i], &entry[4]);
+    }
+
+    // Calculate and append CRC
+    uint16_t crc = crc16_usb_fast(buffer, 3 + payload_size);
+    uint16_to_le(crc, &buffer[3 + payload_size]);
+
+    return (int)frame_size;
+}
+
+// Checks a command batch frame and points entries to its first entry
+// Returns the number of commands on success, -1 on error
+int command_batch_frame_entries(const uint8_t *data, size_t len, const uint8_t **entries)
+{
+    if (!data || !entries || len < COMMAND_BATCH_FRAME_SIZE(0))
+    {
+        return -1;
+    }
+
+    // Extract frame header
+    uint8_t msg_type = data[0];
+    uint16_t payload_size = le_to_uint16(&data[1]);
+    uint16_t count = le_to_uint16(&data[3]);
+
+    if (msg_type != MSG_TYPE_COMMAND_BATCH)
+    {
+        count_error(invalid_type);
+        return -1;
+    }
+
+    if (count > COMMAND_BATCH_MAX_COMMANDS ||
+        payload_size != 2 + count * COMMAND_BATCH_ENTRY_SIZE)
+    {
+        count_error(invalid_size);
+        return -1;
+    }
+
+    size_t expected_len = 1 + 2 + (size_t)payload_size + 2;
+    if (len < expected_len)
+    {
+        count_error(truncated);
+        return -1;
+    }
+
+    // Verify CRC
+    uint16_t received_crc = le_to_uint16(&data[3 + payload_size]);
+    uint16_t calculated_crc = crc16_usb_fast(data, 3 + (size_t)payload_size);
+    if (received_crc != calculated_crc)
+    {
+        count_error(crc_mismatch);
+        return -1;
+    }
+
+    *entries = &data[5];
+    return (int)count;
+}
+
+// Decodes one entry of a checked command batch frame
+void command_batch_entry(const uint8_t *entries, size_t i, uint32_t *id, CommandPayload *cmd)
+{
+    const uint8_t *entry = &entries[i * COMMAND_BATCH_ENTRY_SIZE];
+    *id = le_to_uint32(entry);
+    command_payload_decode(&entry[4], cmd);
+}
+
+// The field bits of the delta payloads are those of the schema
+_Static_assert(EVENT_FIELD_STATE == MESSAGE_FIELD_BIT(event_payload, state), "delta field bits");
+_Static_assert(EVENT_FIELD_CURRENT_TEMPERATURE ==
+                   MESSAGE_FIELD_BIT(event_payload, current_temperature),
+               "delta field bits");
+_Static_assert(EVENT_FIELD_REMAINING_TIME == MESSAGE_FIELD_BIT(event_payload, remaining_time),
+               "delta field bits");
+_Static_assert(EVENT_FIELD_PROGRAMMED_DURATION ==
+                   MESSAGE_FIELD_BIT(event_payload, programmed_duration),
+               "delta field bits");
+_Static_assert(EVENT_FIELD_PROGRAMMED_TEMPERATURE ==
+                   MESSAGE_FIELD_BIT(event_payload, programmed_temperature),
+               "delta field bits");
+_Static_assert(EVENT_FIELDS_ALL == (1u << event_payload_field_count) - 1, "delta field bits");
+
+uint8_t event_changed_fields(const EventPayload *previous, const EventPayload *current)
+{
+    return event_payload_changed_fields(previous, current);
+}
+
+// Writes the field mask and the selected fields of an event
+// Returns the number of bytes written, at most 1 + sizeof(EventPayload)
+static size_t encode_event_delta(const EventPayload *event, uint8_t fields, uint8_t *out)
+{
+    out[0] = fields;
+    return 1 + event_payload_encode_fields(event, fields, &out[1]);
+}
+
+// Marshalls the given fields of an event into an event delta frame
+// Returns frame size on success, -1 on error
+int marshall_event_delta_frame(
+    const EventPayload *event, uint8_t fields, uint8_t *buffer, size_t buffer_size)
+{
+    if (!event || !buffer || (fields & ~EVENT_FIELDS_ALL))
+    {
+        return -1;
+    }
+
+    if (buffer_size < EVENT_DELTA_FRAME_MAX_SIZE)
+    {
+        count_error(buffer_too_small);
+        return -1;
+    }
+
+    size_t payload_size = encode_event_delta(event, fields, &buffer[3]);
+    buffer[0] = MSG_TYPE_EVENT_DELTA;
+    uint16_to_le((uint16_t)payload_size, &buffer[1]);
+
+    // Calculate and append CRC
+    uint16_t crc = crc16_usb_fast(buffer, 3 + payload_size);
+    uint16_to_le(crc, &buffer[3 + payload_size]);
+
+    return (int)(3 + payload_size + 2);
+}
+
+// Marshalls the deltas of n ovens into a single event delta batch frame
+// Returns frame size on success, -1 on error
+int marshall_event_delta_batch_frame(const uint32_t *ids,
+                                     const EventPayload *events,
+                                     const uint8_t *fields,
+                                     size_t n,
+                                     uint8_t *buffer,
+                                     size_t buffer_size)
+{
+    if ((n > 0 && (!ids || !events || !fields)) || !buffer)
+    {
+        return -1;
+    }
+
+    if (n > EVENT_BATCH_MAX_EVENTS)
+    {
+        count_error(too_many_events);
+        return -1;
+    }
+
+    // Checked against the largest possible entries, so that encoding cannot run out of room
+    size_t max_size = EVENT_DELTA_BATCH_FRAME_MAX_SIZE(n);
+    if (buffer_size < max_size)
+    {
+        count_error(buffer_too_small);
+        return -1;
+    }
+
+    // Build payload: count (2), then one entry per oven
+    uint8_t *payload = &buffer[3];
+    size_t payload_size = 2;
+    uint16_to_le((uint16_t)n, payload);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (fields[i] & ~EVENT_FIELDS_ALL)
+        {
+            return -1;
+        }
+        uint32_to_le(ids[i], &payload[payload_size]);
+        payload_size += 4;
+        payload_size += encode_event_delta(&events[i], fields[i], &payload[payload_size]);
+    }
+
+    // Build frame header
+    buffer[0] = MSG_TYPE_EVENT_DELTA_BATCH;
+    uint16_to_le((uint16_t)payload_size, &buffer[1]);
+
+    // Calculate and append CRC
+    uint16_t crc = crc16_usb_fast(buffer, 3 + payload_size);
+    uint16_to_le(crc, &buffer[3 + payload_size]);
+
+    return (int)(3 + payload_size + 2);
+}
+
+// On little-endian hosts the packed CommandPayload has exactly the wire layout of the payload,
+// so decoded commands can point into the input instead of being copied out of it
+#ifdef MESSAGES_LITTLE_ENDIAN
+#define PROTOCOL_ZERO_COPY 1
+#endif
+
+typedef enum {
+    FRAME_VALID,
+    FRAME_INCOMPLETE,
+    FRAME_BAD_HEADER,
+    FRAME_BAD_CRC
+} FrameCheck;
+
+// Checks the command frame at the start of data, using only the len bytes available
+static FrameCheck check_command_frame(const uint8_t *data, size_t len)
+{
+    if (len >= 1 && data[0] != MSG_TYPE_COMMAND)
+    {
+        return FRAME_BAD_HEADER;
+    }
+    if (len >= 3 && le_to_uint16(&data[1]) != sizeof(CommandPayload))
+    {
+        return FRAME_BAD_HEADER;
+    }
+    if (len < COMMAND_FRAME_SIZE)
+    {
+        return FRAME_INCOMPLETE;
+    }
+    if (le_to_uint16(&data[COMMAND_FRAME_SIZE - 2]) !=
+        crc16_usb_fast(data, COMMAND_FRAME_SIZE - 2))
+    {
+        return FRAME_BAD_CRC;
+    }
+    return FRAME_VALID;
+}
+
+// Returns the command of a valid frame, in place when the host layout allows it
+static const CommandPayload *frame_decoder_command(FrameDecoder *decoder, const uint8_t *frame)
+{
+    decoder->frames++;
+    decoder->in_sync = 1;
+
+#ifdef PROTOCOL_ZERO_COPY
+    return (const CommandPayload *)&frame[3];
+#else
+    command_payload_decode(&frame[3], &decoder->scratch);
+    return &decoder->scratch;
+#endif
+}
+
+// Accounts for a frame start that turned out to be invalid
+// Only the first error after a valid frame is counted as a header error; while resynchronizing,
+// every non-header byte would otherwise count as one
+static void frame_decoder_reject(FrameDecoder *decoder, FrameCheck check)
+{
+    if (check == FRAME_BAD_CRC)
+    {
+        decoder->crc_errors++;
+    }
+    else if (decoder->in_sync)
+    {
+        decoder->header_errors++;
+    }
+    decoder->in_sync = 0;
 }
+
+void frame_decoder_init(FrameDecoder *decoder)
+{
+    if (!decoder)
+    {
+        return;
+    }
+
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->in_sync = 1;
+}
+
+void frame_decoder_feed(FrameDecoder *decoder, const uint8_t *data, size_t len)
+{
+    if (!decoder)
+    {
+        return;
+    }
+
+    decoder->chunk = data;
+    decoder->chunk_len = data ? len : 0;
+    decoder->pos = 0;
+}
+
+// Finishes the frame carried over from the previous chunk
+// Returns 1 with *cmd set once it is complete and valid, 0 when the chunk ran out before that
+// or the carried bytes were all discarded
+static int frame_decoder_next_carried(FrameDecoder *decoder, const CommandPayload **cmd)
+{
+    while (decoder->carry_len > 0)
+    {
+        size_t take = COMMAND_FRAME_SIZE - decoder->carry_len;
+        if (take > decoder->chunk_len - decoder->pos)
+        {
+            take = decoder->chunk_len - decoder->pos;
+        }
+        memcpy(&decoder->carry[decoder->carry_len], &decoder->chunk[decoder->pos], take);
+        decoder->carry_len += take;
+        decoder->pos += take;
+
+        FrameCheck check = check_command_frame(decoder->carry, decoder->carry_len);
+        if (check == FRAME_INCOMPLETE)
+        {
+            return 0;
+        }
+        if (check == FRAME_VALID)
+        {
+            decoder->carry_len = 0;
+            *cmd = frame_decoder_command(decoder, decoder->carry);
+            return 1;
+        }
+
+        // Drop the bad header byte and everything up to the next candidate header
+        frame_decoder_reject(decoder, check);
+        size_t skip = 1;
+        while (skip < decoder->carry_len && decoder->carry[skip] != MSG_TYPE_COMMAND)
+        {
+            skip++;
+        }
+        decoder->bytes_skipped += skip;
+        decoder->carry_len -= skip;
+        memmove(decoder->carry, &decoder->carry[skip], decoder->carry_len);
+    }
+
+    return 0;
+}
+
+int frame_decoder_next(FrameDecoder *decoder, const CommandPayload **cmd)
+{
+    if (!decoder || !cmd)
+    {
+        return 0;
+    }
+
+    if (decoder->carry_len > 0 && frame_decoder_next_carried(decoder, cmd))
+    {
+        return 1;
+    }
+
+    while (decoder->pos < decoder->chunk_len)
+    {
+        const uint8_t *frame = &decoder->chunk[decoder->pos];
+        size_t available = decoder->chunk_len - decoder->pos;
+
+        FrameCheck check = check_command_frame(frame, available);
+        if (check == FRAME_VALID)
+        {
+            decoder->pos += COMMAND_FRAME_SIZE;
+            *cmd = frame_decoder_command(decoder, frame);
+            return 1;
+        }
+
+        if (check == FRAME_INCOMPLETE)
+        {
+            // Keep the partial frame until the next chunk completes it
+            memcpy(decoder->carry, frame, available);
+            decoder->carry_len = available;
+            decoder->pos = decoder->chunk_len;
+            return 0;
+        }
+
+        // Resynchronize on the next byte that can start a frame
+        frame_decoder_reject(decoder, check);
+        const uint8_t *next = memchr(frame + 1, MSG_TYPE_COMMAND, available - 1);
+        size_t skip = next ? (size_t)(next - frame) : available;
+        decoder->bytes_skipped += skip;
+        decoder->pos += skip;
+    }
+
+    return 0;
+}
+
@@ -8,9 +8,47 @@
 // Message type identifiers
 #define MSG_TYPE_COMMAND  0x01
 #define MSG_TYPE_EVENT    0x02
+#define MSG_TYPE_EVENT_BATCH 0x03
+#define MSG_TYPE_EVENT_DELTA 0x04
+#define MSG_TYPE_EVENT_DELTA_BATCH 0x05
+#define MSG_TYPE_COMMAND_BATCH 0x06
 
 #define MAX_PAYLOAD_SIZE  32
 
+// Size of complete frames: msg_type (1) + size (2) + payload + crc (2)
+#define COMMAND_FRAME_SIZE (1 + 2 + sizeof(CommandPayload) + 2)
+#define EVENT_FRAME_SIZE   (1 + 2 + sizeof(EventPayload) + 2)
+
+// Event batch payload (little-endian): the events of many ovens under a single CRC
+// [count:2] followed by count entries of [oven_id:4][event:sizeof(EventPayload)]
+#define EVENT_BATCH_ENTRY_SIZE (4 + sizeof(EventPayload))
+#define EVENT_BATCH_MAX_EVENTS 4096
+#define MAX_BATCH_PAYLOAD_SIZE (2 + EVENT_BATCH_MAX_EVENTS * EVENT_BATCH_ENTRY_SIZE)
+#define EVENT_BATCH_FRAME_SIZE(n) (1 + 2 + 2 + (size_t)(n) * EVENT_BATCH_ENTRY_SIZE + 2)
+
+// Command batch payload (little-endian): the commands of many ovens under a single CRC
+// [count:2] followed by count entries of [oven_id:4][command:sizeof(CommandPayload)]
+#define COMMAND_BATCH_ENTRY_SIZE (4 + sizeof(CommandPayload))
+#define COMMAND_BATCH_MAX_COMMANDS 4096
+#define COMMAND_BATCH_FRAME_SIZE(n) (1 + 2 + 2 + (size_t)(n) * COMMAND_BATCH_ENTRY_SIZE + 2)
+
+// Event delta payload (little-endian): [fields:1] followed by only the fields whose bit is set,
+// in EventPayload order. A delta with EVENT_FIELDS_ALL carries the whole event
+#define EVENT_FIELD_STATE                  0x01
+#define EVENT_FIELD_CURRENT_TEMPERATURE    0x02
+#define EVENT_FIELD_REMAINING_TIME         0x04
+#define EVENT_FIELD_PROGRAMMED_DURATION    0x08
+#define EVENT_FIELD_PROGRAMMED_TEMPERATURE 0x10
+#define EVENT_FIELDS_ALL                   0x1F
+
+// Largest frames, with every field present
+#define EVENT_DELTA_FRAME_MAX_SIZE (1 + 2 + 1 + sizeof(EventPayload) + 2)
+
+// Event delta batch payload: [count:2] followed by count entries of [oven_id:4][delta]
+#define EVENT_DELTA_BATCH_ENTRY_MAX_SIZE (4 + 1 + sizeof(EventPayload))
+#define EVENT_DELTA_BATCH_FRAME_MAX_SIZE(n)                                                        \
+    (1 + 2 + 2 + (size_t)(n) * EVENT_DELTA_BATCH_ENTRY_MAX_SIZE + 2)
+
 // Frame structure (little-endian)
 // [msg_type:1][size:2][payload:size][crc:2]
 // The CRC is calculated over msg_type, size, and payload and uses CRC-16/USB
@@ -21,8 +59,35 @@ typedef struct __attribute__((packed)) {
     uint16_t crc;
 } Frame;
 
+// Reference CRC-16/USB implementation, one bit at a time
 uint16_t crc16_usb(const uint8_t *data, size_t length);
 
+// Faster CRC-16/USB implementations, all bit-identical to crc16_usb
+// crc16_usb_table processes one byte per lookup, crc16_usb_slice8 eight bytes per step and
+// crc16_usb_clmul uses carry-less multiplication (PCLMULQDQ on x86-64, PMULL on AArch64)
+uint16_t crc16_usb_table(const uint8_t *data, size_t length);
+uint16_t crc16_usb_slice8(const uint8_t *data, size_t length);
+uint16_t crc16_usb_clmul(const uint8_t *data, size_t length);
+
+// Returns 1 if the CPU supports crc16_usb_clmul, 0 otherwise
+// When it returns 0, crc16_usb_clmul falls back to crc16_usb_slice8
+int crc16_usb_clmul_supported(void);
+
+// Fastest implementation available on this CPU, selected once at startup
+// This is the implementation used by the frame codec
+uint16_t crc16_usb_fast(const uint8_t *data, size_t length);
+
+// Name of the implementation behind crc16_usb_fast ("clmul" or "slice8")
+const char *crc16_usb_fast_name(void);
+
+// Computes the CRC of n independent buffers in one call: crcs[i] = crc16_usb(data[i], lengths[i])
+// The buffers are processed four at a time so that their table lookups overlap
+void crc16_usb_multi(const uint8_t *const *data, const size_t *lengths, size_t n, uint16_t *crcs);
+
+// Marshalls a command frame from command payload structure to raw bytes
+// Returns frame size (COMMAND_FRAME_SIZE) on success, -1 on error
+int marshall_command_frame(const CommandPayload *cmd, uint8_t *buffer, size_t buffer_size);
+
 // Unmarshalls a command frame from raw bytes to a CommandPayload structure
 // Returns 0 on success, -1 on error
 int unmarshall_command_frame(const uint8_t *data, size_t len, CommandPayload *cmd);
@@ -31,7 +96,111 @@ int unmarshall_command_frame(const uint8_t *data, size_t len, CommandPayload *cm
 // Returns frame size on success, -1 on error
 int marshall_event_frame(const EventPayload *event, uint8_t *buffer, size_t buffer_size);
 
-// Helper to print frame in hex format (for debugging)
-void print_frame_hex(const uint8_t *data, size_t len);
+// Marshalls n event frames back-to-back into one buffer of buffer_size bytes
+// The capacity is checked once for the whole batch, so the frames are encoded without any
+// per-frame error handling. If offsets is not NULL, offsets[i] receives the position of frame i
+// Returns the total size (n * EVENT_FRAME_SIZE) on success, -1 on error
+int marshall_event_frames(
+    const EventPayload *events, size_t n, uint8_t *buffer, size_t buffer_size, size_t *offsets);
+
+// Marshalls the events of n ovens into a single event batch frame
+// events[i] is the event of the oven with id ids[i]; n must not exceed EVENT_BATCH_MAX_EVENTS
+// Returns frame size (EVENT_BATCH_FRAME_SIZE(n)) on success, -1 on error
+int marshall_event_batch_frame(
+    const uint32_t *ids, const EventPayload *events, size_t n, uint8_t *buffer, size_t buffer_size);
+
+// Unmarshalls an event batch frame into ids and events, which have room for max_events entries
+// Returns the number of events on success, -1 on error
+int unmarshall_event_batch_frame(
+    const uint8_t *data, size_t len, uint32_t *ids, EventPayload *events, size_t max_events);
+
+// Marshalls the commands of n ovens into a single command batch frame
+// cmds[i] is the command of the oven with id ids[i]; n must not exceed COMMAND_BATCH_MAX_COMMANDS
+// Returns frame size (COMMAND_BATCH_FRAME_SIZE(n)) on success, -1 on error
+int marshall_command_batch_frame(const uint32_t *ids,
+                                 const CommandPayload *cmds,
+                                 size_t n,
+                                 uint8_t *buffer,
+                                 size_t buffer_size);
+
+// Checks the header and CRC of a command batch frame without copying its entries out
+// On success *entries points to the first entry, to be decoded with command_batch_entry
+// Returns the number of commands on success, -1 on error
+int command_batch_frame_entries(const uint8_t *data, size_t len, const uint8_t **entries);
+
+// Decodes entry i of the entries of a checked command batch frame
+void command_batch_entry(const uint8_t *entries, size_t i, uint32_t *id, CommandPayload *cmd);
+
+// Returns the EVENT_FIELD_* bits of the fields that differ between previous and current
+uint8_t event_changed_fields(const EventPayload *previous, const EventPayload *current);
+
+// Marshalls the given fields of an event into an event delta frame
+// Returns frame size on success, -1 on error
+int marshall_event_delta_frame(
+    const EventPayload *event, uint8_t fields, uint8_t *buffer, size_t buffer_size);
+
+// Marshalls the deltas of n ovens into a single event delta batch frame
+// Entry i carries the fields[i] fields of events[i], for the oven with id ids[i]
+// n must not exceed EVENT_BATCH_MAX_EVENTS
+// Returns frame size on success, -1 on error
+int marshall_event_delta_batch_frame(const uint32_t *ids,
+                                     const EventPayload *events,
+                                     const uint8_t *fields,
+                                     size_t n,
+                                     uint8_t *buffer,
+                                     size_t buffer_size);
+
+// Incremental decoder for a stream of concatenated command frames
+// Chunks of any size are fed in order; frames may span chunk boundaries and a chunk may hold
+// any number of frames. Bytes that do not form a valid frame (bad type, size or CRC) are
+// skipped until the next plausible frame header
+typedef struct {
+    const uint8_t *chunk;
+    size_t chunk_len;
+    size_t pos;
+
+    // Start of a frame that continues in the next chunk
+    uint8_t carry[COMMAND_FRAME_SIZE];
+    size_t carry_len;
+
+    // Decoded copy of the last command when it cannot be returned in place
+    CommandPayload scratch;
+    int in_sync;
+
+    // Counters
+    uint64_t frames;
+    uint64_t header_errors;
+    uint64_t crc_errors;
+    uint64_t bytes_skipped;
+} FrameDecoder;
+
+void frame_decoder_init(FrameDecoder *decoder);
+
+// Hands the next chunk of the stream to the decoder
+// The previous chunk must have been drained with frame_decoder_next, and data must stay valid
+// until this chunk is drained in turn
+void frame_decoder_feed(FrameDecoder *decoder, const uint8_t *data, size_t len);
+
+// Decodes the next command of the current chunk
+// On little-endian hosts *cmd points straight into the chunk (or into the decoder for a frame
+// that spanned two chunks); it stays valid until the next call
+// Returns 1 when a command was decoded, 0 when the chunk is drained
+int frame_decoder_next(FrameDecoder *decoder, const CommandPayload **cmd);
+
+// Errors of the codec functions, counted rather than logged so that bad input costs no I/O
+// on the hot path. The frame decoder keeps its own counters
+typedef struct {
+    uint64_t invalid_type;
+    uint64_t invalid_size;
+    uint64_t truncated;
+    uint64_t crc_mismatch;
+    uint64_t buffer_too_small;
+    uint64_t too_many_events;
+} ProtocolErrors;
+
+// Copies the error counters of the codec, which are updated by every thread
+void protocol_errors(ProtocolErrors *errors);
+
+void protocol_errors_reset(void);
 
 #endif /* PROTOCOL_H */
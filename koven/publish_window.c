@@ -0,0 +1,78 @@
+#include "publish_window.h"
+
+void publish_window_init(PublishWindow *window, size_t limit)
+{
+    if (!window)
+    {
+        return;
+    }
+
+    window->limit = limit;
+    atomic_init(&window->in_flight, 0);
+    atomic_init(&window->delivered, 0);
+    atomic_init(&window->dropped, 0);
+}
+
+int publish_window_acquire(PublishWindow *window)
+{
+    if (!window)
+    {
+        return -1;
+    }
+
+    size_t in_flight = atomic_load(&window->in_flight);
+    do
+    {
+        if (in_flight >= window->limit)
+        {
+            atomic_fetch_add(&window->dropped, 1);
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&window->in_flight, &in_flight, in_flight + 1));
+
+    return 0;
+}
+
+// Releases one slot, ignoring releases that were never acquired
+static int publish_window_release(PublishWindow *window)
+{
+    size_t in_flight = atomic_load(&window->in_flight);
+    do
+    {
+        if (in_flight == 0)
+        {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&window->in_flight, &in_flight, in_flight - 1));
+
+    return 0;
+}
+
+void publish_window_cancel(PublishWindow *window)
+{
+    if (window)
+    {
+        publish_window_release(window);
+    }
+}
+
+void publish_window_complete(PublishWindow *window)
+{
+    if (window && publish_window_release(window) == 0)
+    {
+        atomic_fetch_add(&window->delivered, 1);
+    }
+}
+
+void publish_window_reset(PublishWindow *window)
+{
+    if (window)
+    {
+        atomic_store(&window->in_flight, 0);
+    }
+}
+
+size_t publish_window_in_flight(PublishWindow *window)
+{
+    return window ? atomic_load(&window->in_flight) : 0;
+}
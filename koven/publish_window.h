@@ -0,0 +1,39 @@
+#ifndef PUBLISH_WINDOW_H
+#define PUBLISH_WINDOW_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded window of publishes waiting for their delivery to complete
+// The tick loop takes a slot before every publish and the delivery callback of the MQTT client
+// gives it back, so the loop never waits on the broker: when the window is full the publish is
+// dropped instead. Slots are counted with atomics since the two sides run on different threads
+typedef struct {
+    size_t limit;
+    atomic_size_t in_flight;
+
+    // Counters
+    atomic_uint_fast64_t delivered;
+    atomic_uint_fast64_t dropped;
+} PublishWindow;
+
+void publish_window_init(PublishWindow *window, size_t limit);
+
+// Takes a slot for a new publish
+// Returns 0 on success, -1 when limit publishes are already in flight (counted as dropped)
+int publish_window_acquire(PublishWindow *window);
+
+// Gives back a slot whose publish could not be started
+void publish_window_cancel(PublishWindow *window);
+
+// Gives back the slot of a publish whose delivery completed
+void publish_window_complete(PublishWindow *window);
+
+// Forgets every publish in flight, whose delivery will never complete once the session they
+// belonged to is gone
+void publish_window_reset(PublishWindow *window);
+
+size_t publish_window_in_flight(PublishWindow *window);
+
+#endif /* PUBLISH_WINDOW_H */
@@ -0,0 +1,311 @@
+#include "recording.h"
+#include <stdlib.h>
+#include <string.h>
+
+// stdio buffer of a recorder
+#define RECORDER_BUFFER_SIZE (1024 * 1024)
+
+static void store_u32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void store_u64(uint8_t *out, uint64_t value)
+{
+    store_u32(out, (uint32_t)value);
+    store_u32(&out[4], (uint32_t)(value >> 32));
+}
+
+static uint32_t load_u32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+           ((uint32_t)in[3] << 24);
+}
+
+static uint64_t load_u64(const uint8_t *in)
+{
+    return (uint64_t)load_u32(in) | ((uint64_t)load_u32(&in[4]) << 32);
+}
+
+// Writes value as a LEB128 varint
+// Returns the number of bytes written, at most 10
+static size_t store_varint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Reads a LEB128 varint of at most 10 bytes
+// Returns the number of bytes read, 0 when it is truncated or too long
+static size_t load_varint(const uint8_t *in, size_t len, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t n = 0; n < len && n < 10; n++)
+    {
+        result |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80))
+        {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+int recorder_open(Recorder *recorder, const char *path, uint32_t first_id, uint64_t count)
+{
+    if (!recorder || !path || count == 0)
+    {
+        return -1;
+    }
+
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->first_id = first_id;
+    recorder->count = count;
+
+    recorder->file = fopen(path, "wb");
+    recorder->buffer = malloc(RECORDER_BUFFER_SIZE);
+    if (!recorder->file || !recorder->buffer)
+    {
+        if (recorder->file)
+        {
+            fclose(recorder->file);
+        }
+        free(recorder->buffer);
+        recorder->file = NULL;
+        return -1;
+    }
+    setvbuf(recorder->file, recorder->buffer, _IOFBF, RECORDER_BUFFER_SIZE);
+
+    uint8_t header[RECORDING_HEADER_SIZE] = {0};
+    memcpy(header, RECORDING_MAGIC, 8);
+    store_u32(&header[8], RECORDING_VERSION);
+    store_u32(&header[12], first_id);
+    store_u64(&header[16], count);
+
+    if (fwrite(header, sizeof(header), 1, recorder->file) != 1)
+    {
+        recorder->failed = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Appends one record whose frame is already encoded
+static int recorder_append(Recorder *recorder,
+                           uint8_t kind,
+                           uint64_t tick,
+                           uint32_t id,
+                           const uint8_t *frame,
+                           size_t len)
+{
+    if (!recorder->file || recorder->failed || tick < recorder->tick || id < recorder->first_id ||
+        id - recorder->first_id >= recorder->count)
+    {
+        return -1;
+    }
+
+    uint8_t record[RECORD_MAX_SIZE];
+    size_t n = 0;
+    record[n++] = kind;
+    n += store_varint(&record[n], tick - recorder->tick);
+    n += store_varint(&record[n], id - recorder->first_id);
+    memcpy(&record[n], frame, len);
+    n += len;
+
+    if (fwrite(record, n, 1, recorder->file) != 1)
+    {
+        recorder->failed = 1;
+        return -1;
+    }
+
+    recorder->tick = tick;
+    return 0;
+}
+
+int recorder_command(Recorder *recorder, uint64_t tick, uint32_t id, const CommandPayload *cmd)
+{
+    uint8_t frame[COMMAND_FRAME_SIZE];
+    if (!recorder || marshall_command_frame(cmd, frame, sizeof(frame)) < 0 ||
+        recorder_append(recorder, RECORD_COMMAND, tick, id, frame, sizeof(frame)) != 0)
+    {
+        return -1;
+    }
+
+    recorder->commands++;
+    return 0;
+}
+
+int recorder_event(Recorder *recorder, uint64_t tick, uint32_t id, const EventPayload *event)
+{
+    uint8_t frame[EVENT_FRAME_SIZE];
+    if (!recorder || marshall_event_frame(event, frame, sizeof(frame)) < 0 ||
+        recorder_append(recorder, RECORD_EVENT, tick, id, frame, sizeof(frame)) != 0)
+    {
+        return -1;
+    }
+
+    recorder->events++;
+    return 0;
+}
+
+int recorder_initial_state(Recorder *recorder, const KovenFleet *fleet)
+{
+    if (!recorder || !fleet)
+    {
+        return -1;
+    }
+
+    Koven initial;
+    koven_init(&initial);
+
+    for (size_t i = 0; i < fleet->count; i++)
+    {
+        Koven koven;
+        fleet_get(fleet, i, &koven);
+        if (memcmp(&koven, &initial, sizeof(koven)) == 0)
+        {
+            continue;
+        }
+
+        EventPayload event;
+        event.state = (uint8_t)koven.state;
+        event.current_temperature = koven.current_temperature;
+        event.remaining_time = koven.remaining_time;
+        event.programmed_duration = koven.programmed_duration;
+        event.programmed_temperature = koven.programmed_temperature;
+        if (recorder_event(recorder, 0, fleet->first_id + (uint32_t)i, &event) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int recorder_close(Recorder *recorder)
+{
+    if (!recorder || !recorder->file)
+    {
+        return -1;
+    }
+
+    int failed = recorder->failed;
+    if (fclose(recorder->file) != 0)
+    {
+        failed = 1;
+    }
+    free(recorder->buffer);
+    recorder->file = NULL;
+    recorder->buffer = NULL;
+
+    return failed ? -1 : 0;
+}
+
+int recording_cursor_init(RecordingCursor *cursor, const uint8_t *data, size_t len)
+{
+    if (!cursor || !data || len < RECORDING_HEADER_SIZE ||
+        memcmp(data, RECORDING_MAGIC, 8) != 0 || load_u32(&data[8]) != RECORDING_VERSION ||
+        load_u64(&data[16]) == 0)
+    {
+        return -1;
+    }
+
+    cursor->data = data;
+    cursor->len = len;
+    cursor->pos = RECORDING_HEADER_SIZE;
+    cursor->header.version = load_u32(&data[8]);
+    cursor->header.first_id = load_u32(&data[12]);
+    cursor->header.count = load_u64(&data[16]);
+    cursor->tick = 0;
+
+    return 0;
+}
+
+int recording_cursor_next(RecordingCursor *cursor, Record *record)
+{
+    if (cursor->pos == cursor->len)
+    {
+        return 0;
+    }
+
+    const uint8_t *in = &cursor->data[cursor->pos];
+    size_t left = cursor->len - cursor->pos;
+    uint8_t kind = in[0];
+    size_t frame_len = kind == RECORD_COMMAND ? COMMAND_FRAME_SIZE
+                       : kind == RECORD_EVENT ? EVENT_FRAME_SIZE
+                                              : 0;
+    if (frame_len == 0)
+    {
+        return -1;
+    }
+
+    uint64_t delta;
+    uint64_t oven;
+    size_t n = 1;
+    size_t used = load_varint(&in[n], left - n, &delta);
+    if (used == 0)
+    {
+        return -1;
+    }
+    n += used;
+    used = load_varint(&in[n], left - n, &oven);
+    if (used == 0 || oven >= cursor->header.count || left - n - used < frame_len)
+    {
+        return -1;
+    }
+    n += used;
+
+    cursor->tick += delta;
+    record->kind = kind;
+    record->tick = cursor->tick;
+    record->id = cursor->header.first_id + (uint32_t)oven;
+    record->frame = &in[n];
+    record->len = frame_len;
+    cursor->pos += n + frame_len;
+
+    return 1;
+}
+
+int recording_load(const char *path, uint8_t **data, size_t *len)
+{
+    if (!path || !data || !len)
+    {
+        return -1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return -1;
+    }
+
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+        size = ftell(file);
+    }
+    uint8_t *buffer = size >= 0 ? malloc(size > 0 ? (size_t)size : 1) : NULL;
+    if (!buffer || fseek(file, 0, SEEK_SET) != 0 ||
+        fread(buffer, 1, (size_t)size, file) != (size_t)size)
+    {
+        free(buffer);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+    *data = buffer;
+    *len = (size_t)size;
+    return 0;
+}
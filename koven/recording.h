@@ -0,0 +1,103 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "fleet.h"
+#include "protocol.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Capture logs of the traffic of a run, for a deterministic replay (see replay.h)
+// A log starts with a header naming the ovens of the run, followed by one record per command
+// frame received and per event frame emitted, in the order of their ticks:
+// [kind:1][tick delta:varint][oven:varint][frame]
+// The tick delta is counted from the previous record and the oven is its offset from the first
+// id of the header; varints are LEB128. Frames are protocol frames of COMMAND_FRAME_SIZE or
+// EVENT_FRAME_SIZE bytes, events always as full event frames whatever the event mode
+// Ticks are numbered from 1: a command of tick n is applied right before the n-th tick of its
+// oven and an event of tick n is the one of the n-th tick. Events of tick 0 hold the state of
+// ovens that did not start idle, e.g. after a snapshot was restored
+#define RECORDING_MAGIC "KOVENREC"
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_SIZE 32
+
+#define RECORD_COMMAND 0x01
+#define RECORD_EVENT 0x02
+
+// Largest record: kind, two 10-byte varints and a frame
+#define RECORD_MAX_SIZE (1 + 10 + 10 + EVENT_FRAME_SIZE)
+
+typedef struct {
+    uint32_t version;
+    uint32_t first_id;
+    uint64_t count;
+} RecordingHeader;
+
+// Appends records to a log file through a large stdio buffer, so that a tick costs at most a
+// few write calls
+typedef struct {
+    FILE *file;
+    char *buffer;
+    uint32_t first_id;
+    uint64_t count;
+    uint64_t tick;
+    int failed;
+
+    // Counters
+    uint64_t commands;
+    uint64_t events;
+} Recorder;
+
+// Creates the log at path, replacing any previous one, for the ovens first_id to
+// first_id + count - 1
+// Returns 0 on success, -1 on error
+int recorder_open(Recorder *recorder, const char *path, uint32_t first_id, uint64_t count);
+
+// Appends a command frame received for oven id and applied before tick
+// Ticks must never decrease from one record to the next
+// Returns 0 on success, -1 on error (the log stops at the first error)
+int recorder_command(Recorder *recorder, uint64_t tick, uint32_t id, const CommandPayload *cmd);
+
+// Appends the event frame emitted by oven id on tick
+// Returns 0 on success, -1 on error
+int recorder_event(Recorder *recorder, uint64_t tick, uint32_t id, const EventPayload *event);
+
+// Records the ovens of fleet that are not in their initial state as events of tick 0
+// Returns 0 on success, -1 on error
+int recorder_initial_state(Recorder *recorder, const KovenFleet *fleet);
+
+// Flushes and closes the log
+// Returns 0 when every record was written, -1 otherwise
+int recorder_close(Recorder *recorder);
+
+// One record of a log, whose frame points into the log
+typedef struct {
+    uint8_t kind;
+    uint64_t tick;
+    uint32_t id;
+    const uint8_t *frame;
+    size_t len;
+} Record;
+
+// Reads the records of a log held in memory
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    RecordingHeader header;
+    uint64_t tick;
+} RecordingCursor;
+
+// Parses the header of the log in data
+// Returns 0 on success, -1 when data is not a log of this version
+int recording_cursor_init(RecordingCursor *cursor, const uint8_t *data, size_t len);
+
+// Reads the next record
+// Returns 1 with a record, 0 at the end of the log, -1 on a malformed or truncated record
+int recording_cursor_next(RecordingCursor *cursor, Record *record);
+
+// Reads the whole file at path into memory, to be released with free
+// Returns 0 on success, -1 on error
+int recording_load(const char *path, uint8_t **data, size_t *len);
+
+#endif /* RECORDING_H */
@@ -0,0 +1,213 @@
+#include "replay.h"
+#include "fleet.h"
+#include "pending_command.h"
+#include "protocol.h"
+#include "recording.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SECOND 1000000000ull
+
+static uint64_t replay_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+// Fleet rebuilt from a log, with the commands waiting for their tick as in a shard
+typedef struct {
+    KovenFleet fleet;
+    EventPayload *events;
+    PendingCommand *pending;
+    uint64_t *active;
+    size_t *dirty;
+    size_t dirty_count;
+    uint64_t tick;
+} Replayer;
+
+static int replayer_init(Replayer *replayer, const RecordingHeader *header)
+{
+    memset(replayer, 0, sizeof(*replayer));
+    if (header->count > SIZE_MAX / sizeof(EventPayload) ||
+        fleet_init(&replayer->fleet, header->first_id, (size_t)header->count) != 0)
+    {
+        return -1;
+    }
+
+    replayer->events = malloc(replayer->fleet.count * sizeof(EventPayload));
+    replayer->pending = calloc(replayer->fleet.count, sizeof(PendingCommand));
+    replayer->dirty = malloc(replayer->fleet.count * sizeof(size_t));
+    replayer->active = malloc(fleet_active_words(&replayer->fleet) * sizeof(uint64_t));
+    if (!replayer->events || !replayer->pending || !replayer->dirty || !replayer->active)
+    {
+        free(replayer->events);
+        free(replayer->pending);
+        free(replayer->dirty);
+        free(replayer->active);
+        fleet_free(&replayer->fleet);
+        return -1;
+    }
+
+    // The first tick writes the event of every oven, and finds the blocks that are idle
+    fleet_mark_all_active(&replayer->fleet, replayer->active);
+
+    return 0;
+}
+
+static void replayer_free(Replayer *replayer)
+{
+    free(replayer->events);
+    free(replayer->pending);
+    free(replayer->dirty);
+    free(replayer->active);
+    fleet_free(&replayer->fleet);
+}
+
+// Runs the ticks up to tick, each one applying the commands pending for it first
+// Idle blocks are skipped as in the shards, and keep the events of their last tick
+static void replayer_advance(Replayer *replayer, uint64_t tick)
+{
+    while (replayer->tick < tick)
+    {
+        for (size_t d = 0; d < replayer->dirty_count; d++)
+        {
+            size_t index = replayer->dirty[d];
+            Koven koven;
+            fleet_get(&replayer->fleet, index, &koven);
+            pending_command_apply(&replayer->pending[index], &koven);
+            fleet_set(&replayer->fleet, index, &koven);
+            fleet_mark_active(replayer->active, index);
+        }
+        replayer->dirty_count = 0;
+
+        koven_tick_active(&replayer->fleet, replayer->active, replayer->events);
+        replayer->tick++;
+    }
+}
+
+// Queues a command frame for the tick of its record
+// Returns 0 when it was queued, 1 when the frame was rejected
+static int replayer_command(Replayer *replayer, const Record *record)
+{
+    CommandPayload cmd;
+    if (unmarshall_command_frame(record->frame, record->len, &cmd) != 0)
+    {
+        return 1;
+    }
+
+    size_t index = record->id - replayer->fleet.first_id;
+    // Listed once, when the slot gets its first command, as by the shards: unknown actions
+    // leave it empty
+    PendingCommand *slot = &replayer->pending[index];
+    uint8_t flags = slot->flags;
+    pending_command_add(slot, &cmd);
+    if (flags == 0 && slot->flags != 0)
+    {
+        replayer->dirty[replayer->dirty_count++] = index;
+    }
+    return 0;
+}
+
+// Compares a recorded event frame with the one the replay emitted on the same tick
+// Returns 0 when they match
+static int replayer_event(const Replayer *replayer, const Record *record)
+{
+    uint8_t frame[EVENT_FRAME_SIZE];
+    const EventPayload *event = &replayer->events[record->id - replayer->fleet.first_id];
+    if (marshall_event_frame(event, frame, sizeof(frame)) != (int)sizeof(frame))
+    {
+        return -1;
+    }
+    return memcmp(frame, record->frame, sizeof(frame)) == 0 ? 0 : -1;
+}
+
+// Sets an oven to the state of an event of tick 0
+// Returns 0 on success, -1 when the frame is not a valid event
+static int replayer_initial_state(Replayer *replayer, const Record *record)
+{
+    // The frame is valid when it encodes back to itself, header and CRC included
+    EventPayload event;
+    uint8_t frame[EVENT_FRAME_SIZE];
+    event_payload_decode(&record->frame[3], &event);
+    if (marshall_event_frame(&event, frame, sizeof(frame)) != (int)sizeof(frame) ||
+        memcmp(frame, record->frame, sizeof(frame)) != 0)
+    {
+        return -1;
+    }
+
+    if (event.state > STATE_COOLING_DOWN)
+    {
+        return -1;
+    }
+
+    Koven koven;
+    koven.state = (State)event.state;
+    koven.current_temperature = event.current_temperature;
+    koven.remaining_time = event.remaining_time;
+    koven.programmed_duration = event.programmed_duration;
+    koven.programmed_temperature = event.programmed_temperature;
+    fleet_set(&replayer->fleet, record->id - replayer->fleet.first_id, &koven);
+    return 0;
+}
+
+int replay_recording(const uint8_t *data, size_t len, ReplayResult *result)
+{
+    RecordingCursor cursor;
+    if (!result || recording_cursor_init(&cursor, data, len) != 0)
+    {
+        return -1;
+    }
+
+    Replayer replayer;
+    if (replayer_init(&replayer, &cursor.header) != 0)
+    {
+        return -1;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->ovens = cursor.header.count;
+
+    uint64_t start = replay_now_ns();
+    Record record;
+    int status;
+    while ((status = recording_cursor_next(&cursor, &record)) == 1)
+    {
+        if (record.kind == RECORD_COMMAND)
+        {
+            // A command of tick n is pending once tick n - 1 has run
+            if (record.tick == 0)
+            {
+                status = -1;
+                break;
+            }
+            replayer_advance(&replayer, record.tick - 1);
+            result->commands++;
+            result->rejected += (uint64_t)replayer_command(&replayer, &record);
+        }
+        else if (record.tick == 0)
+        {
+            if (replayer_initial_state(&replayer, &record) != 0)
+            {
+                status = -1;
+                break;
+            }
+        }
+        else
+        {
+            replayer_advance(&replayer, record.tick);
+            result->events++;
+            if (replayer_event(&replayer, &record) != 0 && result->mismatches++ == 0)
+            {
+                result->first_mismatch_tick = record.tick;
+                result->first_mismatch_id = record.id;
+            }
+        }
+    }
+    result->elapsed_ns = replay_now_ns() - start;
+    result->ticks = replayer.tick;
+
+    replayer_free(&replayer);
+    return status == 0 ? 0 : -1;
+}
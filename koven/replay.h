@@ -0,0 +1,34 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deterministic replay of a capture log (see recording.h)
+// The fleet of the log is rebuilt from idle ovens and its state of tick 0, then every command
+// frame goes through unmarshall_command_frame and the same per-oven coalescing as the emulator,
+// applied through koven_execute at its tick boundary, and the fleet is ticked as fast as possible
+// with the idle blocks skipped, as in the shards. Every recorded event is checked against the
+// event the replay emits on its tick, so a replay both verifies that a change leaves the emulator
+// deterministic and measures the throughput of the tick and command path on real traffic
+typedef struct {
+    uint64_t ovens;
+    uint64_t ticks;
+    uint64_t commands;
+    uint64_t rejected;
+    uint64_t events;
+    uint64_t mismatches;
+
+    // Tick and oven of the first event that did not match, when there is one
+    uint64_t first_mismatch_tick;
+    uint32_t first_mismatch_id;
+
+    uint64_t elapsed_ns;
+} ReplayResult;
+
+// Replays the log held in data
+// Returns 0 when the log was replayed, whatever its mismatches, -1 when it is malformed or
+// memory ran out
+int replay_recording(const uint8_t *data, size_t len, ReplayResult *result);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,110 @@
+#include "scheduler.h"
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#define NS_PER_SECOND 1000000000ull
+
+uint64_t scheduler_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+// Time of wakeup k, rounded up so that the ticks due at a deadline are never rounded down
+static uint64_t scheduler_wakeup_time(const TickScheduler *scheduler, uint64_t k)
+{
+    return scheduler->start_ns + (uint64_t)ceil((double)k * NS_PER_SECOND / scheduler->tick_rate);
+}
+
+int scheduler_init_at(TickScheduler *scheduler, const TickSchedule *schedule, uint64_t start_ns)
+{
+    if (!scheduler || !schedule || !(schedule->tick_rate > 0) || !(schedule->acceleration > 0))
+    {
+        return -1;
+    }
+
+    scheduler->tick_rate = schedule->tick_rate;
+    scheduler->acceleration = schedule->acceleration;
+    scheduler->max_batch = schedule->max_batch;
+    if (scheduler->max_batch == 0)
+    {
+        double per_wakeup = ceil(schedule->acceleration / schedule->tick_rate);
+        scheduler->max_batch = per_wakeup < 1e6 ? 4 * (unsigned)per_wakeup : 4000000u;
+    }
+
+    scheduler->start_ns = start_ns;
+    scheduler->wakeup = 1;
+    scheduler->deadline_ns = scheduler_wakeup_time(scheduler, 1);
+    scheduler->lateness_ns = 0;
+    scheduler->ticks = 0;
+    scheduler->missed_wakeups = 0;
+
+    return 0;
+}
+
+int scheduler_init(TickScheduler *scheduler, const TickSchedule *schedule)
+{
+    return scheduler_init_at(scheduler, schedule, scheduler_now_ns());
+}
+
+unsigned scheduler_advance(TickScheduler *scheduler, uint64_t now_ns)
+{
+    if (!scheduler || now_ns < scheduler->deadline_ns)
+    {
+        // Woken early, nothing is due yet
+        return 0;
+    }
+
+    uint64_t elapsed = now_ns > scheduler->start_ns ? now_ns - scheduler->start_ns : 0;
+    uint64_t due_total = (uint64_t)((double)elapsed * scheduler->acceleration / NS_PER_SECOND);
+    uint64_t due = due_total > scheduler->ticks ? due_total - scheduler->ticks : 0;
+
+    unsigned ticks = due > scheduler->max_batch ? scheduler->max_batch : (unsigned)due;
+    scheduler->ticks += ticks;
+
+    if (due > ticks)
+    {
+        // Still behind: the next batch runs straight away
+        scheduler->deadline_ns = now_ns;
+        return ticks;
+    }
+
+    // Next wakeup on the original grid, skipping the ones that have already passed
+    uint64_t next = (uint64_t)((double)elapsed * scheduler->tick_rate / NS_PER_SECOND) + 1;
+    if (next <= scheduler->wakeup)
+    {
+        next = scheduler->wakeup + 1;
+    }
+    while (scheduler_wakeup_time(scheduler, next) <= now_ns)
+    {
+        next++;
+    }
+    scheduler->missed_wakeups += next - scheduler->wakeup - 1;
+    scheduler->wakeup = next;
+    scheduler->deadline_ns = scheduler_wakeup_time(scheduler, next);
+
+    return ticks;
+}
+
+unsigned scheduler_wait(TickScheduler *scheduler)
+{
+    if (!scheduler)
+    {
+        return 0;
+    }
+
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)(scheduler->deadline_ns / NS_PER_SECOND);
+    deadline.tv_nsec = (long)(scheduler->deadline_ns % NS_PER_SECOND);
+
+    if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    {
+        return 0;
+    }
+
+    uint64_t now_ns = scheduler_now_ns();
+    scheduler->lateness_ns = now_ns > scheduler->deadline_ns ? now_ns - scheduler->deadline_ns : 0;
+    return scheduler_advance(scheduler, now_ns);
+}
@@ -0,0 +1,56 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Timing of the simulation
+// tick_rate is the number of wakeups per wall-clock second; every wakeup publishes once
+// acceleration is the number of simulated ticks (one simulated second each) per wall-clock
+// second, so an acceleration of 1800 runs a 30-minute bake in one second
+// max_batch bounds the ticks run by one wakeup when catching up, 0 picks four wakeups' worth
+typedef struct {
+    double tick_rate;
+    double acceleration;
+    unsigned max_batch;
+} TickSchedule;
+
+// Drift-free scheduler on the monotonic clock
+// Wakeup k is due at start + k / tick_rate and the ticks due at any time are
+// floor(elapsed * acceleration): both are computed from the start time rather than from the
+// previous wakeup, so neither processing time nor timer jitter accumulates
+typedef struct {
+    double tick_rate;
+    double acceleration;
+    unsigned max_batch;
+
+    uint64_t start_ns;
+    uint64_t deadline_ns;
+    uint64_t wakeup;
+
+    // How late the last wakeup of scheduler_wait was against its deadline
+    uint64_t lateness_ns;
+
+    // Counters
+    uint64_t ticks;
+    uint64_t missed_wakeups;
+} TickScheduler;
+
+// Starts the schedule now
+// Returns 0 on success, -1 if the rate or the acceleration is not positive
+int scheduler_init(TickScheduler *scheduler, const TickSchedule *schedule);
+
+// Starts the schedule at start_ns on the monotonic clock
+int scheduler_init_at(TickScheduler *scheduler, const TickSchedule *schedule, uint64_t start_ns);
+
+// Sleeps until the next wakeup and returns the number of ticks to run now
+// Returns 0 without sleeping the whole way when a signal interrupts the sleep
+unsigned scheduler_wait(TickScheduler *scheduler);
+
+// Accounts for a wakeup at now_ns: returns the ticks due, at most max_batch, and sets the next
+// deadline. While more ticks are due than one batch, the next deadline is now
+unsigned scheduler_advance(TickScheduler *scheduler, uint64_t now_ns);
+
+// Current time of the monotonic clock in nanoseconds
+uint64_t scheduler_now_ns(void);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,631 @@
+#define _GNU_SOURCE
+#include "shard_pool.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#define SHARD_MAX_CPUS CPU_SETSIZE
+#else
+#define SHARD_MAX_CPUS 1
+#endif
+
+// Keeps a drained command for shard_pool_record
+// A capture that runs out of memory is marked lost, and reported by the next shard_pool_record
+static void shard_capture(Shard *shard, uint64_t tick, const QueuedCommand *queued)
+{
+    if (shard->captured_count == shard->captured_capacity)
+    {
+        size_t capacity = shard->captured_capacity ? 2 * shard->captured_capacity : 64;
+        CapturedCommand *captured = realloc(shard->captured, capacity * sizeof(CapturedCommand));
+        if (!captured)
+        {
+            shard->captured_capacity = SIZE_MAX;
+            return;
+        }
+        shard->captured = captured;
+        shard->captured_capacity = capacity;
+    }
+
+    CapturedCommand *entry = &shard->captured[shard->captured_count++];
+    entry->tick = tick;
+    entry->id = queued->id;
+    entry->cmd = queued->cmd;
+}
+
+// Takes the commands queued for the shard into the pending slots of their ovens, in the order of
+// each producer. tick is the tick they apply to
+static void shard_drain(Shard *shard, uint64_t tick)
+{
+    ShardPool *pool = shard->pool;
+    QueuedCommand queued;
+    size_t drained = 0;
+    uint64_t coalesced = 0;
+
+    for (size_t p = 0; p < pool->producers; p++)
+    {
+        while (command_queue_pop(&shard->queues[p], &queued))
+        {
+            drained++;
+
+            size_t index;
+            if (fleet_index(&shard->slice, queued.id, &index) != 0)
+            {
+                continue;
+            }
+
+            if (pool->capture && shard->captured_capacity != SIZE_MAX)
+            {
+                shard_capture(shard, tick, &queued);
+            }
+
+            // An oven is listed once, when its slot gets its first command: commands with an
+            // unknown action leave the slot empty and must not list it again and again
+            PendingCommand *slot = &shard->pending[index];
+            uint8_t flags = slot->flags;
+            coalesced += (uint64_t)pending_command_add(slot, &queued.cmd);
+            if (flags == 0 && slot->flags != 0)
+            {
+                shard->dirty[shard->dirty_count++] = index;
+            }
+        }
+    }
+
+    if (drained > 0)
+    {
+        atomic_fetch_sub_explicit(&pool->backlog, drained, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shard->coalesced, coalesced, memory_order_relaxed);
+    }
+}
+
+// Applies the pending commands of the slice, at a tick boundary
+static void shard_apply(Shard *shard)
+{
+    uint64_t executed = 0;
+    for (size_t d = 0; d < shard->dirty_count; d++)
+    {
+        size_t index = shard->dirty[d];
+        Koven koven;
+        fleet_get(&shard->slice, index, &koven);
+        executed += (uint64_t)pending_command_apply(&shard->pending[index], &koven);
+        fleet_set(&shard->slice, index, &koven);
+        fleet_mark_active(shard->active, index);
+    }
+    shard->dirty_count = 0;
+
+    if (executed > 0)
+    {
+        atomic_fetch_add_explicit(&shard->commands, executed, memory_order_relaxed);
+    }
+}
+
+// Completes the events of a round and applies the event policy
+// Ovens of the blocks skipped by every tick of the round did not change: the tracker takes them
+// as unchanged, and their event is only filled in when it is published. An idle block is not
+// even visited until one of its heartbeats is due, when the tracker catches up with the rounds it
+// was left alone
+static void shard_collect(Shard *shard, EventPayload *events)
+{
+    ShardPool *pool = shard->pool;
+    EventTracker *tracker = pool->fields ? pool->tracker : NULL;
+
+    for (size_t first = 0; first < shard->slice.count; first += FLEET_BLOCK_SIZE)
+    {
+        size_t block = first / FLEET_BLOCK_SIZE;
+        size_t end = first + FLEET_BLOCK_SIZE < shard->slice.count ? first + FLEET_BLOCK_SIZE
+                                                                   : shard->slice.count;
+        int ticked = (shard->ticked[block / 64] >> (block % 64)) & 1;
+
+        if (!tracker)
+        {
+            for (size_t i = first; i < end; i++)
+            {
+                Koven koven;
+                fleet_get(&shard->slice, i, &koven);
+                events[i].state = (uint8_t)koven.state;
+                events[i].current_temperature = koven.current_temperature;
+                events[i].remaining_time = koven.remaining_time;
+                events[i].programmed_duration = koven.programmed_duration;
+                events[i].programmed_temperature = koven.programmed_temperature;
+            }
+            continue;
+        }
+
+        // Slices are made of whole blocks, so the block of the fleet is only written by this shard
+        uint8_t *publishing = &pool->publishing[(shard->first + first) / FLEET_BLOCK_SIZE];
+        if (!ticked && shard->skipped[block] < shard->quiet[block])
+        {
+            shard->skipped[block]++;
+            *publishing = 0;
+            continue;
+        }
+
+        event_tracker_skip(
+            tracker, shard->first + first, shard->first + end, shard->skipped[block]);
+        shard->skipped[block] = 0;
+
+        uint8_t any = 0;
+        for (size_t i = first; i < end; i++)
+        {
+            size_t index = shard->first + i;
+            if (ticked)
+            {
+                pool->fields[index] = event_tracker_update(tracker, index, &events[i]);
+            }
+            else
+            {
+                pool->fields[index] = event_tracker_unchanged(tracker, index);
+                if (pool->fields[index])
+                {
+                    events[i] = tracker->last[index];
+                }
+            }
+            any |= pool->fields[index];
+        }
+        *publishing = any != 0;
+        shard->quiet[block] =
+            event_tracker_quiet_rounds(tracker, shard->first + first, shard->first + end);
+    }
+}
+
+// Pins the calling thread to one CPU, ignoring failures: the shard still runs unpinned
+static void shard_pin(int cpu)
+{
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#else
+    (void)cpu;
+#endif
+}
+
+static void *shard_run(void *arg)
+{
+    Shard *shard = arg;
+    ShardPool *pool = shard->pool;
+    uint64_t seen = 0;
+
+    shard_pin(shard->cpu);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->round == seen && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stopping)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->round;
+        pthread_mutex_unlock(&pool->lock);
+
+        EventPayload *events = &pool->events[shard->first];
+        size_t words = fleet_active_words(&shard->slice);
+        uint64_t oven_ticks = 0;
+        memset(shard->ticked, 0, words * sizeof(uint64_t));
+        for (unsigned t = 0; t < pool->ticks; t++)
+        {
+            // Commands get in between the ticks of a batch, as they arrived
+            shard_drain(shard, pool->ticks_run + t + 1);
+            shard_apply(shard);
+            for (size_t w = 0; w < words; w++)
+            {
+                shard->ticked[w] |= shard->active[w];
+            }
+            oven_ticks += koven_tick_active(&shard->slice, shard->active, events);
+        }
+        atomic_fetch_add_explicit(&shard->oven_ticks, oven_ticks, memory_order_relaxed);
+
+        shard_collect(shard, events);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+// Lists the CPUs the process may run on, at most max of them
+// Returns the number of CPUs found, 0 if they are unknown
+static size_t available_cpus(int *cpus, size_t max)
+{
+    size_t n = 0;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus[n++] = cpu;
+            }
+        }
+    }
+#else
+    (void)cpus;
+    (void)max;
+#endif
+    return n;
+}
+
+size_t shard_pool_default_count(size_t ovens)
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = online > 0 ? (size_t)online : 1;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+    {
+        count = (size_t)CPU_COUNT(&set);
+    }
+#endif
+
+    size_t max = (ovens + SHARD_ALIGNMENT - 1) / SHARD_ALIGNMENT;
+    if (count > max)
+    {
+        count = max;
+    }
+    return count > 0 ? count : 1;
+}
+
+// Stops and joins the first started workers, then releases the queues of every shard
+static void shard_pool_release(ShardPool *pool, size_t started)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t s = 0; s < started; s++)
+    {
+        pthread_join(pool->shards[s].thread, NULL);
+    }
+
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        for (size_t p = 0; pool->shards[s].queues && p < pool->producers; p++)
+        {
+            command_queue_free(&pool->shards[s].queues[p]);
+        }
+        free(pool->shards[s].queues);
+        free(pool->shards[s].pending);
+        free(pool->shards[s].dirty);
+        free(pool->shards[s].captured);
+        free(pool->shards[s].active);
+        free(pool->shards[s].ticked);
+        free(pool->shards[s].quiet);
+        free(pool->shards[s].skipped);
+    }
+    free(pool->shards);
+    pool->shards = NULL;
+    free(pool->publishing);
+    pool->publishing = NULL;
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+}
+
+int shard_pool_init(ShardPool *pool,
+                    KovenFleet *fleet,
+                    size_t shards,
+                    size_t producers,
+                    size_t backlog,
+                    EventTracker *tracker)
+{
+    if (!pool || !fleet || fleet->count == 0 || shards == 0 || producers == 0 ||
+        (tracker && tracker->count != fleet->count))
+    {
+        return -1;
+    }
+
+    // Equal slices rounded up to the alignment, which may leave fewer shards than asked for
+    size_t per_shard = (fleet->count + shards - 1) / shards;
+    size_t slice_size = (per_shard + SHARD_ALIGNMENT - 1) / SHARD_ALIGNMENT * SHARD_ALIGNMENT;
+    size_t count = (fleet->count + slice_size - 1) / slice_size;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->fleet = fleet;
+    pool->tracker = tracker;
+    pool->count = count;
+    pool->producers = producers;
+    pool->slice_size = slice_size;
+    pool->backlog_limit = backlog ? backlog : SHARD_DEFAULT_BACKLOG;
+    atomic_init(&pool->backlog, 0);
+    atomic_init(&pool->overflow, 0);
+
+    pool->shards = calloc(count, sizeof(Shard));
+    if (!pool->shards)
+    {
+        return -1;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // Every block publishes until the shards know better, which the first round tells them
+    size_t fleet_blocks = (fleet->count + FLEET_BLOCK_SIZE - 1) / FLEET_BLOCK_SIZE;
+    pool->publishing = malloc(fleet_blocks);
+    if (!pool->publishing)
+    {
+        shard_pool_release(pool, 0);
+        return -1;
+    }
+    memset(pool->publishing, 1, fleet_blocks);
+
+    int cpus[SHARD_MAX_CPUS];
+    size_t cpu_count = available_cpus(cpus, SHARD_MAX_CPUS);
+
+    for (size_t s = 0; s < count; s++)
+    {
+        Shard *shard = &pool->shards[s];
+        size_t first = s * slice_size;
+        size_t n = fleet->count - first < slice_size ? fleet->count - first : slice_size;
+        size_t blocks = (n + FLEET_BLOCK_SIZE - 1) / FLEET_BLOCK_SIZE;
+
+        shard->pool = pool;
+        shard->first = first;
+        shard->cpu = cpu_count > 0 ? cpus[s % cpu_count] : -1;
+        atomic_init(&shard->commands, 0);
+        atomic_init(&shard->coalesced, 0);
+        atomic_init(&shard->oven_ticks, 0);
+        fleet_slice(fleet, first, n, &shard->slice);
+
+        shard->pending = calloc(n, sizeof(PendingCommand));
+        shard->dirty = malloc(n * sizeof(size_t));
+        shard->active = malloc(fleet_active_words(&shard->slice) * sizeof(uint64_t));
+        shard->ticked = malloc(fleet_active_words(&shard->slice) * sizeof(uint64_t));
+        shard->quiet = calloc(blocks, sizeof(unsigned));
+        shard->skipped = calloc(blocks, sizeof(unsigned));
+        if (!shard->pending || !shard->dirty || !shard->active || !shard->ticked || !shard->quiet ||
+            !shard->skipped)
+        {
+            shard_pool_release(pool, 0);
+            return -1;
+        }
+
+        // The table may come from a snapshot: every block is ticked once to find the idle ones
+        fleet_mark_all_active(&shard->slice, shard->active);
+
+        // Queues are cache line aligned so that producers do not share lines
+        shard->queues = aligned_alloc(64, producers * sizeof(CommandQueue));
+        if (!shard->queues)
+        {
+            shard_pool_release(pool, 0);
+            return -1;
+        }
+        memset(shard->queues, 0, producers * sizeof(CommandQueue));
+        for (size_t p = 0; p < producers; p++)
+        {
+            if (command_queue_init(&shard->queues[p], SHARD_QUEUE_CAPACITY) != 0)
+            {
+                shard_pool_release(pool, 0);
+                return -1;
+            }
+        }
+    }
+
+    for (size_t s = 0; s < count; s++)
+    {
+        if (pthread_create(&pool->shards[s].thread, NULL, shard_run, &pool->shards[s]) != 0)
+        {
+            shard_pool_release(pool, s);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void shard_pool_free(ShardPool *pool)
+{
+    if (!pool || !pool->shards)
+    {
+        return;
+    }
+
+    shard_pool_release(pool, pool->count);
+}
+
+int shard_pool_submit(ShardPool *pool, size_t producer, size_t index, const CommandPayload *cmd)
+{
+    if (!pool || !pool->shards || !cmd || producer >= pool->producers ||
+        index >= pool->fleet->count)
+    {
+        return -1;
+    }
+
+    // Reserve a place in the backlog first, so that the workers never see it go negative
+    if (atomic_fetch_add_explicit(&pool->backlog, 1, memory_order_relaxed) >= pool->backlog_limit)
+    {
+        atomic_fetch_sub_explicit(&pool->backlog, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool->overflow, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    Shard *shard = &pool->shards[index / pool->slice_size];
+    if (command_queue_push(
+            &shard->queues[producer], pool->fleet->first_id + (uint32_t)index, cmd) != 0)
+    {
+        atomic_fetch_sub_explicit(&pool->backlog, 1, memory_order_relaxed);
+        return -1;
+    }
+    return 0;
+}
+
+void shard_pool_tick(ShardPool *pool, unsigned ticks, EventPayload *events, uint8_t *fields)
+{
+    if (!pool || !pool->shards || !events || ticks == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->ticks = ticks;
+    pool->events = events;
+    pool->fields = fields;
+    pool->pending = pool->count;
+    pool->round++;
+    pthread_cond_broadcast(&pool->start);
+
+    // The lock orders the work of the workers before the caller reads their results
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->ticks_run += ticks;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void shard_pool_capture(ShardPool *pool, int enabled)
+{
+    if (pool)
+    {
+        pool->capture = enabled;
+    }
+}
+
+int shard_pool_record(ShardPool *pool, Recorder *recorder)
+{
+    if (!pool || !pool->shards || !recorder)
+    {
+        return -1;
+    }
+
+    // A log missing commands would not replay: it stops at the first lost capture
+    int result = 0;
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        if (pool->shards[s].captured_capacity == SIZE_MAX)
+        {
+            recorder->failed = 1;
+            result = -1;
+        }
+    }
+
+    // Every shard holds its commands in tick order: merge them one tick at a time, from the
+    // oldest tick any of them holds
+    uint64_t tick = UINT64_MAX;
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        pool->shards[s].captured_next = 0;
+        if (pool->shards[s].captured_count > 0 && pool->shards[s].captured[0].tick < tick)
+        {
+            tick = pool->shards[s].captured[0].tick;
+        }
+    }
+
+    for (; tick <= pool->ticks_run && result == 0; tick++)
+    {
+        for (size_t s = 0; s < pool->count && result == 0; s++)
+        {
+            Shard *shard = &pool->shards[s];
+            while (shard->captured_next < shard->captured_count &&
+                   shard->captured[shard->captured_next].tick == tick)
+            {
+                const CapturedCommand *entry = &shard->captured[shard->captured_next++];
+                if (recorder_command(recorder, entry->tick, entry->id, &entry->cmd) != 0)
+                {
+                    result = -1;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        pool->shards[s].captured_count = 0;
+        if (pool->shards[s].captured_capacity == SIZE_MAX)
+        {
+            free(pool->shards[s].captured);
+            pool->shards[s].captured = NULL;
+            pool->shards[s].captured_capacity = 0;
+        }
+    }
+
+    return result;
+}
+
+uint64_t shard_pool_dropped(const ShardPool *pool)
+{
+    if (!pool || !pool->shards)
+    {
+        return 0;
+    }
+
+    uint64_t dropped = 0;
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        for (size_t p = 0; p < pool->producers; p++)
+        {
+            dropped += atomic_load(&pool->shards[s].queues[p].dropped);
+        }
+    }
+    return dropped;
+}
+
+uint64_t shard_pool_overflow(const ShardPool *pool)
+{
+    return pool && pool->shards ? atomic_load(&pool->overflow) : 0;
+}
+
+uint64_t shard_pool_coalesced(const ShardPool *pool)
+{
+    if (!pool || !pool->shards)
+    {
+        return 0;
+    }
+
+    uint64_t coalesced = 0;
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        coalesced += atomic_load(&pool->shards[s].coalesced);
+    }
+    return coalesced;
+}
+
+uint64_t shard_pool_oven_ticks(const ShardPool *pool)
+{
+    if (!pool || !pool->shards)
+    {
+        return 0;
+    }
+
+    uint64_t oven_ticks = 0;
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        oven_ticks += atomic_load(&pool->shards[s].oven_ticks);
+    }
+    return oven_ticks;
+}
+
+uint64_t shard_pool_executed(const ShardPool *pool)
+{
+    if (!pool || !pool->shards)
+    {
+        return 0;
+    }
+
+    uint64_t executed = 0;
+    for (size_t s = 0; s < pool->count; s++)
+    {
+        executed += atomic_load(&pool->shards[s].commands);
+    }
+    return executed;
+}
@@ -0,0 +1,180 @@
+#ifndef SHARD_POOL_H
+#define SHARD_POOL_H
+
+#include "command_queue.h"
+#include "event_tracker.h"
+#include "fleet.h"
+#include "pending_command.h"
+#include "recording.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shard slices are a multiple of this many ovens, so that no two shards write to the same cache
+// line of the fleet table or of the event tracker
+#define SHARD_ALIGNMENT 64
+
+// Commands each queue holds before new ones are dropped: every command of a command batch frame
+// (COMMAND_BATCH_MAX_COMMANDS) may go to the same shard
+#define SHARD_QUEUE_CAPACITY 4096
+
+// Commands queued over the whole pool and not yet taken by a worker, used when no backlog is
+// given to shard_pool_init
+#define SHARD_DEFAULT_BACKLOG 16384
+
+struct ShardPool;
+
+// Command drained by a shard while the pool captures its traffic, with the tick it applies to
+typedef struct {
+    uint64_t tick;
+    uint32_t id;
+    CommandPayload cmd;
+} CapturedCommand;
+
+// Worker thread owning a contiguous slice of the fleet
+// Every producer thread has its own queue into every shard, so each queue has exactly one
+// producer and one consumer
+typedef struct {
+    struct ShardPool *pool;
+    size_t first;
+    KovenFleet slice;
+    CommandQueue *queues;
+    int cpu;
+    pthread_t thread;
+
+    // Pending commands of the slice, and the indices of the ovens that have some
+    PendingCommand *pending;
+    size_t *dirty;
+    size_t dirty_count;
+
+    // Blocks of the slice holding ovens that are not idle (see koven_tick_active), and the
+    // blocks ticked during the current round
+    uint64_t *active;
+    uint64_t *ticked;
+
+    // Rounds each idle block of the slice can be left alone before one of its heartbeats is due,
+    // and the rounds it has been left alone so far (see event_tracker_quiet_rounds)
+    unsigned *quiet;
+    unsigned *skipped;
+
+    // Commands drained since the last shard_pool_record, in the order of their ticks
+    CapturedCommand *captured;
+    size_t captured_count;
+    size_t captured_capacity;
+    size_t captured_next;
+
+    // Counters, only written by the worker
+    atomic_uint_fast64_t commands;
+    atomic_uint_fast64_t coalesced;
+    atomic_uint_fast64_t oven_ticks;
+} Shard;
+
+// Fleet split into shards ticked in parallel, one worker thread per shard
+// Commands are routed to the shard that owns their oven instead of being executed by the thread
+// that received them, so that only the owning worker ever touches an oven and the table needs no
+// lock. Each call to shard_pool_tick makes every worker drain its queues and tick its slice,
+// then waits for all of them. Drained commands are coalesced per oven and applied at the next
+// tick boundary, so a burst of commands to one oven costs at most two executions per tick
+// Workers only tick the blocks of their slice that hold ovens that are not idle: a block joins
+// the active set when a command is applied to one of its ovens and leaves it once all of them are
+// idle again, so that the cost of a tick follows the busy ovens rather than the size of the fleet
+typedef struct ShardPool {
+    KovenFleet *fleet;
+    EventTracker *tracker;
+    size_t count;
+    size_t producers;
+    size_t slice_size;
+    Shard *shards;
+
+    // Commands submitted but not yet drained, bounded by backlog_limit
+    size_t backlog_limit;
+    atomic_size_t backlog;
+    atomic_uint_fast64_t overflow;
+
+    // Rounds of work: the caller bumps round and waits until no shard is pending any more
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t round;
+    size_t pending;
+    int stopping;
+
+    // Work of the current round
+    unsigned ticks;
+    EventPayload *events;
+    uint8_t *fields;
+
+    // Whether any oven of each block of FLEET_BLOCK_SIZE ovens published in the last round
+    uint8_t *publishing;
+
+    // Ticks run since the start, and whether the shards keep the commands they drain
+    uint64_t ticks_run;
+    int capture;
+} ShardPool;
+
+// Splits fleet into at most shards slices and starts their workers, each pinned to one of the
+// CPUs the process may run on. producers is the number of threads that submit commands
+// backlog bounds the commands queued over the whole pool, 0 for SHARD_DEFAULT_BACKLOG
+// tracker may be NULL; otherwise each worker updates it for the ovens of its slice
+// Returns 0 on success, -1 on error
+int shard_pool_init(ShardPool *pool,
+                    KovenFleet *fleet,
+                    size_t shards,
+                    size_t producers,
+                    size_t backlog,
+                    EventTracker *tracker);
+
+// Stops the workers and releases the memory owned by the pool
+void shard_pool_free(ShardPool *pool);
+
+// Number of shards used by default: one per available CPU, without slices smaller than
+// SHARD_ALIGNMENT ovens
+size_t shard_pool_default_count(size_t ovens);
+
+// Queues a command for the oven at index, from the given producer thread
+// The command is coalesced with the other pending commands of the oven by the owning worker and
+// takes effect before its next tick
+// Returns 0 on success, -1 on error, when the queue is full or when the backlog is reached
+int shard_pool_submit(ShardPool *pool, size_t producer, size_t index, const CommandPayload *cmd);
+
+// Runs ticks ticks of the whole fleet on the workers and waits for them
+// events[i] receives the event of the last tick of the oven at index i and, when the pool has a
+// tracker, fields[i] the fields it publishes. With a tracker and fields, the event of an oven
+// that was idle for the whole round is only filled in when fields[i] is not 0, and neither is
+// written for the blocks that publish nothing (see shard_pool_block_publishes)
+void shard_pool_tick(ShardPool *pool, unsigned ticks, EventPayload *events, uint8_t *fields);
+
+// Whether any oven of the block of FLEET_BLOCK_SIZE ovens starting at index
+// block * FLEET_BLOCK_SIZE publishes after the last shard_pool_tick, which otherwise left its
+// fields as they were
+static inline int shard_pool_block_publishes(const ShardPool *pool, size_t block)
+{
+    return pool->publishing[block];
+}
+
+// Makes the shards keep every command they drain from now on, for shard_pool_record
+// Must be called between two ticks
+void shard_pool_capture(ShardPool *pool, int enabled);
+
+// Appends the commands captured since the last call to recorder, in the order of their ticks,
+// and forgets them. Must be called between two ticks
+// Returns 0 on success, -1 on error, including a capture that ran out of memory
+int shard_pool_record(ShardPool *pool, Recorder *recorder);
+
+// Commands dropped because a queue was full, over every queue
+uint64_t shard_pool_dropped(const ShardPool *pool);
+
+// Commands rejected because the backlog of the pool was full
+uint64_t shard_pool_overflow(const ShardPool *pool);
+
+// Commands superseded by later ones before they took effect, over every shard
+uint64_t shard_pool_coalesced(const ShardPool *pool);
+
+// Commands executed on the ovens, over every shard
+uint64_t shard_pool_executed(const ShardPool *pool);
+
+// Oven ticks actually run, over every shard: idle ovens skipped by a tick are not counted
+uint64_t shard_pool_oven_ticks(const ShardPool *pool);
+
+#endif /* SHARD_POOL_H */
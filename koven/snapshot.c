@@ -0,0 +1,253 @@
+#include "snapshot.h"
+#include "log.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Recorded in the header, so that a file is never read back with the other byte order
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// Slot tables start on a cache line boundary
+#define SNAPSHOT_ALIGNMENT 64
+
+_Static_assert(sizeof(SnapshotHeader) == SNAPSHOT_ALIGNMENT, "SnapshotHeader must be 64 bytes");
+_Static_assert(sizeof(SnapshotSlot) == SNAPSHOT_ALIGNMENT, "SnapshotSlot must be 64 bytes");
+
+// Bytes from the start of one slot to the start of the next
+static size_t snapshot_slot_stride(size_t table_size)
+{
+    size_t padded = (table_size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    return sizeof(SnapshotSlot) + padded;
+}
+
+static SnapshotSlot *snapshot_slot(const FleetSnapshot *snapshot, size_t i)
+{
+    return (SnapshotSlot *)(snapshot->map + sizeof(SnapshotHeader) +
+                            i * snapshot_slot_stride(snapshot->table_size));
+}
+
+static const uint8_t *snapshot_slot_table(const SnapshotSlot *slot)
+{
+    return (const uint8_t *)slot + sizeof(SnapshotSlot);
+}
+
+// FNV-1a over the 64-bit words of the table, whose size is always a multiple of 8
+static uint64_t snapshot_checksum(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Nanoseconds since the epoch, which unlike the monotonic clock survive a reboot
+static uint64_t snapshot_unix_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Fills the header the file must have for fleet
+static void snapshot_header_for(const KovenFleet *fleet, SnapshotHeader *header)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->fields = 5;
+    header->first_id = fleet->first_id;
+    header->count = fleet->count;
+    header->table_size = fleet_table_size(fleet);
+}
+
+int snapshot_open(FleetSnapshot *snapshot,
+                  const char *path,
+                  const KovenFleet *fleet,
+                  uint64_t interval_ns)
+{
+    if (!snapshot || !path || !fleet || fleet->count == 0)
+    {
+        return -1;
+    }
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->fd = -1;
+    snapshot->table_size = fleet_table_size(fleet);
+    snapshot->size =
+        sizeof(SnapshotHeader) + SNAPSHOT_SLOTS * snapshot_slot_stride(snapshot->table_size);
+    snapshot->interval_ns = interval_ns;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        log_error("Failed to open snapshot file %s", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // Only a file made for the same fleet and layout keeps its snapshots
+    SnapshotHeader expected;
+    SnapshotHeader actual;
+    snapshot_header_for(fleet, &expected);
+    int matches = (size_t)st.st_size == snapshot->size &&
+                  pread(fd, &actual, sizeof(actual), 0) == (ssize_t)sizeof(actual) &&
+                  memcmp(&actual, &expected, sizeof(expected)) == 0;
+
+    if (!matches)
+    {
+        if (st.st_size > 0)
+        {
+            log_warn("Resetting snapshot file %s, made for another fleet or version", path);
+        }
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)snapshot->size) != 0 ||
+            pwrite(fd, &expected, sizeof(expected), 0) != (ssize_t)sizeof(expected))
+        {
+            log_error("Failed to initialize snapshot file %s", path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    void *map = mmap(NULL, snapshot->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        log_error("Failed to map snapshot file %s", path);
+        close(fd);
+        return -1;
+    }
+
+    snapshot->fd = fd;
+    snapshot->map = map;
+
+    // New snapshots must be numbered after every one in the file, valid or not
+    for (size_t i = 0; i < SNAPSHOT_SLOTS; i++)
+    {
+        if (snapshot_slot(snapshot, i)->sequence > snapshot->sequence)
+        {
+            snapshot->sequence = snapshot_slot(snapshot, i)->sequence;
+        }
+    }
+
+    return 0;
+}
+
+uint64_t snapshot_restore(FleetSnapshot *snapshot, KovenFleet *fleet)
+{
+    if (!snapshot || !snapshot->map || !fleet || fleet_table_size(fleet) != snapshot->table_size)
+    {
+        return 0;
+    }
+
+    const SnapshotSlot *newest = NULL;
+    for (size_t i = 0; i < SNAPSHOT_SLOTS; i++)
+    {
+        const SnapshotSlot *slot = snapshot_slot(snapshot, i);
+        if (slot->sequence == 0 || (newest && slot->sequence < newest->sequence) ||
+            snapshot_checksum(snapshot_slot_table(slot), snapshot->table_size) != slot->checksum)
+        {
+            continue;
+        }
+
+        // The state array comes first in the table
+        const int16_t *states = (const int16_t *)snapshot_slot_table(slot);
+        size_t valid = 0;
+        while (valid < fleet->count && states[valid] >= STATE_IDLE &&
+               states[valid] <= STATE_COOLING_DOWN)
+        {
+            valid++;
+        }
+        if (valid == fleet->count)
+        {
+            newest = slot;
+        }
+    }
+
+    if (!newest)
+    {
+        return 0;
+    }
+
+    memcpy(fleet->state, snapshot_slot_table(newest), snapshot->table_size);
+    snapshot->restored_unix_ns = newest->saved_unix_ns;
+    return newest->sequence;
+}
+
+uint64_t snapshot_downtime_ns(const FleetSnapshot *snapshot)
+{
+    if (!snapshot || snapshot->restored_unix_ns == 0)
+    {
+        return 0;
+    }
+
+    uint64_t now = snapshot_unix_ns();
+    return now > snapshot->restored_unix_ns ? now - snapshot->restored_unix_ns : 0;
+}
+
+int snapshot_save(FleetSnapshot *snapshot, const KovenFleet *fleet, uint64_t now_ns)
+{
+    if (!snapshot || !snapshot->map || !fleet || fleet_table_size(fleet) != snapshot->table_size)
+    {
+        return -1;
+    }
+
+    // The older slot is overwritten; the newer one stays valid until this one is published
+    SnapshotSlot *slot = snapshot_slot(snapshot, 0);
+    if (snapshot_slot(snapshot, 1)->sequence < slot->sequence)
+    {
+        slot = snapshot_slot(snapshot, 1);
+    }
+
+    slot->sequence = 0;
+    atomic_thread_fence(memory_order_release);
+
+    uint8_t *table = (uint8_t *)slot + sizeof(SnapshotSlot);
+    memcpy(table, fleet->state, snapshot->table_size);
+    slot->checksum = snapshot_checksum(table, snapshot->table_size);
+    slot->saved_ns = now_ns;
+    slot->saved_unix_ns = snapshot_unix_ns();
+
+    atomic_thread_fence(memory_order_release);
+    slot->sequence = ++snapshot->sequence;
+
+    // Written back by the kernel in the background: the tick loop never waits for the disk
+    msync(snapshot->map, snapshot->size, MS_ASYNC);
+    return 0;
+}
+
+int snapshot_save_due(FleetSnapshot *snapshot, const KovenFleet *fleet, uint64_t now_ns)
+{
+    if (!snapshot || now_ns < snapshot->next_save_ns)
+    {
+        return 0;
+    }
+
+    snapshot->next_save_ns = now_ns + snapshot->interval_ns;
+    return snapshot_save(snapshot, fleet, now_ns) == 0 ? 1 : -1;
+}
+
+void snapshot_close(FleetSnapshot *snapshot)
+{
+    if (!snapshot || !snapshot->map)
+    {
+        return;
+    }
+
+    msync(snapshot->map, snapshot->size, MS_SYNC);
+    munmap(snapshot->map, snapshot->size);
+    close(snapshot->fd);
+    snapshot->map = NULL;
+    snapshot->fd = -1;
+}
@@ -0,0 +1,86 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "fleet.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Snapshot files of the fleet table, for a warm restart of the emulator
+// The file is mapped shared into memory and holds a header followed by two slots, each one a
+// copy of the whole table. A save copies the table into the older slot and only then publishes
+// it with a new sequence number, so that a crash in the middle of a save always leaves the
+// previous snapshot intact. The layout is that of the host; the header records its byte order
+#define SNAPSHOT_MAGIC "KOVENSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SLOTS 2
+
+// Header at the start of the file
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t fields;
+    uint32_t first_id;
+    uint64_t count;
+    uint64_t table_size;
+    uint8_t reserved[24];
+} SnapshotHeader;
+
+// Header of each slot, followed by table_size bytes of table
+// A slot with sequence 0 is empty, or being written
+// saved_unix_ns is the wall-clock time of the save, 0 in files written before it was recorded
+typedef struct {
+    uint64_t sequence;
+    uint64_t checksum;
+    uint64_t saved_ns;
+    uint64_t saved_unix_ns;
+    uint8_t reserved[32];
+} SnapshotSlot;
+
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t size;
+    size_t table_size;
+
+    // Sequence of the newest snapshot in the file, 0 if there is none
+    uint64_t sequence;
+
+    // Wall-clock time at which the restored snapshot was saved, 0 if unknown
+    uint64_t restored_unix_ns;
+
+    // Saves happen at most once per interval
+    uint64_t interval_ns;
+    uint64_t next_save_ns;
+} FleetSnapshot;
+
+// Opens the snapshot file at path for fleet, creating it if needed, and maps it
+// A file made for another fleet (ids, size or layout) is reset, losing its snapshots
+// Returns 0 on success, -1 on error
+int snapshot_open(FleetSnapshot *snapshot,
+                  const char *path,
+                  const KovenFleet *fleet,
+                  uint64_t interval_ns);
+
+// Copies the newest valid snapshot of the file into the table of fleet
+// Returns the sequence of the restored snapshot, or 0 when there is none (fleet is untouched)
+// snapshot_downtime_ns then tells how long ago the restored snapshot was saved
+uint64_t snapshot_restore(FleetSnapshot *snapshot, KovenFleet *fleet);
+
+// Wall-clock time elapsed since the restored snapshot was saved
+// Returns 0 when nothing was restored, the save time is unknown or the clock went backwards
+uint64_t snapshot_downtime_ns(const FleetSnapshot *snapshot);
+
+// Saves the table of fleet into the older slot of the file
+// The table must not change during the call, e.g. between two ticks of the shard pool
+// Returns 0 on success, -1 on error
+int snapshot_save(FleetSnapshot *snapshot, const KovenFleet *fleet, uint64_t now_ns);
+
+// Saves the table when the interval elapsed since the last save
+// Returns 1 when a snapshot was saved, 0 when none was due, -1 on error
+int snapshot_save_due(FleetSnapshot *snapshot, const KovenFleet *fleet, uint64_t now_ns);
+
+// Flushes the mapping to the file and closes it
+void snapshot_close(FleetSnapshot *snapshot);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,103 @@
+#include "../backoff.h"
+#include "../external/unity.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_backoff_doubles_up_to_max(void)
+{
+    Backoff backoff;
+    backoff_init(&backoff, 100, 1000, 42);
+
+    // Every delay lies between half the ceiling and the ceiling
+    uint64_t ceilings[] = {100, 200, 400, 800, 1000, 1000, 1000};
+    for (size_t i = 0; i < sizeof(ceilings) / sizeof(ceilings[0]); i++)
+    {
+        uint64_t delay = backoff_next(&backoff);
+        TEST_ASSERT_TRUE(delay >= ceilings[i] / 2);
+        TEST_ASSERT_TRUE(delay <= ceilings[i]);
+    }
+}
+
+void test_backoff_reset_starts_over(void)
+{
+    Backoff backoff;
+    backoff_init(&backoff, 100, 100000, 7);
+
+    for (int i = 0; i < 10; i++)
+    {
+        backoff_next(&backoff);
+    }
+    backoff_reset(&backoff);
+
+    TEST_ASSERT_TRUE(backoff_next(&backoff) <= 100);
+}
+
+void test_backoff_jitter_spreads_connections(void)
+{
+    // Connections lost together draw different delays
+    uint64_t first[16];
+    size_t distinct = 0;
+    for (size_t k = 0; k < 16; k++)
+    {
+        Backoff backoff;
+        backoff_init(&backoff, 1000000, 1000000000, k + 1);
+        first[k] = backoff_next(&backoff);
+
+        size_t j = 0;
+        while (j < k && first[j] != first[k])
+        {
+            j++;
+        }
+        distinct += j == k;
+    }
+
+    TEST_ASSERT_TRUE(distinct >= 12);
+}
+
+void test_backoff_large_attempt_counts(void)
+{
+    Backoff backoff;
+    backoff_init(&backoff, 1, UINT64_MAX, 3);
+
+    // The ceiling saturates instead of overflowing
+    uint64_t delay = 0;
+    for (int i = 0; i < 200; i++)
+    {
+        delay = backoff_next(&backoff);
+    }
+    TEST_ASSERT_TRUE(delay >= UINT64_MAX / 2);
+}
+
+void test_backoff_invalid_bounds(void)
+{
+    Backoff backoff;
+
+    // A max below min is raised to min, and a zero min to one nanosecond
+    backoff_init(&backoff, 500, 10, 1);
+    TEST_ASSERT_EQUAL_UINT64(500, backoff.max_ns);
+    backoff_init(&backoff, 0, 0, 1);
+    TEST_ASSERT_TRUE(backoff_next(&backoff) <= 1);
+
+    // Should not crash
+    backoff_init(NULL, 1, 2, 3);
+    backoff_reset(NULL);
+    TEST_ASSERT_EQUAL_UINT64(0, backoff_next(NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Backoff Tests
+    RUN_TEST(test_backoff_doubles_up_to_max);
+    RUN_TEST(test_backoff_reset_starts_over);
+    RUN_TEST(test_backoff_jitter_spreads_connections);
+
+    // Edge Cases
+    RUN_TEST(test_backoff_large_attempt_counts);
+    RUN_TEST(test_backoff_invalid_bounds);
+
+    return UNITY_END();
+}
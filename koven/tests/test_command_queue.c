@@ -0,0 +1,175 @@
+#include "../external/unity.h"
+#include "../command_queue.h"
+#include <pthread.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static CommandPayload make_command(uint8_t action, int16_t temperature, int16_t duration)
+{
+    CommandPayload cmd;
+    cmd.action = action;
+    cmd.temperature = temperature;
+    cmd.duration = duration;
+    return cmd;
+}
+
+void test_command_queue_fifo(void)
+{
+    CommandQueue queue;
+    TEST_ASSERT_EQUAL_INT(0, command_queue_init(&queue, 8));
+    TEST_ASSERT_EQUAL_INT(1, command_queue_empty(&queue));
+
+    for (int16_t i = 0; i < 5; i++)
+    {
+        CommandPayload cmd = make_command(ACTION_START, 180 + i, 60 * i);
+        TEST_ASSERT_EQUAL_INT(0, command_queue_push(&queue, (uint32_t)i, &cmd));
+    }
+
+    QueuedCommand out;
+    for (int16_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, command_queue_pop(&queue, &out));
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)i, out.id);
+        TEST_ASSERT_EQUAL_INT(ACTION_START, out.cmd.action);
+        TEST_ASSERT_EQUAL_INT16(180 + i, out.cmd.temperature);
+        TEST_ASSERT_EQUAL_INT16(60 * i, out.cmd.duration);
+        TEST_ASSERT_EQUAL_INT(i == 4, command_queue_empty(&queue));
+    }
+    TEST_ASSERT_EQUAL_INT(0, command_queue_pop(&queue, &out));
+
+    command_queue_free(&queue);
+}
+
+void test_command_queue_full_drops(void)
+{
+    CommandQueue queue;
+    // Rounded up to 8 entries
+    TEST_ASSERT_EQUAL_INT(0, command_queue_init(&queue, 5));
+    TEST_ASSERT_EQUAL_size_t(8, queue.capacity);
+
+    CommandPayload cmd = make_command(ACTION_STOP, 0, 0);
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, command_queue_push(&queue, i, &cmd));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_push(&queue, 8, &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_push(&queue, 9, &cmd));
+    TEST_ASSERT_EQUAL_UINT64(2, queue.dropped);
+
+    // Taking one entry makes room for exactly one more
+    QueuedCommand out;
+    TEST_ASSERT_EQUAL_INT(1, command_queue_pop(&queue, &out));
+    TEST_ASSERT_EQUAL_UINT32(0, out.id);
+    TEST_ASSERT_EQUAL_INT(0, command_queue_push(&queue, 10, &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_push(&queue, 11, &cmd));
+
+    command_queue_free(&queue);
+}
+
+void test_command_queue_wraps_around(void)
+{
+    CommandQueue queue;
+    TEST_ASSERT_EQUAL_INT(0, command_queue_init(&queue, 4));
+
+    CommandPayload cmd = make_command(ACTION_START, 200, 10);
+    QueuedCommand out;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, command_queue_push(&queue, i, &cmd));
+        TEST_ASSERT_EQUAL_INT(0, command_queue_push(&queue, i + 1000000, &cmd));
+        TEST_ASSERT_EQUAL_INT(1, command_queue_pop(&queue, &out));
+        TEST_ASSERT_EQUAL_UINT32(i, out.id);
+        TEST_ASSERT_EQUAL_INT(1, command_queue_pop(&queue, &out));
+        TEST_ASSERT_EQUAL_UINT32(i + 1000000, out.id);
+    }
+
+    command_queue_free(&queue);
+}
+
+enum
+{
+    STRESS_COMMANDS = 200000
+};
+
+static void *produce(void *arg)
+{
+    CommandQueue *queue = arg;
+    CommandPayload cmd = make_command(ACTION_START, 180, 60);
+
+    for (uint32_t i = 0; i < STRESS_COMMANDS; i++)
+    {
+        // Spin on a full queue: nothing may be lost here
+        while (command_queue_push(queue, i, &cmd) != 0)
+        {
+        }
+    }
+    return NULL;
+}
+
+void test_command_queue_producer_consumer_threads(void)
+{
+    CommandQueue queue;
+    TEST_ASSERT_EQUAL_INT(0, command_queue_init(&queue, 64));
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, &queue);
+
+    // Every command arrives once and in order
+    uint32_t expected = 0;
+    QueuedCommand out;
+    while (expected < STRESS_COMMANDS)
+    {
+        if (command_queue_pop(&queue, &out))
+        {
+            TEST_ASSERT_EQUAL_UINT32(expected, out.id);
+            TEST_ASSERT_EQUAL_INT16(180, out.cmd.temperature);
+            expected++;
+        }
+    }
+
+    pthread_join(producer, NULL);
+    TEST_ASSERT_EQUAL_INT(0, command_queue_pop(&queue, &out));
+
+    command_queue_free(&queue);
+}
+
+void test_command_queue_invalid_arguments(void)
+{
+    CommandQueue queue;
+    CommandPayload cmd = make_command(ACTION_START, 180, 60);
+    QueuedCommand out;
+
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_init(NULL, 8));
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_init(&queue, 0));
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_push(NULL, 0, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, command_queue_pop(NULL, &out));
+
+    TEST_ASSERT_EQUAL_INT(0, command_queue_init(&queue, 8));
+    TEST_ASSERT_EQUAL_INT(-1, command_queue_push(&queue, 0, NULL));
+    TEST_ASSERT_EQUAL_INT(0, command_queue_pop(&queue, NULL));
+    command_queue_free(&queue);
+
+    // Should not crash
+    command_queue_free(NULL);
+    command_queue_free(&queue);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Queue Tests
+    RUN_TEST(test_command_queue_fifo);
+    RUN_TEST(test_command_queue_full_drops);
+    RUN_TEST(test_command_queue_wraps_around);
+
+    // Concurrency Tests
+    RUN_TEST(test_command_queue_producer_consumer_threads);
+
+    // Edge Cases
+    RUN_TEST(test_command_queue_invalid_arguments);
+
+    return UNITY_END();
+}
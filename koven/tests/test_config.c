@@ -0,0 +1,233 @@
+#include "../config.h"
+#include "../external/unity.h"
+#include <stdlib.h>
+
+// The backends are not linked into this suite
+int mqtt_transport_open(Transport *transport,
+                        const TransportConfig *config,
+                        const char *client_id,
+                        const char *subscription)
+{
+    (void)transport;
+    (void)config;
+    (void)client_id;
+    (void)subscription;
+    return -1;
+}
+
+int unix_transport_open(Transport *transport, const char *path)
+{
+    (void)transport;
+    (void)path;
+    return -1;
+}
+
+static const char *const variables[] = {
+    "KOVEN_LOG_LEVEL",         "KOVEN_SHARD_ID",          "KOVEN_FLEET_SIZE",
+    "KOVEN_FLEET_FIRST_ID",    "KOVEN_OVENS",             "KOVEN_FLEET_SHARDS",
+    "KOVEN_FLEET_CONNECTIONS", "KOVEN_FLEET_BATCH_SIZE",  "KOVEN_COMMAND_BACKLOG",
+    "KOVEN_TICK_RATE",         "KOVEN_ACCELERATION",      "KOVEN_TRANSPORT",
+    "MQTT_BROKER",             "KOVEN_TRANSPORT_ADDRESS", "KOVEN_MQTT_QOS",
+    "KOVEN_EVENT_QOS",         "KOVEN_SPOOL_POLICY",      "KOVEN_SPOOL_CAPACITY",
+};
+
+void setUp(void)
+{
+    for (size_t i = 0; i < sizeof(variables) / sizeof(variables[0]); i++)
+    {
+        unsetenv(variables[i]);
+    }
+}
+
+void tearDown(void) {}
+
+static int load(KovenConfig *config, int argc, char *argv[])
+{
+    return config_load(config, argc, argv);
+}
+
+void test_config_defaults(void)
+{
+    char *argv[] = {"koven"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 1, argv));
+
+    TEST_ASSERT_EQUAL_INT(LOG_LEVEL_INFO, config.log_level);
+    TEST_ASSERT_EQUAL_size_t(0, config.fleet_size);
+    TEST_ASSERT_EQUAL_UINT32(0, config.first_id);
+    TEST_ASSERT_EQUAL_UINT32(0, config.transport.shard_id);
+    TEST_ASSERT_EQUAL_size_t(CONFIG_DEFAULT_FLEET_CONNECTIONS, config.connections);
+    TEST_ASSERT_EQUAL_size_t(CONFIG_DEFAULT_FLEET_BATCH_SIZE, config.batch_size);
+    TEST_ASSERT_EQUAL_size_t(0, config.workers);
+    TEST_ASSERT_TRUE(config.schedule.tick_rate == 1.0);
+    TEST_ASSERT_TRUE(config.schedule.acceleration == 1.0);
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_MQTT, config.transport.kind);
+    TEST_ASSERT_NULL(config.transport.address);
+    TEST_ASSERT_NULL(config.transport.client_id);
+    TEST_ASSERT_EQUAL_INT(MQTT_QOS, config.transport.qos);
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_QOS_UNIFORM, config.transport.qos_mode);
+    TEST_ASSERT_EQUAL_INT(EVENT_MODE_FULL, config.policy.mode);
+    TEST_ASSERT_EQUAL_INT(SPOOL_LATEST_PER_OVEN, config.reconnect.spool_policy);
+    TEST_ASSERT_NULL(config.snapshot_path);
+}
+
+void test_config_reads_environment(void)
+{
+    setenv("KOVEN_SHARD_ID", "3", 1);
+    setenv("KOVEN_FLEET_SIZE", "1000", 1);
+    setenv("KOVEN_FLEET_FIRST_ID", "3000", 1);
+    setenv("KOVEN_FLEET_SHARDS", "8", 1);
+    setenv("KOVEN_TICK_RATE", "10", 1);
+    setenv("KOVEN_MQTT_QOS", "0", 1);
+    setenv("KOVEN_EVENT_QOS", "tiered", 1);
+    setenv("KOVEN_TRANSPORT", "unix", 1);
+
+    char *argv[] = {"koven"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 1, argv));
+
+    TEST_ASSERT_EQUAL_UINT32(3, config.transport.shard_id);
+    TEST_ASSERT_EQUAL_size_t(1000, config.fleet_size);
+    TEST_ASSERT_EQUAL_UINT32(3000, config.first_id);
+    TEST_ASSERT_EQUAL_size_t(8, config.workers);
+    TEST_ASSERT_TRUE(config.schedule.tick_rate == 10.0);
+    TEST_ASSERT_EQUAL_INT(0, config.transport.qos);
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_QOS_TIERED, config.transport.qos_mode);
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_UNIX, config.transport.kind);
+}
+
+void test_config_flags_override_environment(void)
+{
+    setenv("KOVEN_TICK_RATE", "10", 1);
+    setenv("KOVEN_SHARD_ID", "3", 1);
+
+    setenv("KOVEN_EVENT_QOS", "tiered", 1);
+
+    char *argv[] = {"koven",
+                    "--tick-rate",
+                    "20",
+                    "--shard-id=4",
+                    "--acceleration",
+                    "60",
+                    "--event-qos=retained"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 7, argv));
+
+    TEST_ASSERT_TRUE(config.schedule.tick_rate == 20.0);
+    TEST_ASSERT_EQUAL_UINT32(4, config.transport.shard_id);
+    TEST_ASSERT_TRUE(config.schedule.acceleration == 60.0);
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_QOS_RETAINED, config.transport.qos_mode);
+}
+
+void test_config_oven_range(void)
+{
+    setenv("KOVEN_FLEET_SIZE", "5", 1);
+    setenv("KOVEN_OVENS", "1000-1999", 1);
+
+    char *argv[] = {"koven"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 1, argv));
+    TEST_ASSERT_EQUAL_UINT32(1000, config.first_id);
+    TEST_ASSERT_EQUAL_size_t(1000, config.fleet_size);
+
+    // The last of several flags wins
+    char *flags[] = {"koven", "--ovens", "7-7", "--fleet-size", "2"};
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 5, flags));
+    TEST_ASSERT_EQUAL_UINT32(7, config.first_id);
+    TEST_ASSERT_EQUAL_size_t(2, config.fleet_size);
+
+    char *reversed[] = {"koven", "--ovens", "9-3"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, reversed));
+    char *open[] = {"koven", "--ovens", "9-"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, open));
+    char *single[] = {"koven", "--ovens", "9"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, single));
+}
+
+void test_config_address_alias(void)
+{
+    setenv("MQTT_BROKER", "tcp://broker:1883", 1);
+
+    char *argv[] = {"koven"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 1, argv));
+    TEST_ASSERT_EQUAL_STRING("tcp://broker:1883", config.transport.address);
+
+    setenv("KOVEN_TRANSPORT_ADDRESS", "tcp://other:1883", 1);
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 1, argv));
+    TEST_ASSERT_EQUAL_STRING("tcp://other:1883", config.transport.address);
+}
+
+void test_config_ignores_invalid_environment(void)
+{
+    setenv("KOVEN_TICK_RATE", "fast", 1);
+    setenv("KOVEN_MQTT_QOS", "3", 1);
+    setenv("KOVEN_FLEET_SIZE", "-1", 1);
+    setenv("KOVEN_FLEET_CONNECTIONS", "0", 1);
+    setenv("KOVEN_SPOOL_POLICY", "oldest", 1);
+    setenv("KOVEN_SPOOL_CAPACITY", "0", 1);
+
+    char *argv[] = {"koven"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 1, argv));
+    TEST_ASSERT_TRUE(config.schedule.tick_rate == 1.0);
+    TEST_ASSERT_EQUAL_INT(MQTT_QOS, config.transport.qos);
+    TEST_ASSERT_EQUAL_size_t(0, config.fleet_size);
+    TEST_ASSERT_EQUAL_size_t(CONFIG_DEFAULT_FLEET_CONNECTIONS, config.connections);
+    TEST_ASSERT_EQUAL_INT(SPOOL_DROP_OLDEST, config.reconnect.spool_policy);
+    TEST_ASSERT_EQUAL_size_t(MQTT_SPOOL_CAPACITY, config.reconnect.spool_capacity);
+}
+
+void test_config_rejects_invalid_flags(void)
+{
+    KovenConfig config;
+
+    char *unknown[] = {"koven", "--colour", "red"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, unknown));
+    char *missing[] = {"koven", "--qos"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 2, missing));
+    char *invalid[] = {"koven", "--qos", "3"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, invalid));
+    char *mode[] = {"koven", "--event-qos", "best"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, mode));
+    char *positional[] = {"koven", "fleet"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 2, positional));
+    char *negative[] = {"koven", "--tick-rate", "-1"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 3, negative));
+
+    // Lost or retained deltas would leave the platform without the state they apply over
+    char *delta[] = {"koven", "--event-qos", "tiered", "--event-mode", "delta"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 5, delta));
+    char *changes[] = {"koven", "--event-qos", "retained", "--event-mode", "changes"};
+    TEST_ASSERT_EQUAL_INT(0, load(&config, 5, changes));
+
+    // A fleet may not run past the last oven id
+    char *overflow[] = {"koven", "--first-id", "4294967295", "--fleet-size", "2"};
+    TEST_ASSERT_EQUAL_INT(-1, load(&config, 5, overflow));
+}
+
+void test_config_help(void)
+{
+    char *argv[] = {"koven", "--tick-rate", "2", "--help"};
+    KovenConfig config;
+    TEST_ASSERT_EQUAL_INT(1, load(&config, 4, argv));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Config Tests
+    RUN_TEST(test_config_defaults);
+    RUN_TEST(test_config_reads_environment);
+    RUN_TEST(test_config_flags_override_environment);
+    RUN_TEST(test_config_oven_range);
+    RUN_TEST(test_config_address_alias);
+
+    // Edge Cases
+    RUN_TEST(test_config_ignores_invalid_environment);
+    RUN_TEST(test_config_rejects_invalid_flags);
+    RUN_TEST(test_config_help);
+
+    return UNITY_END();
+}
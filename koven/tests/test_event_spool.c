@@ -0,0 +1,164 @@
+#include "../event_spool.h"
+#include "../external/unity.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static EventPayload event_at(int16_t temperature)
+{
+    EventPayload event = {STATE_PREHEATING, temperature, 0, 60, 180};
+    return event;
+}
+
+void test_spool_policy_from_string(void)
+{
+    SpoolPolicy policy;
+    TEST_ASSERT_EQUAL_INT(0, spool_policy_from_string("oldest", &policy));
+    TEST_ASSERT_EQUAL_INT(SPOOL_DROP_OLDEST, policy);
+    TEST_ASSERT_EQUAL_INT(0, spool_policy_from_string("latest", &policy));
+    TEST_ASSERT_EQUAL_INT(SPOOL_LATEST_PER_OVEN, policy);
+    TEST_ASSERT_EQUAL_INT(-1, spool_policy_from_string("newest", &policy));
+    TEST_ASSERT_EQUAL_INT(-1, spool_policy_from_string(NULL, &policy));
+    TEST_ASSERT_EQUAL_STRING("latest", spool_policy_to_string(SPOOL_LATEST_PER_OVEN));
+}
+
+void test_spool_drop_oldest_keeps_order(void)
+{
+    EventSpool spool;
+    TEST_ASSERT_EQUAL_INT(0, spool_init(&spool, SPOOL_DROP_OLDEST, 3, 10, 5));
+
+    for (int16_t t = 1; t <= 5; t++)
+    {
+        EventPayload event = event_at(t);
+        TEST_ASSERT_EQUAL_INT(0, spool_push(&spool, 10 + (uint32_t)(t % 2), &event));
+    }
+
+    // The two oldest events were evicted
+    uint32_t ids[4];
+    EventPayload events[4];
+    TEST_ASSERT_EQUAL_size_t(3, spool_peek(&spool, ids, events, 4));
+    TEST_ASSERT_EQUAL_UINT64(2, spool.dropped);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_INT16(3 + i, events[i].current_temperature);
+        TEST_ASSERT_EQUAL_UINT32(10 + (uint32_t)((3 + i) % 2), ids[i]);
+    }
+
+    spool_free(&spool);
+}
+
+void test_spool_latest_per_oven_replaces_in_place(void)
+{
+    EventSpool spool;
+    TEST_ASSERT_EQUAL_INT(0, spool_init(&spool, SPOOL_LATEST_PER_OVEN, 0, 100, 3));
+
+    EventPayload event = event_at(1);
+    spool_push(&spool, 102, &event);
+    event = event_at(2);
+    spool_push(&spool, 100, &event);
+    event = event_at(3);
+    spool_push(&spool, 102, &event);
+
+    // Oven 102 keeps its place with its latest event
+    uint32_t ids[3];
+    EventPayload events[3];
+    TEST_ASSERT_EQUAL_size_t(2, spool_peek(&spool, ids, events, 3));
+    TEST_ASSERT_EQUAL_UINT32(102, ids[0]);
+    TEST_ASSERT_EQUAL_INT16(3, events[0].current_temperature);
+    TEST_ASSERT_EQUAL_UINT32(100, ids[1]);
+    TEST_ASSERT_EQUAL_INT16(2, events[1].current_temperature);
+    TEST_ASSERT_EQUAL_UINT64(1, spool.dropped);
+
+    // Once flushed, an oven is spooled again at the back
+    spool_pop(&spool, 1);
+    event = event_at(4);
+    spool_push(&spool, 102, &event);
+    TEST_ASSERT_EQUAL_size_t(2, spool_peek(&spool, ids, events, 3));
+    TEST_ASSERT_EQUAL_UINT32(100, ids[0]);
+    TEST_ASSERT_EQUAL_UINT32(102, ids[1]);
+    TEST_ASSERT_EQUAL_INT16(4, events[1].current_temperature);
+    TEST_ASSERT_EQUAL_UINT64(1, spool.flushed);
+
+    spool_free(&spool);
+}
+
+void test_spool_peek_and_pop_in_batches(void)
+{
+    EventSpool spool;
+    TEST_ASSERT_EQUAL_INT(0, spool_init(&spool, SPOOL_LATEST_PER_OVEN, 0, 0, 1000));
+
+    for (uint32_t id = 0; id < 1000; id++)
+    {
+        EventPayload event = event_at((int16_t)id);
+        spool_push(&spool, id, &event);
+    }
+
+    uint32_t ids[256];
+    EventPayload events[256];
+    uint32_t expected = 0;
+    while (spool_count(&spool) > 0)
+    {
+        size_t n = spool_peek(&spool, ids, events, 256);
+        for (size_t i = 0; i < n; i++, expected++)
+        {
+            TEST_ASSERT_EQUAL_UINT32(expected, ids[i]);
+            TEST_ASSERT_EQUAL_INT16((int16_t)expected, events[i].current_temperature);
+        }
+        spool_pop(&spool, n);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1000, expected);
+    TEST_ASSERT_EQUAL_UINT64(1000, spool.flushed);
+
+    spool_free(&spool);
+}
+
+void test_spool_rejects_unknown_ovens(void)
+{
+    EventSpool spool;
+    TEST_ASSERT_EQUAL_INT(0, spool_init(&spool, SPOOL_LATEST_PER_OVEN, 0, 10, 2));
+
+    EventPayload event = event_at(1);
+    TEST_ASSERT_EQUAL_INT(-1, spool_push(&spool, 9, &event));
+    TEST_ASSERT_EQUAL_INT(-1, spool_push(&spool, 12, &event));
+    TEST_ASSERT_EQUAL_size_t(0, spool_count(&spool));
+
+    // Popping more than spooled empties the spool
+    TEST_ASSERT_EQUAL_INT(0, spool_push(&spool, 11, &event));
+    spool_pop(&spool, 5);
+    TEST_ASSERT_EQUAL_size_t(0, spool_count(&spool));
+
+    spool_free(&spool);
+}
+
+void test_spool_invalid_arguments(void)
+{
+    EventSpool spool;
+    TEST_ASSERT_EQUAL_INT(-1, spool_init(&spool, SPOOL_DROP_OLDEST, 0, 0, 10));
+    TEST_ASSERT_EQUAL_INT(-1, spool_init(&spool, SPOOL_LATEST_PER_OVEN, 0, 0, 0));
+    TEST_ASSERT_EQUAL_INT(-1, spool_init(NULL, SPOOL_DROP_OLDEST, 1, 0, 1));
+
+    // Should not crash
+    EventPayload event = event_at(1);
+    TEST_ASSERT_EQUAL_INT(-1, spool_push(NULL, 0, &event));
+    TEST_ASSERT_EQUAL_size_t(0, spool_peek(NULL, NULL, NULL, 1));
+    spool_pop(NULL, 1);
+    spool_free(NULL);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Spool Tests
+    RUN_TEST(test_spool_policy_from_string);
+    RUN_TEST(test_spool_drop_oldest_keeps_order);
+    RUN_TEST(test_spool_latest_per_oven_replaces_in_place);
+    RUN_TEST(test_spool_peek_and_pop_in_batches);
+
+    // Edge Cases
+    RUN_TEST(test_spool_rejects_unknown_ovens);
+    RUN_TEST(test_spool_invalid_arguments);
+
+    return UNITY_END();
+}
@@ -0,0 +1,383 @@
+#include "../event_tracker.h"
+#include "../external/unity.h"
+#include "../fleet.h"
+#include "../protocol.h"
+#include <limits.h>
+#include <string.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static EventPayload idle_event(void)
+{
+    EventPayload event;
+    memset(&event, 0, sizeof(event));
+    event.state = STATE_IDLE;
+    event.current_temperature = ROOM_TEMPERATURE;
+    event.remaining_time = -1;
+    event.programmed_duration = -1;
+    event.programmed_temperature = -1;
+    return event;
+}
+
+void test_event_tracker_full_mode_publishes_every_tick(void)
+{
+    EventPolicy policy = {EVENT_MODE_FULL, 0};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+
+    EventPayload event = idle_event();
+    for (int tick = 0; tick < 5; tick++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+    }
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_changes_mode_skips_unchanged_events(void)
+{
+    EventPolicy policy = {EVENT_MODE_CHANGES, 0};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+
+    EventPayload event = idle_event();
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+
+    // Any change publishes the whole event
+    event.current_temperature++;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_delta_mode_reports_changed_fields(void)
+{
+    EventPolicy policy = {EVENT_MODE_DELTA, 0};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+
+    EventPayload event = idle_event();
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+
+    // START: preheating with a program
+    event.state = STATE_PREHEATING;
+    event.current_temperature = 26;
+    event.programmed_duration = 60;
+    event.programmed_temperature = 180;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELD_STATE | EVENT_FIELD_CURRENT_TEMPERATURE |
+                               EVENT_FIELD_PROGRAMMED_DURATION |
+                               EVENT_FIELD_PROGRAMMED_TEMPERATURE,
+                           event_tracker_update(&tracker, 0, &event));
+
+    event.current_temperature = 27;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELD_CURRENT_TEMPERATURE,
+                           event_tracker_update(&tracker, 0, &event));
+
+    event.remaining_time = 59;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELD_REMAINING_TIME, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_heartbeat(void)
+{
+    EventPolicy policy = {EVENT_MODE_DELTA, 4};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+
+    EventPayload event = idle_event();
+    uint8_t published[12];
+    for (int tick = 0; tick < 12; tick++)
+    {
+        published[tick] = event_tracker_update(&tracker, 0, &event);
+    }
+
+    // The first event and then every fourth tick carry the full state
+    static const uint8_t expected[12] = {EVENT_FIELDS_ALL, 0, 0, 0, EVENT_FIELDS_ALL, 0,
+                                         0, 0, EVENT_FIELDS_ALL, 0, 0, 0};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, published, 12);
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_heartbeat_counts_from_last_full_event(void)
+{
+    EventPolicy policy = {EVENT_MODE_CHANGES, 3};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+
+    EventPayload event = idle_event();
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+
+    // A change is a full event in this mode, so the heartbeat starts over
+    event.state = STATE_PREHEATING;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, &event));
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_tracker_update(&tracker, 0, &event));
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_unchanged_matches_update(void)
+{
+    EventPolicy policies[] = {{EVENT_MODE_FULL, 0}, {EVENT_MODE_CHANGES, 0}, {EVENT_MODE_DELTA, 5}};
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+    {
+        EventTracker updated;
+        EventTracker unchanged;
+        TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&updated, &policies[p], 3));
+        TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&unchanged, &policies[p], 3));
+
+        EventPayload event = idle_event();
+        for (size_t i = 0; i < 3; i++)
+        {
+            event_tracker_update(&updated, i, &event);
+            event_tracker_update(&unchanged, i, &event);
+        }
+
+        // An oven left alone publishes exactly what updating it with the same event would
+        for (int tick = 0; tick < 12; tick++)
+        {
+            for (size_t i = 0; i < 3; i++)
+            {
+                TEST_ASSERT_EQUAL_HEX8(event_tracker_update(&updated, i, &event),
+                                       event_tracker_unchanged(&unchanged, i));
+            }
+        }
+        TEST_ASSERT_EQUAL_MEMORY(&event, &unchanged.last[2], sizeof(event));
+
+        event_tracker_free(&updated);
+        event_tracker_free(&unchanged);
+    }
+}
+
+void test_event_tracker_heartbeats_are_staggered(void)
+{
+    enum
+    {
+        BLOCKS = 10,
+        OVENS = BLOCKS * FLEET_BLOCK_SIZE,
+        INTERVAL = 5
+    };
+
+    EventPolicy policy = {EVENT_MODE_CHANGES, INTERVAL};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, OVENS));
+
+    EventPayload event = idle_event();
+    for (size_t i = 0; i < OVENS; i++)
+    {
+        event_tracker_update(&tracker, i, &event);
+    }
+
+    // Once started, every tick refreshes the same share of an unchanged fleet, by whole blocks
+    for (int tick = 0; tick < 3 * INTERVAL; tick++)
+    {
+        size_t refreshed = 0;
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            uint8_t fields = event_tracker_update(&tracker, i, &event);
+            TEST_ASSERT_EQUAL_HEX8(fields, tracker.age[i - i % FLEET_BLOCK_SIZE] == 0
+                                               ? EVENT_FIELDS_ALL
+                                               : 0);
+            refreshed += fields != 0;
+        }
+        TEST_ASSERT_EQUAL_size_t(OVENS / INTERVAL, refreshed);
+    }
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_skip_matches_unchanged(void)
+{
+    enum
+    {
+        OVENS = 4,
+        INTERVAL = 6
+    };
+
+    EventPolicy policy = {EVENT_MODE_DELTA, INTERVAL};
+    EventTracker skipped;
+    EventTracker unchanged;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&skipped, &policy, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&unchanged, &policy, OVENS));
+
+    // A delta event is not a full one: oven 1 is a tick closer to its heartbeat than ovens 0 and
+    // 2, and oven 3 never published
+    EventPayload event = idle_event();
+    for (size_t i = 0; i < 3; i++)
+    {
+        event_tracker_update(&skipped, i, &event);
+        event_tracker_update(&unchanged, i, &event);
+        event_tracker_unchanged(&skipped, i);
+        event_tracker_unchanged(&unchanged, i);
+    }
+    event.state = STATE_PREHEATING;
+    event_tracker_update(&skipped, 1, &event);
+    event_tracker_update(&unchanged, 1, &event);
+
+    // Skipping the quiet rounds and then going on oven by oven publishes exactly what going oven
+    // by oven all along does
+    unsigned quiet = event_tracker_quiet_rounds(&skipped, 0, OVENS);
+    TEST_ASSERT_EQUAL_UINT(INTERVAL - 3, quiet);
+    event_tracker_skip(&skipped, 0, OVENS, quiet);
+    for (unsigned round = 0; round < quiet; round++)
+    {
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            TEST_ASSERT_EQUAL_HEX8(0, event_tracker_unchanged(&unchanged, i));
+        }
+    }
+    for (int round = 0; round < 2 * INTERVAL; round++)
+    {
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            TEST_ASSERT_EQUAL_HEX8(event_tracker_unchanged(&unchanged, i),
+                                   event_tracker_unchanged(&skipped, i));
+        }
+    }
+    TEST_ASSERT_EQUAL_MEMORY(unchanged.age, skipped.age, OVENS * sizeof(unsigned));
+
+    event_tracker_free(&skipped);
+    event_tracker_free(&unchanged);
+}
+
+void test_event_tracker_quiet_rounds(void)
+{
+    EventPolicy full = {EVENT_MODE_FULL, 0};
+    EventPolicy never = {EVENT_MODE_CHANGES, 0};
+    EventTracker tracker;
+    EventPayload event = idle_event();
+
+    // Every round publishes in EVENT_MODE_FULL, none without heartbeats
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &full, 2));
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_EQUAL_UINT(0, event_tracker_quiet_rounds(&tracker, 0, 2));
+    event_tracker_free(&tracker);
+
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &never, 2));
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_EQUAL_UINT(UINT_MAX, event_tracker_quiet_rounds(&tracker, 0, 2));
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_reports_transitions(void)
+{
+    EventPolicy policy = {EVENT_MODE_FULL, 0};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+
+    // The first event is a transition, telemetry of the same state is not
+    EventPayload event = idle_event();
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_TRUE(event_tracker_transition(&tracker, 0));
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_FALSE(event_tracker_transition(&tracker, 0));
+
+    event.state = STATE_PREHEATING;
+    event.current_temperature = 30;
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_TRUE(event_tracker_transition(&tracker, 0));
+    event.current_temperature = 35;
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_FALSE(event_tracker_transition(&tracker, 0));
+
+    event.state = STATE_BAKING;
+    event_tracker_update(&tracker, 0, &event);
+    TEST_ASSERT_TRUE(event_tracker_transition(&tracker, 0));
+    event_tracker_unchanged(&tracker, 0);
+    TEST_ASSERT_FALSE(event_tracker_transition(&tracker, 0));
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_ovens_are_independent(void)
+{
+    EventPolicy policy = {EVENT_MODE_DELTA, 0};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 2));
+
+    EventPayload event = idle_event();
+    event_tracker_update(&tracker, 0, &event);
+    event_tracker_update(&tracker, 1, &event);
+
+    EventPayload hot = event;
+    hot.current_temperature = 100;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELD_CURRENT_TEMPERATURE,
+                           event_tracker_update(&tracker, 0, &hot));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 1, &event));
+
+    event_tracker_free(&tracker);
+}
+
+void test_event_tracker_invalid_arguments(void)
+{
+    EventPolicy policy = {EVENT_MODE_DELTA, 0};
+    EventTracker tracker;
+    EventPayload event = idle_event();
+
+    TEST_ASSERT_EQUAL_INT(-1, event_tracker_init(NULL, &policy, 1));
+    TEST_ASSERT_EQUAL_INT(-1, event_tracker_init(&tracker, NULL, 1));
+    TEST_ASSERT_EQUAL_INT(-1, event_tracker_init(&tracker, &policy, 0));
+
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 1));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 1, &event));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(&tracker, 0, NULL));
+    TEST_ASSERT_EQUAL_HEX8(0, event_tracker_update(NULL, 0, &event));
+    event_tracker_free(&tracker);
+
+    // Should not crash
+    event_tracker_free(NULL);
+}
+
+void test_event_mode_from_string(void)
+{
+    EventMode mode;
+
+    TEST_ASSERT_EQUAL_INT(0, event_mode_from_string("full", &mode));
+    TEST_ASSERT_EQUAL_INT(EVENT_MODE_FULL, mode);
+    TEST_ASSERT_EQUAL_INT(0, event_mode_from_string("changes", &mode));
+    TEST_ASSERT_EQUAL_INT(EVENT_MODE_CHANGES, mode);
+    TEST_ASSERT_EQUAL_INT(0, event_mode_from_string("delta", &mode));
+    TEST_ASSERT_EQUAL_INT(EVENT_MODE_DELTA, mode);
+
+    TEST_ASSERT_EQUAL_INT(-1, event_mode_from_string("DELTA", &mode));
+    TEST_ASSERT_EQUAL_INT(-1, event_mode_from_string("", &mode));
+    TEST_ASSERT_EQUAL_INT(-1, event_mode_from_string(NULL, &mode));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Event Mode Tests
+    RUN_TEST(test_event_tracker_full_mode_publishes_every_tick);
+    RUN_TEST(test_event_tracker_changes_mode_skips_unchanged_events);
+    RUN_TEST(test_event_tracker_delta_mode_reports_changed_fields);
+
+    // Heartbeat Tests
+    RUN_TEST(test_event_tracker_heartbeat);
+    RUN_TEST(test_event_tracker_heartbeat_counts_from_last_full_event);
+    RUN_TEST(test_event_tracker_heartbeats_are_staggered);
+    RUN_TEST(test_event_tracker_unchanged_matches_update);
+    RUN_TEST(test_event_tracker_skip_matches_unchanged);
+    RUN_TEST(test_event_tracker_quiet_rounds);
+
+    // Transition Tests
+    RUN_TEST(test_event_tracker_reports_transitions);
+
+    // Edge Cases
+    RUN_TEST(test_event_tracker_ovens_are_independent);
+    RUN_TEST(test_event_tracker_invalid_arguments);
+    RUN_TEST(test_event_mode_from_string);
+
+    return UNITY_END();
+}
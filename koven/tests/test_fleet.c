@@ -0,0 +1,409 @@
+#include "../external/unity.h"
+#include "../fleet.h"
+#include "../koven.h"
+#include <string.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_fleet_init_all_ovens_idle(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 100, 16));
+
+    TEST_ASSERT_EQUAL_UINT32(100, fleet.first_id);
+    TEST_ASSERT_EQUAL_size_t(16, fleet.count);
+
+    for (size_t i = 0; i < fleet.count; i++)
+    {
+        Koven koven;
+        fleet_get(&fleet, i, &koven);
+
+        TEST_ASSERT_EQUAL_INT(STATE_IDLE, koven.state);
+        TEST_ASSERT_EQUAL_INT16(25, koven.current_temperature);
+        TEST_ASSERT_EQUAL_INT16(-1, koven.remaining_time);
+        TEST_ASSERT_EQUAL_INT16(-1, koven.programmed_duration);
+        TEST_ASSERT_EQUAL_INT16(-1, koven.programmed_temperature);
+    }
+
+    fleet_free(&fleet);
+}
+
+void test_fleet_init_invalid_arguments(void)
+{
+    KovenFleet fleet;
+
+    TEST_ASSERT_EQUAL_INT(-1, fleet_init(NULL, 0, 16));
+    TEST_ASSERT_EQUAL_INT(-1, fleet_init(&fleet, 0, 0));
+    // The last id would not fit in 32 bits
+    TEST_ASSERT_EQUAL_INT(-1, fleet_init(&fleet, UINT32_MAX, 2));
+}
+
+void test_fleet_index_bounds(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 10, 5));
+
+    size_t index;
+    TEST_ASSERT_EQUAL_INT(0, fleet_index(&fleet, 10, &index));
+    TEST_ASSERT_EQUAL_size_t(0, index);
+    TEST_ASSERT_EQUAL_INT(0, fleet_index(&fleet, 14, &index));
+    TEST_ASSERT_EQUAL_size_t(4, index);
+
+    TEST_ASSERT_EQUAL_INT(-1, fleet_index(&fleet, 9, &index));
+    TEST_ASSERT_EQUAL_INT(-1, fleet_index(&fleet, 15, &index));
+    TEST_ASSERT_EQUAL_INT(-1, fleet_index(&fleet, 10, NULL));
+
+    fleet_free(&fleet);
+}
+
+void test_fleet_execute_targets_single_oven(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 8));
+
+    CommandPayload cmd;
+    cmd.action = ACTION_START;
+    cmd.temperature = 180;
+    cmd.duration = 600;
+
+    TEST_ASSERT_EQUAL_INT(0, fleet_execute(&fleet, 3, &cmd));
+
+    for (size_t i = 0; i < fleet.count; i++)
+    {
+        Koven koven;
+        fleet_get(&fleet, i, &koven);
+
+        if (i == 3)
+        {
+            TEST_ASSERT_EQUAL_INT(STATE_PREHEATING, koven.state);
+            TEST_ASSERT_EQUAL_INT16(180, koven.programmed_temperature);
+            TEST_ASSERT_EQUAL_INT16(600, koven.programmed_duration);
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_INT(STATE_IDLE, koven.state);
+        }
+    }
+
+    fleet_free(&fleet);
+}
+
+void test_fleet_execute_unknown_oven(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 8));
+
+    CommandPayload cmd;
+    cmd.action = ACTION_START;
+    cmd.temperature = 180;
+    cmd.duration = 600;
+
+    TEST_ASSERT_EQUAL_INT(-1, fleet_execute(&fleet, 8, &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, fleet_execute(&fleet, 0, NULL));
+
+    fleet_free(&fleet);
+}
+
+void test_koven_tick_batch_matches_single_oven(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 4));
+
+    Koven reference;
+    koven_init(&reference);
+
+    CommandPayload cmd;
+    cmd.action = ACTION_START;
+    cmd.temperature = 30;
+    cmd.duration = 3;
+
+    koven_execute(&reference, &cmd);
+    TEST_ASSERT_EQUAL_INT(0, fleet_execute(&fleet, 2, &cmd));
+
+    EventPayload events[4];
+    EventPayload expected;
+
+    // Run the oven through a whole bake and back to idle
+    for (int tick = 0; tick < 20; tick++)
+    {
+        koven_tick_batch(&fleet, fleet.count, events);
+        koven_tick(&reference, &expected);
+
+        TEST_ASSERT_EQUAL_MEMORY(&expected, &events[2], sizeof(EventPayload));
+        TEST_ASSERT_EQUAL_INT(STATE_IDLE, events[0].state);
+        TEST_ASSERT_EQUAL_INT(STATE_IDLE, events[3].state);
+    }
+
+    TEST_ASSERT_EQUAL_INT(STATE_IDLE, events[2].state);
+
+    fleet_free(&fleet);
+}
+
+// Small deterministic generator so that failures are reproducible
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+// Picks values around the thresholds of the state machine, plus the int16_t extremes
+static int16_t random_field(uint32_t *seed)
+{
+    static const int16_t interesting[] = {-32768, -1, 0, 1, 2, 24, 25, 26, 27, 180, 32766, 32767};
+
+    uint32_t r = next_random(seed);
+    if (r & 1)
+    {
+        return interesting[(r >> 1) % (sizeof(interesting) / sizeof(interesting[0]))];
+    }
+    return (int16_t)((r >> 1) % 64);
+}
+
+void test_koven_tick_batch_matches_scalar_on_random_states(void)
+{
+    enum
+    {
+        OVENS = 1021,
+        TICKS = 64
+    };
+
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, OVENS));
+
+    static Koven reference[OVENS];
+    static EventPayload events[OVENS];
+    uint32_t seed = 42;
+
+    for (size_t i = 0; i < OVENS; i++)
+    {
+        // Mostly valid states, with a few unknown ones that must be left untouched
+        reference[i].state = (State)(next_random(&seed) % 5);
+        reference[i].current_temperature = random_field(&seed);
+        reference[i].remaining_time = random_field(&seed);
+        reference[i].programmed_duration = random_field(&seed);
+        reference[i].programmed_temperature = random_field(&seed);
+        fleet_set(&fleet, i, &reference[i]);
+    }
+
+    for (int tick = 0; tick < TICKS; tick++)
+    {
+        koven_tick_batch(&fleet, fleet.count, events);
+
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            EventPayload expected;
+            koven_tick(&reference[i], &expected);
+            TEST_ASSERT_EQUAL_MEMORY(&expected, &events[i], sizeof(EventPayload));
+
+            Koven koven;
+            fleet_get(&fleet, i, &koven);
+            TEST_ASSERT_EQUAL_INT(reference[i].state, koven.state);
+            TEST_ASSERT_EQUAL_INT16(reference[i].current_temperature, koven.current_temperature);
+            TEST_ASSERT_EQUAL_INT16(reference[i].remaining_time, koven.remaining_time);
+            TEST_ASSERT_EQUAL_INT16(reference[i].programmed_duration, koven.programmed_duration);
+            TEST_ASSERT_EQUAL_INT16(reference[i].programmed_temperature,
+                                    koven.programmed_temperature);
+        }
+    }
+
+    fleet_free(&fleet);
+}
+
+void test_koven_tick_batch_partial_fleet(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 40));
+
+    CommandPayload cmd;
+    cmd.action = ACTION_START;
+    cmd.temperature = 180;
+    cmd.duration = 600;
+    for (uint32_t id = 0; id < 40; id++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, fleet_execute(&fleet, id, &cmd));
+    }
+
+    // Only the first 17 ovens are ticked
+    EventPayload events[40];
+    koven_tick_batch(&fleet, 17, events);
+
+    for (size_t i = 0; i < 40; i++)
+    {
+        Koven koven;
+        fleet_get(&fleet, i, &koven);
+        TEST_ASSERT_EQUAL_INT16(i < 17 ? 26 : 25, koven.current_temperature);
+    }
+
+    fleet_free(&fleet);
+}
+
+void test_koven_tick_batch_null_arguments(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 4));
+
+    EventPayload events[4];
+
+    // Should not crash
+    koven_tick_batch(NULL, 4, events);
+    koven_tick_batch(&fleet, 4, NULL);
+
+    Koven koven;
+    fleet_get(&fleet, 0, &koven);
+    TEST_ASSERT_EQUAL_INT(STATE_IDLE, koven.state);
+
+    fleet_free(&fleet);
+}
+
+void test_koven_tick_active_matches_batch(void)
+{
+    enum
+    {
+        OVENS = 1000
+    };
+
+    KovenFleet active_fleet;
+    KovenFleet reference;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&active_fleet, 0, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, OVENS));
+
+    uint64_t active[1];
+    TEST_ASSERT_EQUAL_size_t(1, fleet_active_words(&active_fleet));
+    fleet_mark_all_active(&active_fleet, active);
+
+    // 16 blocks, the last one partial
+    TEST_ASSERT_EQUAL_HEX64(0xFFFF, active[0]);
+
+    static EventPayload events[OVENS];
+    static EventPayload expected[OVENS];
+    CommandPayload start = {ACTION_START, 30, 3};
+    CommandPayload stop = {ACTION_STOP, 0, 0};
+    for (int tick = 0; tick < 60; tick++)
+    {
+        // Short bakes started on a few ovens, and one stopped right away
+        if (tick % 10 == 0 && tick < 40)
+        {
+            uint32_t id = (uint32_t)(tick * 23 + 7) % OVENS;
+            fleet_execute(&active_fleet, id, &start);
+            fleet_execute(&reference, id, &start);
+            fleet_mark_active(active, id);
+        }
+        if (tick == 21)
+        {
+            fleet_execute(&active_fleet, 999, &stop);
+            fleet_execute(&reference, 999, &stop);
+            fleet_mark_active(active, 999);
+        }
+
+        size_t ticked = koven_tick_active(&active_fleet, active, events);
+        koven_tick_batch(&reference, OVENS, expected);
+
+        // Every oven is ticked once, then only the blocks of the two busy ovens and of the STOP
+        if (tick == 0)
+        {
+            TEST_ASSERT_EQUAL_size_t(OVENS, ticked);
+        }
+        else
+        {
+            TEST_ASSERT_TRUE(ticked <= 3 * FLEET_BLOCK_SIZE);
+        }
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            Koven a;
+            Koven b;
+            fleet_get(&active_fleet, i, &a);
+            fleet_get(&reference, i, &b);
+            TEST_ASSERT_EQUAL_MEMORY(&b, &a, sizeof(a));
+        }
+        TEST_ASSERT_EQUAL_MEMORY(expected, events, sizeof(expected));
+    }
+
+    // The last bake is over: nothing is ticked any more
+    TEST_ASSERT_EQUAL_HEX64(0, active[0]);
+    TEST_ASSERT_EQUAL_size_t(0, koven_tick_active(&active_fleet, active, events));
+
+    fleet_free(&active_fleet);
+    fleet_free(&reference);
+}
+
+void test_fleet_advance_matches_batch(void)
+{
+    KovenFleet advanced;
+    KovenFleet reference;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&advanced, 0, 100));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, 100));
+
+    for (uint32_t id = 0; id < 100; id += 3)
+    {
+        CommandPayload start = {ACTION_START, (int16_t)(30 + id), (int16_t)id};
+        fleet_execute(&advanced, id, &start);
+        fleet_execute(&reference, id, &start);
+    }
+
+    // Jumps of every length land where the same number of batch ticks does
+    EventPayload events[100];
+    uint32_t jumps[] = {0, 1, 2, 7, 40, 100, 250};
+    for (size_t j = 0; j < sizeof(jumps) / sizeof(jumps[0]); j++)
+    {
+        fleet_advance(&advanced, jumps[j]);
+        for (uint32_t t = 0; t < jumps[j]; t++)
+        {
+            koven_tick_batch(&reference, reference.count, events);
+        }
+
+        for (size_t i = 0; i < 100; i++)
+        {
+            Koven a;
+            Koven b;
+            fleet_get(&advanced, i, &a);
+            fleet_get(&reference, i, &b);
+            TEST_ASSERT_EQUAL_MEMORY(&b, &a, sizeof(a));
+        }
+    }
+
+    fleet_advance(NULL, 1);
+    fleet_free(&advanced);
+    fleet_free(&reference);
+}
+
+void test_fleet_free_null(void)
+{
+    // Should not crash
+    fleet_free(NULL);
+    TEST_ASSERT_TRUE(1);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // fleet_init Tests
+    RUN_TEST(test_fleet_init_all_ovens_idle);
+    RUN_TEST(test_fleet_init_invalid_arguments);
+
+    // fleet_index Tests
+    RUN_TEST(test_fleet_index_bounds);
+
+    // fleet_execute Tests
+    RUN_TEST(test_fleet_execute_targets_single_oven);
+    RUN_TEST(test_fleet_execute_unknown_oven);
+
+    // koven_tick_batch Tests
+    RUN_TEST(test_koven_tick_batch_matches_single_oven);
+    RUN_TEST(test_koven_tick_batch_matches_scalar_on_random_states);
+    RUN_TEST(test_koven_tick_batch_partial_fleet);
+    RUN_TEST(test_koven_tick_batch_null_arguments);
+
+    // koven_tick_active Tests
+    RUN_TEST(test_koven_tick_active_matches_batch);
+
+    // fleet_advance Tests
+    RUN_TEST(test_fleet_advance_matches_batch);
+
+    // fleet_free Tests
+    RUN_TEST(test_fleet_free_null);
+
+    return UNITY_END();
+}
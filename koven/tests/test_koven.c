@@ -2,6 +2,53 @@
 #include "../koven.h"
 #include <string.h>
 
+#ifdef KOVEN_TEST_BATCH_TICK
+#include "../fleet.h"
+
+// Differential build of this suite: every koven_tick call below also runs the same state
+// through koven_tick_batch, with enough ovens to cover both the vector and the scalar lanes,
+// and every oven of the batch must end up bit-identical to the scalar state machine
+#define DIFFERENTIAL_FLEET_SIZE 37
+
+static void differential_tick(Koven *koven, EventPayload *event)
+{
+    if (!koven || !event)
+    {
+        koven_tick(koven, event);
+        return;
+    }
+
+    KovenFleet fleet;
+    EventPayload events[DIFFERENTIAL_FLEET_SIZE];
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, DIFFERENTIAL_FLEET_SIZE));
+
+    for (size_t i = 0; i < fleet.count; i++)
+    {
+        fleet_set(&fleet, i, koven);
+    }
+
+    koven_tick(koven, event);
+    koven_tick_batch(&fleet, fleet.count, events);
+
+    for (size_t i = 0; i < fleet.count; i++)
+    {
+        Koven lane;
+        fleet_get(&fleet, i, &lane);
+
+        TEST_ASSERT_EQUAL_MEMORY(event, &events[i], sizeof(EventPayload));
+        TEST_ASSERT_EQUAL_INT(koven->state, lane.state);
+        TEST_ASSERT_EQUAL_INT16(koven->current_temperature, lane.current_temperature);
+        TEST_ASSERT_EQUAL_INT16(koven->remaining_time, lane.remaining_time);
+        TEST_ASSERT_EQUAL_INT16(koven->programmed_duration, lane.programmed_duration);
+        TEST_ASSERT_EQUAL_INT16(koven->programmed_temperature, lane.programmed_temperature);
+    }
+
+    fleet_free(&fleet);
+}
+
+#define koven_tick differential_tick
+#endif
+
 void setUp(void) {}
 
 void tearDown(void) {}
@@ -446,6 +493,137 @@ void test_stop_during_baking_should_cool_down(void)
     assert_event_payload(&event, STATE_IDLE, 25, -1, -1, -1);
 }
 
+// Small deterministic generator so that failures are reproducible
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+// Picks values around the thresholds of the state machine, plus the int16_t extremes
+static int16_t random_field(uint32_t *seed)
+{
+    static const int16_t interesting[] = {-32768, -1, 0, 1, 2, 24, 25, 26, 27, 180, 32766, 32767};
+
+    uint32_t r = next_random(seed);
+    if (r & 1)
+    {
+        return interesting[(r >> 1) % (sizeof(interesting) / sizeof(interesting[0]))];
+    }
+    return (int16_t)((r >> 1) % 64);
+}
+
+static void assert_same_koven(const Koven *expected, const Koven *actual)
+{
+    TEST_ASSERT_EQUAL_INT(expected->state, actual->state);
+    TEST_ASSERT_EQUAL_INT16(expected->current_temperature, actual->current_temperature);
+    TEST_ASSERT_EQUAL_INT16(expected->remaining_time, actual->remaining_time);
+    TEST_ASSERT_EQUAL_INT16(expected->programmed_duration, actual->programmed_duration);
+    TEST_ASSERT_EQUAL_INT16(expected->programmed_temperature, actual->programmed_temperature);
+}
+
+void test_koven_state_at_full_bake(void)
+{
+    Koven koven;
+    koven_init(&koven);
+    CommandPayload cmd = {ACTION_START, 200, 3600};
+    koven_execute(&koven, &cmd);
+
+    Koven later;
+    koven_state_at(&koven, 0, &later);
+    assert_same_koven(&koven, &later);
+
+    // 175 ticks of preheating, the transition to baking, then the countdown
+    koven_state_at(&koven, 175, &later);
+    assert_koven_state(&later, STATE_PREHEATING, 200, -1, 200, 3600);
+    koven_state_at(&koven, 176, &later);
+    assert_koven_state(&later, STATE_BAKING, 200, 3600, 200, 3600);
+    koven_state_at(&koven, 176 + 3600, &later);
+    assert_koven_state(&later, STATE_BAKING, 200, 0, 200, 3600);
+
+    // Then 175 ticks of cooling down and the transition to idle
+    koven_state_at(&koven, 177 + 3600, &later);
+    assert_koven_state(&later, STATE_COOLING_DOWN, 200, 0, -1, -1);
+    koven_state_at(&koven, 177 + 3600 + 175, &later);
+    assert_koven_state(&later, STATE_COOLING_DOWN, 25, 0, -1, -1);
+    koven_state_at(&koven, 178 + 3600 + 175, &later);
+    assert_koven_state(&later, STATE_IDLE, 25, -1, -1, -1);
+    koven_state_at(&koven, UINT32_MAX, &later);
+    assert_koven_state(&later, STATE_IDLE, 25, -1, -1, -1);
+
+    TEST_ASSERT_EQUAL_UINT32(178 + 3600 + 175, koven_ticks_until_idle(&koven));
+}
+
+void test_koven_state_at_matches_ticks_on_random_states(void)
+{
+    uint32_t seed = 7;
+    for (int n = 0; n < 200; n++)
+    {
+        Koven start;
+        start.state = (State)(next_random(&seed) % 5);
+        start.current_temperature = random_field(&seed);
+        start.remaining_time = random_field(&seed);
+        start.programmed_duration = random_field(&seed);
+        start.programmed_temperature = random_field(&seed);
+
+        // Stepping tick after tick must go through every state koven_state_at jumps to
+        Koven stepped = start;
+        EventPayload event;
+        for (uint32_t ticks = 0; ticks <= 300; ticks++)
+        {
+            Koven jumped;
+            koven_state_at(&start, ticks, &jumped);
+            assert_same_koven(&stepped, &jumped);
+            koven_tick(&stepped, &event);
+        }
+    }
+}
+
+void test_koven_ticks_until_idle_on_random_states(void)
+{
+    uint32_t seed = 11;
+    for (int n = 0; n < 1000; n++)
+    {
+        Koven start;
+        start.state = (State)(next_random(&seed) % 4);
+        start.current_temperature = random_field(&seed);
+        start.remaining_time = random_field(&seed);
+        start.programmed_duration = random_field(&seed);
+        start.programmed_temperature = random_field(&seed);
+
+        uint32_t ticks = koven_ticks_until_idle(&start);
+        Koven later;
+        koven_state_at(&start, ticks, &later);
+        TEST_ASSERT_EQUAL_INT(STATE_IDLE, later.state);
+        if (ticks > 0)
+        {
+            koven_state_at(&start, ticks - 1, &later);
+            TEST_ASSERT_NOT_EQUAL(STATE_IDLE, later.state);
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_INT(STATE_IDLE, start.state);
+        }
+    }
+}
+
+void test_koven_state_at_in_place(void)
+{
+    Koven koven;
+    koven_init(&koven);
+    CommandPayload cmd = {ACTION_START, 30, 3};
+    koven_execute(&koven, &cmd);
+
+    koven_state_at(&koven, 8, &koven);
+    assert_koven_state(&koven, STATE_BAKING, 30, 1, 30, 3);
+
+    // NULL arguments are ignored
+    koven_state_at(NULL, 1, &koven);
+    koven_state_at(&koven, 1, NULL);
+    assert_koven_state(&koven, STATE_BAKING, 30, 1, 30, 3);
+    TEST_ASSERT_EQUAL_UINT32(0, koven_ticks_until_idle(NULL));
+}
+
 void test_state_to_string_all_states(void)
 {
     TEST_ASSERT_EQUAL_STRING("idle", state_to_string(STATE_IDLE));
@@ -514,6 +692,12 @@ int main(void)
     RUN_TEST(test_stop_during_preheating_should_cool_down);
     RUN_TEST(test_stop_during_baking_should_cool_down);
 
+    // koven_state_at Tests
+    RUN_TEST(test_koven_state_at_full_bake);
+    RUN_TEST(test_koven_state_at_matches_ticks_on_random_states);
+    RUN_TEST(test_koven_ticks_until_idle_on_random_states);
+    RUN_TEST(test_koven_state_at_in_place);
+
     // Helper function tests
     RUN_TEST(test_state_to_string_all_states);
     RUN_TEST(test_state_to_string_invalid_state);
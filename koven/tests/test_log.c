@@ -0,0 +1,284 @@
+#include "../external/unity.h"
+#include "../log.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static FILE *out;
+static FILE *err;
+
+void setUp(void)
+{
+    out = tmpfile();
+    err = tmpfile();
+    log_set_level(LOG_LEVEL_DEBUG);
+    TEST_ASSERT_EQUAL_INT(0, log_start(out, err));
+}
+
+void tearDown(void)
+{
+    log_stop();
+    fclose(out);
+    fclose(err);
+    log_set_level(LOG_LEVEL_INFO);
+}
+
+// Stops the logger and reads back everything written to stream
+static char *read_stream(FILE *stream)
+{
+    log_stop();
+
+    static char contents[1 << 20];
+    rewind(stream);
+    size_t len = fread(contents, 1, sizeof(contents) - 1, stream);
+    contents[len] = '\0';
+    return contents;
+}
+
+static size_t count_lines(const char *text, const char *prefix)
+{
+    size_t count = 0;
+    size_t prefix_len = strlen(prefix);
+    for (const char *line = text; *line; line = strchr(line, '\n') + 1)
+    {
+        if (strncmp(line, prefix, prefix_len) == 0)
+        {
+            count++;
+        }
+        if (!strchr(line, '\n'))
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+void test_log_levels_and_streams(void)
+{
+    log_debug("debug %d", 1);
+    log_info("info %d", 2);
+    log_warn("warn %d", 3);
+    log_error("error %d", 4);
+
+    TEST_ASSERT_EQUAL_STRING("debug: debug 1\ninfo 2\n", read_stream(out));
+    TEST_ASSERT_EQUAL_STRING("warning: warn 3\nerror: error 4\n", read_stream(err));
+}
+
+void test_log_level_filter(void)
+{
+    log_set_level(LOG_LEVEL_WARN);
+
+    log_info("hidden");
+    log_warn("shown");
+    log_set_level(LOG_LEVEL_OFF);
+    log_error("hidden");
+
+    TEST_ASSERT_EQUAL_STRING("", read_stream(out));
+    TEST_ASSERT_EQUAL_STRING("warning: shown\n", read_stream(err));
+}
+
+void test_log_level_from_string(void)
+{
+    LogLevel level;
+
+    TEST_ASSERT_EQUAL_INT(0, log_level_from_string("debug", &level));
+    TEST_ASSERT_EQUAL_INT(LOG_LEVEL_DEBUG, level);
+    TEST_ASSERT_EQUAL_INT(0, log_level_from_string("warn", &level));
+    TEST_ASSERT_EQUAL_INT(LOG_LEVEL_WARN, level);
+    TEST_ASSERT_EQUAL_INT(0, log_level_from_string("off", &level));
+    TEST_ASSERT_EQUAL_INT(LOG_LEVEL_OFF, level);
+
+    TEST_ASSERT_EQUAL_INT(-1, log_level_from_string("verbose", &level));
+    TEST_ASSERT_EQUAL_INT(-1, log_level_from_string(NULL, &level));
+    TEST_ASSERT_EQUAL_INT(-1, log_level_from_string("info", NULL));
+}
+
+void test_log_truncates_long_messages(void)
+{
+    char message[LOG_LINE_SIZE * 2];
+    memset(message, 'x', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+
+    log_info("%s", message);
+
+    const char *text = read_stream(out);
+    TEST_ASSERT_EQUAL_size_t(LOG_LINE_SIZE, strlen(text));
+    TEST_ASSERT_EQUAL_CHAR('\n', text[LOG_LINE_SIZE - 1]);
+}
+
+void test_log_hex_dump(void)
+{
+    const uint8_t frame[] = {0x01, 0xAB, 0xFF};
+    log_debug_hex("Frame", frame, sizeof(frame));
+
+    TEST_ASSERT_EQUAL_STRING("debug: Frame (3 bytes): 01ABFF\n", read_stream(out));
+}
+
+void test_log_hex_dump_elides_long_buffers(void)
+{
+    uint8_t data[LOG_LINE_SIZE];
+    memset(data, 0x5A, sizeof(data));
+    log_debug_hex("Frame", data, sizeof(data));
+
+    const char *text = read_stream(out);
+    TEST_ASSERT_TRUE(strlen(text) <= strlen("debug: ") + LOG_LINE_SIZE);
+    TEST_ASSERT_NOT_NULL(strstr(text, "Frame (256 bytes): 5A5A"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "5A...\n"));
+}
+
+void test_log_limit_allow(void)
+{
+    LogLimit limit = {0};
+    uint64_t suppressed = 99;
+
+    TEST_ASSERT_EQUAL_INT(1, log_limit_allow(&limit, 1000, 5000, &suppressed));
+    TEST_ASSERT_EQUAL_UINT64(0, suppressed);
+
+    // Within the interval
+    TEST_ASSERT_EQUAL_INT(0, log_limit_allow(&limit, 1000, 5500, &suppressed));
+    TEST_ASSERT_EQUAL_INT(0, log_limit_allow(&limit, 1000, 5999, &suppressed));
+
+    // The next message reports the two suppressed ones
+    TEST_ASSERT_EQUAL_INT(1, log_limit_allow(&limit, 1000, 6000, &suppressed));
+    TEST_ASSERT_EQUAL_UINT64(2, suppressed);
+}
+
+void test_log_limited_call_site(void)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        log_limited(60 * 1000000000ull, LOG_LEVEL_INFO, "tick %d", i);
+    }
+
+    TEST_ASSERT_EQUAL_STRING("tick 0\n", read_stream(out));
+}
+
+void test_log_sampled_call_site(void)
+{
+    for (int i = 0; i < 7; i++)
+    {
+        log_sampled(3, LOG_LEVEL_INFO, "sample %d", i);
+    }
+
+    TEST_ASSERT_EQUAL_STRING("sample 0\nsample 3\nsample 6\n", read_stream(out));
+}
+
+void test_log_full_ring_drops(void)
+{
+    enum
+    {
+        MESSAGES = LOG_RING_SIZE * 8
+    };
+
+    uint64_t dropped_before = log_dropped();
+    for (int i = 0; i < MESSAGES; i++)
+    {
+        log_info("message %d", i);
+    }
+
+    // Every message is either written or counted as dropped, never blocked on
+    size_t written = count_lines(read_stream(out), "message ");
+    uint64_t dropped = log_dropped() - dropped_before;
+    TEST_ASSERT_EQUAL_UINT64(MESSAGES, written + dropped);
+
+    if (dropped > 0)
+    {
+        TEST_ASSERT_NOT_NULL(strstr(read_stream(err), "log messages dropped"));
+    }
+}
+
+enum
+{
+    PRODUCERS = 4,
+    MESSAGES_PER_PRODUCER = 500
+};
+
+static void *produce(void *arg)
+{
+    int producer = *(int *)arg;
+    for (int i = 0; i < MESSAGES_PER_PRODUCER; i++)
+    {
+        log_info("producer %d message %d", producer, i);
+    }
+    return NULL;
+}
+
+void test_log_concurrent_producers(void)
+{
+    pthread_t threads[PRODUCERS];
+    int ids[PRODUCERS];
+    uint64_t dropped_before = log_dropped();
+
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        ids[p] = p;
+        pthread_create(&threads[p], NULL, produce, &ids[p]);
+    }
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        pthread_join(threads[p], NULL);
+    }
+
+    char *text = read_stream(out);
+    uint64_t dropped = log_dropped() - dropped_before;
+
+    // The messages of each producer come out in the order they were logged
+    int last[PRODUCERS];
+    size_t written = 0;
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        last[p] = -1;
+    }
+    for (char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n"))
+    {
+        int producer, message;
+        TEST_ASSERT_EQUAL_INT(2, sscanf(line, "producer %d message %d", &producer, &message));
+        TEST_ASSERT_TRUE(producer >= 0 && producer < PRODUCERS);
+        TEST_ASSERT_TRUE(message > last[producer]);
+        last[producer] = message;
+        written++;
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(PRODUCERS * MESSAGES_PER_PRODUCER, written + dropped);
+}
+
+void test_log_start_twice(void)
+{
+    TEST_ASSERT_EQUAL_INT(-1, log_start(out, err));
+    TEST_ASSERT_EQUAL_INT(-1, log_start(NULL, NULL));
+
+    // Should not crash
+    log_stop();
+    log_stop();
+    TEST_ASSERT_EQUAL_INT(0, log_start(out, err));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Level Tests
+    RUN_TEST(test_log_levels_and_streams);
+    RUN_TEST(test_log_level_filter);
+    RUN_TEST(test_log_level_from_string);
+
+    // Formatting Tests
+    RUN_TEST(test_log_truncates_long_messages);
+    RUN_TEST(test_log_hex_dump);
+    RUN_TEST(test_log_hex_dump_elides_long_buffers);
+
+    // Rate Limit Tests
+    RUN_TEST(test_log_limit_allow);
+    RUN_TEST(test_log_limited_call_site);
+    RUN_TEST(test_log_sampled_call_site);
+
+    // Ring Tests
+    RUN_TEST(test_log_full_ring_drops);
+    RUN_TEST(test_log_concurrent_producers);
+
+    // Edge Cases
+    RUN_TEST(test_log_start_twice);
+
+    return UNITY_END();
+}
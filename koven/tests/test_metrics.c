@@ -0,0 +1,217 @@
+#include "../external/unity.h"
+#include "../metrics.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void setUp(void)
+{
+    metrics_reset();
+}
+
+void tearDown(void) {}
+
+void test_metrics_bucket_bounds(void)
+{
+    size_t previous = 0;
+    for (uint64_t value = 0; value < (1u << 20); value++)
+    {
+        size_t bucket = metrics_bucket(value);
+        uint64_t floor = metrics_bucket_floor(bucket);
+
+        // Buckets grow with the value and stay within 1/8 of it
+        TEST_ASSERT_TRUE(bucket >= previous);
+        TEST_ASSERT_TRUE(floor <= value);
+        TEST_ASSERT_TRUE((value - floor) * METRICS_SUB_BUCKETS <= floor || value < 8);
+        TEST_ASSERT_EQUAL_size_t(bucket, metrics_bucket(floor));
+        previous = bucket;
+    }
+
+    TEST_ASSERT_EQUAL_size_t(METRICS_BUCKETS - 1, metrics_bucket(UINT64_MAX));
+    TEST_ASSERT_EQUAL_UINT64(1ull << 30, metrics_bucket_floor(metrics_bucket(1ull << 30)));
+}
+
+void test_metrics_quantiles(void)
+{
+    // 1 to 1000 microseconds, once each
+    for (uint64_t us = 1; us <= 1000; us++)
+    {
+        metrics_observe(METRIC_TICK_DURATION, us * 1000);
+    }
+
+    MetricsHistogram h;
+    metrics_histogram(METRIC_TICK_DURATION, &h);
+    TEST_ASSERT_EQUAL_UINT64(1000, h.count);
+    TEST_ASSERT_EQUAL_UINT64(500500000ull, h.sum);
+
+    uint64_t p50 = metrics_quantile(&h, 0.5);
+    uint64_t p99 = metrics_quantile(&h, 0.99);
+    TEST_ASSERT_TRUE(p50 <= 500000 && p50 * 9 >= 500000 * 8);
+    TEST_ASSERT_TRUE(p99 <= 990000 && p99 * 9 >= 990000 * 8);
+    TEST_ASSERT_EQUAL_UINT64(metrics_bucket_floor(metrics_bucket(1000)), metrics_quantile(&h, 0));
+    TEST_ASSERT_TRUE(metrics_quantile(&h, 1) <= 1000000);
+
+    // observe_n is the same as observing count times
+    metrics_observe_n(METRIC_COMMAND_DECODE, 250, 7);
+    metrics_histogram(METRIC_COMMAND_DECODE, &h);
+    TEST_ASSERT_EQUAL_UINT64(7, h.count);
+    TEST_ASSERT_EQUAL_UINT64(7 * 250, h.sum);
+    TEST_ASSERT_EQUAL_UINT64(7, h.buckets[metrics_bucket(250)]);
+}
+
+#define RECORDING_THREADS 4
+#define RECORDS_PER_THREAD 100000
+
+static void *record_metrics(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < RECORDS_PER_THREAD; i++)
+    {
+        metrics_count(METRIC_COMMANDS_RECEIVED, 1);
+        metrics_observe(METRIC_PUBLISH_RTT, (uint64_t)i);
+    }
+    return NULL;
+}
+
+void test_metrics_sum_over_threads(void)
+{
+    pthread_t threads[RECORDING_THREADS];
+    for (int t = 0; t < RECORDING_THREADS; t++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[t], NULL, record_metrics, NULL));
+    }
+    for (int t = 0; t < RECORDING_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(RECORDING_THREADS * RECORDS_PER_THREAD,
+                             metrics_counter(METRIC_COMMANDS_RECEIVED));
+
+    MetricsHistogram h;
+    metrics_histogram(METRIC_PUBLISH_RTT, &h);
+    TEST_ASSERT_EQUAL_UINT64(RECORDING_THREADS * RECORDS_PER_THREAD, h.count);
+    TEST_ASSERT_EQUAL_UINT64(
+        RECORDING_THREADS * ((uint64_t)RECORDS_PER_THREAD * (RECORDS_PER_THREAD - 1) / 2), h.sum);
+}
+
+void test_metrics_format_prometheus(void)
+{
+    metrics_count(METRIC_TICKS, 5);
+    metrics_observe(METRIC_TICK_JITTER, 100);
+    metrics_observe(METRIC_TICK_JITTER, 3000000);
+
+    size_t len = metrics_format(NULL, 0);
+    char *text = malloc(len + 1);
+    TEST_ASSERT_NOT_NULL(text);
+    TEST_ASSERT_EQUAL_size_t(len, metrics_format(text, len + 1));
+    TEST_ASSERT_EQUAL_size_t(len, strlen(text));
+
+    TEST_ASSERT_NOT_NULL(strstr(text, "# TYPE koven_ticks_total counter\nkoven_ticks_total 5\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_protocol_errors_total{kind=\"crc_mismatch\"} 0\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "# TYPE koven_tick_jitter_seconds histogram\n"));
+
+    // Cumulative buckets: 100 ns is below 128 ns, 3 ms only below 4.2 ms
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_tick_jitter_seconds_bucket{le=\"6.4e-08\"} 0\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_tick_jitter_seconds_bucket{le=\"1.28e-07\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_tick_jitter_seconds_bucket{le=\"0.002097152\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_tick_jitter_seconds_bucket{le=\"0.004194304\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_tick_jitter_seconds_bucket{le=\"+Inf\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "koven_tick_jitter_seconds_count 2\n"));
+
+    // A short buffer is truncated but the whole length is still returned
+    char small[16];
+    TEST_ASSERT_EQUAL_size_t(len, metrics_format(small, sizeof(small)));
+    TEST_ASSERT_EQUAL_size_t(sizeof(small) - 1, strlen(small));
+
+    free(text);
+}
+
+// Sends one request to the server and reads the whole response
+static void http_request(uint16_t port, const char *request, char *response, size_t size)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL_INT(0, connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT((int)strlen(request), (int)send(fd, request, strlen(request), 0));
+
+    size_t len = 0;
+    ssize_t n;
+    while (len + 1 < size && (n = recv(fd, response + len, size - 1 - len, 0)) > 0)
+    {
+        len += (size_t)n;
+    }
+    response[len] = '\0';
+    close(fd);
+}
+
+void test_metrics_server_serves_metrics(void)
+{
+    MetricsServer server;
+    TEST_ASSERT_EQUAL_INT(0, metrics_server_start(&server, "127.0.0.1:0"));
+    TEST_ASSERT_TRUE(server.port != 0);
+
+    metrics_count(METRIC_COMMANDS_DROPPED, 3);
+
+    static char response[65536];
+    http_request(server.port, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", response,
+                 sizeof(response));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(response, "HTTP/1.1 200 OK\r\n", 17));
+    TEST_ASSERT_NOT_NULL(strstr(response, "Content-Type: text/plain; version=0.0.4"));
+    TEST_ASSERT_NOT_NULL(strstr(response, "\r\n\r\n# HELP koven_commands_received_total"));
+    TEST_ASSERT_NOT_NULL(strstr(response, "koven_commands_dropped_total 3\n"));
+
+    http_request(server.port, "GET /other HTTP/1.1\r\n\r\n", response, sizeof(response));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(response, "HTTP/1.1 404 Not Found\r\n", 24));
+    http_request(server.port, "POST /metrics HTTP/1.1\r\n\r\n", response, sizeof(response));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(response, "HTTP/1.1 405 Method Not Allowed\r\n", 33));
+
+    metrics_server_stop(&server);
+    TEST_ASSERT_EQUAL_UINT64(1, atomic_load(&server.scrapes));
+}
+
+void test_metrics_invalid_arguments(void)
+{
+    MetricsServer server;
+    TEST_ASSERT_EQUAL_INT(-1, metrics_server_start(NULL, "9100"));
+    TEST_ASSERT_EQUAL_INT(-1, metrics_server_start(&server, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, metrics_server_start(&server, "not-an-ip:9100"));
+    TEST_ASSERT_EQUAL_INT(-1, metrics_server_start(&server, "127.0.0.1:70000"));
+    TEST_ASSERT_EQUAL_INT(-1, metrics_server_start(&server, "127.0.0.1:"));
+    metrics_server_stop(NULL);
+
+    // Unknown metrics are ignored
+    metrics_count(METRIC_COUNTERS, 1);
+    metrics_observe(METRIC_HISTOGRAMS, 1);
+    TEST_ASSERT_EQUAL_UINT64(0, metrics_counter(METRIC_COUNTERS));
+    TEST_ASSERT_EQUAL_UINT64(0, metrics_quantile(NULL, 0.5));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Histogram Tests
+    RUN_TEST(test_metrics_bucket_bounds);
+    RUN_TEST(test_metrics_quantiles);
+    RUN_TEST(test_metrics_sum_over_threads);
+
+    // Exporter Tests
+    RUN_TEST(test_metrics_format_prometheus);
+    RUN_TEST(test_metrics_server_serves_metrics);
+
+    // Edge Cases
+    RUN_TEST(test_metrics_invalid_arguments);
+
+    return UNITY_END();
+}
@@ -0,0 +1,170 @@
+#include "../external/unity.h"
+#include "../koven.h"
+#include "../pending_command.h"
+#include <stdlib.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static CommandPayload command(uint8_t action, int16_t temperature, int16_t duration)
+{
+    CommandPayload cmd;
+    cmd.action = action;
+    cmd.temperature = temperature;
+    cmd.duration = duration;
+    return cmd;
+}
+
+static void assert_same_koven(const Koven *expected, const Koven *actual)
+{
+    TEST_ASSERT_EQUAL_INT(expected->state, actual->state);
+    TEST_ASSERT_EQUAL_INT16(expected->current_temperature, actual->current_temperature);
+    TEST_ASSERT_EQUAL_INT16(expected->remaining_time, actual->remaining_time);
+    TEST_ASSERT_EQUAL_INT16(expected->programmed_duration, actual->programmed_duration);
+    TEST_ASSERT_EQUAL_INT16(expected->programmed_temperature, actual->programmed_temperature);
+}
+
+void test_pending_start_then_stop_collapses_to_stop(void)
+{
+    PendingCommand slot = {0};
+    CommandPayload start = command(ACTION_START, 180, 60);
+    CommandPayload stop = command(ACTION_STOP, 0, 0);
+
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, &start));
+    TEST_ASSERT_EQUAL_INT(1, pending_command_add(&slot, &stop));
+    TEST_ASSERT_EQUAL_UINT8(PENDING_STOP, slot.flags);
+
+    Koven koven;
+    koven_init(&koven);
+    TEST_ASSERT_EQUAL_INT(1, pending_command_apply(&slot, &koven));
+    TEST_ASSERT_EQUAL_INT(STATE_IDLE, koven.state);
+    TEST_ASSERT_EQUAL_INT16(-1, koven.programmed_temperature);
+    TEST_ASSERT_EQUAL_UINT8(0, slot.flags);
+}
+
+void test_pending_stop_then_start_keeps_both(void)
+{
+    PendingCommand slot = {0};
+    CommandPayload start = command(ACTION_START, 200, 30);
+    CommandPayload stop = command(ACTION_STOP, 0, 0);
+
+    Koven koven;
+    koven_init(&koven);
+    koven.state = STATE_BAKING;
+
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, &stop));
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, &start));
+    TEST_ASSERT_EQUAL_INT(2, pending_command_apply(&slot, &koven));
+
+    // The STOP makes the oven idle so that the START applies
+    TEST_ASSERT_EQUAL_INT(STATE_PREHEATING, koven.state);
+    TEST_ASSERT_EQUAL_INT16(200, koven.programmed_temperature);
+    TEST_ASSERT_EQUAL_INT16(30, koven.programmed_duration);
+}
+
+void test_pending_first_start_wins(void)
+{
+    PendingCommand slot = {0};
+    CommandPayload first = command(ACTION_START, 180, 60);
+    CommandPayload second = command(ACTION_START, 220, 10);
+
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, &first));
+    TEST_ASSERT_EQUAL_INT(1, pending_command_add(&slot, &second));
+
+    Koven koven;
+    koven_init(&koven);
+    TEST_ASSERT_EQUAL_INT(1, pending_command_apply(&slot, &koven));
+    TEST_ASSERT_EQUAL_INT16(180, koven.programmed_temperature);
+    TEST_ASSERT_EQUAL_INT16(60, koven.programmed_duration);
+}
+
+void test_pending_stop_supersedes_stop_and_start(void)
+{
+    PendingCommand slot = {0};
+    CommandPayload start = command(ACTION_START, 180, 60);
+    CommandPayload stop = command(ACTION_STOP, 0, 0);
+
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, &stop));
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, &start));
+    TEST_ASSERT_EQUAL_INT(2, pending_command_add(&slot, &stop));
+    TEST_ASSERT_EQUAL_UINT8(PENDING_STOP, slot.flags);
+}
+
+void test_pending_matches_sequential_execution(void)
+{
+    srand(42);
+
+    for (int trial = 0; trial < 5000; trial++)
+    {
+        Koven sequential;
+        koven_init(&sequential);
+        sequential.state = (State)(rand() % 4);
+        sequential.current_temperature = (int16_t)(20 + rand() % 200);
+        sequential.remaining_time = (int16_t)(rand() % 100 - 1);
+        Koven coalesced = sequential;
+
+        PendingCommand slot = {0};
+        int commands = 1 + rand() % 8;
+        int superseded = 0;
+        for (int c = 0; c < commands; c++)
+        {
+            int kind = rand() % 5;
+            CommandPayload cmd = command(kind < 2 ? ACTION_START : kind < 4 ? ACTION_STOP : 9,
+                                         (int16_t)(100 + rand() % 150),
+                                         (int16_t)(rand() % 600));
+            koven_execute(&sequential, &cmd);
+            superseded += pending_command_add(&slot, &cmd);
+        }
+
+        // Nothing is lost: every command is either executed or counted as superseded
+        int executed = pending_command_apply(&slot, &coalesced);
+        TEST_ASSERT_EQUAL_INT(commands, executed + superseded);
+        assert_same_koven(&sequential, &coalesced);
+    }
+}
+
+void test_pending_ignores_unknown_actions(void)
+{
+    PendingCommand slot = {0};
+    CommandPayload unknown = command(0x7F, 180, 60);
+
+    TEST_ASSERT_EQUAL_INT(1, pending_command_add(&slot, &unknown));
+    TEST_ASSERT_EQUAL_UINT8(0, slot.flags);
+
+    Koven koven;
+    koven_init(&koven);
+    TEST_ASSERT_EQUAL_INT(0, pending_command_apply(&slot, &koven));
+    TEST_ASSERT_EQUAL_INT(STATE_IDLE, koven.state);
+}
+
+void test_pending_null_arguments(void)
+{
+    PendingCommand slot = {0};
+    CommandPayload stop = command(ACTION_STOP, 0, 0);
+    Koven koven;
+    koven_init(&koven);
+
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(NULL, &stop));
+    TEST_ASSERT_EQUAL_INT(0, pending_command_add(&slot, NULL));
+    TEST_ASSERT_EQUAL_INT(0, pending_command_apply(NULL, &koven));
+    TEST_ASSERT_EQUAL_INT(0, pending_command_apply(&slot, NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Coalescing Tests
+    RUN_TEST(test_pending_start_then_stop_collapses_to_stop);
+    RUN_TEST(test_pending_stop_then_start_keeps_both);
+    RUN_TEST(test_pending_first_start_wins);
+    RUN_TEST(test_pending_stop_supersedes_stop_and_start);
+    RUN_TEST(test_pending_matches_sequential_execution);
+
+    // Edge Cases
+    RUN_TEST(test_pending_ignores_unknown_actions);
+    RUN_TEST(test_pending_null_arguments);
+
+    return UNITY_END();
+}
@@ -1,5 +1,6 @@
 #include "../external/unity.h"
 #include "../koven.h"
+#include "../messages.h"
 #include "../protocol.h"
 #include <string.h>
 
@@ -53,6 +54,94 @@ void test_crc16_usb_deterministic(void)
     TEST_ASSERT_EQUAL_HEX16(crc1, crc2);
 }
 
+// Small deterministic generator so that failures are reproducible
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+typedef uint16_t (*crc_function)(const uint8_t *, size_t);
+
+// Checks an implementation against crc16_usb for every length up to 300 bytes, at every
+// alignment of the 8-byte blocks
+static void assert_crc_matches_reference(crc_function crc)
+{
+    static uint8_t buffer[320];
+    uint32_t seed = 7;
+    for (size_t i = 0; i < sizeof(buffer); i++)
+    {
+        buffer[i] = (uint8_t)next_random(&seed);
+    }
+
+    const uint8_t check[] = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0xB4C8, crc(check, 9));
+    TEST_ASSERT_EQUAL_HEX16(0x0000, crc(NULL, 0));
+
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t len = 0; len <= 300; len++)
+        {
+            TEST_ASSERT_EQUAL_HEX16(crc16_usb(buffer + offset, len), crc(buffer + offset, len));
+        }
+    }
+}
+
+void test_crc16_usb_table_matches_reference(void) { assert_crc_matches_reference(crc16_usb_table); }
+
+void test_crc16_usb_slice8_matches_reference(void)
+{
+    assert_crc_matches_reference(crc16_usb_slice8);
+}
+
+void test_crc16_usb_clmul_matches_reference(void)
+{
+    // Without carry-less multiplication this checks the slice8 fallback
+    int supported = crc16_usb_clmul_supported();
+    TEST_ASSERT_TRUE(supported == 0 || supported == 1);
+    assert_crc_matches_reference(crc16_usb_clmul);
+}
+
+void test_crc16_usb_fast_matches_reference(void)
+{
+    assert_crc_matches_reference(crc16_usb_fast);
+
+    const char *name = crc16_usb_fast_name();
+    TEST_ASSERT_TRUE(strcmp(name, "clmul") == 0 || strcmp(name, "slice8") == 0);
+}
+
+void test_crc16_usb_multi_matches_reference(void)
+{
+    enum
+    {
+        BUFFERS = 23
+    };
+
+    static uint8_t storage[BUFFERS][64];
+    const uint8_t *data[BUFFERS];
+    size_t lengths[BUFFERS];
+    uint16_t crcs[BUFFERS];
+    uint32_t seed = 99;
+
+    // Mixed lengths, including empty buffers and a partial group at the end
+    for (size_t i = 0; i < BUFFERS; i++)
+    {
+        for (size_t j = 0; j < sizeof(storage[i]); j++)
+        {
+            storage[i][j] = (uint8_t)next_random(&seed);
+        }
+        data[i] = storage[i];
+        lengths[i] = (i % 5 == 0) ? 0 : next_random(&seed) % sizeof(storage[i]);
+    }
+
+    crc16_usb_multi(data, lengths, BUFFERS, crcs);
+
+    for (size_t i = 0; i < BUFFERS; i++)
+    {
+        TEST_ASSERT_EQUAL_HEX16(crc16_usb(data[i], lengths[i]), crcs[i]);
+    }
+}
+
 void test_unmarshall_command_frame_valid_start(void)
 {
     // Create a valid START command frame
@@ -237,6 +326,28 @@ void test_unmarshall_command_frame_boundary_values(void)
     TEST_ASSERT_EQUAL_INT16(32767, cmd.duration);
 }
 
+void test_marshall_command_frame_round_trip(void)
+{
+    CommandPayload cmd = {ACTION_START, 200, 480};
+    uint8_t frame[COMMAND_FRAME_SIZE];
+    TEST_ASSERT_EQUAL_INT(COMMAND_FRAME_SIZE, marshall_command_frame(&cmd, frame, sizeof(frame)));
+
+    // Same bytes as the hand-built frame of test_unmarshall_command_frame_valid_start
+    uint8_t expected[10] = {MSG_TYPE_COMMAND, 0x05, 0x00, ACTION_START, 0xC8, 0x00, 0xE0, 0x01};
+    uint16_t crc = crc16_usb(expected, 8);
+    expected[8] = crc & 0xFF;
+    expected[9] = (crc >> 8) & 0xFF;
+    TEST_ASSERT_EQUAL_MEMORY(expected, frame, sizeof(expected));
+
+    CommandPayload decoded;
+    TEST_ASSERT_EQUAL_INT(0, unmarshall_command_frame(frame, sizeof(frame), &decoded));
+    TEST_ASSERT_EQUAL_INT16(200, decoded.temperature);
+    TEST_ASSERT_EQUAL_INT16(480, decoded.duration);
+
+    TEST_ASSERT_EQUAL_INT(-1, marshall_command_frame(&cmd, frame, sizeof(frame) - 1));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_command_frame(NULL, frame, sizeof(frame)));
+}
+
 void test_marshall_event_frame_idle_state(void)
 {
     EventPayload event;
@@ -392,6 +503,706 @@ void test_marshall_event_frame_negative_values(void)
     TEST_ASSERT_EQUAL_INT16(-10, decoded_temp);
 }
 
+void test_marshall_event_frames_matches_single_frames(void)
+{
+    enum
+    {
+        EVENTS = 150
+    };
+
+    static EventPayload events[EVENTS];
+    static uint8_t buffer[EVENTS * EVENT_FRAME_SIZE];
+    size_t offsets[EVENTS];
+
+    for (size_t i = 0; i < EVENTS; i++)
+    {
+        events[i].state = (uint8_t)(i % 4);
+        events[i].current_temperature = (int16_t)(25 + i);
+        events[i].remaining_time = (int16_t)(i % 3 ? 600 - (int)i : -1);
+        events[i].programmed_duration = (int16_t)(i % 2 ? 600 : -1);
+        events[i].programmed_temperature = (int16_t)(i % 2 ? -200 : -1);
+    }
+
+    int result = marshall_event_frames(events, EVENTS, buffer, sizeof(buffer), offsets);
+    TEST_ASSERT_EQUAL_INT(EVENTS * EVENT_FRAME_SIZE, result);
+
+    for (size_t i = 0; i < EVENTS; i++)
+    {
+        uint8_t expected[EVENT_FRAME_SIZE];
+        TEST_ASSERT_EQUAL_INT(EVENT_FRAME_SIZE,
+                              marshall_event_frame(&events[i], expected, sizeof(expected)));
+
+        TEST_ASSERT_EQUAL_size_t(i * EVENT_FRAME_SIZE, offsets[i]);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer + offsets[i], EVENT_FRAME_SIZE);
+    }
+}
+
+void test_marshall_event_frames_without_offsets(void)
+{
+    EventPayload events[2];
+    memset(events, 0, sizeof(events));
+    events[1].state = STATE_BAKING;
+
+    uint8_t buffer[2 * EVENT_FRAME_SIZE];
+    int result = marshall_event_frames(events, 2, buffer, sizeof(buffer), NULL);
+
+    TEST_ASSERT_EQUAL_INT(2 * EVENT_FRAME_SIZE, result);
+    TEST_ASSERT_EQUAL_UINT8(MSG_TYPE_EVENT, buffer[EVENT_FRAME_SIZE]);
+    TEST_ASSERT_EQUAL_UINT8(STATE_BAKING, buffer[EVENT_FRAME_SIZE + 3]);
+}
+
+void test_marshall_event_frames_empty_batch(void)
+{
+    EventPayload event;
+    memset(&event, 0, sizeof(event));
+    uint8_t buffer[1];
+
+    TEST_ASSERT_EQUAL_INT(0, marshall_event_frames(&event, 0, buffer, 0, NULL));
+}
+
+void test_marshall_event_frames_buffer_too_small(void)
+{
+    EventPayload events[3];
+    memset(events, 0, sizeof(events));
+    uint8_t buffer[3 * EVENT_FRAME_SIZE];
+
+    // One byte short of the last frame: nothing may be written past the buffer
+    int result = marshall_event_frames(events, 3, buffer, sizeof(buffer) - 1, NULL);
+    TEST_ASSERT_EQUAL_INT(-1, result);
+}
+
+void test_marshall_event_frames_null_arguments(void)
+{
+    EventPayload event;
+    memset(&event, 0, sizeof(event));
+    uint8_t buffer[EVENT_FRAME_SIZE];
+
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_frames(NULL, 1, buffer, sizeof(buffer), NULL));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_frames(&event, 1, NULL, sizeof(buffer), NULL));
+}
+
+// Two ovens, also decoded by the Go protocol tests
+static const uint8_t event_batch_vector[] = {
+    0x03, 0x1C, 0x00, 0x02, 0x00, 0x07, 0x00, 0x00, 0x00, 0x02, 0xB4, 0x00, 0x37, 0x00, 0x3C, 0x00,
+    0xB4, 0x00, 0x04, 0x03, 0x02, 0x01, 0x00, 0x19, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3C,
+    0x38};
+
+void test_marshall_event_batch_frame_known_vector(void)
+{
+    uint32_t ids[2] = {7, 0x01020304};
+    EventPayload events[2];
+    events[0].state = STATE_BAKING;
+    events[0].current_temperature = 180;
+    events[0].remaining_time = 55;
+    events[0].programmed_duration = 60;
+    events[0].programmed_temperature = 180;
+    events[1].state = STATE_IDLE;
+    events[1].current_temperature = 25;
+    events[1].remaining_time = -1;
+    events[1].programmed_duration = -1;
+    events[1].programmed_temperature = -1;
+
+    uint8_t buffer[64];
+    int result = marshall_event_batch_frame(ids, events, 2, buffer, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL_INT(sizeof(event_batch_vector), result);
+    TEST_ASSERT_EQUAL_INT(EVENT_BATCH_FRAME_SIZE(2), result);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(event_batch_vector, buffer, sizeof(event_batch_vector));
+}
+
+void test_event_batch_frame_round_trip(void)
+{
+    static uint32_t ids[EVENT_BATCH_MAX_EVENTS];
+    static EventPayload events[EVENT_BATCH_MAX_EVENTS];
+    static uint32_t decoded_ids[EVENT_BATCH_MAX_EVENTS];
+    static EventPayload decoded[EVENT_BATCH_MAX_EVENTS];
+    static uint8_t buffer[EVENT_BATCH_FRAME_SIZE(EVENT_BATCH_MAX_EVENTS)];
+    uint32_t seed = 7;
+
+    memset(events, 0, sizeof(events));
+    for (size_t i = 0; i < EVENT_BATCH_MAX_EVENTS; i++)
+    {
+        ids[i] = next_random(&seed) * 3u;
+        events[i].state = (uint8_t)(next_random(&seed) % 4);
+        events[i].current_temperature = (int16_t)next_random(&seed);
+        events[i].remaining_time = (int16_t)next_random(&seed);
+        events[i].programmed_duration = (int16_t)next_random(&seed);
+        events[i].programmed_temperature = (int16_t)next_random(&seed);
+    }
+
+    // The largest batch still fits the 16-bit size field
+    TEST_ASSERT_LESS_OR_EQUAL(UINT16_MAX, MAX_BATCH_PAYLOAD_SIZE);
+
+    int size = marshall_event_batch_frame(
+        ids, events, EVENT_BATCH_MAX_EVENTS, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_INT(sizeof(buffer), size);
+
+    int count = unmarshall_event_batch_frame(
+        buffer, (size_t)size, decoded_ids, decoded, EVENT_BATCH_MAX_EVENTS);
+    TEST_ASSERT_EQUAL_INT(EVENT_BATCH_MAX_EVENTS, count);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(ids, decoded_ids, EVENT_BATCH_MAX_EVENTS);
+    TEST_ASSERT_EQUAL_MEMORY(events, decoded, sizeof(events));
+}
+
+void test_event_batch_frame_empty(void)
+{
+    uint32_t id;
+    EventPayload event;
+    uint8_t buffer[EVENT_BATCH_FRAME_SIZE(0)];
+
+    TEST_ASSERT_EQUAL_INT(
+        sizeof(buffer), marshall_event_batch_frame(NULL, NULL, 0, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(0, unmarshall_event_batch_frame(buffer, sizeof(buffer), &id, &event, 1));
+}
+
+void test_marshall_event_batch_frame_invalid(void)
+{
+    uint32_t ids[2] = {1, 2};
+    EventPayload events[2];
+    memset(events, 0, sizeof(events));
+    uint8_t buffer[64];
+
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_batch_frame(NULL, events, 2, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_batch_frame(ids, NULL, 2, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_batch_frame(ids, events, 2, NULL, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(
+        -1, marshall_event_batch_frame(ids, events, 2, buffer, EVENT_BATCH_FRAME_SIZE(2) - 1));
+    TEST_ASSERT_EQUAL_INT(-1,
+                          marshall_event_batch_frame(
+                              ids, events, EVENT_BATCH_MAX_EVENTS + 1, buffer, sizeof(buffer)));
+}
+
+void test_unmarshall_event_batch_frame_invalid(void)
+{
+    uint32_t ids[2];
+    EventPayload events[2];
+    uint8_t frame[sizeof(event_batch_vector)];
+    size_t len = sizeof(frame);
+
+    // Truncated frame
+    memcpy(frame, event_batch_vector, len);
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len - 1, ids, events, 2));
+
+    // Not enough room for the events
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len, ids, events, 1));
+
+    // Wrong message type
+    frame[0] = MSG_TYPE_EVENT;
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len, ids, events, 2));
+
+    // Count that does not match the payload size
+    memcpy(frame, event_batch_vector, len);
+    frame[3] = 0x03;
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len, ids, events, 2));
+
+    // Corrupted entry
+    memcpy(frame, event_batch_vector, len);
+    frame[10] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len, ids, events, 2));
+
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(NULL, len, ids, events, 2));
+    memcpy(frame, event_batch_vector, len);
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len, NULL, events, 2));
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_event_batch_frame(frame, len, ids, NULL, 2));
+    TEST_ASSERT_EQUAL_INT(2, unmarshall_event_batch_frame(frame, len, ids, events, 2));
+}
+
+// Command batch of two ovens, also decoded by the Go protocol tests
+static const uint8_t command_batch_vector[] = {
+    0x06, 0x14, 0x00, 0x02, 0x00, 0x07, 0x00, 0x00, 0x00, 0x01, 0xB4, 0x00, 0x3C,
+    0x00, 0x04, 0x03, 0x02, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0xDB, 0xC7};
+
+void test_command_batch_frame_known_vector(void)
+{
+    uint32_t ids[2] = {7, 0x01020304};
+    CommandPayload cmds[2];
+    cmds[0].action = ACTION_START;
+    cmds[0].temperature = 180;
+    cmds[0].duration = 60;
+    cmds[1].action = ACTION_STOP;
+    cmds[1].temperature = 0;
+    cmds[1].duration = 0;
+
+    uint8_t buffer[64];
+    int result = marshall_command_batch_frame(ids, cmds, 2, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_INT(sizeof(command_batch_vector), result);
+    TEST_ASSERT_EQUAL_INT(COMMAND_BATCH_FRAME_SIZE(2), result);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(command_batch_vector, buffer, sizeof(command_batch_vector));
+
+    const uint8_t *entries = NULL;
+    TEST_ASSERT_EQUAL_INT(2, command_batch_frame_entries(buffer, (size_t)result, &entries));
+    TEST_ASSERT_EQUAL_PTR(&buffer[5], entries);
+    for (size_t i = 0; i < 2; i++)
+    {
+        uint32_t id;
+        CommandPayload cmd;
+        command_batch_entry(entries, i, &id, &cmd);
+        TEST_ASSERT_EQUAL_UINT32(ids[i], id);
+        TEST_ASSERT_EQUAL_UINT8(cmds[i].action, cmd.action);
+        TEST_ASSERT_EQUAL_INT16(cmds[i].temperature, cmd.temperature);
+        TEST_ASSERT_EQUAL_INT16(cmds[i].duration, cmd.duration);
+    }
+
+    // The largest batch still fits the 16-bit size field
+    TEST_ASSERT_LESS_OR_EQUAL(UINT16_MAX, COMMAND_BATCH_FRAME_SIZE(COMMAND_BATCH_MAX_COMMANDS));
+}
+
+void test_command_batch_frame_invalid(void)
+{
+    uint32_t ids[2] = {1, 2};
+    CommandPayload cmds[2];
+    memset(cmds, 0, sizeof(cmds));
+    uint8_t buffer[64];
+    const uint8_t *entries;
+
+    TEST_ASSERT_EQUAL_INT(-1, marshall_command_batch_frame(NULL, cmds, 2, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_command_batch_frame(ids, cmds, 2, NULL, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(
+        -1, marshall_command_batch_frame(ids, cmds, 2, buffer, COMMAND_BATCH_FRAME_SIZE(2) - 1));
+    TEST_ASSERT_EQUAL_INT(-1,
+                          marshall_command_batch_frame(
+                              ids, cmds, COMMAND_BATCH_MAX_COMMANDS + 1, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(COMMAND_BATCH_FRAME_SIZE(0),
+                          marshall_command_batch_frame(NULL, NULL, 0, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(
+        0, command_batch_frame_entries(buffer, COMMAND_BATCH_FRAME_SIZE(0), &entries));
+
+    uint8_t frame[sizeof(command_batch_vector)];
+    size_t len = sizeof(frame);
+    memcpy(frame, command_batch_vector, len);
+
+    // Truncated frame, missing arguments
+    TEST_ASSERT_EQUAL_INT(-1, command_batch_frame_entries(frame, len - 1, &entries));
+    TEST_ASSERT_EQUAL_INT(-1, command_batch_frame_entries(NULL, len, &entries));
+    TEST_ASSERT_EQUAL_INT(-1, command_batch_frame_entries(frame, len, NULL));
+
+    // Wrong message type
+    frame[0] = MSG_TYPE_EVENT_BATCH;
+    TEST_ASSERT_EQUAL_INT(-1, command_batch_frame_entries(frame, len, &entries));
+
+    // Count that does not match the payload size
+    memcpy(frame, command_batch_vector, len);
+    frame[3] = 0x03;
+    TEST_ASSERT_EQUAL_INT(-1, command_batch_frame_entries(frame, len, &entries));
+
+    // Corrupted entry
+    memcpy(frame, command_batch_vector, len);
+    frame[10] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT(-1, command_batch_frame_entries(frame, len, &entries));
+}
+
+static EventPayload baking_event(void)
+{
+    EventPayload event;
+    event.state = STATE_BAKING;
+    event.current_temperature = 180;
+    event.remaining_time = 55;
+    event.programmed_duration = 60;
+    event.programmed_temperature = 180;
+    return event;
+}
+
+void test_event_changed_fields(void)
+{
+    EventPayload previous = baking_event();
+    EventPayload current = previous;
+
+    TEST_ASSERT_EQUAL_HEX8(0, event_changed_fields(&previous, &current));
+
+    current.remaining_time = 54;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELD_REMAINING_TIME, event_changed_fields(&previous, &current));
+
+    current.state = STATE_COOLING_DOWN;
+    current.programmed_temperature = -1;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELD_STATE | EVENT_FIELD_REMAINING_TIME |
+                               EVENT_FIELD_PROGRAMMED_TEMPERATURE,
+                           event_changed_fields(&previous, &current));
+
+    current.current_temperature = 0;
+    current.programmed_duration = 0;
+    TEST_ASSERT_EQUAL_HEX8(EVENT_FIELDS_ALL, event_changed_fields(&previous, &current));
+}
+
+// These vectors are also decoded by the Go protocol tests
+void test_marshall_event_delta_frame(void)
+{
+    static const uint8_t remaining_time_only[] = {0x04, 0x03, 0x00, 0x04, 0x37, 0x00, 0xED, 0x91};
+    static const uint8_t all_fields[] = {0x04, 0x0A, 0x00, 0x1F, 0x02, 0xB4, 0x00, 0x37,
+                                         0x00, 0x3C, 0x00, 0xB4, 0x00, 0xB7, 0xDD};
+
+    EventPayload event = baking_event();
+    uint8_t buffer[EVENT_DELTA_FRAME_MAX_SIZE];
+
+    int result =
+        marshall_event_delta_frame(&event, EVENT_FIELD_REMAINING_TIME, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_INT(sizeof(remaining_time_only), result);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(remaining_time_only, buffer, sizeof(remaining_time_only));
+
+    result = marshall_event_delta_frame(&event, EVENT_FIELDS_ALL, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_INT(EVENT_DELTA_FRAME_MAX_SIZE, result);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(all_fields, buffer, sizeof(all_fields));
+
+    // A delta with no fields still refreshes the oven's liveness
+    TEST_ASSERT_EQUAL_INT(6, marshall_event_delta_frame(&event, 0, buffer, sizeof(buffer)));
+}
+
+void test_marshall_event_delta_batch_frame(void)
+{
+    static const uint8_t expected[] = {0x05, 0x11, 0x00, 0x02, 0x00, 0x07, 0x00, 0x00,
+                                       0x00, 0x04, 0x37, 0x00, 0x09, 0x00, 0x00, 0x00,
+                                       0x03, 0x03, 0x63, 0x00, 0xB4, 0x27};
+
+    uint32_t ids[2] = {7, 9};
+    EventPayload events[2] = {baking_event(), baking_event()};
+    events[1].state = STATE_COOLING_DOWN;
+    events[1].current_temperature = 99;
+    uint8_t fields[2] = {EVENT_FIELD_REMAINING_TIME,
+                         EVENT_FIELD_STATE | EVENT_FIELD_CURRENT_TEMPERATURE};
+
+    uint8_t buffer[EVENT_DELTA_BATCH_FRAME_MAX_SIZE(2)];
+    int result = marshall_event_delta_batch_frame(ids, events, fields, 2, buffer, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL_INT(sizeof(expected), result);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_marshall_event_delta_frames_invalid(void)
+{
+    uint32_t id = 1;
+    EventPayload event = baking_event();
+    uint8_t fields = EVENT_FIELDS_ALL;
+    uint8_t buffer[EVENT_DELTA_BATCH_FRAME_MAX_SIZE(1)];
+
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_delta_frame(NULL, fields, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_delta_frame(&event, fields, NULL, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_delta_frame(&event, 0x20, buffer, sizeof(buffer)));
+    // The capacity is checked against a full delta, whatever the fields
+    TEST_ASSERT_EQUAL_INT(
+        -1,
+        marshall_event_delta_frame(
+            &event, EVENT_FIELD_STATE, buffer, EVENT_DELTA_FRAME_MAX_SIZE - 1));
+
+    TEST_ASSERT_EQUAL_INT(
+        -1, marshall_event_delta_batch_frame(NULL, &event, &fields, 1, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(
+        -1, marshall_event_delta_batch_frame(&id, &event, NULL, 1, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_INT(
+        -1, marshall_event_delta_batch_frame(&id, &event, &fields, 1, buffer, sizeof(buffer) - 1));
+    TEST_ASSERT_EQUAL_INT(-1,
+                          marshall_event_delta_batch_frame(
+                              &id, &event, &fields, EVENT_BATCH_MAX_EVENTS + 1, buffer, 0));
+
+    fields = 0x80;
+    TEST_ASSERT_EQUAL_INT(
+        -1, marshall_event_delta_batch_frame(&id, &event, &fields, 1, buffer, sizeof(buffer)));
+}
+
+// Builds a valid command frame into frame (COMMAND_FRAME_SIZE bytes)
+static void build_command_frame(uint8_t *frame,
+                                uint8_t action,
+                                int16_t temperature,
+                                int16_t duration)
+{
+    frame[0] = MSG_TYPE_COMMAND;
+    frame[1] = 0x05;
+    frame[2] = 0x00;
+    frame[3] = action;
+    frame[4] = (uint8_t)(temperature & 0xFF);
+    frame[5] = (uint8_t)((uint16_t)temperature >> 8);
+    frame[6] = (uint8_t)(duration & 0xFF);
+    frame[7] = (uint8_t)((uint16_t)duration >> 8);
+
+    uint16_t crc = crc16_usb(frame, 8);
+    frame[8] = crc & 0xFF;
+    frame[9] = (crc >> 8) & 0xFF;
+}
+
+void test_frame_decoder_concatenated_frames(void)
+{
+    uint8_t stream[3 * COMMAND_FRAME_SIZE];
+    build_command_frame(&stream[0], ACTION_START, 180, 600);
+    build_command_frame(&stream[COMMAND_FRAME_SIZE], ACTION_STOP, 0, 0);
+    build_command_frame(&stream[2 * COMMAND_FRAME_SIZE], ACTION_START, -10, 32767);
+
+    FrameDecoder decoder;
+    frame_decoder_init(&decoder);
+    frame_decoder_feed(&decoder, stream, sizeof(stream));
+
+    const CommandPayload *cmd;
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT8(ACTION_START, cmd->action);
+    TEST_ASSERT_EQUAL_INT16(180, cmd->temperature);
+    TEST_ASSERT_EQUAL_INT16(600, cmd->duration);
+
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT8(ACTION_STOP, cmd->action);
+
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_INT16(-10, cmd->temperature);
+    TEST_ASSERT_EQUAL_INT16(32767, cmd->duration);
+
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT64(3, decoder.frames);
+    TEST_ASSERT_EQUAL_UINT64(0, decoder.bytes_skipped);
+}
+
+void test_frame_decoder_zero_copy(void)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint8_t stream[2 * COMMAND_FRAME_SIZE];
+    build_command_frame(&stream[0], ACTION_START, 180, 600);
+    build_command_frame(&stream[COMMAND_FRAME_SIZE], ACTION_STOP, 0, 0);
+
+    FrameDecoder decoder;
+    frame_decoder_init(&decoder);
+    frame_decoder_feed(&decoder, stream, sizeof(stream));
+
+    // Commands are returned in place, right after each frame header
+    const CommandPayload *cmd;
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_PTR(&stream[3], cmd);
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_PTR(&stream[COMMAND_FRAME_SIZE + 3], cmd);
+#else
+    TEST_IGNORE_MESSAGE("Commands are copied on big-endian hosts");
+#endif
+}
+
+void test_frame_decoder_frames_split_across_chunks(void)
+{
+    uint8_t stream[2 * COMMAND_FRAME_SIZE];
+    build_command_frame(&stream[0], ACTION_START, 200, 480);
+    build_command_frame(&stream[COMMAND_FRAME_SIZE], ACTION_STOP, 0, 0);
+
+    // Split the stream at every possible position
+    for (size_t split = 0; split <= sizeof(stream); split++)
+    {
+        FrameDecoder decoder;
+        const CommandPayload *cmd;
+        uint8_t actions[2];
+        size_t decoded = 0;
+        frame_decoder_init(&decoder);
+
+        frame_decoder_feed(&decoder, stream, split);
+        while (frame_decoder_next(&decoder, &cmd))
+        {
+            actions[decoded++] = cmd->action;
+        }
+        frame_decoder_feed(&decoder, &stream[split], sizeof(stream) - split);
+        while (frame_decoder_next(&decoder, &cmd))
+        {
+            TEST_ASSERT_LESS_THAN(2, decoded);
+            if (decoded == 0)
+            {
+                TEST_ASSERT_EQUAL_INT16(200, cmd->temperature);
+                TEST_ASSERT_EQUAL_INT16(480, cmd->duration);
+            }
+            actions[decoded++] = cmd->action;
+        }
+
+        TEST_ASSERT_EQUAL_size_t(2, decoded);
+        TEST_ASSERT_EQUAL_UINT8(ACTION_START, actions[0]);
+        TEST_ASSERT_EQUAL_UINT8(ACTION_STOP, actions[1]);
+        TEST_ASSERT_EQUAL_UINT64(0, decoder.bytes_skipped);
+    }
+}
+
+void test_frame_decoder_byte_by_byte(void)
+{
+    uint8_t stream[3 * COMMAND_FRAME_SIZE];
+    for (size_t i = 0; i < 3; i++)
+    {
+        build_command_frame(&stream[i * COMMAND_FRAME_SIZE], ACTION_START, (int16_t)(100 + i), 60);
+    }
+
+    FrameDecoder decoder;
+    const CommandPayload *cmd;
+    size_t decoded = 0;
+    frame_decoder_init(&decoder);
+
+    for (size_t i = 0; i < sizeof(stream); i++)
+    {
+        frame_decoder_feed(&decoder, &stream[i], 1);
+        while (frame_decoder_next(&decoder, &cmd))
+        {
+            TEST_ASSERT_EQUAL_INT16(100 + (int)decoded, cmd->temperature);
+            decoded++;
+        }
+    }
+
+    TEST_ASSERT_EQUAL_size_t(3, decoded);
+}
+
+void test_frame_decoder_resyncs_after_garbage(void)
+{
+    // Garbage, including a stray header byte, before and between two valid frames
+    uint8_t stream[4 + COMMAND_FRAME_SIZE + 3 + COMMAND_FRAME_SIZE] = {
+        0xFF, MSG_TYPE_COMMAND, 0x22, 0x00};
+    build_command_frame(&stream[4], ACTION_START, 180, 600);
+    stream[4 + COMMAND_FRAME_SIZE] = 0x00;
+    stream[4 + COMMAND_FRAME_SIZE + 1] = 0x7E;
+    stream[4 + COMMAND_FRAME_SIZE + 2] = 0x02;
+    build_command_frame(&stream[4 + COMMAND_FRAME_SIZE + 3], ACTION_STOP, 0, 0);
+
+    FrameDecoder decoder;
+    frame_decoder_init(&decoder);
+    frame_decoder_feed(&decoder, stream, sizeof(stream));
+
+    const CommandPayload *cmd;
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT8(ACTION_START, cmd->action);
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT8(ACTION_STOP, cmd->action);
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(&decoder, &cmd));
+
+    TEST_ASSERT_EQUAL_UINT64(2, decoder.frames);
+    TEST_ASSERT_EQUAL_UINT64(7, decoder.bytes_skipped);
+    TEST_ASSERT_EQUAL_UINT64(2, decoder.header_errors);
+}
+
+void test_frame_decoder_resyncs_after_bad_crc(void)
+{
+    uint8_t stream[2 * COMMAND_FRAME_SIZE];
+    build_command_frame(&stream[0], ACTION_START, 180, 600);
+    build_command_frame(&stream[COMMAND_FRAME_SIZE], ACTION_STOP, 0, 0);
+    stream[8] ^= 0xFF; // Corrupt the CRC of the first frame
+
+    // Also split the corrupted frame so that the resync runs through the carried bytes
+    FrameDecoder decoder;
+    const CommandPayload *cmd;
+    frame_decoder_init(&decoder);
+
+    frame_decoder_feed(&decoder, stream, 6);
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(&decoder, &cmd));
+    frame_decoder_feed(&decoder, &stream[6], sizeof(stream) - 6);
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT8(ACTION_STOP, cmd->action);
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(&decoder, &cmd));
+
+    TEST_ASSERT_EQUAL_UINT64(1, decoder.frames);
+    TEST_ASSERT_EQUAL_UINT64(1, decoder.crc_errors);
+    TEST_ASSERT_EQUAL_UINT64(COMMAND_FRAME_SIZE, decoder.bytes_skipped);
+}
+
+void test_frame_decoder_rejects_event_frames(void)
+{
+    EventPayload event;
+    memset(&event, 0, sizeof(event));
+    uint8_t stream[EVENT_FRAME_SIZE + COMMAND_FRAME_SIZE];
+    TEST_ASSERT_EQUAL_INT(EVENT_FRAME_SIZE, marshall_event_frame(&event, stream, EVENT_FRAME_SIZE));
+    build_command_frame(&stream[EVENT_FRAME_SIZE], ACTION_STOP, 0, 0);
+
+    FrameDecoder decoder;
+    frame_decoder_init(&decoder);
+    frame_decoder_feed(&decoder, stream, sizeof(stream));
+
+    const CommandPayload *cmd;
+    TEST_ASSERT_EQUAL_INT(1, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_UINT8(ACTION_STOP, cmd->action);
+    TEST_ASSERT_EQUAL_UINT64(1, decoder.frames);
+    TEST_ASSERT_EQUAL_UINT64(EVENT_FRAME_SIZE, decoder.bytes_skipped);
+}
+
+void test_frame_decoder_null_arguments(void)
+{
+    FrameDecoder decoder;
+    const CommandPayload *cmd;
+    frame_decoder_init(&decoder);
+
+    // Should not crash
+    frame_decoder_init(NULL);
+    frame_decoder_feed(NULL, NULL, 0);
+    frame_decoder_feed(&decoder, NULL, 10);
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(&decoder, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(&decoder, NULL));
+    TEST_ASSERT_EQUAL_INT(0, frame_decoder_next(NULL, &cmd));
+}
+
+void test_schema_wire_layout(void)
+{
+    TEST_ASSERT_EQUAL_size_t(5, command_payload_wire_size);
+    TEST_ASSERT_EQUAL_size_t(9, event_payload_wire_size);
+    TEST_ASSERT_EQUAL_INT(3, command_payload_field_count);
+    TEST_ASSERT_EQUAL_INT(5, event_payload_field_count);
+
+    CommandPayload cmd = {ACTION_START, -2, 0x1234};
+    uint8_t command_bytes[5];
+    const uint8_t expected_command[] = {ACTION_START, 0xFE, 0xFF, 0x34, 0x12};
+    command_payload_encode(&cmd, command_bytes);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected_command, command_bytes, sizeof(expected_command));
+
+    EventPayload event = {STATE_BAKING, 180, 0x0102, -1, 0x7FFF};
+    uint8_t event_bytes[9];
+    const uint8_t expected_event[] = {STATE_BAKING, 0xB4, 0x00, 0x02, 0x01, 0xFF, 0xFF, 0xFF, 0x7F};
+    event_payload_encode(&event, event_bytes);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected_event, event_bytes, sizeof(expected_event));
+
+    EventPayload decoded;
+    event_payload_decode(event_bytes, &decoded);
+    TEST_ASSERT_EQUAL_MEMORY(&event, &decoded, sizeof(event));
+}
+
+void test_schema_encode_fields(void)
+{
+    EventPayload event = {STATE_BAKING, 180, 0x0102, -1, 0x7FFF};
+    uint8_t bytes[9];
+
+    TEST_ASSERT_EQUAL_size_t(0, event_payload_encode_fields(&event, 0, bytes));
+    TEST_ASSERT_EQUAL_size_t(3, event_payload_encode_fields(
+                                    &event, MESSAGE_FIELD_BIT(event_payload, state) |
+                                                MESSAGE_FIELD_BIT(event_payload, remaining_time),
+                                    bytes));
+    const uint8_t expected[] = {STATE_BAKING, 0x02, 0x01};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, bytes, sizeof(expected));
+
+    // Every field gives the whole payload
+    uint8_t whole[9];
+    event_payload_encode(&event, whole);
+    TEST_ASSERT_EQUAL_size_t(9, event_payload_encode_fields(&event, EVENT_FIELDS_ALL, bytes));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(whole, bytes, sizeof(whole));
+}
+
+void test_protocol_errors_counted(void)
+{
+    protocol_errors_reset();
+
+    uint8_t frame[COMMAND_FRAME_SIZE] = {MSG_TYPE_COMMAND, 0x05, 0x00, ACTION_START, 0xC8, 0x00,
+                                         0xE0, 0x01, 0xFF, 0xFF};
+    CommandPayload cmd;
+
+    // Wrong CRC
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_command_frame(frame, sizeof(frame), &cmd));
+
+    // Wrong payload size
+    frame[1] = 0x04;
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_command_frame(frame, sizeof(frame), &cmd));
+
+    // Wrong message type
+    frame[0] = MSG_TYPE_EVENT;
+    TEST_ASSERT_EQUAL_INT(-1, unmarshall_command_frame(frame, sizeof(frame), &cmd));
+
+    EventPayload event = {STATE_IDLE, 25, -1, -1, -1};
+    uint8_t small[4];
+    TEST_ASSERT_EQUAL_INT(-1, marshall_event_frame(&event, small, sizeof(small)));
+
+    ProtocolErrors errors;
+    protocol_errors(&errors);
+    TEST_ASSERT_EQUAL_UINT64(1, errors.crc_mismatch);
+    TEST_ASSERT_EQUAL_UINT64(1, errors.invalid_size);
+    TEST_ASSERT_EQUAL_UINT64(1, errors.invalid_type);
+    TEST_ASSERT_EQUAL_UINT64(1, errors.buffer_too_small);
+    TEST_ASSERT_EQUAL_UINT64(0, errors.truncated);
+    TEST_ASSERT_EQUAL_UINT64(0, errors.too_many_events);
+
+    protocol_errors_reset();
+    protocol_errors(&errors);
+    TEST_ASSERT_EQUAL_UINT64(0, errors.crc_mismatch);
+    TEST_ASSERT_EQUAL_UINT64(0, errors.buffer_too_small);
+
+    // Should not crash
+    protocol_errors(NULL);
+}
+
 int main(void)
 {
     UNITY_BEGIN();
@@ -403,6 +1214,11 @@ int main(void)
     RUN_TEST(test_crc16_usb_all_zeros);
     RUN_TEST(test_crc16_usb_all_ones);
     RUN_TEST(test_crc16_usb_deterministic);
+    RUN_TEST(test_crc16_usb_table_matches_reference);
+    RUN_TEST(test_crc16_usb_slice8_matches_reference);
+    RUN_TEST(test_crc16_usb_clmul_matches_reference);
+    RUN_TEST(test_crc16_usb_fast_matches_reference);
+    RUN_TEST(test_crc16_usb_multi_matches_reference);
 
     // Unmarshall Command Frame Tests
     RUN_TEST(test_unmarshall_command_frame_valid_start);
@@ -415,6 +1231,7 @@ int main(void)
     RUN_TEST(test_unmarshall_command_frame_invalid_payload_size);
     RUN_TEST(test_unmarshall_command_frame_crc_mismatch);
     RUN_TEST(test_unmarshall_command_frame_boundary_values);
+    RUN_TEST(test_marshall_command_frame_round_trip);
 
     // Marshall Event Frame Tests
     RUN_TEST(test_marshall_event_frame_idle_state);
@@ -427,5 +1244,46 @@ int main(void)
     RUN_TEST(test_marshall_event_frame_boundary_values);
     RUN_TEST(test_marshall_event_frame_negative_values);
 
+    // Marshall Event Frames (batch) Tests
+    RUN_TEST(test_marshall_event_frames_matches_single_frames);
+    RUN_TEST(test_marshall_event_frames_without_offsets);
+    RUN_TEST(test_marshall_event_frames_empty_batch);
+    RUN_TEST(test_marshall_event_frames_buffer_too_small);
+    RUN_TEST(test_marshall_event_frames_null_arguments);
+
+    // Event Batch Frame Tests
+    RUN_TEST(test_marshall_event_batch_frame_known_vector);
+    RUN_TEST(test_event_batch_frame_round_trip);
+    RUN_TEST(test_event_batch_frame_empty);
+    RUN_TEST(test_marshall_event_batch_frame_invalid);
+    RUN_TEST(test_unmarshall_event_batch_frame_invalid);
+
+    // Command Batch Frame Tests
+    RUN_TEST(test_command_batch_frame_known_vector);
+    RUN_TEST(test_command_batch_frame_invalid);
+
+    // Event Delta Frame Tests
+    RUN_TEST(test_event_changed_fields);
+    RUN_TEST(test_marshall_event_delta_frame);
+    RUN_TEST(test_marshall_event_delta_batch_frame);
+    RUN_TEST(test_marshall_event_delta_frames_invalid);
+
+    // Frame Decoder Tests
+    RUN_TEST(test_frame_decoder_concatenated_frames);
+    RUN_TEST(test_frame_decoder_zero_copy);
+    RUN_TEST(test_frame_decoder_frames_split_across_chunks);
+    RUN_TEST(test_frame_decoder_byte_by_byte);
+    RUN_TEST(test_frame_decoder_resyncs_after_garbage);
+    RUN_TEST(test_frame_decoder_resyncs_after_bad_crc);
+    RUN_TEST(test_frame_decoder_rejects_event_frames);
+    RUN_TEST(test_frame_decoder_null_arguments);
+
+    // Schema Tests
+    RUN_TEST(test_schema_wire_layout);
+    RUN_TEST(test_schema_encode_fields);
+
+    // Error Counter Tests
+    RUN_TEST(test_protocol_errors_counted);
+
     return UNITY_END();
 }
@@ -0,0 +1,180 @@
+#include "../external/unity.h"
+#include "../publish_window.h"
+#include <pthread.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_publish_window_acquire_up_to_limit(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, 3);
+
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_size_t(3, publish_window_in_flight(&window));
+
+    // A full window drops the publish
+    TEST_ASSERT_EQUAL_INT(-1, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_UINT64(1, atomic_load(&window.dropped));
+    TEST_ASSERT_EQUAL_size_t(3, publish_window_in_flight(&window));
+}
+
+void test_publish_window_complete_frees_a_slot(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, 1);
+
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(-1, publish_window_acquire(&window));
+
+    publish_window_complete(&window);
+    TEST_ASSERT_EQUAL_UINT64(1, atomic_load(&window.delivered));
+    TEST_ASSERT_EQUAL_size_t(0, publish_window_in_flight(&window));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+}
+
+void test_publish_window_cancel_is_not_a_delivery(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, 2);
+
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    publish_window_cancel(&window);
+
+    TEST_ASSERT_EQUAL_size_t(0, publish_window_in_flight(&window));
+    TEST_ASSERT_EQUAL_UINT64(0, atomic_load(&window.delivered));
+}
+
+void test_publish_window_ignores_unmatched_releases(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, 2);
+
+    // A delivery without a publish must not open extra slots
+    publish_window_complete(&window);
+    publish_window_cancel(&window);
+
+    TEST_ASSERT_EQUAL_size_t(0, publish_window_in_flight(&window));
+    TEST_ASSERT_EQUAL_UINT64(0, atomic_load(&window.delivered));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(-1, publish_window_acquire(&window));
+}
+
+void test_publish_window_reset_forgets_in_flight(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, 2);
+
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    publish_window_reset(&window);
+
+    // The whole window is open again, and late deliveries do not open extra slots
+    TEST_ASSERT_EQUAL_size_t(0, publish_window_in_flight(&window));
+    publish_window_complete(&window);
+    TEST_ASSERT_EQUAL_UINT64(0, atomic_load(&window.delivered));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(0, publish_window_acquire(&window));
+    TEST_ASSERT_EQUAL_INT(-1, publish_window_acquire(&window));
+}
+
+void test_publish_window_zero_limit(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, 0);
+
+    TEST_ASSERT_EQUAL_INT(-1, publish_window_acquire(&window));
+}
+
+enum
+{
+    STRESS_PUBLISHES = 200000,
+    STRESS_LIMIT = 64
+};
+
+static atomic_size_t stress_acquired;
+static atomic_int stress_done;
+
+// Completes deliveries from another thread, as the callback thread of the MQTT client does
+static void *stress_deliveries(void *arg)
+{
+    PublishWindow *window = (PublishWindow *)arg;
+    size_t completed = 0;
+
+    while (!atomic_load(&stress_done) || completed < atomic_load(&stress_acquired))
+    {
+        if (completed < atomic_load(&stress_acquired))
+        {
+            publish_window_complete(window);
+            completed++;
+        }
+    }
+
+    return NULL;
+}
+
+void test_publish_window_concurrent_deliveries(void)
+{
+    PublishWindow window;
+    publish_window_init(&window, STRESS_LIMIT);
+    atomic_store(&stress_acquired, 0);
+    atomic_store(&stress_done, 0);
+
+    pthread_t thread;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, NULL, stress_deliveries, &window));
+
+    size_t acquired = 0;
+    for (int i = 0; i < STRESS_PUBLISHES; i++)
+    {
+        if (publish_window_acquire(&window) == 0)
+        {
+            acquired++;
+            atomic_fetch_add(&stress_acquired, 1);
+        }
+        TEST_ASSERT_TRUE(publish_window_in_flight(&window) <= STRESS_LIMIT);
+    }
+
+    atomic_store(&stress_done, 1);
+    pthread_join(thread, NULL);
+
+    // Every publish was either delivered or dropped, and the window is empty again
+    TEST_ASSERT_EQUAL_size_t(0, publish_window_in_flight(&window));
+    TEST_ASSERT_EQUAL_UINT64(acquired, atomic_load(&window.delivered));
+    TEST_ASSERT_EQUAL_UINT64(STRESS_PUBLISHES - acquired, atomic_load(&window.dropped));
+}
+
+void test_publish_window_null(void)
+{
+    // Should not crash
+    publish_window_init(NULL, 1);
+    publish_window_cancel(NULL);
+    publish_window_complete(NULL);
+    publish_window_reset(NULL);
+    TEST_ASSERT_EQUAL_INT(-1, publish_window_acquire(NULL));
+    TEST_ASSERT_EQUAL_size_t(0, publish_window_in_flight(NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Slot Accounting Tests
+    RUN_TEST(test_publish_window_acquire_up_to_limit);
+    RUN_TEST(test_publish_window_complete_frees_a_slot);
+    RUN_TEST(test_publish_window_cancel_is_not_a_delivery);
+    RUN_TEST(test_publish_window_ignores_unmatched_releases);
+    RUN_TEST(test_publish_window_reset_forgets_in_flight);
+    RUN_TEST(test_publish_window_zero_limit);
+
+    // Concurrency Tests
+    RUN_TEST(test_publish_window_concurrent_deliveries);
+
+    // Edge Cases
+    RUN_TEST(test_publish_window_null);
+
+    return UNITY_END();
+}
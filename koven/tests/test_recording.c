@@ -0,0 +1,329 @@
+#include "../external/unity.h"
+#include "../fleet.h"
+#include "../recording.h"
+#include "../replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char path[64];
+
+void setUp(void)
+{
+    snprintf(path, sizeof(path), "/tmp/koven_recording_test_%d.bin", (int)getpid());
+    unlink(path);
+}
+
+void tearDown(void)
+{
+    unlink(path);
+}
+
+// Runs fleet for ticks ticks as the emulator does, recording every command and every event
+// Every fifth oven gets a START on tick 1 and every seventh a STOP then a START on tick 40
+static void record_run(Recorder *recorder, KovenFleet *fleet, uint64_t ticks)
+{
+    CommandPayload start = {ACTION_START, 60, 20};
+    CommandPayload stop = {ACTION_STOP, 0, 0};
+    EventPayload *events = malloc(fleet->count * sizeof(EventPayload));
+    TEST_ASSERT_NOT_NULL(events);
+
+    for (uint64_t tick = 1; tick <= ticks; tick++)
+    {
+        for (size_t i = 0; i < fleet->count; i++)
+        {
+            uint32_t id = fleet->first_id + (uint32_t)i;
+            if (tick == 1 && i % 5 == 0)
+            {
+                TEST_ASSERT_EQUAL_INT(0, recorder_command(recorder, tick, id, &start));
+                fleet_execute(fleet, id, &start);
+            }
+            if (tick == 40 && i % 7 == 0)
+            {
+                TEST_ASSERT_EQUAL_INT(0, recorder_command(recorder, tick, id, &stop));
+                TEST_ASSERT_EQUAL_INT(0, recorder_command(recorder, tick, id, &start));
+                fleet_execute(fleet, id, &stop);
+                fleet_execute(fleet, id, &start);
+            }
+        }
+
+        koven_tick_batch(fleet, fleet->count, events);
+        for (size_t i = 0; i < fleet->count; i++)
+        {
+            TEST_ASSERT_EQUAL_INT(
+                0, recorder_event(recorder, tick, fleet->first_id + (uint32_t)i, &events[i]));
+        }
+    }
+
+    free(events);
+}
+
+// Records a run of a fresh fleet to the test file and loads it back
+static uint8_t *record_fleet(uint32_t first_id, size_t count, uint64_t ticks, size_t *len)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, first_id, count));
+
+    Recorder recorder;
+    TEST_ASSERT_EQUAL_INT(0, recorder_open(&recorder, path, first_id, count));
+    record_run(&recorder, &fleet, ticks);
+    TEST_ASSERT_EQUAL_INT(0, recorder_close(&recorder));
+    fleet_free(&fleet);
+
+    uint8_t *data;
+    TEST_ASSERT_EQUAL_INT(0, recording_load(path, &data, len));
+    return data;
+}
+
+void test_recording_round_trip(void)
+{
+    Recorder recorder;
+    TEST_ASSERT_EQUAL_INT(0, recorder_open(&recorder, path, 1000, 500));
+
+    CommandPayload cmd = {ACTION_START, 180, 600};
+    EventPayload event = {STATE_BAKING, 180, 599, 600, 180};
+    TEST_ASSERT_EQUAL_INT(0, recorder_command(&recorder, 1, 1000, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, recorder_command(&recorder, 1, 1499, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, recorder_event(&recorder, 300, 1200, &event));
+    TEST_ASSERT_EQUAL_INT(0, recorder_event(&recorder, 1000000, 1000, &event));
+    TEST_ASSERT_EQUAL_UINT64(2, recorder.commands);
+    TEST_ASSERT_EQUAL_UINT64(2, recorder.events);
+    TEST_ASSERT_EQUAL_INT(0, recorder_close(&recorder));
+
+    uint8_t *data;
+    size_t len;
+    TEST_ASSERT_EQUAL_INT(0, recording_load(path, &data, &len));
+
+    // Varints take one byte per 7 bits of the tick delta and of the oven offset
+    TEST_ASSERT_EQUAL_size_t(RECORDING_HEADER_SIZE + (1 + 1 + 1 + COMMAND_FRAME_SIZE) +
+                                 (1 + 1 + 2 + COMMAND_FRAME_SIZE) + (1 + 2 + 2 + EVENT_FRAME_SIZE) +
+                                 (1 + 3 + 1 + EVENT_FRAME_SIZE),
+                             len);
+
+    RecordingCursor cursor;
+    TEST_ASSERT_EQUAL_INT(0, recording_cursor_init(&cursor, data, len));
+    TEST_ASSERT_EQUAL_UINT32(1000, cursor.header.first_id);
+    TEST_ASSERT_EQUAL_UINT64(500, cursor.header.count);
+
+    const uint8_t kinds[] = {RECORD_COMMAND, RECORD_COMMAND, RECORD_EVENT, RECORD_EVENT};
+    const uint64_t ticks[] = {1, 1, 300, 1000000};
+    const uint32_t ids[] = {1000, 1499, 1200, 1000};
+    Record record;
+    for (size_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, recording_cursor_next(&cursor, &record));
+        TEST_ASSERT_EQUAL_UINT8(kinds[i], record.kind);
+        TEST_ASSERT_EQUAL_UINT64(ticks[i], record.tick);
+        TEST_ASSERT_EQUAL_UINT32(ids[i], record.id);
+    }
+    TEST_ASSERT_EQUAL_INT(0, recording_cursor_next(&cursor, &record));
+
+    // The last record holds the frame as marshalled
+    uint8_t frame[EVENT_FRAME_SIZE];
+    TEST_ASSERT_EQUAL_INT((int)EVENT_FRAME_SIZE,
+                          marshall_event_frame(&event, frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL_MEMORY(frame, record.frame, EVENT_FRAME_SIZE);
+
+    free(data);
+}
+
+void test_replay_reproduces_run(void)
+{
+    size_t len;
+    uint8_t *data = record_fleet(100, 300, 200, &len);
+
+    ReplayResult result;
+    TEST_ASSERT_EQUAL_INT(0, replay_recording(data, len, &result));
+    TEST_ASSERT_EQUAL_UINT64(300, result.ovens);
+    TEST_ASSERT_EQUAL_UINT64(200, result.ticks);
+    TEST_ASSERT_EQUAL_UINT64(60 + 2 * 43, result.commands);
+    TEST_ASSERT_EQUAL_UINT64(0, result.rejected);
+    TEST_ASSERT_EQUAL_UINT64(300 * 200, result.events);
+    TEST_ASSERT_EQUAL_UINT64(0, result.mismatches);
+
+    free(data);
+}
+
+void test_replay_detects_divergence(void)
+{
+    size_t len;
+    uint8_t *data = record_fleet(0, 64, 50, &len);
+
+    RecordingCursor cursor;
+    Record record;
+    TEST_ASSERT_EQUAL_INT(0, recording_cursor_init(&cursor, data, len));
+    do
+    {
+        TEST_ASSERT_EQUAL_INT(1, recording_cursor_next(&cursor, &record));
+    } while (record.kind != RECORD_EVENT || record.tick != 30 || record.id != 10);
+
+    // An event the emulator would not have emitted: its temperature is off by one
+    uint8_t *frame = data + (record.frame - data);
+    EventPayload event;
+    event_payload_decode(&frame[3], &event);
+    event.current_temperature++;
+    TEST_ASSERT_EQUAL_INT((int)EVENT_FRAME_SIZE, marshall_event_frame(&event, frame, record.len));
+
+    ReplayResult result;
+    TEST_ASSERT_EQUAL_INT(0, replay_recording(data, len, &result));
+    TEST_ASSERT_EQUAL_UINT64(1, result.mismatches);
+    TEST_ASSERT_EQUAL_UINT64(30, result.first_mismatch_tick);
+    TEST_ASSERT_EQUAL_UINT32(10, result.first_mismatch_id);
+
+    free(data);
+}
+
+void test_replay_from_initial_state(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 7, 16));
+
+    // Ovens already busy when the capture starts, as after a snapshot was restored
+    EventPayload *events = malloc(fleet.count * sizeof(EventPayload));
+    TEST_ASSERT_NOT_NULL(events);
+    CommandPayload start = {ACTION_START, 120, 30};
+    fleet_execute(&fleet, 9, &start);
+    fleet_execute(&fleet, 20, &start);
+    for (int t = 0; t < 25; t++)
+    {
+        koven_tick_batch(&fleet, fleet.count, events);
+    }
+    free(events);
+
+    Recorder recorder;
+    TEST_ASSERT_EQUAL_INT(0, recorder_open(&recorder, path, 7, 16));
+    TEST_ASSERT_EQUAL_INT(0, recorder_initial_state(&recorder, &fleet));
+    TEST_ASSERT_EQUAL_UINT64(2, recorder.events);
+    record_run(&recorder, &fleet, 100);
+    TEST_ASSERT_EQUAL_INT(0, recorder_close(&recorder));
+    fleet_free(&fleet);
+
+    uint8_t *data;
+    size_t len;
+    TEST_ASSERT_EQUAL_INT(0, recording_load(path, &data, &len));
+
+    ReplayResult result;
+    TEST_ASSERT_EQUAL_INT(0, replay_recording(data, len, &result));
+    TEST_ASSERT_EQUAL_UINT64(16 * 100, result.events);
+    TEST_ASSERT_EQUAL_UINT64(0, result.mismatches);
+
+    free(data);
+}
+
+void test_replay_counts_rejected_commands(void)
+{
+    size_t len;
+    uint8_t *data = record_fleet(0, 10, 5, &len);
+
+    // The first record is a START of tick 1: a bad CRC makes the oven stay idle
+    data[RECORDING_HEADER_SIZE + 3 + COMMAND_FRAME_SIZE - 1] ^= 0xFF;
+
+    ReplayResult result;
+    TEST_ASSERT_EQUAL_INT(0, replay_recording(data, len, &result));
+    TEST_ASSERT_EQUAL_UINT64(1, result.rejected);
+    TEST_ASSERT_EQUAL_UINT64(5, result.mismatches);
+    TEST_ASSERT_EQUAL_UINT64(1, result.first_mismatch_tick);
+    TEST_ASSERT_EQUAL_UINT32(0, result.first_mismatch_id);
+
+    free(data);
+}
+
+void test_replay_ignores_unknown_actions(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 4));
+    Recorder recorder;
+    TEST_ASSERT_EQUAL_INT(0, recorder_open(&recorder, path, 0, 4));
+
+    // Far more commands for one oven than the fleet has ovens, none of them valid
+    CommandPayload invalid = {7, 180, 60};
+    for (int c = 0; c < 1000; c++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, recorder_command(&recorder, 1, 2, &invalid));
+        fleet_execute(&fleet, 2, &invalid);
+    }
+    EventPayload events[4];
+    koven_tick_batch(&fleet, fleet.count, events);
+    for (uint32_t id = 0; id < 4; id++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, recorder_event(&recorder, 1, id, &events[id]));
+    }
+    TEST_ASSERT_EQUAL_INT(0, recorder_close(&recorder));
+    fleet_free(&fleet);
+
+    uint8_t *data;
+    size_t len;
+    TEST_ASSERT_EQUAL_INT(0, recording_load(path, &data, &len));
+
+    ReplayResult result;
+    TEST_ASSERT_EQUAL_INT(0, replay_recording(data, len, &result));
+    TEST_ASSERT_EQUAL_UINT64(4, result.events);
+    TEST_ASSERT_EQUAL_UINT64(0, result.mismatches);
+
+    free(data);
+}
+
+void test_replay_of_malformed_log(void)
+{
+    size_t len;
+    uint8_t *data = record_fleet(0, 8, 3, &len);
+
+    ReplayResult result;
+    TEST_ASSERT_EQUAL_INT(-1, replay_recording(data, RECORDING_HEADER_SIZE - 1, &result));
+    TEST_ASSERT_EQUAL_INT(-1, replay_recording(data, len - 1, &result));
+
+    // An empty log replays nothing
+    TEST_ASSERT_EQUAL_INT(0, replay_recording(data, RECORDING_HEADER_SIZE, &result));
+    TEST_ASSERT_EQUAL_UINT64(0, result.ticks);
+
+    data[RECORDING_HEADER_SIZE] = 0x7F;
+    TEST_ASSERT_EQUAL_INT(-1, replay_recording(data, len, &result));
+
+    data[0] = 'X';
+    TEST_ASSERT_EQUAL_INT(-1, replay_recording(data, len, &result));
+
+    free(data);
+}
+
+void test_recorder_rejects_invalid_records(void)
+{
+    Recorder recorder;
+    CommandPayload cmd = {ACTION_STOP, 0, 0};
+    TEST_ASSERT_EQUAL_INT(-1, recorder_open(&recorder, path, 0, 0));
+    TEST_ASSERT_EQUAL_INT(-1, recorder_open(&recorder, "/nonexistent/dir/log", 0, 1));
+
+    TEST_ASSERT_EQUAL_INT(0, recorder_open(&recorder, path, 10, 10));
+    TEST_ASSERT_EQUAL_INT(-1, recorder_command(&recorder, 1, 9, &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, recorder_command(&recorder, 1, 20, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, recorder_command(&recorder, 5, 10, &cmd));
+
+    // Ticks never go back
+    TEST_ASSERT_EQUAL_INT(-1, recorder_command(&recorder, 4, 10, &cmd));
+    TEST_ASSERT_EQUAL_UINT64(1, recorder.commands);
+    TEST_ASSERT_EQUAL_INT(0, recorder_close(&recorder));
+    TEST_ASSERT_EQUAL_INT(-1, recorder_close(&recorder));
+
+    TEST_ASSERT_EQUAL_INT(-1, recording_load("/nonexistent/dir/log", NULL, NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Recording Tests
+    RUN_TEST(test_recording_round_trip);
+
+    // Replay Tests
+    RUN_TEST(test_replay_reproduces_run);
+    RUN_TEST(test_replay_detects_divergence);
+    RUN_TEST(test_replay_from_initial_state);
+    RUN_TEST(test_replay_counts_rejected_commands);
+    RUN_TEST(test_replay_ignores_unknown_actions);
+
+    // Edge Cases
+    RUN_TEST(test_replay_of_malformed_log);
+    RUN_TEST(test_recorder_rejects_invalid_records);
+
+    return UNITY_END();
+}
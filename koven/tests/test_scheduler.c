@@ -0,0 +1,187 @@
+#include "../external/unity.h"
+#include "../scheduler.h"
+
+#define SECOND 1000000000ull
+#define START (1000 * SECOND)
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static TickScheduler start_scheduler(double tick_rate, double acceleration, unsigned max_batch)
+{
+    TickSchedule schedule = {tick_rate, acceleration, max_batch};
+    TickScheduler scheduler;
+    TEST_ASSERT_EQUAL_INT(0, scheduler_init_at(&scheduler, &schedule, START));
+    return scheduler;
+}
+
+void test_scheduler_real_time_one_tick_per_second(void)
+{
+    TickScheduler scheduler = start_scheduler(1, 1, 0);
+
+    TEST_ASSERT_EQUAL_UINT64(START + SECOND, scheduler.deadline_ns);
+    for (uint64_t k = 1; k <= 10; k++)
+    {
+        // Wakeups land a little late, as they do with a real timer
+        TEST_ASSERT_EQUAL_UINT(1, scheduler_advance(&scheduler, scheduler.deadline_ns + 2000));
+        TEST_ASSERT_EQUAL_UINT64(START + (k + 1) * SECOND, scheduler.deadline_ns);
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(10, scheduler.ticks);
+    TEST_ASSERT_EQUAL_UINT64(0, scheduler.missed_wakeups);
+}
+
+void test_scheduler_does_not_drift(void)
+{
+    TickScheduler scheduler = start_scheduler(1, 1, 0);
+
+    // Every wakeup is 0.9 s late: the deadlines stay on the original grid regardless
+    for (uint64_t k = 1; k <= 1000; k++)
+    {
+        uint64_t woke = START + k * SECOND + 900000000ull;
+        TEST_ASSERT_EQUAL_UINT(1, scheduler_advance(&scheduler, woke));
+        TEST_ASSERT_EQUAL_UINT64(START + (k + 1) * SECOND, scheduler.deadline_ns);
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(1000, scheduler.ticks);
+}
+
+void test_scheduler_accelerated_time(void)
+{
+    // A 30-minute bake worth of ticks in one second
+    TickScheduler scheduler = start_scheduler(10, 1800, 0);
+
+    uint64_t ticks = 0;
+    while (scheduler.deadline_ns <= START + SECOND)
+    {
+        unsigned due = scheduler_advance(&scheduler, scheduler.deadline_ns);
+        TEST_ASSERT_EQUAL_UINT(180, due);
+        ticks += due;
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(1800, ticks);
+}
+
+void test_scheduler_fractional_ticks_per_wakeup(void)
+{
+    // 2.5 ticks per wakeup alternate between 2 and 3 without losing any
+    TickScheduler scheduler = start_scheduler(4, 10, 0);
+
+    unsigned expected[8] = {2, 3, 2, 3, 2, 3, 2, 3};
+    for (int k = 0; k < 8; k++)
+    {
+        TEST_ASSERT_EQUAL_UINT(expected[k], scheduler_advance(&scheduler, scheduler.deadline_ns));
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(20, scheduler.ticks);
+}
+
+void test_scheduler_wakeups_faster_than_ticks(void)
+{
+    // Four wakeups per simulated tick: only every fourth one runs a tick
+    TickScheduler scheduler = start_scheduler(4, 1, 0);
+
+    unsigned expected[8] = {0, 0, 0, 1, 0, 0, 0, 1};
+    for (int k = 0; k < 8; k++)
+    {
+        TEST_ASSERT_EQUAL_UINT(expected[k], scheduler_advance(&scheduler, scheduler.deadline_ns));
+    }
+}
+
+void test_scheduler_catches_up_in_batches(void)
+{
+    TickScheduler scheduler = start_scheduler(1, 100, 250);
+
+    // The process stalls for 10 seconds: 1000 ticks are due
+    uint64_t now = START + 10 * SECOND;
+    TEST_ASSERT_EQUAL_UINT(250, scheduler_advance(&scheduler, now));
+    TEST_ASSERT_EQUAL_UINT64(now, scheduler.deadline_ns);
+    TEST_ASSERT_EQUAL_UINT(250, scheduler_advance(&scheduler, now));
+    TEST_ASSERT_EQUAL_UINT(250, scheduler_advance(&scheduler, now));
+    TEST_ASSERT_EQUAL_UINT(250, scheduler_advance(&scheduler, now));
+
+    // Caught up: back on the grid, with the passed wakeups counted as missed
+    TEST_ASSERT_EQUAL_UINT64(1000, scheduler.ticks);
+    TEST_ASSERT_EQUAL_UINT64(START + 11 * SECOND, scheduler.deadline_ns);
+    TEST_ASSERT_EQUAL_UINT64(9, scheduler.missed_wakeups);
+
+    TEST_ASSERT_EQUAL_UINT(100, scheduler_advance(&scheduler, START + 11 * SECOND));
+}
+
+void test_scheduler_default_batch(void)
+{
+    TickScheduler scheduler = start_scheduler(2, 100, 0);
+
+    // Four wakeups' worth of ticks
+    TEST_ASSERT_EQUAL_UINT(200, scheduler.max_batch);
+}
+
+void test_scheduler_early_wakeup(void)
+{
+    TickScheduler scheduler = start_scheduler(1, 1, 0);
+
+    // Woken before the deadline, e.g. by a signal: nothing is due and the deadline stays
+    TEST_ASSERT_EQUAL_UINT(0, scheduler_advance(&scheduler, START + SECOND / 2));
+    TEST_ASSERT_EQUAL_UINT64(START + SECOND, scheduler.deadline_ns);
+    TEST_ASSERT_EQUAL_UINT(1, scheduler_advance(&scheduler, START + SECOND));
+}
+
+void test_scheduler_wait_sleeps_until_deadline(void)
+{
+    TickSchedule schedule = {100, 100, 0};
+    TickScheduler scheduler;
+    TEST_ASSERT_EQUAL_INT(0, scheduler_init(&scheduler, &schedule));
+
+    uint64_t before = scheduler_now_ns();
+    unsigned ticks = 0;
+    while (ticks < 5)
+    {
+        ticks += scheduler_wait(&scheduler);
+    }
+
+    // Five 10 ms wakeups
+    TEST_ASSERT_TRUE(scheduler_now_ns() - before >= 40000000ull);
+}
+
+void test_scheduler_invalid_schedule(void)
+{
+    TickScheduler scheduler;
+    TickSchedule zero_rate = {0, 1, 0};
+    TickSchedule negative_acceleration = {1, -1, 0};
+    TickSchedule valid = {1, 1, 0};
+
+    TEST_ASSERT_EQUAL_INT(-1, scheduler_init_at(&scheduler, &zero_rate, START));
+    TEST_ASSERT_EQUAL_INT(-1, scheduler_init_at(&scheduler, &negative_acceleration, START));
+    TEST_ASSERT_EQUAL_INT(-1, scheduler_init_at(&scheduler, NULL, START));
+    TEST_ASSERT_EQUAL_INT(-1, scheduler_init_at(NULL, &valid, START));
+
+    // Should not crash
+    TEST_ASSERT_EQUAL_UINT(0, scheduler_advance(NULL, START));
+    TEST_ASSERT_EQUAL_UINT(0, scheduler_wait(NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Schedule Tests
+    RUN_TEST(test_scheduler_real_time_one_tick_per_second);
+    RUN_TEST(test_scheduler_does_not_drift);
+    RUN_TEST(test_scheduler_accelerated_time);
+    RUN_TEST(test_scheduler_fractional_ticks_per_wakeup);
+    RUN_TEST(test_scheduler_wakeups_faster_than_ticks);
+
+    // Catch-up Tests
+    RUN_TEST(test_scheduler_catches_up_in_batches);
+    RUN_TEST(test_scheduler_default_batch);
+    RUN_TEST(test_scheduler_early_wakeup);
+
+    // Clock Tests
+    RUN_TEST(test_scheduler_wait_sleeps_until_deadline);
+
+    // Edge Cases
+    RUN_TEST(test_scheduler_invalid_schedule);
+
+    return UNITY_END();
+}
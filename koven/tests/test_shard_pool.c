@@ -0,0 +1,555 @@
+#include "../external/unity.h"
+#include "../event_tracker.h"
+#include "../fleet.h"
+#include "../koven.h"
+#include "../shard_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static CommandPayload start_command(int16_t temperature, int16_t duration)
+{
+    CommandPayload cmd;
+    cmd.action = ACTION_START;
+    cmd.temperature = temperature;
+    cmd.duration = duration;
+    return cmd;
+}
+
+// Fields published by the oven at index in the last tick of the pool
+static uint8_t published_fields(const ShardPool *pool, const uint8_t *fields, size_t index)
+{
+    return shard_pool_block_publishes(pool, index / FLEET_BLOCK_SIZE) ? fields[index] : 0;
+}
+
+void test_shard_pool_slices_cover_fleet(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 1000, 1000));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 3, 1, 0, NULL));
+
+    // 334 ovens per shard, rounded up to 384
+    TEST_ASSERT_EQUAL_size_t(3, pool.count);
+    TEST_ASSERT_EQUAL_size_t(384, pool.slice_size);
+
+    size_t next = 0;
+    for (size_t s = 0; s < pool.count; s++)
+    {
+        TEST_ASSERT_EQUAL_size_t(next, pool.shards[s].first);
+        TEST_ASSERT_EQUAL_size_t(0, pool.shards[s].first % SHARD_ALIGNMENT);
+        TEST_ASSERT_EQUAL_UINT32(1000 + next, pool.shards[s].slice.first_id);
+        next += pool.shards[s].slice.count;
+    }
+    TEST_ASSERT_EQUAL_size_t(fleet.count, next);
+
+    shard_pool_free(&pool);
+    fleet_free(&fleet);
+}
+
+void test_shard_pool_small_fleet_uses_fewer_shards(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 100));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 8, 1, 0, NULL));
+    TEST_ASSERT_EQUAL_size_t(2, pool.count);
+    TEST_ASSERT_EQUAL_size_t(36, pool.shards[1].slice.count);
+
+    shard_pool_free(&pool);
+    fleet_free(&fleet);
+
+    size_t count = shard_pool_default_count(100);
+    TEST_ASSERT_TRUE(count >= 1 && count <= 2);
+    TEST_ASSERT_EQUAL_size_t(1, shard_pool_default_count(1));
+}
+
+void test_shard_pool_matches_single_threaded_tick(void)
+{
+    enum
+    {
+        OVENS = 1000,
+        PRODUCERS = 2
+    };
+
+    KovenFleet sharded;
+    KovenFleet reference;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&sharded, 0, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, OVENS));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &sharded, 4, PRODUCERS, 0, NULL));
+
+    static EventPayload events[OVENS];
+    static EventPayload expected[OVENS];
+
+    for (int round = 0; round < 40; round++)
+    {
+        // A few commands per round, from both producers
+        for (uint32_t i = (uint32_t)round; i < OVENS; i += 97)
+        {
+            CommandPayload cmd = start_command((int16_t)(30 + round % 5), (int16_t)(round % 7));
+            TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, i % PRODUCERS, i, &cmd));
+            TEST_ASSERT_EQUAL_INT(0, fleet_execute(&reference, i, &cmd));
+        }
+
+        shard_pool_tick(&pool, 1, events, NULL);
+        koven_tick_batch(&reference, OVENS, expected);
+
+        TEST_ASSERT_EQUAL_MEMORY(expected, events, sizeof(expected));
+    }
+
+    shard_pool_free(&pool);
+    fleet_free(&sharded);
+    fleet_free(&reference);
+}
+
+void test_shard_pool_several_ticks_per_round(void)
+{
+    KovenFleet sharded;
+    KovenFleet reference;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&sharded, 0, 300));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, 300));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &sharded, 3, 1, 0, NULL));
+
+    CommandPayload cmd = start_command(40, 5);
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 250, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, fleet_execute(&reference, 250, &cmd));
+
+    EventPayload events[300];
+    EventPayload expected[300];
+    shard_pool_tick(&pool, 7, events, NULL);
+    for (int t = 0; t < 7; t++)
+    {
+        koven_tick_batch(&reference, 300, expected);
+    }
+
+    // The events are those of the last tick
+    TEST_ASSERT_EQUAL_MEMORY(expected, events, sizeof(expected));
+    TEST_ASSERT_EQUAL_INT16(32, events[250].current_temperature);
+
+    shard_pool_free(&pool);
+    fleet_free(&sharded);
+    fleet_free(&reference);
+}
+
+void test_shard_pool_updates_tracker(void)
+{
+    enum
+    {
+        OVENS = 200
+    };
+
+    EventPolicy policy = {EVENT_MODE_DELTA, 0};
+    KovenFleet sharded;
+    KovenFleet reference;
+    EventTracker tracker;
+    EventTracker expected_tracker;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&sharded, 0, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&expected_tracker, &policy, OVENS));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &sharded, 4, 1, 0, &tracker));
+
+    EventPayload events[OVENS];
+    EventPayload expected[OVENS];
+    uint8_t fields[OVENS];
+
+    for (int round = 0; round < 10; round++)
+    {
+        if (round == 2)
+        {
+            CommandPayload cmd = start_command(30, 2);
+            TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 150, &cmd));
+            TEST_ASSERT_EQUAL_INT(0, fleet_execute(&reference, 150, &cmd));
+        }
+
+        shard_pool_tick(&pool, 1, events, fields);
+        koven_tick_batch(&reference, OVENS, expected);
+
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            TEST_ASSERT_EQUAL_UINT8(event_tracker_update(&expected_tracker, i, &expected[i]),
+                                    published_fields(&pool, fields, i));
+        }
+    }
+
+    shard_pool_free(&pool);
+    event_tracker_free(&tracker);
+    event_tracker_free(&expected_tracker);
+    fleet_free(&sharded);
+    fleet_free(&reference);
+}
+
+void test_shard_pool_skips_idle_blocks(void)
+{
+    enum
+    {
+        OVENS = 512
+    };
+
+    EventPolicy policy = {EVENT_MODE_CHANGES, 4};
+    KovenFleet sharded;
+    KovenFleet reference;
+    EventTracker tracker;
+    EventTracker expected_tracker;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&sharded, 0, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, OVENS));
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&expected_tracker, &policy, OVENS));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &sharded, 2, 1, 0, &tracker));
+
+    static EventPayload events[OVENS];
+    static EventPayload expected[OVENS];
+    uint8_t fields[OVENS];
+
+    // One busy oven: after the first round only its block of 64 ovens is ticked
+    CommandPayload cmd = start_command(40, 10);
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 300, &cmd));
+    TEST_ASSERT_EQUAL_INT(0, fleet_execute(&reference, 300, &cmd));
+
+    for (int round = 0; round < 12; round++)
+    {
+        memset(fields, 0xFF, sizeof(fields));
+        shard_pool_tick(&pool, 1, events, fields);
+        koven_tick_batch(&reference, OVENS, expected);
+
+        // Idle ovens still send their heartbeats, with the right state
+        for (size_t i = 0; i < OVENS; i++)
+        {
+            uint8_t expected_fields = event_tracker_update(&expected_tracker, i, &expected[i]);
+            TEST_ASSERT_EQUAL_UINT8(expected_fields, published_fields(&pool, fields, i));
+            if (expected_fields)
+            {
+                TEST_ASSERT_EQUAL_MEMORY(&expected[i], &events[i], sizeof(EventPayload));
+            }
+        }
+
+        // After the first round, an idle block is left alone but on its heartbeats
+        for (size_t block = 0; round > 0 && block < OVENS / FLEET_BLOCK_SIZE; block++)
+        {
+            size_t first = block * FLEET_BLOCK_SIZE;
+            int visited = block == 300 / FLEET_BLOCK_SIZE || expected_tracker.age[first] == 0;
+            TEST_ASSERT_EQUAL_INT(visited, fields[first] != 0xFF);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT64(OVENS + 11 * FLEET_BLOCK_SIZE, shard_pool_oven_ticks(&pool));
+
+    shard_pool_free(&pool);
+    event_tracker_free(&tracker);
+    event_tracker_free(&expected_tracker);
+    fleet_free(&sharded);
+    fleet_free(&reference);
+}
+
+void test_shard_pool_coalesces_commands_per_tick(void)
+{
+    KovenFleet sharded;
+    KovenFleet reference;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&sharded, 0, 128));
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&reference, 0, 128));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &sharded, 2, 1, 0, NULL));
+
+    // A double click, then a change of mind, on one oven; a restart on another
+    CommandPayload start = start_command(180, 60);
+    CommandPayload restart = start_command(200, 30);
+    CommandPayload stop = {ACTION_STOP, 0, 0};
+    const struct {
+        uint32_t id;
+        const CommandPayload *cmd;
+    } burst[] = {{10, &start}, {10, &start}, {10, &stop}, {100, &stop}, {100, &restart}};
+
+    for (size_t c = 0; c < sizeof(burst) / sizeof(burst[0]); c++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, burst[c].id, burst[c].cmd));
+        TEST_ASSERT_EQUAL_INT(0, fleet_execute(&reference, burst[c].id, burst[c].cmd));
+    }
+
+    EventPayload events[128];
+    EventPayload expected[128];
+    shard_pool_tick(&pool, 1, events, NULL);
+    koven_tick_batch(&reference, 128, expected);
+
+    TEST_ASSERT_EQUAL_MEMORY(expected, events, sizeof(expected));
+    TEST_ASSERT_EQUAL_INT(STATE_IDLE, events[10].state);
+    TEST_ASSERT_EQUAL_INT16(200, events[100].programmed_temperature);
+
+    // Oven 10 only gets the STOP, oven 100 the STOP and the START
+    TEST_ASSERT_EQUAL_UINT64(3, shard_pool_executed(&pool));
+    TEST_ASSERT_EQUAL_UINT64(2, shard_pool_coalesced(&pool));
+
+    shard_pool_free(&pool);
+    fleet_free(&sharded);
+    fleet_free(&reference);
+}
+
+void test_shard_pool_ignores_unknown_actions(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 64));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 1, 1, 0, NULL));
+
+    // Far more commands for one oven than the slice has ovens, none of them valid
+    CommandPayload invalid = {7, 180, 60};
+    EventPayload events[64];
+    size_t submitted = 0;
+    for (int c = 0; c < 1000; c++)
+    {
+        if (shard_pool_submit(&pool, 0, 5, &invalid) != 0)
+        {
+            shard_pool_tick(&pool, 1, events, NULL);
+            TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 5, &invalid));
+        }
+        submitted++;
+    }
+    shard_pool_tick(&pool, 1, events, NULL);
+
+    TEST_ASSERT_EQUAL_INT(STATE_IDLE, events[5].state);
+    TEST_ASSERT_EQUAL_UINT64(0, shard_pool_executed(&pool));
+    TEST_ASSERT_EQUAL_UINT64(submitted, shard_pool_coalesced(&pool));
+
+    // The oven still takes valid commands
+    CommandPayload start = start_command(180, 60);
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 5, &invalid));
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 5, &start));
+    shard_pool_tick(&pool, 1, events, NULL);
+    TEST_ASSERT_EQUAL_INT(STATE_PREHEATING, events[5].state);
+    TEST_ASSERT_EQUAL_UINT64(1, shard_pool_executed(&pool));
+
+    shard_pool_free(&pool);
+    fleet_free(&fleet);
+}
+
+void test_shard_pool_records_captured_commands(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/koven_shard_pool_test_%d.bin", (int)getpid());
+
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 128));
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 2, 1, 0, NULL));
+    Recorder recorder;
+    TEST_ASSERT_EQUAL_INT(0, recorder_open(&recorder, path, 0, 128));
+    shard_pool_capture(&pool, 1);
+
+    // Submitted to the second shard first, recorded in shard order within the tick
+    CommandPayload start = start_command(180, 60);
+    EventPayload events[128];
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 100, &start));
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 10, &start));
+    shard_pool_tick(&pool, 1, events, NULL);
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_record(&pool, &recorder));
+
+    // A round of three ticks drains its commands before the first of them: the second tick
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 5, &start));
+    shard_pool_tick(&pool, 3, events, NULL);
+    TEST_ASSERT_EQUAL_UINT64(4, pool.ticks_run);
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_record(&pool, &recorder));
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_record(&pool, &recorder));
+    TEST_ASSERT_EQUAL_UINT64(3, recorder.commands);
+    TEST_ASSERT_EQUAL_INT(0, recorder_close(&recorder));
+
+    uint8_t *data;
+    size_t len;
+    RecordingCursor cursor;
+    Record record;
+    TEST_ASSERT_EQUAL_INT(0, recording_load(path, &data, &len));
+    TEST_ASSERT_EQUAL_INT(0, recording_cursor_init(&cursor, data, len));
+
+    const uint64_t ticks[] = {1, 1, 2};
+    const uint32_t ids[] = {10, 100, 5};
+    for (size_t i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, recording_cursor_next(&cursor, &record));
+        TEST_ASSERT_EQUAL_UINT8(RECORD_COMMAND, record.kind);
+        TEST_ASSERT_EQUAL_UINT64(ticks[i], record.tick);
+        TEST_ASSERT_EQUAL_UINT32(ids[i], record.id);
+    }
+    TEST_ASSERT_EQUAL_INT(0, recording_cursor_next(&cursor, &record));
+
+    free(data);
+    unlink(path);
+    shard_pool_free(&pool);
+    fleet_free(&fleet);
+}
+
+void test_shard_pool_backlog_overflow(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 256));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 4, 1, 10, NULL));
+
+    // Nothing drains the queues until the next tick
+    CommandPayload cmd = start_command(180, 60);
+    for (size_t i = 0; i < 15; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(i < 10 ? 0 : -1, shard_pool_submit(&pool, 0, i * 17, &cmd));
+    }
+    TEST_ASSERT_EQUAL_UINT64(5, shard_pool_overflow(&pool));
+    TEST_ASSERT_EQUAL_UINT64(0, shard_pool_dropped(&pool));
+
+    // The tick frees the backlog again
+    EventPayload events[256];
+    shard_pool_tick(&pool, 1, events, NULL);
+    TEST_ASSERT_EQUAL_UINT64(10, shard_pool_executed(&pool));
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_submit(&pool, 0, 255, &cmd));
+
+    shard_pool_free(&pool);
+    fleet_free(&fleet);
+}
+
+typedef struct {
+    ShardPool *pool;
+    size_t producer;
+    size_t submitted;
+} Producer;
+
+static void *produce(void *arg)
+{
+    Producer *producer = arg;
+    CommandPayload cmd = start_command(180, 600);
+
+    for (size_t i = 0; i < 20000; i++)
+    {
+        size_t index = (i * 7919 + producer->producer) % producer->pool->fleet->count;
+        if (shard_pool_submit(producer->pool, producer->producer, index, &cmd) == 0)
+        {
+            producer->submitted++;
+        }
+    }
+    return NULL;
+}
+
+void test_shard_pool_commands_while_ticking(void)
+{
+    enum
+    {
+        PRODUCERS = 3
+    };
+
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 4096));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 4, PRODUCERS, 0, NULL));
+
+    pthread_t threads[PRODUCERS];
+    Producer producers[PRODUCERS];
+    for (size_t p = 0; p < PRODUCERS; p++)
+    {
+        producers[p].pool = &pool;
+        producers[p].producer = p;
+        producers[p].submitted = 0;
+        pthread_create(&threads[p], NULL, produce, &producers[p]);
+    }
+
+    static EventPayload events[4096];
+    for (int round = 0; round < 200; round++)
+    {
+        shard_pool_tick(&pool, 1, events, NULL);
+    }
+
+    size_t submitted = 0;
+    for (size_t p = 0; p < PRODUCERS; p++)
+    {
+        pthread_join(threads[p], NULL);
+        submitted += producers[p].submitted;
+    }
+
+    // One more round drains the queues
+    shard_pool_tick(&pool, 1, events, NULL);
+
+    // Every accepted command is either executed or superseded by a later one
+    TEST_ASSERT_EQUAL_UINT64(submitted, shard_pool_executed(&pool) + shard_pool_coalesced(&pool));
+    TEST_ASSERT_EQUAL_UINT64(
+        PRODUCERS * 20000,
+        submitted + shard_pool_dropped(&pool) + shard_pool_overflow(&pool));
+    TEST_ASSERT_EQUAL_size_t(0, pool.backlog);
+
+    shard_pool_free(&pool);
+    fleet_free(&fleet);
+}
+
+void test_shard_pool_invalid_arguments(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 100));
+
+    EventPolicy policy = {EVENT_MODE_FULL, 0};
+    EventTracker tracker;
+    TEST_ASSERT_EQUAL_INT(0, event_tracker_init(&tracker, &policy, 50));
+
+    ShardPool pool;
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_init(NULL, &fleet, 1, 1, 0, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_init(&pool, NULL, 1, 1, 0, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_init(&pool, &fleet, 0, 1, 0, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_init(&pool, &fleet, 1, 0, 0, NULL));
+    // The tracker must cover the whole fleet
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_init(&pool, &fleet, 1, 1, 0, &tracker));
+
+    TEST_ASSERT_EQUAL_INT(0, shard_pool_init(&pool, &fleet, 2, 1, 0, NULL));
+    CommandPayload cmd = start_command(180, 60);
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_submit(&pool, 1, 0, &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_submit(&pool, 0, 100, &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, shard_pool_submit(&pool, 0, 0, NULL));
+
+    // Should not crash
+    shard_pool_tick(&pool, 1, NULL, NULL);
+    shard_pool_tick(NULL, 1, NULL, NULL);
+    shard_pool_free(&pool);
+    shard_pool_free(&pool);
+    shard_pool_free(NULL);
+
+    event_tracker_free(&tracker);
+    fleet_free(&fleet);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Slicing Tests
+    RUN_TEST(test_shard_pool_slices_cover_fleet);
+    RUN_TEST(test_shard_pool_small_fleet_uses_fewer_shards);
+
+    // Tick Tests
+    RUN_TEST(test_shard_pool_matches_single_threaded_tick);
+    RUN_TEST(test_shard_pool_several_ticks_per_round);
+    RUN_TEST(test_shard_pool_updates_tracker);
+    RUN_TEST(test_shard_pool_skips_idle_blocks);
+
+    // Command Tests
+    RUN_TEST(test_shard_pool_coalesces_commands_per_tick);
+    RUN_TEST(test_shard_pool_ignores_unknown_actions);
+    RUN_TEST(test_shard_pool_backlog_overflow);
+    RUN_TEST(test_shard_pool_records_captured_commands);
+
+    // Concurrency Tests
+    RUN_TEST(test_shard_pool_commands_while_ticking);
+
+    // Edge Cases
+    RUN_TEST(test_shard_pool_invalid_arguments);
+
+    return UNITY_END();
+}
@@ -0,0 +1,300 @@
+#include "../external/unity.h"
+#include "../fleet.h"
+#include "../log.h"
+#include "../snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static char path[64];
+
+void setUp(void)
+{
+    snprintf(path, sizeof(path), "/tmp/koven_snapshot_test_%d.bin", (int)getpid());
+    unlink(path);
+}
+
+void tearDown(void)
+{
+    unlink(path);
+}
+
+// Starts a bake on every third oven and ticks the fleet a few times
+static void run_fleet(KovenFleet *fleet, int ticks)
+{
+    CommandPayload start = {ACTION_START, 60, 30};
+    for (size_t i = 0; i < fleet->count; i += 3)
+    {
+        fleet_execute(fleet, fleet->first_id + (uint32_t)i, &start);
+    }
+
+    EventPayload *events = malloc(fleet->count * sizeof(EventPayload));
+    TEST_ASSERT_NOT_NULL(events);
+    for (int t = 0; t < ticks; t++)
+    {
+        koven_tick_batch(fleet, fleet->count, events);
+    }
+    free(events);
+}
+
+static void assert_same_fleet(const KovenFleet *expected, const KovenFleet *actual)
+{
+    TEST_ASSERT_EQUAL_size_t(expected->count, actual->count);
+    for (size_t i = 0; i < expected->count; i++)
+    {
+        Koven a;
+        Koven b;
+        fleet_get(expected, i, &a);
+        fleet_get(actual, i, &b);
+        TEST_ASSERT_EQUAL_INT(a.state, b.state);
+        TEST_ASSERT_EQUAL_INT16(a.current_temperature, b.current_temperature);
+        TEST_ASSERT_EQUAL_INT16(a.remaining_time, b.remaining_time);
+        TEST_ASSERT_EQUAL_INT16(a.programmed_duration, b.programmed_duration);
+        TEST_ASSERT_EQUAL_INT16(a.programmed_temperature, b.programmed_temperature);
+    }
+}
+
+// Opens the test file for fleet and restores it into a fresh fleet of the same shape
+static uint64_t restore_into(const KovenFleet *shape, KovenFleet *restored)
+{
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(restored, shape->first_id, shape->count));
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, restored, 0));
+    uint64_t sequence = snapshot_restore(&snapshot, restored);
+    snapshot_close(&snapshot);
+    return sequence;
+}
+
+void test_snapshot_round_trip(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 100, 1000));
+    run_fleet(&fleet, 50);
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 1));
+    snapshot_close(&snapshot);
+
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_UINT64(1, restore_into(&fleet, &restored));
+    assert_same_fleet(&fleet, &restored);
+
+    // The restored table keeps ticking exactly like the original one
+    run_fleet(&fleet, 100);
+    run_fleet(&restored, 100);
+    assert_same_fleet(&fleet, &restored);
+
+    fleet_free(&restored);
+    fleet_free(&fleet);
+}
+
+void test_snapshot_restores_newest(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 200));
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    for (int s = 0; s < 5; s++)
+    {
+        run_fleet(&fleet, 7);
+        TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, (uint64_t)s));
+    }
+    snapshot_close(&snapshot);
+
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_UINT64(5, restore_into(&fleet, &restored));
+    assert_same_fleet(&fleet, &restored);
+
+    // Reopening continues the numbering of the file
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    TEST_ASSERT_EQUAL_UINT64(5, snapshot.sequence);
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 6));
+    TEST_ASSERT_EQUAL_UINT64(6, snapshot.sequence);
+    snapshot_close(&snapshot);
+
+    fleet_free(&restored);
+    fleet_free(&fleet);
+}
+
+void test_snapshot_falls_back_on_corrupt_slot(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 64));
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    run_fleet(&fleet, 3);
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 1));
+
+    KovenFleet first;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&first, 0, 64));
+    TEST_ASSERT_EQUAL_UINT64(1, snapshot_restore(&snapshot, &first));
+
+    // A save torn by a crash: the newer slot holds a table that does not match its checksum
+    run_fleet(&fleet, 3);
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 2));
+    uint8_t *table = snapshot.map + sizeof(SnapshotHeader) + sizeof(SnapshotSlot);
+    size_t stride = (snapshot.size - sizeof(SnapshotHeader)) / SNAPSHOT_SLOTS;
+    table[stride + 3] ^= 0x5A;
+    snapshot_close(&snapshot);
+
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_UINT64(1, restore_into(&fleet, &restored));
+    assert_same_fleet(&first, &restored);
+
+    fleet_free(&restored);
+    fleet_free(&first);
+    fleet_free(&fleet);
+}
+
+void test_snapshot_downtime(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 16));
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, snapshot_downtime_ns(&snapshot));
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 1));
+    snapshot_close(&snapshot);
+
+    usleep(20000);
+
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&restored, 0, 16));
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &restored, 0));
+    TEST_ASSERT_EQUAL_UINT64(1, snapshot_restore(&snapshot, &restored));
+
+    // The wall-clock time of the save is kept in the file
+    uint64_t downtime = snapshot_downtime_ns(&snapshot);
+    TEST_ASSERT_TRUE(downtime >= 20000000ull);
+    TEST_ASSERT_TRUE(downtime < 60000000000ull);
+    snapshot_close(&snapshot);
+
+    TEST_ASSERT_EQUAL_UINT64(0, snapshot_downtime_ns(NULL));
+    fleet_free(&restored);
+    fleet_free(&fleet);
+}
+
+void test_snapshot_save_due(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 16));
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 1000));
+    TEST_ASSERT_EQUAL_INT(1, snapshot_save_due(&snapshot, &fleet, 5000));
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save_due(&snapshot, &fleet, 5999));
+    TEST_ASSERT_EQUAL_INT(1, snapshot_save_due(&snapshot, &fleet, 6000));
+    TEST_ASSERT_EQUAL_UINT64(2, snapshot.sequence);
+    snapshot_close(&snapshot);
+
+    fleet_free(&fleet);
+}
+
+void test_snapshot_restore_100k_ovens(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 100000));
+    run_fleet(&fleet, 10);
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 1));
+    snapshot_close(&snapshot);
+
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&restored, 0, 100000));
+
+    uint64_t start = log_now_ns();
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &restored, 0));
+    TEST_ASSERT_EQUAL_UINT64(1, snapshot_restore(&snapshot, &restored));
+    uint64_t elapsed_ns = log_now_ns() - start;
+    snapshot_close(&snapshot);
+
+    // Generous bound for loaded CI machines; a restore normally takes about a millisecond
+    TEST_ASSERT_TRUE(elapsed_ns < 200000000ull);
+    assert_same_fleet(&fleet, &restored);
+
+    fleet_free(&restored);
+    fleet_free(&fleet);
+}
+
+void test_snapshot_without_snapshot(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 32));
+
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_UINT64(0, restore_into(&fleet, &restored));
+    assert_same_fleet(&fleet, &restored);
+
+    fleet_free(&restored);
+    fleet_free(&fleet);
+}
+
+void test_snapshot_of_another_fleet_is_reset(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 32));
+    run_fleet(&fleet, 5);
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, snapshot_open(&snapshot, path, &fleet, 0));
+    TEST_ASSERT_EQUAL_INT(0, snapshot_save(&snapshot, &fleet, 1));
+    snapshot_close(&snapshot);
+
+    // Other ids, then another size: neither may pick up the snapshot
+    KovenFleet other;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&other, 1, 32));
+    KovenFleet restored;
+    TEST_ASSERT_EQUAL_UINT64(0, restore_into(&other, &restored));
+    fleet_free(&restored);
+    fleet_free(&other);
+
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&other, 0, 48));
+    TEST_ASSERT_EQUAL_UINT64(0, restore_into(&other, &restored));
+    fleet_free(&restored);
+    fleet_free(&other);
+
+    fleet_free(&fleet);
+}
+
+void test_snapshot_null_arguments(void)
+{
+    KovenFleet fleet;
+    TEST_ASSERT_EQUAL_INT(0, fleet_init(&fleet, 0, 8));
+
+    FleetSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(-1, snapshot_open(NULL, path, &fleet, 0));
+    TEST_ASSERT_EQUAL_INT(-1, snapshot_open(&snapshot, NULL, &fleet, 0));
+    TEST_ASSERT_EQUAL_INT(-1, snapshot_open(&snapshot, "/nonexistent/dir/snapshot", &fleet, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, snapshot_restore(NULL, &fleet));
+    TEST_ASSERT_EQUAL_INT(-1, snapshot_save(NULL, &fleet, 0));
+    snapshot_close(NULL);
+
+    fleet_free(&fleet);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Snapshot Tests
+    RUN_TEST(test_snapshot_round_trip);
+    RUN_TEST(test_snapshot_restores_newest);
+    RUN_TEST(test_snapshot_falls_back_on_corrupt_slot);
+    RUN_TEST(test_snapshot_save_due);
+    RUN_TEST(test_snapshot_downtime);
+    RUN_TEST(test_snapshot_restore_100k_ovens);
+
+    // Edge Cases
+    RUN_TEST(test_snapshot_without_snapshot);
+    RUN_TEST(test_snapshot_of_another_fleet_is_reset);
+    RUN_TEST(test_snapshot_null_arguments);
+
+    return UNITY_END();
+}
@@ -0,0 +1,342 @@
+#include "../external/unity.h"
+#include "../protocol.h"
+#include "../transport.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// The broker backend is not linked into this suite
+int mqtt_transport_open(Transport *transport,
+                        const TransportConfig *config,
+                        const char *client_id,
+                        const char *subscription)
+{
+    (void)transport;
+    (void)config;
+    (void)client_id;
+    (void)subscription;
+    return -1;
+}
+
+// What the handlers of the transport saw, written by its reader thread
+typedef struct {
+    pthread_mutex_t lock;
+    int messages;
+    int lost;
+    char topic[TRANSPORT_UNIX_MAX_TOPIC + 1];
+    uint8_t payload[64];
+    size_t len;
+} Received;
+
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int listener = -1;
+static Received received;
+
+static void on_message(void *context, const char *topic, const uint8_t *payload, size_t len)
+{
+    Received *r = context;
+    pthread_mutex_lock(&r->lock);
+    r->messages++;
+    snprintf(r->topic, sizeof(r->topic), "%s", topic);
+    r->len = len < sizeof(r->payload) ? len : sizeof(r->payload);
+    memcpy(r->payload, payload, r->len);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void on_lost(void *context, const char *cause)
+{
+    (void)cause;
+    Received *r = context;
+    pthread_mutex_lock(&r->lock);
+    r->lost++;
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Waits up to a second for the reader thread to have seen count messages (or losses)
+static int wait_for(int *counter, int count)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        pthread_mutex_lock(&received.lock);
+        int value = *counter;
+        pthread_mutex_unlock(&received.lock);
+        if (value >= count)
+        {
+            return 1;
+        }
+
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, NULL);
+    }
+    return 0;
+}
+
+// The test plays the platform, which listens for the emulator
+static void start_listener(void)
+{
+    snprintf(socket_path, sizeof(socket_path), "/tmp/koven_test_%d.sock", (int)getpid());
+    unlink(socket_path);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    listener = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    TEST_ASSERT_TRUE(listener >= 0);
+    TEST_ASSERT_EQUAL_INT(0, bind(listener, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, listen(listener, 4));
+}
+
+void setUp(void)
+{
+    memset(&received, 0, sizeof(received));
+    pthread_mutex_init(&received.lock, NULL);
+    start_listener();
+}
+
+void tearDown(void)
+{
+    close(listener);
+    unlink(socket_path);
+    pthread_mutex_destroy(&received.lock);
+}
+
+// Opens a transport with the handlers of the suite
+static int open_with(Transport *transport, const TransportConfig *config)
+{
+    return transport_open(transport, config, "test", "cmds/koven", on_message, on_lost, &received);
+}
+
+// Connects a transport to the test socket and accepts it
+static int open_transport(Transport *transport)
+{
+    TransportConfig config = {.kind = TRANSPORT_UNIX, .address = socket_path};
+    TEST_ASSERT_EQUAL_INT(0, open_with(transport, &config));
+
+    int peer = accept(listener, NULL, NULL);
+    TEST_ASSERT_TRUE(peer >= 0);
+    return peer;
+}
+
+// Sends one datagram of the unix transport from the platform side
+static void send_message(int peer, const char *topic, const uint8_t *payload, size_t len)
+{
+    uint8_t datagram[256];
+    size_t topic_len = strlen(topic);
+    datagram[0] = (uint8_t)topic_len;
+    memcpy(&datagram[1], topic, topic_len);
+    if (len > 0)
+    {
+        memcpy(&datagram[1 + topic_len], payload, len);
+    }
+    TEST_ASSERT_EQUAL_INT((int)(1 + topic_len + len),
+                          (int)send(peer, datagram, 1 + topic_len + len, 0));
+}
+
+void test_transport_kind_from_string(void)
+{
+    TransportKind kind;
+    TEST_ASSERT_EQUAL_INT(0, transport_kind_from_string("unix", &kind));
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_UNIX, kind);
+    TEST_ASSERT_EQUAL_INT(0, transport_kind_from_string("mqtt", &kind));
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_MQTT, kind);
+    TEST_ASSERT_EQUAL_INT(-1, transport_kind_from_string("shm", &kind));
+    TEST_ASSERT_EQUAL_INT(-1, transport_kind_from_string(NULL, &kind));
+    TEST_ASSERT_EQUAL_STRING("unix", transport_kind_to_string(TRANSPORT_UNIX));
+}
+
+void test_transport_qos_mode_from_string(void)
+{
+    TransportQosMode mode;
+    TEST_ASSERT_EQUAL_INT(0, transport_qos_mode_from_string("uniform", &mode));
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_QOS_UNIFORM, mode);
+    TEST_ASSERT_EQUAL_INT(0, transport_qos_mode_from_string("tiered", &mode));
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_QOS_TIERED, mode);
+    TEST_ASSERT_EQUAL_INT(0, transport_qos_mode_from_string("retained", &mode));
+    TEST_ASSERT_EQUAL_INT(TRANSPORT_QOS_RETAINED, mode);
+    TEST_ASSERT_EQUAL_INT(-1, transport_qos_mode_from_string("best", &mode));
+    TEST_ASSERT_EQUAL_INT(-1, transport_qos_mode_from_string(NULL, &mode));
+}
+
+void test_transport_default_address(void)
+{
+    TransportConfig config = {.kind = TRANSPORT_UNIX, .address = NULL};
+    TEST_ASSERT_EQUAL_STRING(TRANSPORT_UNIX_DEFAULT_ADDRESS, transport_address(&config));
+    config.kind = TRANSPORT_MQTT;
+    TEST_ASSERT_EQUAL_STRING(TRANSPORT_MQTT_DEFAULT_ADDRESS, transport_address(&config));
+    config.address = "/run/koven.sock";
+    TEST_ASSERT_EQUAL_STRING("/run/koven.sock", transport_address(&config));
+}
+
+void test_unix_transport_publishes_frames_unchanged(void)
+{
+    Transport transport;
+    int peer = open_transport(&transport);
+
+    EventPayload event = {STATE_BAKING, 180, 42, 60, 180};
+    uint8_t frame[EVENT_FRAME_SIZE];
+    int frame_size = marshall_event_frame(&event, frame, sizeof(frame));
+    TEST_ASSERT_EQUAL_INT(
+        0,
+        transport_publish(
+            &transport, "events/koven", frame, (size_t)frame_size, TRANSPORT_STATE));
+    TEST_ASSERT_EQUAL_size_t(0, transport_in_flight(&transport));
+
+    // One datagram: topic length, topic, then the frame byte for byte
+    uint8_t datagram[256];
+    ssize_t n = recv(peer, datagram, sizeof(datagram), 0);
+    TEST_ASSERT_EQUAL_INT(1 + 12 + frame_size, (int)n);
+    TEST_ASSERT_EQUAL_UINT8(12, datagram[0]);
+    TEST_ASSERT_EQUAL_MEMORY("events/koven", &datagram[1], 12);
+    TEST_ASSERT_EQUAL_MEMORY(frame, &datagram[13], (size_t)frame_size);
+
+    transport_close(&transport);
+    close(peer);
+    TEST_ASSERT_EQUAL_INT(0, received.lost);
+}
+
+void test_unix_transport_receives_commands(void)
+{
+    Transport transport;
+    int peer = open_transport(&transport);
+
+    // START at 180°C for 60 seconds
+    uint8_t frame[COMMAND_FRAME_SIZE] = {0x01, 0x05, 0x00, ACTION_START, 0xB4, 0x00, 0x3C, 0x00};
+    uint16_t crc = crc16_usb(frame, 8);
+    frame[8] = crc & 0xFF;
+    frame[9] = (crc >> 8) & 0xFF;
+    send_message(peer, "cmds/koven/7", frame, sizeof(frame));
+
+    TEST_ASSERT_TRUE(wait_for(&received.messages, 1));
+    TEST_ASSERT_EQUAL_STRING("cmds/koven/7", received.topic);
+    TEST_ASSERT_EQUAL_size_t(sizeof(frame), received.len);
+    TEST_ASSERT_EQUAL_MEMORY(frame, received.payload, sizeof(frame));
+
+    CommandPayload cmd;
+    TEST_ASSERT_EQUAL_INT(0, unmarshall_command_frame(received.payload, received.len, &cmd));
+    TEST_ASSERT_EQUAL_INT16(180, cmd.temperature);
+
+    transport_close(&transport);
+    close(peer);
+}
+
+void test_unix_transport_rejects_oversized_topic(void)
+{
+    Transport transport;
+    int peer = open_transport(&transport);
+
+    char topic[TRANSPORT_UNIX_MAX_TOPIC + 2];
+    memset(topic, 'a', sizeof(topic) - 1);
+    topic[sizeof(topic) - 1] = '\0';
+    uint8_t payload[1] = {0};
+    TEST_ASSERT_EQUAL_INT(
+        -1, transport_publish(&transport, topic, payload, sizeof(payload), TRANSPORT_TELEMETRY));
+
+    transport_close(&transport);
+    close(peer);
+}
+
+void test_unix_transport_ignores_malformed_datagrams(void)
+{
+    Transport transport;
+    int peer = open_transport(&transport);
+
+    // A topic longer than the datagram, then an empty payload, neither of which is delivered
+    uint8_t bad[3] = {200, 'c', 'm'};
+    TEST_ASSERT_EQUAL_INT(3, (int)send(peer, bad, sizeof(bad), 0));
+    send_message(peer, "cmds/koven", NULL, 0);
+
+    uint8_t payload[2] = {0xAB, 0xCD};
+    send_message(peer, "cmds/koven", payload, sizeof(payload));
+
+    TEST_ASSERT_TRUE(wait_for(&received.messages, 1));
+    TEST_ASSERT_EQUAL_INT(1, received.messages);
+    TEST_ASSERT_EQUAL_size_t(2, received.len);
+    TEST_ASSERT_EQUAL_UINT8(0xAB, received.payload[0]);
+
+    transport_close(&transport);
+    close(peer);
+}
+
+void test_unix_transport_reports_lost_platform(void)
+{
+    Transport transport;
+    int peer = open_transport(&transport);
+
+    close(peer);
+    TEST_ASSERT_TRUE(wait_for(&received.lost, 1));
+
+    transport_close(&transport);
+    TEST_ASSERT_EQUAL_INT(1, received.lost);
+}
+
+void test_unix_transport_reconnects(void)
+{
+    Transport transport;
+    int peer = open_transport(&transport);
+
+    // The platform goes away, and the socket with it
+    close(peer);
+    TEST_ASSERT_TRUE(wait_for(&received.lost, 1));
+    close(listener);
+    unlink(socket_path);
+    TEST_ASSERT_EQUAL_INT(-1, transport_reconnect(&transport));
+    uint8_t payload[2] = {0x12, 0x34};
+    TEST_ASSERT_EQUAL_INT(
+        -1, transport_publish(&transport, "events/koven", payload, 2, TRANSPORT_TELEMETRY));
+
+    // Once the platform listens again, the same transport carries messages both ways
+    start_listener();
+    TEST_ASSERT_EQUAL_INT(0, transport_reconnect(&transport));
+    peer = accept(listener, NULL, NULL);
+    TEST_ASSERT_TRUE(peer >= 0);
+
+    TEST_ASSERT_EQUAL_INT(
+        0, transport_publish(&transport, "events/koven", payload, 2, TRANSPORT_TELEMETRY));
+    uint8_t datagram[64];
+    TEST_ASSERT_EQUAL_INT(1 + 12 + 2, (int)recv(peer, datagram, sizeof(datagram), 0));
+    send_message(peer, "cmds/koven", payload, sizeof(payload));
+    TEST_ASSERT_TRUE(wait_for(&received.messages, 1));
+
+    transport_close(&transport);
+    close(peer);
+    TEST_ASSERT_EQUAL_INT(1, received.lost);
+}
+
+void test_unix_transport_without_platform(void)
+{
+    Transport transport;
+    TransportConfig config = {.kind = TRANSPORT_UNIX, .address = "/tmp/koven_test_missing.sock"};
+    unlink(config.address);
+
+    TEST_ASSERT_EQUAL_INT(-1, open_with(&transport, &config));
+    TEST_ASSERT_EQUAL_INT(-1, open_with(NULL, &config));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Transport Tests
+    RUN_TEST(test_transport_kind_from_string);
+    RUN_TEST(test_transport_qos_mode_from_string);
+    RUN_TEST(test_transport_default_address);
+
+    // Unix Transport Tests
+    RUN_TEST(test_unix_transport_publishes_frames_unchanged);
+    RUN_TEST(test_unix_transport_receives_commands);
+    RUN_TEST(test_unix_transport_rejects_oversized_topic);
+    RUN_TEST(test_unix_transport_reconnects);
+
+    // Edge Cases
+    RUN_TEST(test_unix_transport_ignores_malformed_datagrams);
+    RUN_TEST(test_unix_transport_reports_lost_platform);
+    RUN_TEST(test_unix_transport_without_platform);
+
+    return UNITY_END();
+}
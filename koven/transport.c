@@ -0,0 +1,104 @@
+#include "transport.h"
+#include <string.h>
+
+int transport_kind_from_string(const char *name, TransportKind *kind)
+{
+    if (!name || !kind)
+    {
+        return -1;
+    }
+
+    if (strcmp(name, "mqtt") == 0)
+    {
+        *kind = TRANSPORT_MQTT;
+    }
+    else if (strcmp(name, "unix") == 0)
+    {
+        *kind = TRANSPORT_UNIX;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *transport_kind_to_string(TransportKind kind)
+{
+    switch (kind)
+    {
+    case TRANSPORT_MQTT:
+        return "mqtt";
+    case TRANSPORT_UNIX:
+        return "unix";
+    default:
+        return "unknown";
+    }
+}
+
+int transport_qos_mode_from_string(const char *name, TransportQosMode *mode)
+{
+    if (!name || !mode)
+    {
+        return -1;
+    }
+
+    if (strcmp(name, "uniform") == 0)
+    {
+        *mode = TRANSPORT_QOS_UNIFORM;
+    }
+    else if (strcmp(name, "tiered") == 0)
+    {
+        *mode = TRANSPORT_QOS_TIERED;
+    }
+    else if (strcmp(name, "retained") == 0)
+    {
+        *mode = TRANSPORT_QOS_RETAINED;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *transport_address(const TransportConfig *config)
+{
+    if (config->address && *config->address != '\0')
+    {
+        return config->address;
+    }
+    return config->kind == TRANSPORT_UNIX ? TRANSPORT_UNIX_DEFAULT_ADDRESS
+                                          : TRANSPORT_MQTT_DEFAULT_ADDRESS;
+}
+
+int transport_open(Transport *transport,
+                   const TransportConfig *config,
+                   const char *client_id,
+                   const char *subscription,
+                   TransportMessageHandler on_message,
+                   TransportLostHandler on_lost,
+                   void *context)
+{
+    if (!transport || !config || !on_message || !on_lost)
+    {
+        return -1;
+    }
+
+    memset(transport, 0, sizeof(*transport));
+    transport->on_message = on_message;
+    transport->on_lost = on_lost;
+    transport->context = context;
+
+    switch (config->kind)
+    {
+    case TRANSPORT_MQTT:
+        return mqtt_transport_open(transport, config, client_id, subscription);
+    case TRANSPORT_UNIX:
+        return unix_transport_open(transport, transport_address(config));
+    default:
+        return -1;
+    }
+}
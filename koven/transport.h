@@ -0,0 +1,163 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// How messages travel between the emulator and the platform
+// TRANSPORT_MQTT goes through the broker, TRANSPORT_UNIX through a local AF_UNIX SOCK_SEQPACKET
+// socket the platform listens on, for an emulator and a platform running on the same host
+typedef enum {
+    TRANSPORT_MQTT = 0,
+    TRANSPORT_UNIX = 1
+} TransportKind;
+
+// How the events of the emulator are delivered by the broker, ignored by the unix transport
+// TRANSPORT_QOS_UNIFORM publishes every event at the QoS of the connection. TRANSPORT_QOS_TIERED
+// publishes telemetry, events of ovens that stay in the same state, at QoS 0 and keeps the QoS of
+// the connection for the state transitions; TRANSPORT_QOS_RETAINED also retains the transitions
+// published on the topic of a single oven, for subscribers to get the state of the oven at once
+// Neither tiered mode works with EVENT_MODE_DELTA, whose events only apply over the previous one
+typedef enum {
+    TRANSPORT_QOS_UNIFORM = 0,
+    TRANSPORT_QOS_TIERED = 1,
+    TRANSPORT_QOS_RETAINED = 2
+} TransportQosMode;
+
+// What a publish carries, for the transport to pick its delivery (see TransportQosMode)
+// TRANSPORT_STATE is a transition published on the topic of a single oven
+typedef enum {
+    TRANSPORT_TELEMETRY = 0,
+    TRANSPORT_TRANSITION = 1,
+    TRANSPORT_STATE = 2
+} TransportStream;
+
+// Default address of each transport
+#define TRANSPORT_MQTT_DEFAULT_ADDRESS "tcp://mqtt:1883"
+#define TRANSPORT_UNIX_DEFAULT_ADDRESS "/tmp/koven.sock"
+
+// Every datagram of the unix transport carries one message: the length of its topic on one
+// byte, the topic, then the payload, which is a protocol frame as sent over MQTT
+#define TRANSPORT_UNIX_MAX_TOPIC 255
+#define TRANSPORT_UNIX_MAX_MESSAGE (128 * 1024)
+
+// Socket send buffer asked for, so that the events of a whole fleet tick fit in it
+#define TRANSPORT_UNIX_SEND_BUFFER (4 * 1024 * 1024)
+
+typedef struct {
+    TransportKind kind;
+    // Broker URL or socket path, NULL for the default of the transport
+    const char *address;
+
+    // Settings of the broker connections, ignored by the unix transport
+    // QoS of the publishes and of the subscription, and time given to a disconnect to complete,
+    // 0 for MQTT_TIMEOUT
+    int qos;
+    long timeout_ms;
+    TransportQosMode qos_mode;
+    // Client id of the single oven, or prefix of the client ids of the fleet connections; NULL
+    // for MQTT_CLIENT_ID or MQTT_FLEET_CLIENT_ID_PREFIX
+    const char *client_id;
+    // Replica of the emulator the fleet connections belong to (see mqtt_client_run_fleet)
+    uint32_t shard_id;
+} TransportConfig;
+
+// Called on the receiving thread of the transport for every message of the subscription
+// The topic and the payload are only valid during the call
+typedef void (*TransportMessageHandler)(void *context,
+                                        const char *topic,
+                                        const uint8_t *payload,
+                                        size_t len);
+
+// Called on the receiving thread of the transport when the connection is lost
+typedef void (*TransportLostHandler)(void *context, const char *cause);
+
+struct Transport;
+
+typedef struct {
+    int (*publish)(struct Transport *transport,
+                   const char *topic,
+                   const uint8_t *payload,
+                   size_t len,
+                   TransportStream stream);
+    size_t (*in_flight)(struct Transport *transport);
+    int (*reconnect)(struct Transport *transport);
+    void (*close)(struct Transport *transport);
+} TransportOps;
+
+// One connection of the emulator, whatever carries it
+// Messages are protocol frames, unchanged by the transport; publishes never wait for their
+// delivery and are dropped instead when the transport cannot take them right away
+// The backends keep pointers to the struct, which must not move until it is closed
+typedef struct Transport {
+    const TransportOps *ops;
+    TransportMessageHandler on_message;
+    TransportLostHandler on_lost;
+    void *context;
+    void *impl;
+} Transport;
+
+// Parses a transport name ("mqtt" or "unix")
+// Returns 0 on success, -1 on error
+int transport_kind_from_string(const char *name, TransportKind *kind);
+
+const char *transport_kind_to_string(TransportKind kind);
+
+// Parses a QoS mode name ("uniform", "tiered" or "retained")
+// Returns 0 on success, -1 on error
+int transport_qos_mode_from_string(const char *name, TransportQosMode *mode);
+
+// Address a transport connects to: the one of config, or the default of its kind
+const char *transport_address(const TransportConfig *config);
+
+// Connects a transport and subscribes it to subscription; the handlers get context
+// client_id names the connection to the broker and is ignored by local transports
+// Returns 0 on success, -1 on error
+int transport_open(Transport *transport,
+                   const TransportConfig *config,
+                   const char *client_id,
+                   const char *subscription,
+                   TransportMessageHandler on_message,
+                   TransportLostHandler on_lost,
+                   void *context);
+
+// Backends, as selected by transport_open, which sets the handlers and context beforehand
+int mqtt_transport_open(Transport *transport,
+                        const TransportConfig *config,
+                        const char *client_id,
+                        const char *subscription);
+int unix_transport_open(Transport *transport, const char *path);
+
+// Publishes payload on topic without waiting for its delivery, as the given stream
+// Returns 0 on success, -1 on error or when the transport cannot take it right away
+static inline int transport_publish(Transport *transport,
+                                    const char *topic,
+                                    const uint8_t *payload,
+                                    size_t len,
+                                    TransportStream stream)
+{
+    return transport->ops->publish(transport, topic, payload, len, stream);
+}
+
+// Publishes whose delivery is not confirmed yet
+static inline size_t transport_in_flight(Transport *transport)
+{
+    return transport->ops->in_flight(transport);
+}
+
+// Connects a lost transport again, with the same address and subscription
+// Only called once the lost handler ran, never concurrently with another reconnect or the close;
+// publishes racing with it fail until it succeeds. Messages that were in flight are forgotten
+// Returns 0 on success, -1 on error, after which it may be retried
+static inline int transport_reconnect(Transport *transport)
+{
+    return transport->ops->reconnect(transport);
+}
+
+// Disconnects the transport; no handler is called once it returns
+static inline void transport_close(Transport *transport)
+{
+    transport->ops->close(transport);
+}
+
+#endif /* TRANSPORT_H */
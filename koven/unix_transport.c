@@ -0,0 +1,252 @@
+#include "log.h"
+#include "transport.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Shortest interval between two warnings about malformed datagrams
+#define UNIX_TRANSPORT_LOG_INTERVAL_NS 1000000000ull
+
+// Connected SOCK_SEQPACKET socket, read by its own thread
+// The kernel keeps the boundaries of every datagram, so each one is exactly one message and
+// publishes complete synchronously: nothing ever stays in flight
+// A reconnect moves the new socket onto the same descriptor, so publishes never see it change
+typedef struct {
+    int fd;
+    struct sockaddr_un addr;
+    pthread_t reader;
+    int reading;
+    atomic_int closing;
+    uint8_t *buffer;
+} UnixTransport;
+
+// Receiving thread: hands every datagram to the message handler, until the socket is closed
+static void *unix_transport_read(void *arg)
+{
+    Transport *transport = arg;
+    UnixTransport *local = transport->impl;
+    char topic[TRANSPORT_UNIX_MAX_TOPIC + 1];
+
+    for (;;)
+    {
+        struct iovec iov = {local->buffer, TRANSPORT_UNIX_MAX_MESSAGE};
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        ssize_t n = recvmsg(local->fd, &msg, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            if (!atomic_load(&local->closing))
+            {
+                transport->on_lost(transport->context,
+                                   n == 0 ? "socket closed by the platform" : "socket read error");
+            }
+            return NULL;
+        }
+
+        size_t topic_len = local->buffer[0];
+        if ((msg.msg_flags & MSG_TRUNC) || (size_t)n < 1 + topic_len)
+        {
+            log_limited(UNIX_TRANSPORT_LOG_INTERVAL_NS,
+                        LOG_LEVEL_WARN,
+                        "Ignoring malformed datagram of %zd bytes",
+                        n);
+            continue;
+        }
+
+        memcpy(topic, &local->buffer[1], topic_len);
+        topic[topic_len] = '\0';
+
+        size_t len = (size_t)n - 1 - topic_len;
+        if (len > 0)
+        {
+            transport->on_message(transport->context, topic, &local->buffer[1 + topic_len], len);
+        }
+    }
+}
+
+// Sends the topic header and the payload as one datagram, straight from the caller's buffers
+// Every stream is delivered the same: the socket never loses a datagram it took
+static int unix_transport_publish(Transport *transport,
+                                  const char *topic,
+                                  const uint8_t *payload,
+                                  size_t len,
+                                  TransportStream stream)
+{
+    (void)stream;
+    UnixTransport *local = transport->impl;
+    size_t topic_len = strlen(topic);
+    if (topic_len > TRANSPORT_UNIX_MAX_TOPIC || 1 + topic_len + len > TRANSPORT_UNIX_MAX_MESSAGE)
+    {
+        return -1;
+    }
+
+    uint8_t header = (uint8_t)topic_len;
+    struct iovec iov[3] = {
+        {&header, 1},
+        {(void *)topic, topic_len},
+        {(void *)payload, len},
+    };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+
+    // A full socket buffer drops the message rather than blocking the tick loop
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(local->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    return sent < 0 ? -1 : 0;
+}
+
+static size_t unix_transport_in_flight(Transport *transport)
+{
+    (void)transport;
+    return 0;
+}
+
+// Creates a socket connected to the platform
+// Returns the socket, or -1 on error
+static int unix_transport_connect(const struct sockaddr_un *addr)
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Best effort: the kernel caps the buffer at its own limit
+    int send_buffer = TRANSPORT_UNIX_SEND_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    return fd;
+}
+
+// The reader of the lost socket returned after calling the lost handler; a new socket takes
+// its descriptor and gets a new reader
+static int unix_transport_reconnect(Transport *transport)
+{
+    UnixTransport *local = transport->impl;
+
+    if (local->reading)
+    {
+        pthread_join(local->reader, NULL);
+        local->reading = 0;
+    }
+
+    int fd = unix_transport_connect(&local->addr);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // dup2 swaps the sockets atomically: a racing publish goes to one or the other
+    int moved = dup2(fd, local->fd);
+    close(fd);
+    if (moved < 0 || pthread_create(&local->reader, NULL, unix_transport_read, transport) != 0)
+    {
+        shutdown(local->fd, SHUT_RDWR);
+        return -1;
+    }
+
+    local->reading = 1;
+    return 0;
+}
+
+// Wakes the reader up by shutting the socket down, then waits for it before releasing anything
+static void unix_transport_close(Transport *transport)
+{
+    UnixTransport *local = transport->impl;
+
+    atomic_store(&local->closing, 1);
+    shutdown(local->fd, SHUT_RDWR);
+    if (local->reading)
+    {
+        pthread_join(local->reader, NULL);
+    }
+    close(local->fd);
+    free(local->buffer);
+    free(local);
+    transport->impl = NULL;
+}
+
+static const TransportOps unix_transport_ops = {
+    unix_transport_publish,
+    unix_transport_in_flight,
+    unix_transport_reconnect,
+    unix_transport_close,
+};
+
+int unix_transport_open(Transport *transport, const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(addr.sun_path))
+    {
+        log_error("Invalid socket path: %s", path ? path : "(null)");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    UnixTransport *local = calloc(1, sizeof(UnixTransport));
+    uint8_t *buffer = malloc(TRANSPORT_UNIX_MAX_MESSAGE);
+    if (!local || !buffer)
+    {
+        free(local);
+        free(buffer);
+        return -1;
+    }
+    local->buffer = buffer;
+    local->addr = addr;
+    atomic_init(&local->closing, 0);
+
+    local->fd = unix_transport_connect(&addr);
+    if (local->fd < 0)
+    {
+        log_error("Failed to connect to %s: %s", path, strerror(errno));
+        free(buffer);
+        free(local);
+        return -1;
+    }
+
+    transport->ops = &unix_transport_ops;
+    transport->impl = local;
+
+    if (pthread_create(&local->reader, NULL, unix_transport_read, transport) != 0)
+    {
+        log_error("Failed to start the reader of %s", path);
+        close(local->fd);
+        free(buffer);
+        free(local);
+        transport->impl = NULL;
+        return -1;
+    }
+
+    local->reading = 1;
+    return 0;
+}
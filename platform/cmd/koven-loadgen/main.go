@@ -0,0 +1,85 @@
+// Command koven-loadgen runs an end-to-end load test of the emulator fleet and the platform
+//
+//	go build -o koven-platform . && go run ./cmd/koven-loadgen -platform ./koven-platform \
+//	    -emulator ../koven/build/koven -ovens 10000 -clients 20 -rate 200 -duration 30s
+//
+// It prints the report of the run, and exits with status 1 when the run regresses past the
+// report saved with -save-baseline and given back with -baseline
+package main
+
+import (
+	"flag"
+	"fmt"
+	"log"
+	"os"
+	"path/filepath"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/loadgen"
+)
+
+func main() {
+	var cfg loadgen.Config
+	flag.StringVar(&cfg.Emulator, "emulator", "", "Emulator binary to start, empty to use a running fleet")
+	flag.StringVar(&cfg.Platform, "platform", "", "Platform binary to start, empty to use the one running at -addr")
+	flag.StringVar(&cfg.Addr, "addr", "localhost:18080", "HTTP address of the platform")
+	flag.StringVar(&cfg.Socket, "local-socket", filepath.Join(os.TempDir(), "koven-loadgen.sock"), "Socket of the local transport")
+	flag.StringVar(&cfg.Broker, "mqtt-broker", "", "MQTT broker URL to use instead of the local transport")
+	flag.StringVar(&cfg.LogDir, "log-dir", os.TempDir(), "Directory of the logs of the started components")
+	flag.IntVar(&cfg.Ovens, "ovens", 10000, "Ovens of the fleet")
+	first := flag.Uint("first-id", 0, "Id of the first oven of the fleet")
+	flag.Float64Var(&cfg.TickRate, "tick-rate", 1, "Wakeups (and publishes) per second of the emulator")
+	flag.Float64Var(&cfg.Acceleration, "acceleration", 1, "Simulated seconds per second of the emulator")
+	flag.IntVar(&cfg.Clients, "clients", 10, "WebSocket clients attached to the event stream")
+	flag.Float64Var(&cfg.Rate, "rate", 100, "Commands per second")
+	flag.IntVar(&cfg.Concurrency, "concurrency", 16, "Commands in flight over HTTP at a time")
+	flag.DurationVar(&cfg.Duration, "duration", 30*time.Second, "Time commands are sent for")
+	flag.DurationVar(&cfg.Warmup, "warmup", 2*time.Second, "Time the clients are connected before commands are sent")
+	flag.DurationVar(&cfg.Timeout, "timeout", 5*time.Second, "Time after which a command without event is lost")
+	flag.DurationVar(&cfg.Startup, "startup", 30*time.Second, "Longest wait for the components and every oven")
+	baseline := flag.String("baseline", "", "Report of a previous run to compare with")
+	tolerance := flag.Float64("tolerance", 0.2, "Regression allowed against the baseline, 0.2 for 20%")
+	saveBaseline := flag.String("save-baseline", "", "File to save the report of this run to")
+	flag.Parse()
+	cfg.FirstID = uint32(*first)
+
+	if cfg.Ovens <= 0 || cfg.Clients <= 0 || cfg.Rate <= 0 || cfg.Concurrency <= 0 ||
+		cfg.TickRate <= 0 || cfg.Acceleration <= 0 {
+		log.Fatalf("-ovens, -clients, -rate, -concurrency, -tick-rate and -acceleration must be positive")
+	}
+
+	// The baseline is read first, so that a wrong path does not cost a whole run
+	var base *loadgen.Report
+	if *baseline != "" {
+		var err error
+		if base, err = loadgen.LoadReport(*baseline); err != nil {
+			log.Fatalf("Failed to read the baseline: %v", err)
+		}
+	}
+
+	report, err := loadgen.Run(cfg)
+	if err != nil {
+		log.Fatalf("Load test failed: %v", err)
+	}
+	if err := report.WriteText(os.Stdout); err != nil {
+		log.Fatalf("Failed to write the report: %v", err)
+	}
+
+	if *saveBaseline != "" {
+		if err := report.Save(*saveBaseline); err != nil {
+			log.Fatalf("Failed to save the report: %v", err)
+		}
+		log.Printf("Saved the report to %s", *saveBaseline)
+	}
+
+	if base != nil {
+		regressions := report.Regressions(base, *tolerance)
+		for _, regression := range regressions {
+			fmt.Fprintf(os.Stderr, "Regression: %s\n", regression)
+		}
+		if len(regressions) > 0 {
+			os.Exit(1)
+		}
+		log.Printf("No regression against %s", *baseline)
+	}
+}
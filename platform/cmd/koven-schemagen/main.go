@@ -0,0 +1,43 @@
+// Command koven-schemagen generates the Go codecs of the messages defined in koven/messages.def
+//
+//	go run ./cmd/koven-schemagen -schema ../koven/messages.def -package protocol -out internal/protocol/messages_gen.go
+//
+// It is run by go generate in internal/protocol; the generated file is committed so that the
+// platform builds without the emulator sources
+package main
+
+import (
+	"flag"
+	"log"
+	"os"
+	"path/filepath"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/schema"
+)
+
+func main() {
+	schemaPath := flag.String("schema", "../../../koven/messages.def", "Message schema to read")
+	pkg := flag.String("package", "protocol", "Package of the generated file")
+	out := flag.String("out", "messages_gen.go", "Generated file")
+	flag.Parse()
+
+	file, err := os.Open(*schemaPath)
+	if err != nil {
+		log.Fatalf("Failed to open schema: %v", err)
+	}
+	defer file.Close()
+
+	messages, err := schema.Parse(file)
+	if err != nil {
+		log.Fatalf("Failed to parse %s: %v", *schemaPath, err)
+	}
+
+	source, err := schema.GenerateGo(*pkg, "koven/"+filepath.Base(*schemaPath), messages)
+	if err != nil {
+		log.Fatalf("Failed to generate codecs: %v", err)
+	}
+
+	if err := os.WriteFile(*out, source, 0o644); err != nil {
+		log.Fatalf("Failed to write %s: %v", *out, err)
+	}
+}
@@ -0,0 +1,438 @@
+// Package loadgen runs end-to-end load tests of the whole system: the emulator fleet, the
+// transport between them and the platform
+//
+// A run starts the platform and a fleet emulator of N ovens, or uses running ones, attaches M
+// WebSocket clients to the event stream and sends commands through POST /fleet/commands at a
+// fixed rate. Every command is matched with the first event of its oven showing its effect, as
+// received by the first client, which gives the end-to-end latency; the run also measures the
+// event throughput over all clients, the memory of the emulator per oven and of the platform per
+// client, and the CPU of every component it started
+package loadgen
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"io"
+	"log"
+	"net/http"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+	"github.com/dropkitchen/koven-platform/platform/internal/service"
+	"github.com/gorilla/websocket"
+)
+
+// Interval of the pacer of the commands and of the expiry of lost ones
+const (
+	pacerInterval  = time.Millisecond
+	expiryInterval = 100 * time.Millisecond
+	pollInterval   = 100 * time.Millisecond
+)
+
+// Config describes a load test run
+type Config struct {
+	Emulator string // Emulator binary to start, "" to use one already running
+	Platform string // Platform binary to start, "" to use one already running at Addr
+	Addr     string // HTTP address of the platform
+	Socket   string // Socket of the local transport, used when Broker is empty
+	Broker   string // MQTT broker URL the components connect to instead of the local transport
+	LogDir   string // Directory of the logs of the started components
+
+	Ovens        int
+	FirstID      uint32
+	TickRate     float64 // Wakeups per second of the emulator
+	Acceleration float64 // Simulated seconds per second of the emulator
+
+	Clients     int
+	Rate        float64       // Commands per second
+	Concurrency int           // Commands in flight over HTTP at a time
+	Duration    time.Duration // Time commands are sent for
+	Warmup      time.Duration // Time the clients are connected before commands are sent
+	Timeout     time.Duration // Time after which a command without event is lost
+	Startup     time.Duration // Longest wait for the components and every oven
+}
+
+// run holds the state of one load test
+type run struct {
+	cfg       Config
+	http      *http.Client
+	tracker   *tracker
+	processes map[string]*Process
+	clients   []*websocket.Conn
+	events    atomic.Uint64
+	sent      atomic.Uint64
+	failed    atomic.Uint64
+	starved   atomic.Uint64
+	readers   sync.WaitGroup
+}
+
+// Run runs a load test and returns its report
+func Run(cfg Config) (*Report, error) {
+	r := &run{
+		cfg: cfg,
+		http: &http.Client{
+			Timeout:   cfg.Timeout,
+			Transport: &http.Transport{MaxIdleConnsPerHost: cfg.Concurrency},
+		},
+		tracker:   newTracker(cfg.FirstID, cfg.Ovens),
+		processes: make(map[string]*Process),
+	}
+	defer r.close()
+
+	if err := r.startComponents(); err != nil {
+		return nil, err
+	}
+
+	// Memory of the platform with every oven known but no client, then with the clients
+	platformBase, _ := r.stats("platform")
+	if err := r.connectClients(); err != nil {
+		return nil, err
+	}
+	time.Sleep(r.cfg.Warmup)
+	platformClients, _ := r.stats("platform")
+
+	report := r.measure()
+	report.Ovens = cfg.Ovens
+	report.Clients = cfg.Clients
+	report.Rate = cfg.Rate
+	if emulator, err := r.stats("emulator"); err == nil && cfg.Ovens > 0 {
+		report.EmulatorBytesPerOven = float64(emulator.RSS) / float64(cfg.Ovens)
+	}
+	if platformClients.RSS > platformBase.RSS && cfg.Clients > 0 {
+		report.PlatformBytesPerClient = float64(platformClients.RSS-platformBase.RSS) / float64(cfg.Clients)
+	}
+	return report, nil
+}
+
+// startComponents starts the platform and the emulator that are not already running, and waits
+// until the platform has an event of every oven
+func (r *run) startComponents() error {
+	if r.cfg.Platform != "" {
+		args := []string{"-addr", r.cfg.Addr}
+		if r.cfg.Broker != "" {
+			args = append(args, "-mqtt-broker", r.cfg.Broker)
+		} else {
+			os.Remove(r.cfg.Socket)
+			args = append(args, "-local-socket", r.cfg.Socket)
+		}
+		if err := r.start("platform", r.cfg.Platform, args, nil); err != nil {
+			return err
+		}
+	}
+	if err := r.waitFor("the platform", func() (bool, error) {
+		resp, err := r.http.Get("http://" + r.cfg.Addr + "/health")
+		if err != nil {
+			return false, nil
+		}
+		resp.Body.Close()
+		return resp.StatusCode == http.StatusOK, nil
+	}); err != nil {
+		return err
+	}
+
+	if r.cfg.Emulator != "" {
+		env := []string{
+			"KOVEN_FLEET_SIZE=" + strconv.Itoa(r.cfg.Ovens),
+			"KOVEN_FLEET_FIRST_ID=" + strconv.FormatUint(uint64(r.cfg.FirstID), 10),
+			"KOVEN_TICK_RATE=" + strconv.FormatFloat(r.cfg.TickRate, 'g', -1, 64),
+			"KOVEN_ACCELERATION=" + strconv.FormatFloat(r.cfg.Acceleration, 'g', -1, 64),
+		}
+		if r.cfg.Broker != "" {
+			env = append(env, "KOVEN_TRANSPORT=mqtt", "KOVEN_TRANSPORT_ADDRESS="+r.cfg.Broker)
+		} else {
+			env = append(env, "KOVEN_TRANSPORT=unix", "KOVEN_TRANSPORT_ADDRESS="+r.cfg.Socket)
+		}
+		if err := r.start("emulator", r.cfg.Emulator, nil, env); err != nil {
+			return err
+		}
+	}
+	return r.waitFor(fmt.Sprintf("an event of %d ovens", r.cfg.Ovens), func() (bool, error) {
+		ovens, err := r.platformOvens()
+		return err == nil && ovens >= r.cfg.Ovens, nil
+	})
+}
+
+// start starts a component, logging to a file of the log directory
+func (r *run) start(name, path string, args, env []string) error {
+	logPath := filepath.Join(r.cfg.LogDir, "koven-loadgen-"+name+".log")
+	logFile, err := os.Create(logPath)
+	if err != nil {
+		return fmt.Errorf("failed to create the log of the %s: %w", name, err)
+	}
+	defer logFile.Close()
+
+	p, err := StartProcess(name, path, args, env, logFile)
+	if err != nil {
+		return err
+	}
+	r.processes[name] = p
+	log.Printf("Started the %s (%s), logging to %s", name, path, logPath)
+	return nil
+}
+
+// waitFor polls ready until it returns true, a started component exits or cfg.Startup elapses
+func (r *run) waitFor(what string, ready func() (bool, error)) error {
+	deadline := time.Now().Add(r.cfg.Startup)
+	for {
+		ok, err := ready()
+		if err != nil {
+			return err
+		}
+		if ok {
+			return nil
+		}
+		for _, p := range r.processes {
+			if p.Exited() {
+				return fmt.Errorf("the %s exited while waiting for %s", p.Name, what)
+			}
+		}
+		if time.Now().After(deadline) {
+			return fmt.Errorf("timed out waiting for %s", what)
+		}
+		time.Sleep(pollInterval)
+	}
+}
+
+// platformOvens returns the number of ovens the platform has an event of, from its metrics
+func (r *run) platformOvens() (int, error) {
+	resp, err := r.http.Get("http://" + r.cfg.Addr + "/metrics")
+	if err != nil {
+		return 0, err
+	}
+	defer resp.Body.Close()
+
+	scanner := bufio.NewScanner(resp.Body)
+	for scanner.Scan() {
+		if value, ok := strings.CutPrefix(scanner.Text(), "koven_platform_ovens "); ok {
+			return strconv.Atoi(value)
+		}
+	}
+	return 0, fmt.Errorf("no koven_platform_ovens in the metrics of the platform")
+}
+
+// stats returns the resource usage of a started component
+func (r *run) stats(name string) (ProcessStats, error) {
+	p, ok := r.processes[name]
+	if !ok {
+		return ProcessStats{}, fmt.Errorf("the %s was not started", name)
+	}
+	return p.Stats()
+}
+
+// connectClients attaches the WebSocket clients; the first one matches commands with events
+func (r *run) connectClients() error {
+	url := "ws://" + r.cfg.Addr + "/ws/events"
+	for i := 0; i < r.cfg.Clients; i++ {
+		conn, _, err := websocket.DefaultDialer.Dial(url, nil)
+		if err != nil {
+			return fmt.Errorf("failed to connect WebSocket client %d: %w", i, err)
+		}
+		r.clients = append(r.clients, conn)
+		r.readers.Add(1)
+		go r.read(conn, i == 0)
+	}
+	return nil
+}
+
+// read counts the events received by a client, and matches them with the commands in flight on
+// the probe client, until the connection is closed
+func (r *run) read(conn *websocket.Conn, probe bool) {
+	defer r.readers.Done()
+
+	eventType := []byte(`"type":"event"`)
+	for {
+		_, data, err := conn.ReadMessage()
+		if err != nil {
+			return
+		}
+		if !probe {
+			r.events.Add(uint64(bytes.Count(data, eventType)))
+			continue
+		}
+
+		received := time.Now()
+		var msg struct {
+			Type string `json:"type"`
+			Event
+			Events []Event `json:"events"`
+		}
+		if err := json.Unmarshal(data, &msg); err != nil {
+			log.Printf("Ignoring malformed WebSocket message: %v", err)
+			continue
+		}
+		if msg.Type == "event" {
+			r.events.Add(1)
+			r.tracker.observe(&msg.Event, received)
+			continue
+		}
+		r.events.Add(uint64(len(msg.Events)))
+		for i := range msg.Events {
+			r.tracker.observe(&msg.Events[i], received)
+		}
+	}
+}
+
+// measure sends commands for cfg.Duration, waits for the events of those in flight and reports
+// the throughput, latency and CPU of the run
+func (r *run) measure() *Report {
+	cpuStart := r.cpu()
+	eventsStart := r.events.Load()
+	start := time.Now()
+
+	var workers sync.WaitGroup
+	tokens := make(chan struct{}, r.cfg.Concurrency)
+	for i := 0; i < r.cfg.Concurrency; i++ {
+		workers.Add(1)
+		go func() {
+			defer workers.Done()
+			for range tokens {
+				r.sendNext()
+			}
+		}()
+	}
+
+	stopExpiry := make(chan struct{})
+	expired := make(chan struct{})
+	go func() {
+		defer close(expired)
+		ticker := time.NewTicker(expiryInterval)
+		defer ticker.Stop()
+		for {
+			select {
+			case now := <-ticker.C:
+				r.tracker.expire(now.Add(-r.cfg.Timeout))
+			case <-stopExpiry:
+				return
+			}
+		}
+	}()
+
+	// Commands are paced on the time elapsed, so that a late wakeup sends the ones it missed
+	issued := 0
+	ticker := time.NewTicker(pacerInterval)
+	for now := range ticker.C {
+		elapsed := now.Sub(start)
+		if elapsed >= r.cfg.Duration {
+			break
+		}
+		for due := int(r.cfg.Rate*elapsed.Seconds()) - issued; due > 0; due-- {
+			select {
+			case tokens <- struct{}{}:
+				issued++
+			default:
+				due = 0 // Every worker is busy: the next wakeup catches up
+			}
+		}
+	}
+	ticker.Stop()
+	close(tokens)
+	workers.Wait()
+
+	duration := time.Since(start)
+	events := r.events.Load() - eventsStart
+	cpuEnd := r.cpu()
+
+	// Commands still in flight get their timeout to be matched
+	deadline := time.Now().Add(r.cfg.Timeout)
+	for r.tracker.inFlight() > 0 && time.Now().Before(deadline) {
+		time.Sleep(pollInterval)
+	}
+	close(stopExpiry)
+	<-expired
+	r.tracker.expire(time.Now().Add(time.Hour))
+
+	t := r.tracker
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	report := &Report{
+		Duration:          duration.Seconds(),
+		CommandsSent:      r.sent.Load(),
+		CommandsFailed:    r.failed.Load(),
+		CommandsMatched:   t.matched,
+		CommandsLost:      t.lost,
+		CommandsStarved:   r.starved.Load(),
+		EventsReceived:    events,
+		CommandsPerSecond: float64(t.matched) / duration.Seconds(),
+		EventsPerSecond:   float64(events) / duration.Seconds(),
+		LatencyP50:        t.latency.Quantile(0.5).Seconds(),
+		LatencyP99:        t.latency.Quantile(0.99).Seconds(),
+		LatencyP999:       t.latency.Quantile(0.999).Seconds(),
+		LatencyMax:        t.slowest.Seconds(),
+		CPU:               make(map[string]float64),
+	}
+	for name, end := range cpuEnd {
+		if begin, ok := cpuStart[name]; ok {
+			report.CPU[name] = (end - begin).Seconds() / duration.Seconds()
+		}
+	}
+	return report
+}
+
+// sendNext sends the next command of the tracker through POST /fleet/commands
+func (r *run) sendNext() {
+	cmd, ok := r.tracker.next(time.Now())
+	if !ok {
+		r.starved.Add(1)
+		return
+	}
+
+	req := service.FleetCommandRequest{
+		Ovens:   service.OvenSelector{IDs: []uint32{cmd.OvenID}},
+		Command: service.CommandRequest{Action: "stop"},
+	}
+	if cmd.Payload.Action == protocol.ActionStart {
+		req.Command = service.CommandRequest{
+			Action:      "start",
+			Temperature: int(cmd.Payload.Temperature),
+			Duration:    int(cmd.Payload.Duration),
+		}
+	}
+	body, _ := json.Marshal(&req)
+
+	resp, err := r.http.Post("http://"+r.cfg.Addr+"/fleet/commands", "application/json", bytes.NewReader(body))
+	if err == nil {
+		io.Copy(io.Discard, resp.Body)
+		resp.Body.Close()
+	}
+	if err != nil || resp.StatusCode != http.StatusOK {
+		r.failed.Add(1)
+		r.tracker.abandon(cmd.OvenID)
+		return
+	}
+	r.sent.Add(1)
+}
+
+// cpu returns the CPU time used so far by the load generator and every started component
+func (r *run) cpu() map[string]time.Duration {
+	times := make(map[string]time.Duration)
+	if self, err := selfStats(); err == nil {
+		times["loadgen"] = self.CPU
+	}
+	for name, p := range r.processes {
+		if stats, err := p.Stats(); err == nil {
+			times[name] = stats.CPU
+		}
+	}
+	return times
+}
+
+// close disconnects the clients and stops the started components, the emulator first
+func (r *run) close() {
+	for _, conn := range r.clients {
+		conn.Close()
+	}
+	r.readers.Wait()
+	for _, name := range []string{"emulator", "platform"} {
+		if p, ok := r.processes[name]; ok {
+			p.Stop()
+		}
+	}
+}
@@ -0,0 +1,134 @@
+package loadgen
+
+import (
+	"bytes"
+	"fmt"
+	"os"
+	"os/exec"
+	"strconv"
+	"strings"
+	"syscall"
+	"time"
+)
+
+// Clock ticks per second of the CPU times in /proc/<pid>/stat (USER_HZ), 100 on every Linux
+// architecture
+const userHZ = 100
+
+// Time a process is given to exit after SIGTERM before it is killed
+const stopTimeout = 10 * time.Second
+
+// ProcessStats is the resource usage of a process at one point in time
+type ProcessStats struct {
+	CPU time.Duration // User and system time since the process started
+	RSS uint64        // Resident set size in bytes
+}
+
+// readProcessStats reads the resource usage of a running process from /proc
+func readProcessStats(pid int) (ProcessStats, error) {
+	stat, err := os.ReadFile(fmt.Sprintf("/proc/%d/stat", pid))
+	if err != nil {
+		return ProcessStats{}, err
+	}
+	// The command name may hold spaces and parentheses: the fields start after the last ')'
+	end := bytes.LastIndexByte(stat, ')')
+	if end < 0 {
+		return ProcessStats{}, fmt.Errorf("malformed /proc/%d/stat", pid)
+	}
+	fields := strings.Fields(string(stat[end+1:]))
+	if len(fields) < 13 {
+		return ProcessStats{}, fmt.Errorf("malformed /proc/%d/stat", pid)
+	}
+	// utime and stime are fields 14 and 15 of stat, 12 and 13 after the name
+	utime, err1 := strconv.ParseUint(fields[11], 10, 64)
+	stime, err2 := strconv.ParseUint(fields[12], 10, 64)
+	if err1 != nil || err2 != nil {
+		return ProcessStats{}, fmt.Errorf("malformed CPU times in /proc/%d/stat", pid)
+	}
+
+	status, err := os.ReadFile(fmt.Sprintf("/proc/%d/status", pid))
+	if err != nil {
+		return ProcessStats{}, err
+	}
+	var rss uint64
+	for _, line := range strings.Split(string(status), "\n") {
+		if value, ok := strings.CutPrefix(line, "VmRSS:"); ok {
+			kb, err := strconv.ParseUint(strings.TrimSuffix(strings.TrimSpace(value), " kB"), 10, 64)
+			if err != nil {
+				return ProcessStats{}, fmt.Errorf("malformed VmRSS in /proc/%d/status", pid)
+			}
+			rss = kb * 1024
+		}
+	}
+
+	return ProcessStats{
+		CPU: time.Duration(utime+stime) * time.Second / userHZ,
+		RSS: rss,
+	}, nil
+}
+
+// Process is a component the load generator started: the emulator or the platform
+type Process struct {
+	Name string
+	cmd  *exec.Cmd
+	done chan struct{}
+	err  error
+}
+
+// StartProcess starts path with args and the environment of the load generator plus env, its
+// output going to log
+func StartProcess(name, path string, args, env []string, log *os.File) (*Process, error) {
+	cmd := exec.Command(path, args...)
+	cmd.Env = append(os.Environ(), env...)
+	cmd.Stdout = log
+	cmd.Stderr = log
+	if err := cmd.Start(); err != nil {
+		return nil, fmt.Errorf("failed to start the %s: %w", name, err)
+	}
+
+	p := &Process{Name: name, cmd: cmd, done: make(chan struct{})}
+	go func() {
+		p.err = cmd.Wait()
+		close(p.done)
+	}()
+	return p, nil
+}
+
+// Stats returns the resource usage of the process, which must still be running
+func (p *Process) Stats() (ProcessStats, error) {
+	select {
+	case <-p.done:
+		return ProcessStats{}, fmt.Errorf("the %s exited: %v", p.Name, p.err)
+	default:
+	}
+	return readProcessStats(p.cmd.Process.Pid)
+}
+
+// Exited returns whether the process has exited
+func (p *Process) Exited() bool {
+	select {
+	case <-p.done:
+		return true
+	default:
+		return false
+	}
+}
+
+// Stop asks the process to shut down gracefully, and kills it if it does not within stopTimeout
+func (p *Process) Stop() {
+	if p.Exited() {
+		return
+	}
+	p.cmd.Process.Signal(syscall.SIGTERM)
+	select {
+	case <-p.done:
+	case <-time.After(stopTimeout):
+		p.cmd.Process.Kill()
+		<-p.done
+	}
+}
+
+// selfStats returns the resource usage of the load generator itself
+func selfStats() (ProcessStats, error) {
+	return readProcessStats(os.Getpid())
+}
@@ -0,0 +1,128 @@
+package loadgen
+
+import (
+	"encoding/json"
+	"fmt"
+	"io"
+	"os"
+	"sort"
+)
+
+// Report is the outcome of a load test run
+// A saved report is the baseline of later runs: see Regressions
+type Report struct {
+	Ovens    int     `json:"ovens"`
+	Clients  int     `json:"clients"`
+	Rate     float64 `json:"rate"`
+	Duration float64 `json:"duration_seconds"`
+
+	CommandsSent    uint64 `json:"commands_sent"`
+	CommandsFailed  uint64 `json:"commands_failed"`
+	CommandsMatched uint64 `json:"commands_matched"`
+	CommandsLost    uint64 `json:"commands_lost"`
+	CommandsStarved uint64 `json:"commands_starved"`
+	EventsReceived  uint64 `json:"events_received"`
+
+	// Throughput: acknowledged commands, and events received by all the clients together
+	CommandsPerSecond float64 `json:"commands_per_second"`
+	EventsPerSecond   float64 `json:"events_per_second"`
+
+	// Time from sending a command to the first WebSocket event showing its effect
+	LatencyP50  float64 `json:"latency_p50_seconds"`
+	LatencyP99  float64 `json:"latency_p99_seconds"`
+	LatencyP999 float64 `json:"latency_p999_seconds"`
+	LatencyMax  float64 `json:"latency_max_seconds"`
+
+	// Resident memory of the emulator per oven, and growth of the platform per client; 0 for
+	// components the load generator did not start
+	EmulatorBytesPerOven   float64 `json:"emulator_bytes_per_oven"`
+	PlatformBytesPerClient float64 `json:"platform_bytes_per_client"`
+
+	// CPU cores used by each component over the run
+	CPU map[string]float64 `json:"cpu_cores"`
+}
+
+// check is one metric compared with its baseline
+type check struct {
+	name   string
+	value  func(*Report) float64
+	higher bool // Whether higher values are better
+}
+
+var checks = []check{
+	{"commands_per_second", func(r *Report) float64 { return r.CommandsPerSecond }, true},
+	{"events_per_second", func(r *Report) float64 { return r.EventsPerSecond }, true},
+	{"latency_p50_seconds", func(r *Report) float64 { return r.LatencyP50 }, false},
+	{"latency_p99_seconds", func(r *Report) float64 { return r.LatencyP99 }, false},
+	{"latency_p999_seconds", func(r *Report) float64 { return r.LatencyP999 }, false},
+}
+
+// Regressions compares a report with a baseline and describes every throughput below, or latency
+// above, the baseline by more than tolerance (0.1 for 10%); metrics the baseline does not have
+// are not compared
+func (r *Report) Regressions(baseline *Report, tolerance float64) []string {
+	var regressions []string
+	for _, c := range checks {
+		want, got := c.value(baseline), c.value(r)
+		if want <= 0 {
+			continue
+		}
+		if (c.higher && got < want*(1-tolerance)) || (!c.higher && got > want*(1+tolerance)) {
+			regressions = append(regressions, fmt.Sprintf("%s: %.6g, baseline %.6g (tolerance %.0f%%)",
+				c.name, got, want, tolerance*100))
+		}
+	}
+	return regressions
+}
+
+// WriteText writes the report for a human
+func (r *Report) WriteText(w io.Writer) error {
+	names := make([]string, 0, len(r.CPU))
+	for name := range r.CPU {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+
+	_, err := fmt.Fprintf(w, `Load test: %d ovens, %d WebSocket clients, %.0f commands/s for %.1fs
+Commands: %d sent, %d acknowledged by an event, %d failed, %d lost, %d not sent (no idle oven)
+Throughput: %.1f commands/s, %.0f events/s over all clients
+Command to event latency: p50 %.3fms, p99 %.3fms, p99.9 %.3fms, max %.3fms
+Memory: %.0f bytes per oven (emulator), %.0f bytes per client (platform)
+`,
+		r.Ovens, r.Clients, r.Rate, r.Duration,
+		r.CommandsSent, r.CommandsMatched, r.CommandsFailed, r.CommandsLost, r.CommandsStarved,
+		r.CommandsPerSecond, r.EventsPerSecond,
+		r.LatencyP50*1e3, r.LatencyP99*1e3, r.LatencyP999*1e3, r.LatencyMax*1e3,
+		r.EmulatorBytesPerOven, r.PlatformBytesPerClient)
+	if err != nil {
+		return err
+	}
+	for _, name := range names {
+		if _, err := fmt.Fprintf(w, "CPU: %s %.2f cores\n", name, r.CPU[name]); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// LoadReport reads a report saved by Save
+func LoadReport(path string) (*Report, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	var r Report
+	if err := json.Unmarshal(data, &r); err != nil {
+		return nil, fmt.Errorf("invalid report %s: %w", path, err)
+	}
+	return &r, nil
+}
+
+// Save writes the report as JSON, to be used as a baseline
+func (r *Report) Save(path string) error {
+	data, err := json.MarshalIndent(r, "", "  ")
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(path, append(data, '\n'), 0o644)
+}
@@ -0,0 +1,58 @@
+package loadgen
+
+import (
+	"bytes"
+	"path/filepath"
+	"strings"
+	"testing"
+)
+
+// TestReportRegressions tests the comparison of a run with its baseline
+func TestReportRegressions(t *testing.T) {
+	baseline := &Report{CommandsPerSecond: 100, EventsPerSecond: 5000, LatencyP50: 0.1, LatencyP99: 0.5}
+
+	within := &Report{CommandsPerSecond: 91, EventsPerSecond: 9000, LatencyP50: 0.01, LatencyP99: 0.54, LatencyP999: 3}
+	if regressions := within.Regressions(baseline, 0.1); len(regressions) != 0 {
+		t.Errorf("Regressions() = %v, want none", regressions)
+	}
+
+	slower := &Report{CommandsPerSecond: 89, EventsPerSecond: 5000, LatencyP50: 0.1, LatencyP99: 0.56}
+	regressions := slower.Regressions(baseline, 0.1)
+	if len(regressions) != 2 || !strings.HasPrefix(regressions[0], "commands_per_second: 89") ||
+		!strings.HasPrefix(regressions[1], "latency_p99_seconds: 0.56") {
+		t.Errorf("Regressions() = %v", regressions)
+	}
+}
+
+// TestReportSaveLoad tests that a saved report reads back as the baseline
+func TestReportSaveLoad(t *testing.T) {
+	report := &Report{
+		Ovens:             1000,
+		CommandsMatched:   42,
+		CommandsPerSecond: 4.2,
+		LatencyP999:       0.25,
+		CPU:               map[string]float64{"emulator": 0.5, "platform": 1.25},
+	}
+	path := filepath.Join(t.TempDir(), "baseline.json")
+	if err := report.Save(path); err != nil {
+		t.Fatalf("Save() unexpected error: %v", err)
+	}
+	loaded, err := LoadReport(path)
+	if err != nil {
+		t.Fatalf("LoadReport() unexpected error: %v", err)
+	}
+	if loaded.Ovens != 1000 || loaded.CommandsMatched != 42 || loaded.LatencyP999 != 0.25 || loaded.CPU["platform"] != 1.25 {
+		t.Errorf("LoadReport() = %+v", loaded)
+	}
+	if _, err := LoadReport(filepath.Join(t.TempDir(), "missing.json")); err == nil {
+		t.Error("LoadReport() expected error for a missing file, got nil")
+	}
+
+	var text bytes.Buffer
+	if err := report.WriteText(&text); err != nil {
+		t.Fatalf("WriteText() unexpected error: %v", err)
+	}
+	if !strings.Contains(text.String(), "CPU: emulator 0.50 cores\nCPU: platform 1.25 cores\n") {
+		t.Errorf("WriteText() = %q", text.String())
+	}
+}
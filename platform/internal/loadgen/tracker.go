@@ -0,0 +1,157 @@
+package loadgen
+
+import (
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/metrics"
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// Programmed temperatures of the START commands, cycled through so that the event acknowledging
+// a command is told apart from those of the previous one on the same oven
+const (
+	markerFirst = 100
+	markerCount = 150
+)
+
+// Command is one command the load generator sends to one oven
+type Command struct {
+	OvenID  uint32
+	Payload protocol.CommandPayload
+}
+
+// Event is the part of a WebSocket event message the tracker matches commands against
+type Event struct {
+	OvenID                uint32 `json:"oven_id"`
+	State                 string `json:"state"`
+	ProgrammedTemperature string `json:"programmed_temperature"`
+}
+
+// pendingCommand is a command waiting for the first event showing its effect
+type pendingCommand struct {
+	cmd    protocol.CommandPayload
+	marker string
+	sent   time.Time
+}
+
+// tracker hands out the ovens to send commands to and matches the commands with the events
+// they cause, recording the latency from sending a command to its first matching event
+// Every oven alternates between START, acknowledged by an event with the programmed temperature
+// of the command, and STOP, acknowledged by an IDLE event; an oven has at most one command in
+// flight, so that every event matches at most one command
+type tracker struct {
+	mu       sync.Mutex
+	first    uint32
+	stopNext []bool
+	ready    []uint32 // Ovens without a command in flight, oldest first
+	pending  map[uint32]pendingCommand
+	sequence int
+
+	latency *metrics.Histogram
+	slowest time.Duration
+	matched uint64
+	lost    uint64
+}
+
+// newTracker creates a tracker of the ovens with ids first to first+ovens-1, all idle
+func newTracker(first uint32, ovens int) *tracker {
+	t := &tracker{
+		first:    first,
+		stopNext: make([]bool, ovens),
+		ready:    make([]uint32, ovens),
+		pending:  make(map[uint32]pendingCommand),
+		latency:  &metrics.Histogram{},
+	}
+	for i := range t.ready {
+		t.ready[i] = first + uint32(i)
+	}
+	return t
+}
+
+// next returns the command to send to the oven that has waited longest, and marks it sent at
+// now; ok is false when every oven has a command in flight
+func (t *tracker) next(now time.Time) (cmd Command, ok bool) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	if len(t.ready) == 0 {
+		return Command{}, false
+	}
+	id := t.ready[0]
+	t.ready = t.ready[1:]
+
+	p := pendingCommand{sent: now}
+	if t.stopNext[id-t.first] {
+		p.cmd = protocol.CommandPayload{Action: protocol.ActionStop}
+	} else {
+		temperature := markerFirst + t.sequence%markerCount
+		t.sequence++
+		p.cmd = protocol.CommandPayload{Action: protocol.ActionStart, Temperature: int16(temperature), Duration: 600}
+		p.marker = strconv.Itoa(temperature) + "°C"
+	}
+	t.pending[id] = p
+	return Command{OvenID: id, Payload: p.cmd}, true
+}
+
+// observe matches an event received at now with the command in flight to its oven
+func (t *tracker) observe(event *Event, now time.Time) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	p, ok := t.pending[event.OvenID]
+	if !ok {
+		return
+	}
+	if p.cmd.Action == protocol.ActionStart && event.ProgrammedTemperature != p.marker {
+		return
+	}
+	if p.cmd.Action == protocol.ActionStop && event.State != "IDLE" {
+		return
+	}
+
+	latency := now.Sub(p.sent)
+	t.latency.Observe(latency)
+	t.slowest = max(t.slowest, latency)
+	t.matched++
+	t.release(event.OvenID, p.cmd.Action == protocol.ActionStart)
+}
+
+// abandon gives back the oven of a command that could not be sent
+func (t *tracker) abandon(id uint32) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	if p, ok := t.pending[id]; ok {
+		t.release(id, p.cmd.Action == protocol.ActionStop)
+	}
+}
+
+// expire counts the commands sent before deadline and still unmatched as lost; their ovens are
+// sent a STOP next, which brings them back to IDLE whatever their state
+func (t *tracker) expire(deadline time.Time) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	for id, p := range t.pending {
+		if p.sent.Before(deadline) {
+			t.lost++
+			t.release(id, true)
+		}
+	}
+}
+
+// release ends the command in flight to an oven and queues the oven again; t.mu must be held
+func (t *tracker) release(id uint32, stopNext bool) {
+	delete(t.pending, id)
+	t.stopNext[id-t.first] = stopNext
+	t.ready = append(t.ready, id)
+}
+
+// inFlight returns the number of commands waiting for their event
+func (t *tracker) inFlight() int {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	return len(t.pending)
+}
@@ -0,0 +1,100 @@
+package loadgen
+
+import (
+	"os"
+	"strconv"
+	"testing"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// TestTrackerMatchesCommands tests that START and STOP commands alternate on every oven and are
+// matched with the first event showing their effect
+func TestTrackerMatchesCommands(t *testing.T) {
+	tr := newTracker(10, 2)
+	start := time.Now()
+
+	first, ok := tr.next(start)
+	second, _ := tr.next(start)
+	if !ok || first.OvenID != 10 || second.OvenID != 11 || first.Payload.Action != protocol.ActionStart {
+		t.Fatalf("next() = %+v, %+v", first, second)
+	}
+	if first.Payload.Temperature == second.Payload.Temperature {
+		t.Errorf("Commands in flight should have distinct temperatures, got %d", first.Payload.Temperature)
+	}
+	if _, ok := tr.next(start); ok {
+		t.Fatal("next() should have no oven left")
+	}
+
+	// Events of other ovens, or from before the command, do not match
+	marker := func(cmd Command) string {
+		return strconv.Itoa(int(cmd.Payload.Temperature)) + "°C"
+	}
+	tr.observe(&Event{OvenID: 12, ProgrammedTemperature: marker(first)}, start)
+	tr.observe(&Event{OvenID: 10, State: "IDLE", ProgrammedTemperature: "Not set"}, start)
+	if tr.matched != 0 || tr.inFlight() != 2 {
+		t.Fatalf("Unrelated events matched %d commands", tr.matched)
+	}
+
+	tr.observe(&Event{OvenID: 10, State: "PREHEATING", ProgrammedTemperature: marker(first)}, start.Add(30*time.Millisecond))
+	if tr.matched != 1 || tr.latency.Count() != 1 || tr.slowest != 30*time.Millisecond {
+		t.Fatalf("Matched %d commands, slowest %v", tr.matched, tr.slowest)
+	}
+
+	// The oven is queued again, for a STOP acknowledged by an IDLE event
+	stop, ok := tr.next(start)
+	if !ok || stop.OvenID != 10 || stop.Payload.Action != protocol.ActionStop {
+		t.Fatalf("next() = %+v, want a STOP to oven 10", stop)
+	}
+	tr.observe(&Event{OvenID: 10, State: "PREHEATING", ProgrammedTemperature: marker(first)}, start)
+	tr.observe(&Event{OvenID: 10, State: "IDLE"}, start.Add(time.Millisecond))
+	if tr.matched != 2 {
+		t.Errorf("Matched %d commands, want 2", tr.matched)
+	}
+}
+
+// TestTrackerExpiresCommands tests that unmatched commands are lost and their ovens stopped
+func TestTrackerExpiresCommands(t *testing.T) {
+	tr := newTracker(0, 2)
+	start := time.Now()
+
+	lost, _ := tr.next(start)
+	failed, _ := tr.next(start.Add(time.Second))
+	tr.abandon(failed.OvenID)
+	tr.expire(start.Add(time.Millisecond))
+	if tr.lost != 1 || tr.inFlight() != 0 {
+		t.Fatalf("Lost %d commands with %d in flight, want 1 and 0", tr.lost, tr.inFlight())
+	}
+
+	// The abandoned oven keeps its START; the lost one gets a STOP
+	retried, _ := tr.next(start)
+	stopped, _ := tr.next(start)
+	if retried.OvenID != failed.OvenID || retried.Payload.Action != protocol.ActionStart ||
+		stopped.OvenID != lost.OvenID || stopped.Payload.Action != protocol.ActionStop {
+		t.Errorf("next() = %+v, %+v", retried, stopped)
+	}
+}
+
+// TestReadProcessStats tests reading the resource usage of a process from /proc
+func TestReadProcessStats(t *testing.T) {
+	if _, err := os.Stat("/proc/self/stat"); err != nil {
+		t.Skip("No /proc on this system")
+	}
+
+	// Burn some CPU so that the count of clock ticks moves
+	begin := time.Now()
+	for time.Since(begin) < 50*time.Millisecond {
+	}
+	stats, err := selfStats()
+	if err != nil {
+		t.Fatalf("selfStats() unexpected error: %v", err)
+	}
+	if stats.CPU <= 0 || stats.RSS < 1<<20 {
+		t.Errorf("selfStats() = %+v", stats)
+	}
+
+	if _, err := readProcessStats(-1); err == nil {
+		t.Error("readProcessStats(-1) expected error, got nil")
+	}
+}
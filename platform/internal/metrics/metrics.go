@@ -0,0 +1,237 @@
+// Package metrics holds always-on counters, gauges and latency histograms, exported in the
+// Prometheus text format
+//
+// Histograms use the buckets of the emulator (koven/metrics.c): HDR-style log-linear buckets
+// with SubBuckets linear buckets per power of two of nanoseconds, exported with a le bound at
+// every power of two from 64 ns to about 69 s, so that latencies of both sides line up
+package metrics
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"log"
+	"math"
+	"math/bits"
+	"net/http"
+	"sort"
+	"strconv"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+const (
+	SubBucketBits = 3
+	SubBuckets    = 1 << SubBucketBits
+	Buckets       = (64 - SubBucketBits + 1) * SubBuckets
+
+	exportFirstPower = 6
+	exportLastPower  = 36
+)
+
+// Counter is a monotonically increasing count
+type Counter struct {
+	value atomic.Uint64
+}
+
+// Add adds n to the counter
+func (c *Counter) Add(n uint64) { c.value.Add(n) }
+
+// Inc adds one to the counter
+func (c *Counter) Inc() { c.value.Add(1) }
+
+// Value returns the current count
+func (c *Counter) Value() uint64 { return c.value.Load() }
+
+// Gauge is a value that goes up and down
+type Gauge struct {
+	value atomic.Int64
+}
+
+// Set replaces the value of the gauge
+func (g *Gauge) Set(v int64) { g.value.Store(v) }
+
+// Add adds delta, which may be negative, to the gauge
+func (g *Gauge) Add(delta int64) { g.value.Add(delta) }
+
+// Value returns the current value
+func (g *Gauge) Value() int64 { return g.value.Load() }
+
+// Histogram counts durations in log-linear buckets of nanoseconds
+type Histogram struct {
+	count   atomic.Uint64
+	sum     atomic.Uint64
+	buckets [Buckets]atomic.Uint64
+}
+
+// Bucket returns the bucket of a value
+func Bucket(value uint64) int {
+	if value < SubBuckets {
+		return int(value)
+	}
+	power := 63 - bits.LeadingZeros64(value)
+	sub := int(value>>(power-SubBucketBits)) - SubBuckets
+	return (power-SubBucketBits+1)*SubBuckets + sub
+}
+
+// BucketFloor returns the lowest value of a bucket
+func BucketFloor(bucket int) uint64 {
+	if bucket < SubBuckets {
+		return uint64(bucket)
+	}
+	power := bucket/SubBuckets + SubBucketBits - 1
+	sub := uint64(bucket % SubBuckets)
+	return (SubBuckets + sub) << (power - SubBucketBits)
+}
+
+// Observe records one duration
+func (h *Histogram) Observe(d time.Duration) {
+	ns := uint64(0)
+	if d > 0 {
+		ns = uint64(d)
+	}
+	h.count.Add(1)
+	h.sum.Add(ns)
+	h.buckets[Bucket(ns)].Add(1)
+}
+
+// Since records the time elapsed since start
+func (h *Histogram) Since(start time.Time) {
+	h.Observe(time.Since(start))
+}
+
+// Count returns the number of recorded durations
+func (h *Histogram) Count() uint64 { return h.count.Load() }
+
+// Quantile returns the lowest value of the bucket holding the q-quantile (0 <= q <= 1), or 0
+// when nothing was recorded
+func (h *Histogram) Quantile(q float64) time.Duration {
+	count := h.count.Load()
+	if count == 0 {
+		return 0
+	}
+	target := uint64(math.Max(1, q*float64(count)))
+	if target > count {
+		target = count
+	}
+
+	seen := uint64(0)
+	for b := range h.buckets {
+		seen += h.buckets[b].Load()
+		if seen >= target {
+			return time.Duration(BucketFloor(b))
+		}
+	}
+	return time.Duration(BucketFloor(Buckets - 1))
+}
+
+type metric struct {
+	name    string
+	help    string
+	counter *Counter
+	gauge   *Gauge
+	gaugeFn func() int64
+	hist    *Histogram
+}
+
+// Registry is a set of named metrics
+type Registry struct {
+	mu      sync.Mutex
+	metrics []metric
+}
+
+// NewRegistry creates an empty registry
+func NewRegistry() *Registry {
+	return &Registry{}
+}
+
+func (r *Registry) add(m metric) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.metrics = append(r.metrics, m)
+}
+
+// NewCounter registers a counter; name should end in _total
+func (r *Registry) NewCounter(name, help string) *Counter {
+	c := &Counter{}
+	r.add(metric{name: name, help: help, counter: c})
+	return c
+}
+
+// NewGauge registers a gauge
+func (r *Registry) NewGauge(name, help string) *Gauge {
+	g := &Gauge{}
+	r.add(metric{name: name, help: help, gauge: g})
+	return g
+}
+
+// NewGaugeFunc registers a gauge read from fn on every export
+func (r *Registry) NewGaugeFunc(name, help string, fn func() int64) {
+	r.add(metric{name: name, help: help, gaugeFn: fn})
+}
+
+// NewHistogram registers a histogram of durations; name should end in _seconds
+func (r *Registry) NewHistogram(name, help string) *Histogram {
+	h := &Histogram{}
+	r.add(metric{name: name, help: help, hist: h})
+	return h
+}
+
+// Write writes every metric in the Prometheus text exposition format, sorted by name
+func (r *Registry) Write(w io.Writer) error {
+	r.mu.Lock()
+	metrics := append([]metric(nil), r.metrics...)
+	r.mu.Unlock()
+	sort.Slice(metrics, func(i, j int) bool { return metrics[i].name < metrics[j].name })
+
+	// The buffered writer keeps the first error, returned by Flush
+	cw := bufio.NewWriter(w)
+	for _, m := range metrics {
+		switch {
+		case m.counter != nil:
+			fmt.Fprintf(cw, "# HELP %s %s\n# TYPE %s counter\n%s %d\n", m.name, m.help, m.name, m.name, m.counter.Value())
+		case m.gauge != nil:
+			fmt.Fprintf(cw, "# HELP %s %s\n# TYPE %s gauge\n%s %d\n", m.name, m.help, m.name, m.name, m.gauge.Value())
+		case m.gaugeFn != nil:
+			fmt.Fprintf(cw, "# HELP %s %s\n# TYPE %s gauge\n%s %d\n", m.name, m.help, m.name, m.name, m.gaugeFn())
+		case m.hist != nil:
+			writeHistogram(cw, m)
+		}
+	}
+	return cw.Flush()
+}
+
+// writeHistogram writes the cumulative counts of the values below each power of two
+func writeHistogram(w io.Writer, m metric) {
+	fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s histogram\n", m.name, m.help, m.name)
+
+	below := uint64(0)
+	b := 0
+	for power := exportFirstPower; power <= exportLastPower; power++ {
+		for end := Bucket(1 << power); b < end; b++ {
+			below += m.hist.buckets[b].Load()
+		}
+		// Formatted as %.9g is in C, so that both sides export the same labels
+		le := strconv.FormatFloat(float64(uint64(1)<<power)/1e9, 'g', 9, 64)
+		fmt.Fprintf(w, "%s_bucket{le=\"%s\"} %d\n", m.name, le, below)
+	}
+	count := m.hist.count.Load()
+	fmt.Fprintf(w, "%s_bucket{le=\"+Inf\"} %d\n", m.name, count)
+	fmt.Fprintf(w, "%s_sum %.9f\n", m.name, float64(m.hist.sum.Load())/1e9)
+	fmt.Fprintf(w, "%s_count %d\n", m.name, count)
+}
+
+// Handler serves the registry on GET requests
+func (r *Registry) Handler() http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, req *http.Request) {
+		if req.Method != http.MethodGet {
+			http.Error(w, "Method not allowed", http.StatusMethodNotAllowed)
+			return
+		}
+		w.Header().Set("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+		if err := r.Write(w); err != nil {
+			log.Printf("Failed to write metrics: %v", err)
+		}
+	})
+}
@@ -0,0 +1,112 @@
+package metrics
+
+import (
+	"net/http"
+	"net/http/httptest"
+	"strings"
+	"testing"
+	"time"
+)
+
+// TestBucketBounds tests that buckets grow with the value and stay within 1/8 of it
+func TestBucketBounds(t *testing.T) {
+	previous := 0
+	for value := uint64(0); value < 1<<20; value++ {
+		bucket := Bucket(value)
+		floor := BucketFloor(bucket)
+		if bucket < previous || floor > value || Bucket(floor) != bucket {
+			t.Fatalf("Bucket(%d) = %d with floor %d", value, bucket, floor)
+		}
+		if value >= SubBuckets && (value-floor)*SubBuckets > floor {
+			t.Fatalf("Bucket(%d) floor %d is more than 1/8 below", value, floor)
+		}
+		previous = bucket
+	}
+
+	if got := Bucket(^uint64(0)); got != Buckets-1 {
+		t.Errorf("Bucket(max) = %d, want %d", got, Buckets-1)
+	}
+}
+
+// TestHistogramQuantile tests quantiles against a uniform distribution
+func TestHistogramQuantile(t *testing.T) {
+	var h Histogram
+	if got := h.Quantile(0.5); got != 0 {
+		t.Errorf("Quantile of empty histogram = %v, want 0", got)
+	}
+
+	for us := 1; us <= 1000; us++ {
+		h.Observe(time.Duration(us) * time.Microsecond)
+	}
+	h.Observe(-time.Second)
+
+	if got := h.Count(); got != 1001 {
+		t.Errorf("Count() = %d, want 1001", got)
+	}
+	p50 := h.Quantile(0.5)
+	if p50 > 500*time.Microsecond || p50*9 < 500*time.Microsecond*8 {
+		t.Errorf("Quantile(0.5) = %v, want about 500µs", p50)
+	}
+	if got := h.Quantile(0); got != 0 {
+		t.Errorf("Quantile(0) = %v, want the negative duration clamped to 0", got)
+	}
+}
+
+// TestRegistryWrite tests the text exposition, which uses the same labels as the emulator
+func TestRegistryWrite(t *testing.T) {
+	r := NewRegistry()
+	r.NewCounter("b_total", "A counter").Add(3)
+	r.NewGauge("c", "A gauge").Set(-2)
+	r.NewGaugeFunc("d", "A gauge func", func() int64 { return 7 })
+	h := r.NewHistogram("a_seconds", "A histogram")
+	h.Observe(100 * time.Nanosecond)
+	h.Observe(3 * time.Millisecond)
+
+	var b strings.Builder
+	if err := r.Write(&b); err != nil {
+		t.Fatalf("Write() error = %v", err)
+	}
+	text := b.String()
+
+	for _, want := range []string{
+		"# TYPE a_seconds histogram\n",
+		"a_seconds_bucket{le=\"6.4e-08\"} 0\n",
+		"a_seconds_bucket{le=\"1.28e-07\"} 1\n",
+		"a_seconds_bucket{le=\"0.002097152\"} 1\n",
+		"a_seconds_bucket{le=\"0.004194304\"} 2\n",
+		"a_seconds_bucket{le=\"+Inf\"} 2\n",
+		"a_seconds_sum 0.003000100\n",
+		"a_seconds_count 2\n",
+		"# TYPE b_total counter\nb_total 3\n",
+		"# TYPE c gauge\nc -2\n",
+		"d 7\n",
+	} {
+		if !strings.Contains(text, want) {
+			t.Errorf("Write() missing %q", want)
+		}
+	}
+	if strings.Index(text, "a_seconds") > strings.Index(text, "b_total") {
+		t.Error("Write() should sort metrics by name")
+	}
+}
+
+// TestHandler tests that only GET is served
+func TestHandler(t *testing.T) {
+	r := NewRegistry()
+	r.NewCounter("x_total", "A counter").Inc()
+
+	w := httptest.NewRecorder()
+	r.Handler().ServeHTTP(w, httptest.NewRequest(http.MethodGet, "/metrics", nil))
+	if w.Code != http.StatusOK || !strings.Contains(w.Body.String(), "x_total 1\n") {
+		t.Errorf("GET = %d %q", w.Code, w.Body.String())
+	}
+	if ct := w.Header().Get("Content-Type"); !strings.HasPrefix(ct, "text/plain; version=0.0.4") {
+		t.Errorf("Content-Type = %q", ct)
+	}
+
+	w = httptest.NewRecorder()
+	r.Handler().ServeHTTP(w, httptest.NewRequest(http.MethodPost, "/metrics", nil))
+	if w.Code != http.StatusMethodNotAllowed {
+		t.Errorf("POST = %d, want %d", w.Code, http.StatusMethodNotAllowed)
+	}
+}
@@ -0,0 +1,44 @@
+package mqtt
+
+import (
+	"sync"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// Command frames sent in one message by SendCommands; the emulator decodes any number of frames
+// per message, and 1024 frames keep a message well below LocalMaxMessage
+const MaxCommandsPerMessage = 1024
+
+// commandBuffers recycles the buffers command messages are built in, so that sending a command
+// does not allocate its frame
+var commandBuffers = sync.Pool{
+	New: func() any {
+		buf := make([]byte, 0, 1+LocalMaxTopic+MaxCommandsPerMessage*protocol.CommandFrameSize)
+		return &buf
+	},
+}
+
+// appendCommandFrames appends the frames of the commands to dst
+func appendCommandFrames(dst []byte, cmds []protocol.CommandPayload) []byte {
+	for i := range cmds {
+		dst = protocol.AppendCommandFrame(dst, &cmds[i])
+	}
+	return dst
+}
+
+// ovenCommandChunk returns the end of the chunk of ids starting at start that goes in one command
+// batch frame: at most MaxCommandBatchCommands entries, ending on the last command of an oven
+// when it can, so that the commands of an oven, which ids holds in a row, travel in one message
+// and are applied in order by the emulator
+func ovenCommandChunk(ids []uint32, start int) int {
+	end := min(start+protocol.MaxCommandBatchCommands, len(ids))
+	cut := end
+	for cut < len(ids) && cut > start && ids[cut-1] == ids[cut] {
+		cut--
+	}
+	if cut == start {
+		return end
+	}
+	return cut
+}
@@ -0,0 +1,175 @@
+package mqtt
+
+import (
+	"log"
+	"strconv"
+	"strings"
+	"sync"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// dispatcher decodes event messages and hands their events to the event callback
+// Every transport embeds one, they only differ in how messages reach it
+type dispatcher struct {
+	mu            sync.RWMutex
+	eventCallback EventCallback
+
+	// Last known state of every oven, to rebuild full events from delta frames
+	deltas *protocol.DeltaDecoder
+}
+
+// newDispatcher creates a dispatcher without an event callback
+func newDispatcher() *dispatcher {
+	return &dispatcher{deltas: protocol.NewDeltaDecoder()}
+}
+
+// SetEventCallback sets the callback function for received events
+func (d *dispatcher) SetEventCallback(callback EventCallback) {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+	d.eventCallback = callback
+}
+
+// dispatch processes one incoming event message, whatever transport carried it
+func (d *dispatcher) dispatch(topic string, payload []byte) {
+	if len(payload) == 0 {
+		log.Printf("Ignoring empty message from %s", topic)
+		return
+	}
+
+	switch payload[0] {
+	case protocol.MessageTypeEventBatch:
+		d.handleEventBatch(topic, payload)
+	case protocol.MessageTypeEventDelta:
+		d.handleEventDelta(topic, payload)
+	case protocol.MessageTypeEventDeltaBatch:
+		d.handleEventDeltaBatch(topic, payload)
+	default:
+		d.handleEvent(topic, payload)
+	}
+}
+
+// dispatchRetained processes a retained message, which the broker only sends on subscribing: the
+// last state transition an emulator published on the topic of an oven (koven --event-qos
+// retained). It may be older than the state already known, so its events are only delivered for
+// ovens without any known state
+func (d *dispatcher) dispatchRetained(topic string, payload []byte) {
+	if len(payload) == 0 {
+		return
+	}
+
+	switch payload[0] {
+	case protocol.MessageTypeEventBatch:
+		events, err := protocol.UnmarshallEventBatchFrame(payload)
+		if err != nil {
+			log.Printf("Failed to unmarshal retained event batch frame from %s: %v", topic, err)
+			return
+		}
+		unknown := events[:0]
+		for i := range events {
+			if !d.deltas.Known(events[i].OvenID) {
+				d.deltas.Record(&events[i])
+				unknown = append(unknown, events[i])
+			}
+		}
+		d.deliver(unknown)
+	case protocol.MessageTypeEventDeltaBatch:
+		// Entries of a delta batch cannot be told apart before they are applied
+		log.Printf("Ignoring retained event delta batch from %s", topic)
+	default:
+		if d.deltas.Known(topicOvenID(topic)) {
+			return
+		}
+		d.dispatch(topic, payload)
+	}
+}
+
+// handleEvent delivers a full event frame to the event callback
+func (d *dispatcher) handleEvent(topic string, payload []byte) {
+	log.Printf("Received event from %s (%d bytes)", topic, len(payload))
+
+	event, err := protocol.UnmarshallEventFrame(payload)
+	if err != nil {
+		log.Printf("Failed to unmarshal event frame: %v", err)
+		return
+	}
+	event.OvenID = topicOvenID(topic)
+	d.deltas.Record(event)
+
+	log.Printf("Event parsed: state=%s, temp=%d°C, remaining=%ds, programmed_temp=%d°C, programmed_duration=%ds",
+		protocol.StateToString(event.State),
+		event.CurrentTemperature,
+		event.RemainingTime,
+		event.ProgrammedTemperature,
+		event.ProgrammedDuration)
+
+	// Call the event callback if set
+	if callback := d.callback(); callback != nil {
+		callback(event)
+	}
+}
+
+// handleEventDelta rebuilds the full event of a delta frame and delivers it to the callback
+func (d *dispatcher) handleEventDelta(topic string, payload []byte) {
+	event, err := d.deltas.UnmarshallEventDeltaFrame(payload, topicOvenID(topic))
+	if err != nil {
+		log.Printf("Failed to apply event delta from %s: %v", topic, err)
+		return
+	}
+
+	if callback := d.callback(); callback != nil {
+		callback(event)
+	}
+}
+
+// handleEventBatch delivers every event of a batch frame to the event callback
+func (d *dispatcher) handleEventBatch(topic string, payload []byte) {
+	events, err := protocol.UnmarshallEventBatchFrame(payload)
+	if err != nil {
+		log.Printf("Failed to unmarshal event batch frame from %s: %v", topic, err)
+		return
+	}
+
+	log.Printf("Received batch of %d events from %s (%d bytes)", len(events), topic, len(payload))
+	for i := range events {
+		d.deltas.Record(&events[i])
+	}
+	d.deliver(events)
+}
+
+// handleEventDeltaBatch rebuilds the full events of a delta batch frame and delivers them
+// Ovens without a known state yet are skipped until their next full event
+func (d *dispatcher) handleEventDeltaBatch(topic string, payload []byte) {
+	events, err := d.deltas.UnmarshallEventDeltaBatchFrame(payload)
+	if err != nil {
+		log.Printf("Failed to apply event delta batch from %s: %v", topic, err)
+	}
+
+	d.deliver(events)
+}
+
+// deliver hands events to the event callback
+func (d *dispatcher) deliver(events []protocol.EventPayload) {
+	if callback := d.callback(); callback != nil {
+		for i := range events {
+			callback(&events[i])
+		}
+	}
+}
+
+// callback returns the current event callback
+func (d *dispatcher) callback() EventCallback {
+	d.mu.RLock()
+	defer d.mu.RUnlock()
+	return d.eventCallback
+}
+
+// topicOvenID returns the oven id of an events/koven/<id> topic, or 0 for any other topic
+func topicOvenID(topic string) uint32 {
+	id, err := strconv.ParseUint(strings.TrimPrefix(topic, TopicEventsPrefix), 10, 32)
+	if err != nil || !strings.HasPrefix(topic, TopicEventsPrefix) {
+		return 0
+	}
+	return uint32(id)
+}
@@ -0,0 +1,42 @@
+package mqtt
+
+import (
+	"testing"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// TestDispatchRetainedSkipsKnownOvens tests that retained transitions only fill in the state of
+// ovens that no live event reported yet
+func TestDispatchRetainedSkipsKnownOvens(t *testing.T) {
+	d := newDispatcher()
+	var got []protocol.EventPayload
+	d.SetEventCallback(func(event *protocol.EventPayload) { got = append(got, *event) })
+
+	live, err := protocol.MarshallEventBatchFrame([]protocol.EventPayload{
+		{OvenID: 3, State: protocol.StateBaking, CurrentTemperature: 180, RemainingTime: 30},
+	})
+	if err != nil {
+		t.Fatalf("MarshallEventBatchFrame failed: %v", err)
+	}
+	d.dispatch(TopicEventBatches, live)
+
+	// Oven 3 preheated long ago, oven 4 was never heard of
+	stale := []protocol.EventPayload{
+		{OvenID: 3, State: protocol.StatePreheating, CurrentTemperature: 40},
+		{OvenID: 4, State: protocol.StateCoolingDown, CurrentTemperature: 90},
+	}
+	retained, err := protocol.MarshallEventBatchFrame(stale)
+	if err != nil {
+		t.Fatalf("MarshallEventBatchFrame failed: %v", err)
+	}
+	d.dispatchRetained(TopicEventBatches, retained)
+	d.dispatchRetained(TopicEventBatches, retained)
+
+	if len(got) != 2 || got[0].OvenID != 3 || got[1] != stale[1] {
+		t.Errorf("Expected the live event of oven 3 and the retained one of oven 4, got %+v", got)
+	}
+	if got[0].State != protocol.StateBaking {
+		t.Errorf("Expected oven 3 to stay baking, got %+v", got[0])
+	}
+}
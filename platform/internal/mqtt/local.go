@@ -0,0 +1,387 @@
+package mqtt
+
+import (
+	"errors"
+	"fmt"
+	"io"
+	"io/fs"
+	"log"
+	"net"
+	"os"
+	"sync"
+	"syscall"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// Local transport: emulators on the same host connect to a Unix SOCK_SEQPACKET socket the
+// platform listens on, and no broker sits in between. Every datagram carries one message: the
+// length of its topic on one byte, the topic, then the payload, which is a protocol frame exactly
+// as sent over MQTT
+const (
+	LocalMaxTopic   = 255
+	LocalMaxMessage = 128 * 1024
+
+	// Longest time a command waits for the socket buffer of a stalled emulator
+	localWriteTimeout = time.Second
+)
+
+// LocalClient exchanges messages with the emulators connected to a local Unix socket
+// Commands go to every connected emulator, as MQTT delivers them to every subscriber; fleet
+// commands go to one connection of each emulator process, as a shared subscription delivers them
+// to one of its subscribers
+type LocalClient struct {
+	*dispatcher
+	path     string
+	mu       sync.RWMutex
+	listener *net.UnixListener
+	conns    map[*net.UnixConn]int32 // Process id of the emulator, -1 when unknown
+	wg       sync.WaitGroup
+}
+
+// NewLocalClient creates a client listening on the socket at path once connected
+func NewLocalClient(path string) *LocalClient {
+	return &LocalClient{
+		dispatcher: newDispatcher(),
+		path:       path,
+		conns:      make(map[*net.UnixConn]int32),
+	}
+}
+
+// Connect starts listening for emulators, replacing the socket left over by a previous run
+func (c *LocalClient) Connect() error {
+	log.Printf("Listening for emulators on %s...", c.path)
+
+	if err := os.Remove(c.path); err != nil && !errors.Is(err, fs.ErrNotExist) {
+		return fmt.Errorf("failed to remove stale socket %s: %w", c.path, err)
+	}
+
+	listener, err := net.ListenUnix("unixpacket", &net.UnixAddr{Name: c.path, Net: "unixpacket"})
+	if err != nil {
+		return fmt.Errorf("failed to listen on %s: %w", c.path, err)
+	}
+
+	c.mu.Lock()
+	c.listener = listener
+	c.mu.Unlock()
+
+	c.wg.Add(1)
+	go c.acceptLoop(listener)
+	return nil
+}
+
+// Disconnect stops listening and closes the connection of every emulator
+func (c *LocalClient) Disconnect() {
+	c.mu.Lock()
+	listener := c.listener
+	c.listener = nil
+	for conn := range c.conns {
+		conn.Close()
+	}
+	c.mu.Unlock()
+
+	if listener == nil {
+		return
+	}
+	listener.Close()
+	c.wg.Wait()
+	log.Printf("Stopped listening on %s", c.path)
+}
+
+// IsConnected reports whether at least one emulator is connected
+func (c *LocalClient) IsConnected() bool {
+	return c.emulators() > 0
+}
+
+// emulators returns the number of connected emulators
+func (c *LocalClient) emulators() int {
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	if c.listener == nil {
+		return 0
+	}
+	return len(c.conns)
+}
+
+// acceptLoop adds every emulator that connects, until the listener is closed
+func (c *LocalClient) acceptLoop(listener *net.UnixListener) {
+	defer c.wg.Done()
+
+	for {
+		conn, err := listener.AcceptUnix()
+		if err != nil {
+			if !errors.Is(err, net.ErrClosed) {
+				log.Printf("Failed to accept emulator on %s: %v", c.path, err)
+			}
+			return
+		}
+
+		c.mu.Lock()
+		if c.listener == nil {
+			c.mu.Unlock()
+			conn.Close()
+			return
+		}
+		c.conns[conn] = peerPID(conn)
+		c.mu.Unlock()
+
+		log.Printf("Emulator connected on %s", c.path)
+		c.wg.Add(1)
+		go c.readLoop(conn)
+	}
+}
+
+// readLoop dispatches every message of an emulator, until its connection is closed
+// The read buffer is reused: dispatch copies whatever it keeps
+func (c *LocalClient) readLoop(conn *net.UnixConn) {
+	defer c.wg.Done()
+	defer c.remove(conn)
+
+	buf := make([]byte, LocalMaxMessage)
+	for {
+		n, _, flags, _, err := conn.ReadMsgUnix(buf, nil)
+		if err != nil || n == 0 {
+			if err != nil && !errors.Is(err, io.EOF) && !errors.Is(err, net.ErrClosed) {
+				log.Printf("Emulator connection on %s failed: %v", c.path, err)
+			}
+			return
+		}
+		if flags&syscall.MSG_TRUNC != 0 {
+			log.Printf("Ignoring message over %d bytes on %s", LocalMaxMessage, c.path)
+			continue
+		}
+
+		topic, payload, err := decodeLocalMessage(buf[:n])
+		if err != nil {
+			log.Printf("Ignoring malformed message on %s: %v", c.path, err)
+			continue
+		}
+		c.dispatch(topic, payload)
+	}
+}
+
+// remove forgets and closes the connection of an emulator
+func (c *LocalClient) remove(conn *net.UnixConn) {
+	c.mu.Lock()
+	_, known := c.conns[conn]
+	delete(c.conns, conn)
+	c.mu.Unlock()
+
+	conn.Close()
+	if known {
+		log.Printf("Emulator disconnected from %s", c.path)
+	}
+}
+
+// SendCommand sends a command to every connected emulator
+func (c *LocalClient) SendCommand(cmd *protocol.CommandPayload) error {
+	buf := commandBuffers.Get().(*[]byte)
+	defer commandBuffers.Put(buf)
+	*buf = protocol.AppendCommandFrame(appendLocalHeader((*buf)[:0], TopicCommands), cmd)
+
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	if len(c.conns) == 0 {
+		return fmt.Errorf("no emulator connected on %s", c.path)
+	}
+
+	log.Printf("Sending command: action=%s, temperature=%d°C, duration=%ds",
+		protocol.ActionToString(cmd.Action),
+		cmd.Temperature,
+		cmd.Duration)
+
+	if err := c.writeAll(*buf); err != nil {
+		return fmt.Errorf("failed to send command: %w", err)
+	}
+
+	log.Printf("Command sent successfully")
+	return nil
+}
+
+// SendCommands sends commands to every connected emulator in order, MaxCommandsPerMessage
+// frames per datagram
+func (c *LocalClient) SendCommands(cmds []protocol.CommandPayload) error {
+	buf := commandBuffers.Get().(*[]byte)
+	defer commandBuffers.Put(buf)
+
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	if len(c.conns) == 0 {
+		return fmt.Errorf("no emulator connected on %s", c.path)
+	}
+
+	messages := 0
+	for start := 0; start < len(cmds); start += MaxCommandsPerMessage {
+		end := min(start+MaxCommandsPerMessage, len(cmds))
+		*buf = appendCommandFrames(appendLocalHeader((*buf)[:0], TopicCommands), cmds[start:end])
+		if err := c.writeAll(*buf); err != nil {
+			return fmt.Errorf("failed to send commands: %w", err)
+		}
+		messages++
+	}
+
+	log.Printf("Sent %d commands in %d messages", len(cmds), messages)
+	return nil
+}
+
+// SendFleetCommand sends cmd to every oven of ids, in command batch frames of up to
+// MaxCommandBatchCommands ovens, to every connected emulator; the emulators that do not own an
+// oven ignore its entry
+// A message is acknowledged once written to one connection of every emulator process: ack is
+// called with the time this took. Returns the number of messages sent
+func (c *LocalClient) SendFleetCommand(ids []uint32, cmd *protocol.CommandPayload, ack func(time.Duration)) (int, error) {
+	buf := commandBuffers.Get().(*[]byte)
+	defer commandBuffers.Put(buf)
+
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	if len(c.conns) == 0 {
+		return 0, fmt.Errorf("no emulator connected on %s", c.path)
+	}
+
+	messages := 0
+	for start := 0; start < len(ids); start += protocol.MaxCommandBatchCommands {
+		end := min(start+protocol.MaxCommandBatchCommands, len(ids))
+		// The chunk never exceeds MaxCommandBatchCommands, which is the only error
+		*buf, _ = protocol.AppendCommandBatchFrame(appendLocalHeader((*buf)[:0], TopicCommandBatches), ids[start:end], cmd)
+		sent := time.Now()
+		if err := c.writeShared(*buf); err != nil {
+			return messages, fmt.Errorf("failed to send fleet command: %w", err)
+		}
+		ack(time.Since(sent))
+		messages++
+	}
+
+	log.Printf("Sent %s to %d ovens in %d messages", protocol.ActionToString(cmd.Action), len(ids), messages)
+	return messages, nil
+}
+
+// SendOvenCommands sends cmds[i] to the oven ids[i], in command batch frames of up to
+// MaxCommandBatchCommands entries, to every connected emulator; the emulators that do not own an
+// oven ignore its entries. The commands of an oven are held in a row by ids and go in one
+// message when they fit, and all the messages go through the same connection of each emulator
+// process, so that it applies them in order
+func (c *LocalClient) SendOvenCommands(ids []uint32, cmds []protocol.CommandPayload) error {
+	if len(ids) != len(cmds) {
+		return fmt.Errorf("%d commands for %d ovens", len(cmds), len(ids))
+	}
+
+	buf := commandBuffers.Get().(*[]byte)
+	defer commandBuffers.Put(buf)
+
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	if len(c.conns) == 0 {
+		return fmt.Errorf("no emulator connected on %s", c.path)
+	}
+
+	conns := c.sharedConns()
+	messages := 0
+	for start, end := 0, 0; start < len(ids); start = end {
+		end = ovenCommandChunk(ids, start)
+		// The chunk never exceeds MaxCommandBatchCommands and the lengths match, the only errors
+		*buf, _ = protocol.AppendOvenCommandBatchFrame(appendLocalHeader((*buf)[:0], TopicCommandBatches), ids[start:end], cmds[start:end])
+		if err := writeConns(conns, *buf); err != nil {
+			return fmt.Errorf("failed to send oven commands: %w", err)
+		}
+		messages++
+	}
+
+	log.Printf("Sent %d oven commands in %d messages", len(ids), messages)
+	return nil
+}
+
+// writeAll writes a datagram to every connected emulator; c.mu must be held
+func (c *LocalClient) writeAll(msg []byte) error {
+	for conn := range c.conns {
+		conn.SetWriteDeadline(time.Now().Add(localWriteTimeout))
+		if _, err := conn.Write(msg); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// writeShared writes a datagram to one connection of every emulator process; c.mu must be held
+func (c *LocalClient) writeShared(msg []byte) error {
+	return writeConns(c.sharedConns(), msg)
+}
+
+// sharedConns picks one connection of every emulator process, in map order so that the load
+// spreads over its connections; c.mu must be held
+func (c *LocalClient) sharedConns() []*net.UnixConn {
+	conns := make([]*net.UnixConn, 0, len(c.conns))
+	picked := make(map[int32]bool, len(c.conns))
+	for conn, pid := range c.conns {
+		if picked[pid] {
+			continue
+		}
+		if pid >= 0 {
+			picked[pid] = true
+		}
+		conns = append(conns, conn)
+	}
+	return conns
+}
+
+// writeConns writes a datagram to every connection of conns
+func writeConns(conns []*net.UnixConn, msg []byte) error {
+	for _, conn := range conns {
+		conn.SetWriteDeadline(time.Now().Add(localWriteTimeout))
+		if _, err := conn.Write(msg); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// peerPID returns the process id of the emulator at the other end of conn, or -1 when the kernel
+// does not tell
+func peerPID(conn *net.UnixConn) int32 {
+	raw, err := conn.SyscallConn()
+	if err != nil {
+		return -1
+	}
+	pid := int32(-1)
+	raw.Control(func(fd uintptr) {
+		if cred, err := syscall.GetsockoptUcred(int(fd), syscall.SOL_SOCKET, syscall.SO_PEERCRED); err == nil {
+			pid = cred.Pid
+		}
+	})
+	return pid
+}
+
+// encodeLocalMessage builds the datagram of a message of the local transport
+func encodeLocalMessage(topic string, payload []byte) ([]byte, error) {
+	if len(topic) > LocalMaxTopic {
+		return nil, fmt.Errorf("topic too long: %d bytes", len(topic))
+	}
+	if 1+len(topic)+len(payload) > LocalMaxMessage {
+		return nil, fmt.Errorf("message too large: %d bytes", 1+len(topic)+len(payload))
+	}
+
+	msg := appendLocalHeader(make([]byte, 0, 1+len(topic)+len(payload)), topic)
+	return append(msg, payload...), nil
+}
+
+// appendLocalHeader appends the topic header of a datagram of the local transport to dst
+// The topic is one of the fixed command topics, which fit in LocalMaxTopic
+func appendLocalHeader(dst []byte, topic string) []byte {
+	dst = append(dst, byte(len(topic)))
+	return append(dst, topic...)
+}
+
+// decodeLocalMessage splits the datagram of a message of the local transport
+// The payload aliases msg
+func decodeLocalMessage(msg []byte) (string, []byte, error) {
+	if len(msg) == 0 {
+		return "", nil, fmt.Errorf("empty datagram")
+	}
+
+	topicLen := int(msg[0])
+	if len(msg) < 1+topicLen {
+		return "", nil, fmt.Errorf("topic of %d bytes in a datagram of %d", topicLen, len(msg))
+	}
+	return string(msg[1 : 1+topicLen]), msg[1+topicLen:], nil
+}
@@ -0,0 +1,330 @@
+package mqtt
+
+import (
+	"bytes"
+	"net"
+	"os"
+	"path/filepath"
+	"slices"
+	"testing"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// startLocalClient listens on a socket of a temporary directory, with events sent to a channel
+func startLocalClient(t *testing.T) (*LocalClient, chan *protocol.EventPayload) {
+	t.Helper()
+	c := NewLocalClient(filepath.Join(t.TempDir(), "koven.sock"))
+	events := make(chan *protocol.EventPayload, 16)
+	c.SetEventCallback(func(event *protocol.EventPayload) { events <- event })
+
+	if err := c.Connect(); err != nil {
+		t.Fatalf("Connect failed: %v", err)
+	}
+	t.Cleanup(c.Disconnect)
+	return c, events
+}
+
+// dialEmulator connects to the client as an emulator would, and waits until it is accepted
+func dialEmulator(t *testing.T, c *LocalClient) *net.UnixConn {
+	t.Helper()
+	accepted := c.emulators() + 1
+	conn, err := net.DialUnix("unixpacket", nil, &net.UnixAddr{Name: c.path, Net: "unixpacket"})
+	if err != nil {
+		t.Fatalf("Dial failed: %v", err)
+	}
+	t.Cleanup(func() { conn.Close() })
+
+	deadline := time.Now().Add(time.Second)
+	for c.emulators() < accepted {
+		if time.Now().After(deadline) {
+			t.Fatal("Emulator was not accepted")
+		}
+		time.Sleep(time.Millisecond)
+	}
+	return conn
+}
+
+// TestLocalMessageRoundTrip tests the datagram layout of the local transport
+func TestLocalMessageRoundTrip(t *testing.T) {
+	frame := []byte{0x01, 0x05, 0x00, 0x01, 0xB4, 0x00, 0x3C, 0x00, 0x00, 0x00}
+	msg, err := encodeLocalMessage("cmds/koven/7", frame)
+	if err != nil {
+		t.Fatalf("encodeLocalMessage failed: %v", err)
+	}
+	if msg[0] != 12 || string(msg[1:13]) != "cmds/koven/7" || !bytes.Equal(msg[13:], frame) {
+		t.Errorf("Unexpected datagram % x", msg)
+	}
+
+	topic, payload, err := decodeLocalMessage(msg)
+	if err != nil {
+		t.Fatalf("decodeLocalMessage failed: %v", err)
+	}
+	if topic != "cmds/koven/7" || !bytes.Equal(payload, frame) {
+		t.Errorf("Unexpected message %q % x", topic, payload)
+	}
+}
+
+// TestLocalMessageErrors tests that malformed datagrams and oversized messages are rejected
+func TestLocalMessageErrors(t *testing.T) {
+	for _, msg := range [][]byte{{}, {5, 'a', 'b'}} {
+		if _, _, err := decodeLocalMessage(msg); err == nil {
+			t.Errorf("Expected an error for % x", msg)
+		}
+	}
+
+	if _, err := encodeLocalMessage(string(make([]byte, LocalMaxTopic+1)), nil); err == nil {
+		t.Error("Expected an error for a long topic")
+	}
+	if _, err := encodeLocalMessage(TopicEvents, make([]byte, LocalMaxMessage)); err == nil {
+		t.Error("Expected an error for a large message")
+	}
+}
+
+// TestLocalClientReceivesEvents tests that event frames from an emulator reach the callback
+func TestLocalClientReceivesEvents(t *testing.T) {
+	c, events := startLocalClient(t)
+	conn := dialEmulator(t, c)
+
+	batch := []protocol.EventPayload{
+		{OvenID: 3, State: protocol.StatePreheating, CurrentTemperature: 40},
+		{OvenID: 4, State: protocol.StateBaking, CurrentTemperature: 180, RemainingTime: 30},
+	}
+	frame, err := protocol.MarshallEventBatchFrame(batch)
+	if err != nil {
+		t.Fatalf("MarshallEventBatchFrame failed: %v", err)
+	}
+	msg, _ := encodeLocalMessage(TopicEventBatches, frame)
+	if _, err := conn.Write(msg); err != nil {
+		t.Fatalf("Write failed: %v", err)
+	}
+
+	for i := range batch {
+		select {
+		case event := <-events:
+			if *event != batch[i] {
+				t.Errorf("Event %d: expected %+v, got %+v", i, batch[i], *event)
+			}
+		case <-time.After(time.Second):
+			t.Fatalf("Event %d not received", i)
+		}
+	}
+}
+
+// TestLocalClientSendsCommands tests that commands reach every emulator as unchanged frames
+func TestLocalClientSendsCommands(t *testing.T) {
+	c, _ := startLocalClient(t)
+	first := dialEmulator(t, c)
+	second := dialEmulator(t, c)
+
+	cmd := &protocol.CommandPayload{Action: protocol.ActionStart, Temperature: 180, Duration: 60}
+	if err := c.SendCommand(cmd); err != nil {
+		t.Fatalf("SendCommand failed: %v", err)
+	}
+
+	expected, _ := protocol.MarshallCommandFrame(cmd)
+	for _, conn := range []*net.UnixConn{first, second} {
+		buf := make([]byte, 64)
+		conn.SetReadDeadline(time.Now().Add(time.Second))
+		n, err := conn.Read(buf)
+		if err != nil {
+			t.Fatalf("Read failed: %v", err)
+		}
+		topic, payload, err := decodeLocalMessage(buf[:n])
+		if err != nil || topic != TopicCommands || !bytes.Equal(payload, expected) {
+			t.Errorf("Unexpected command message %q % x (%v)", topic, payload, err)
+		}
+	}
+}
+
+// TestLocalClientSendsCommandBatches tests that batches are split into datagrams of frames, in order
+func TestLocalClientSendsCommandBatches(t *testing.T) {
+	c, _ := startLocalClient(t)
+	emulator := dialEmulator(t, c)
+
+	cmds := make([]protocol.CommandPayload, 2*MaxCommandsPerMessage+452)
+	for i := range cmds {
+		cmds[i] = protocol.CommandPayload{Action: protocol.ActionStart, Temperature: int16(i % 300), Duration: int16(i)}
+	}
+	if err := c.SendCommands(cmds); err != nil {
+		t.Fatalf("SendCommands failed: %v", err)
+	}
+
+	next := 0
+	for _, frames := range []int{MaxCommandsPerMessage, MaxCommandsPerMessage, 452} {
+		buf := make([]byte, LocalMaxMessage)
+		emulator.SetReadDeadline(time.Now().Add(time.Second))
+		n, err := emulator.Read(buf)
+		if err != nil {
+			t.Fatalf("Read failed: %v", err)
+		}
+		topic, payload, err := decodeLocalMessage(buf[:n])
+		if err != nil || topic != TopicCommands || len(payload) != frames*protocol.CommandFrameSize {
+			t.Fatalf("Unexpected batch message %q of %d bytes (%v)", topic, len(payload), err)
+		}
+		for i := 0; i < frames; i++ {
+			expected, _ := protocol.MarshallCommandFrame(&cmds[next])
+			frame := payload[i*protocol.CommandFrameSize : (i+1)*protocol.CommandFrameSize]
+			if !bytes.Equal(frame, expected) {
+				t.Fatalf("Frame %d = % x, want % x", next, frame, expected)
+			}
+			next++
+		}
+	}
+}
+
+// TestLocalClientSendsFleetCommands tests that a fleet command is split into command batch frames
+// sent to one connection of the emulator process
+func TestLocalClientSendsFleetCommands(t *testing.T) {
+	c, _ := startLocalClient(t)
+	conns := []*net.UnixConn{dialEmulator(t, c), dialEmulator(t, c)}
+
+	ids := make([]uint32, protocol.MaxCommandBatchCommands+10)
+	for i := range ids {
+		ids[i] = uint32(1000 + i)
+	}
+	cmd := &protocol.CommandPayload{Action: protocol.ActionStart, Temperature: 200, Duration: 900}
+	acks := 0
+	messages, err := c.SendFleetCommand(ids, cmd, func(time.Duration) { acks++ })
+	if err != nil || messages != 2 || acks != 2 {
+		t.Fatalf("SendFleetCommand() = %d, %v with %d acks, want 2 messages", messages, err, acks)
+	}
+
+	// Both connections are of this process: each message reaches only one of them
+	received := make(map[uint32]int)
+	for _, conn := range conns {
+		buf := make([]byte, LocalMaxMessage)
+		for {
+			conn.SetReadDeadline(time.Now().Add(100 * time.Millisecond))
+			n, err := conn.Read(buf)
+			if err != nil {
+				break
+			}
+			topic, payload, err := decodeLocalMessage(buf[:n])
+			if err != nil || topic != TopicCommandBatches {
+				t.Fatalf("Unexpected fleet message %q (%v)", topic, err)
+			}
+			got, cmds, err := protocol.UnmarshallCommandBatchFrame(payload)
+			if err != nil || (len(got) != protocol.MaxCommandBatchCommands && len(got) != 10) {
+				t.Fatalf("Fleet message holds %d commands (%v)", len(got), err)
+			}
+			for i := range got {
+				if cmds[i] != *cmd {
+					t.Fatalf("Command of oven %d = %+v, want %+v", got[i], cmds[i], *cmd)
+				}
+				received[got[i]]++
+			}
+		}
+	}
+	for _, id := range ids {
+		if received[id] != 1 {
+			t.Fatalf("Oven %d received %d commands, want 1", id, received[id])
+		}
+	}
+	if len(received) != len(ids) {
+		t.Errorf("Received commands for %d ovens, want %d", len(received), len(ids))
+	}
+}
+
+// TestLocalClientSendsOvenCommands tests that the commands of an oven are never split over two
+// messages, and that all the messages go through the same connection of the emulator process
+func TestLocalClientSendsOvenCommands(t *testing.T) {
+	c, _ := startLocalClient(t)
+	conns := []*net.UnixConn{dialEmulator(t, c), dialEmulator(t, c)}
+
+	// The last oven would straddle the first message
+	const single = protocol.MaxCommandBatchCommands - 6
+	var ids []uint32
+	var cmds []protocol.CommandPayload
+	for i := 0; i < single; i++ {
+		ids = append(ids, uint32(i))
+		cmds = append(cmds, protocol.CommandPayload{Action: protocol.ActionStop})
+	}
+	for i := 0; i < 10; i++ {
+		ids = append(ids, 5000)
+		cmds = append(cmds, protocol.CommandPayload{Action: protocol.ActionStart, Temperature: int16(i), Duration: 60})
+	}
+	if err := c.SendOvenCommands(ids, cmds); err != nil {
+		t.Fatalf("SendOvenCommands() = %v", err)
+	}
+
+	var gotIDs []uint32
+	var gotCmds []protocol.CommandPayload
+	var sizes []int
+	readers := 0
+	for _, conn := range conns {
+		buf := make([]byte, LocalMaxMessage)
+		read := false
+		for {
+			conn.SetReadDeadline(time.Now().Add(100 * time.Millisecond))
+			n, err := conn.Read(buf)
+			if err != nil {
+				break
+			}
+			topic, payload, err := decodeLocalMessage(buf[:n])
+			if err != nil || topic != TopicCommandBatches {
+				t.Fatalf("Unexpected oven command message %q (%v)", topic, err)
+			}
+			frameIDs, frameCmds, err := protocol.UnmarshallCommandBatchFrame(payload)
+			if err != nil {
+				t.Fatalf("UnmarshallCommandBatchFrame() = %v", err)
+			}
+			gotIDs = append(gotIDs, frameIDs...)
+			gotCmds = append(gotCmds, frameCmds...)
+			sizes = append(sizes, len(frameIDs))
+			read = true
+		}
+		if read {
+			readers++
+		}
+	}
+	if readers != 1 || !slices.Equal(sizes, []int{single, 10}) {
+		t.Fatalf("Received messages of %v commands on %d connections, want [%d 10] on 1", sizes, readers, single)
+	}
+	if !slices.Equal(gotIDs, ids) || !slices.Equal(gotCmds, cmds) {
+		t.Errorf("Received commands out of order")
+	}
+
+	if err := c.SendOvenCommands(ids, cmds[1:]); err == nil {
+		t.Errorf("SendOvenCommands() expected error for missing commands, got nil")
+	}
+}
+
+// TestLocalClientWithoutEmulator tests that commands fail while no emulator is connected
+func TestLocalClientWithoutEmulator(t *testing.T) {
+	c, _ := startLocalClient(t)
+
+	if c.IsConnected() {
+		t.Error("Expected no emulator connected")
+	}
+	cmd := &protocol.CommandPayload{Action: protocol.ActionStop}
+	if err := c.SendCommand(cmd); err == nil {
+		t.Error("Expected an error without emulator")
+	}
+
+	// A disconnected emulator is forgotten
+	conn := dialEmulator(t, c)
+	conn.Close()
+	deadline := time.Now().Add(time.Second)
+	for c.IsConnected() && time.Now().Before(deadline) {
+		time.Sleep(time.Millisecond)
+	}
+	if c.IsConnected() {
+		t.Error("Expected the emulator to be forgotten")
+	}
+}
+
+// TestLocalClientReplacesStaleSocket tests that a socket left by a previous run is replaced
+func TestLocalClientReplacesStaleSocket(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "koven.sock")
+	if err := os.WriteFile(path, nil, 0o600); err != nil {
+		t.Fatalf("WriteFile failed: %v", err)
+	}
+
+	c := NewLocalClient(path)
+	if err := c.Connect(); err != nil {
+		t.Fatalf("Connect failed: %v", err)
+	}
+	c.Disconnect()
+}
@@ -14,7 +14,21 @@ import (
 const (
 	TopicCommands = "cmds/koven"
 	TopicEvents   = "events/koven"
-	QoS           = 1
+
+	// QoS of the commands and of the event subscriptions. Emulators may publish telemetry at QoS
+	// 0 and state transitions at QoS 1 (koven --event-qos tiered); subscribing at QoS 1 receives
+	// each stream at the QoS it was published with
+	QoS = 1
+
+	// Fleet emulators publish event batches to TopicEventBatches, or one event per oven to
+	// TopicEventsPrefix + <id>; both match TopicFleetEvents
+	TopicEventsPrefix = "events/koven/"
+	TopicEventBatches = "events/koven/batch"
+	TopicFleetEvents  = "events/koven/+"
+
+	// Fleet commands go to TopicCommandBatches as command batch frames, which the emulator that
+	// owns an oven applies to it
+	TopicCommandBatches = "cmds/koven/batch"
 )
 
 // EventCallback is a function type for handling received events
@@ -22,17 +36,17 @@ type EventCallback func(*protocol.EventPayload)
 
 // Client manages MQTT communication with Koven devices
 type Client struct {
-	client        mqtt.Client
-	mu            sync.RWMutex
-	connected     bool
-	eventCallback EventCallback
+	*dispatcher
+	client    mqtt.Client
+	mu        sync.RWMutex
+	connected bool
 }
 
 // NewClient creates a new MQTT client
 func NewClient(brokerURL string, clientID string) (*Client, error) {
 	c := &Client{
-		connected:     false,
-		eventCallback: nil,
+		dispatcher: newDispatcher(),
+		connected:  false,
 	}
 
 	opts := mqtt.NewClientOptions()
@@ -85,24 +99,18 @@ func (c *Client) IsConnected() bool {
 	return c.connected
 }
 
-// SetEventCallback sets the callback function for received events
-func (c *Client) SetEventCallback(callback EventCallback) {
-	c.mu.Lock()
-	defer c.mu.Unlock()
-	c.eventCallback = callback
-}
-
 // onConnect is called when the client connects to the broker
 func (c *Client) onConnect(client mqtt.Client) {
-	log.Printf("MQTT client connected, subscribing to %s", TopicEvents)
+	log.Printf("MQTT client connected, subscribing to %s and %s", TopicEvents, TopicFleetEvents)
 
-	token := client.Subscribe(TopicEvents, QoS, c.messageHandler)
+	filters := map[string]byte{TopicEvents: QoS, TopicFleetEvents: QoS}
+	token := client.SubscribeMultiple(filters, c.messageHandler)
 	if token.Wait() && token.Error() != nil {
-		log.Printf("Failed to subscribe to %s: %v", TopicEvents, token.Error())
+		log.Printf("Failed to subscribe to %s and %s: %v", TopicEvents, TopicFleetEvents, token.Error())
 		return
 	}
 
-	log.Printf("Subscribed to %s", TopicEvents)
+	log.Printf("Subscribed to %s and %s", TopicEvents, TopicFleetEvents)
 }
 
 // onConnectionLost is called when the connection to the broker is lost
@@ -115,30 +123,13 @@ func (c *Client) onConnectionLost(client mqtt.Client, err error) {
 }
 
 // messageHandler processes incoming MQTT messages
+// Live messages never carry the retained flag, only those the broker replays on subscribing
 func (c *Client) messageHandler(client mqtt.Client, msg mqtt.Message) {
-	log.Printf("Received event from %s (%d bytes)", msg.Topic(), len(msg.Payload()))
-
-	event, err := protocol.UnmarshallEventFrame(msg.Payload())
-	if err != nil {
-		log.Printf("Failed to unmarshal event frame: %v", err)
+	if msg.Retained() {
+		c.dispatchRetained(msg.Topic(), msg.Payload())
 		return
 	}
-
-	log.Printf("Event parsed: state=%s, temp=%d°C, remaining=%ds, programmed_temp=%d°C, programmed_duration=%ds",
-		protocol.StateToString(event.State),
-		event.CurrentTemperature,
-		event.RemainingTime,
-		event.ProgrammedTemperature,
-		event.ProgrammedDuration)
-
-	// Call the event callback if set
-	c.mu.RLock()
-	callback := c.eventCallback
-	c.mu.RUnlock()
-
-	if callback != nil {
-		callback(event)
-	}
+	c.dispatch(msg.Topic(), msg.Payload())
 }
 
 // SendCommand sends a command to the Koven device
@@ -147,10 +138,8 @@ func (c *Client) SendCommand(cmd *protocol.CommandPayload) error {
 		return fmt.Errorf("MQTT client not connected")
 	}
 
-	frame, err := protocol.MarshallCommandFrame(cmd)
-	if err != nil {
-		return fmt.Errorf("failed to marshall command: %w", err)
-	}
+	buf := commandBuffers.Get().(*[]byte)
+	frame := protocol.AppendCommandFrame((*buf)[:0], cmd)
 
 	log.Printf("Sending command: action=%s, temperature=%d°C, duration=%ds",
 		protocol.ActionToString(cmd.Action),
@@ -159,9 +148,137 @@ func (c *Client) SendCommand(cmd *protocol.CommandPayload) error {
 
 	token := c.client.Publish(TopicCommands, QoS, false, frame)
 	if token.Wait() && token.Error() != nil {
+		// The client may still hold the frame for a resend, so the buffer is not recycled
 		return fmt.Errorf("failed to publish command: %w", token.Error())
 	}
+	commandBuffers.Put(buf)
 
 	log.Printf("Command sent successfully")
 	return nil
 }
+
+// SendCommands sends commands to the Koven device in order, MaxCommandsPerMessage frames per
+// message; every message is published before the first acknowledgement is waited for
+func (c *Client) SendCommands(cmds []protocol.CommandPayload) error {
+	if !c.IsConnected() {
+		return fmt.Errorf("MQTT client not connected")
+	}
+
+	type published struct {
+		token mqtt.Token
+		buf   *[]byte
+	}
+	pending := make([]published, 0, (len(cmds)+MaxCommandsPerMessage-1)/MaxCommandsPerMessage)
+	for start := 0; start < len(cmds); start += MaxCommandsPerMessage {
+		end := min(start+MaxCommandsPerMessage, len(cmds))
+		buf := commandBuffers.Get().(*[]byte)
+		*buf = appendCommandFrames((*buf)[:0], cmds[start:end])
+		pending = append(pending, published{c.client.Publish(TopicCommands, QoS, false, *buf), buf})
+	}
+
+	var err error
+	for _, p := range pending {
+		if p.token.Wait() && p.token.Error() != nil {
+			if err == nil {
+				err = fmt.Errorf("failed to publish commands: %w", p.token.Error())
+			}
+			continue
+		}
+		commandBuffers.Put(p.buf)
+	}
+	if err != nil {
+		return err
+	}
+
+	log.Printf("Sent %d commands in %d messages", len(cmds), len(pending))
+	return nil
+}
+
+// SendOvenCommands sends cmds[i] to the oven ids[i], in command batch frames of up to
+// MaxCommandBatchCommands entries published to TopicCommandBatches; the commands of an oven are
+// held in a row by ids and go in one message when they fit. Every message is published before
+// the first acknowledgement is waited for
+func (c *Client) SendOvenCommands(ids []uint32, cmds []protocol.CommandPayload) error {
+	if !c.IsConnected() {
+		return fmt.Errorf("MQTT client not connected")
+	}
+	if len(ids) != len(cmds) {
+		return fmt.Errorf("%d commands for %d ovens", len(cmds), len(ids))
+	}
+
+	type published struct {
+		token mqtt.Token
+		buf   *[]byte
+	}
+	var pending []published
+	for start, end := 0, 0; start < len(ids); start = end {
+		end = ovenCommandChunk(ids, start)
+		buf := commandBuffers.Get().(*[]byte)
+		// The chunk never exceeds MaxCommandBatchCommands and the lengths match, the only errors
+		*buf, _ = protocol.AppendOvenCommandBatchFrame((*buf)[:0], ids[start:end], cmds[start:end])
+		pending = append(pending, published{c.client.Publish(TopicCommandBatches, QoS, false, *buf), buf})
+	}
+
+	var err error
+	for _, p := range pending {
+		if p.token.Wait() && p.token.Error() != nil {
+			if err == nil {
+				err = fmt.Errorf("failed to publish oven commands: %w", p.token.Error())
+			}
+			continue
+		}
+		commandBuffers.Put(p.buf)
+	}
+	if err != nil {
+		return err
+	}
+
+	log.Printf("Sent %d oven commands in %d messages", len(ids), len(pending))
+	return nil
+}
+
+// SendFleetCommand sends cmd to every oven of ids, in command batch frames of up to
+// MaxCommandBatchCommands ovens published to TopicCommandBatches; every message is published
+// before the first acknowledgement is waited for
+// ack is called with the time each message took to be acknowledged, in publish order. Returns the
+// number of messages acknowledged
+func (c *Client) SendFleetCommand(ids []uint32, cmd *protocol.CommandPayload, ack func(time.Duration)) (int, error) {
+	if !c.IsConnected() {
+		return 0, fmt.Errorf("MQTT client not connected")
+	}
+
+	type published struct {
+		token mqtt.Token
+		buf   *[]byte
+		sent  time.Time
+	}
+	pending := make([]published, 0, (len(ids)+protocol.MaxCommandBatchCommands-1)/protocol.MaxCommandBatchCommands)
+	for start := 0; start < len(ids); start += protocol.MaxCommandBatchCommands {
+		end := min(start+protocol.MaxCommandBatchCommands, len(ids))
+		buf := commandBuffers.Get().(*[]byte)
+		// The chunk never exceeds MaxCommandBatchCommands, which is the only error
+		*buf, _ = protocol.AppendCommandBatchFrame((*buf)[:0], ids[start:end], cmd)
+		sent := time.Now()
+		pending = append(pending, published{c.client.Publish(TopicCommandBatches, QoS, false, *buf), buf, sent})
+	}
+
+	var err error
+	acked := 0
+	for _, p := range pending {
+		if p.token.Wait() && p.token.Error() != nil {
+			if err == nil {
+				err = fmt.Errorf("failed to publish fleet command: %w", p.token.Error())
+			}
+			continue
+		}
+		ack(time.Since(p.sent))
+		commandBuffers.Put(p.buf)
+		acked++
+	}
+	if err != nil {
+		return acked, err
+	}
+
+	log.Printf("Sent %s to %d ovens in %d messages", protocol.ActionToString(cmd.Action), len(ids), acked)
+	return acked, nil
+}
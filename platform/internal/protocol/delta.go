@@ -0,0 +1,207 @@
+package protocol
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"sync"
+)
+
+// Delta message types: only the fields that changed since the oven's previous event
+const (
+	MessageTypeEventDelta      uint8 = 0x04
+	MessageTypeEventDeltaBatch uint8 = 0x05
+)
+
+// Field bits of a delta, in payload order, as defined by koven/messages.def
+const (
+	FieldState                 = eventPayloadFieldState
+	FieldCurrentTemperature    = eventPayloadFieldCurrentTemperature
+	FieldRemainingTime         = eventPayloadFieldRemainingTime
+	FieldProgrammedDuration    = eventPayloadFieldProgrammedDuration
+	FieldProgrammedTemperature = eventPayloadFieldProgrammedTemperature
+
+	FieldsAll = eventPayloadFieldsAll
+)
+
+// ErrNoBaseline is returned for a partial delta of an oven whose full state is not known yet
+// The emulator sends the full state periodically, so such an oven recovers on its next heartbeat
+var ErrNoBaseline = errors.New("no baseline state")
+
+// eventDelta is a parsed delta, not yet applied to any state
+type eventDelta struct {
+	ovenID uint32
+	fields uint8
+	values EventPayload
+}
+
+// DeltaDecoder rebuilds full events from delta frames, keeping the last known state of every
+// oven
+type DeltaDecoder struct {
+	mu   sync.Mutex
+	last map[uint32]EventPayload
+}
+
+// NewDeltaDecoder creates a decoder that knows no oven yet
+func NewDeltaDecoder() *DeltaDecoder {
+	return &DeltaDecoder{last: make(map[uint32]EventPayload)}
+}
+
+// Record stores a full event as the baseline of its oven
+func (d *DeltaDecoder) Record(event *EventPayload) {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+	d.last[event.OvenID] = *event
+}
+
+// Known reports whether the decoder holds the state of an oven
+func (d *DeltaDecoder) Known(ovenID uint32) bool {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+	_, ok := d.last[ovenID]
+	return ok
+}
+
+// UnmarshallEventDeltaFrame parses a delta frame of the given oven and returns its full state
+func (d *DeltaDecoder) UnmarshallEventDeltaFrame(frame []byte, ovenID uint32) (*EventPayload, error) {
+	payload, err := deltaFramePayload(frame, MessageTypeEventDelta)
+	if err != nil {
+		return nil, err
+	}
+
+	delta := eventDelta{ovenID: ovenID}
+	n, err := parseEventDelta(payload, &delta)
+	if err != nil {
+		return nil, err
+	}
+	if n != len(payload) {
+		return nil, fmt.Errorf("payload size %d does not match fields 0x%02X", len(payload), delta.fields)
+	}
+
+	d.mu.Lock()
+	defer d.mu.Unlock()
+
+	event, err := d.apply(&delta)
+	if err != nil {
+		return nil, err
+	}
+	return &event, nil
+}
+
+// UnmarshallEventDeltaBatchFrame parses a delta batch frame and returns the full state of every
+// oven in it
+// Entries of ovens without a baseline are left out; the other events are still returned, along
+// with an error wrapping ErrNoBaseline
+func (d *DeltaDecoder) UnmarshallEventDeltaBatchFrame(frame []byte) ([]EventPayload, error) {
+	payload, err := deltaFramePayload(frame, MessageTypeEventDeltaBatch)
+	if err != nil {
+		return nil, err
+	}
+	if len(payload) < 2 {
+		return nil, fmt.Errorf("batch payload too short: %d bytes", len(payload))
+	}
+
+	// Parse the whole frame first so that a malformed one changes no state
+	count := int(binary.LittleEndian.Uint16(payload))
+	if count > MaxEventBatchEvents {
+		return nil, fmt.Errorf("too many events in batch: %d (max %d)", count, MaxEventBatchEvents)
+	}
+
+	deltas := make([]eventDelta, count)
+	offset := 2
+	for i := range deltas {
+		if len(payload)-offset < 4 {
+			return nil, fmt.Errorf("batch entry %d truncated", i)
+		}
+		deltas[i].ovenID = binary.LittleEndian.Uint32(payload[offset:])
+		offset += 4
+
+		n, err := parseEventDelta(payload[offset:], &deltas[i])
+		if err != nil {
+			return nil, fmt.Errorf("batch entry %d: %w", i, err)
+		}
+		offset += n
+	}
+	if offset != len(payload) {
+		return nil, fmt.Errorf("payload size %d does not match %d entries", len(payload), count)
+	}
+
+	d.mu.Lock()
+	defer d.mu.Unlock()
+
+	events := make([]EventPayload, 0, count)
+	missing := 0
+	for i := range deltas {
+		event, err := d.apply(&deltas[i])
+		if err != nil {
+			missing++
+			continue
+		}
+		events = append(events, event)
+	}
+
+	if missing > 0 {
+		return events, fmt.Errorf("%d of %d ovens: %w", missing, count, ErrNoBaseline)
+	}
+	return events, nil
+}
+
+// apply merges a delta into the state of its oven and returns the new state
+// The caller holds d.mu
+func (d *DeltaDecoder) apply(delta *eventDelta) (EventPayload, error) {
+	event, known := d.last[delta.ovenID]
+	if !known && delta.fields != FieldsAll {
+		return EventPayload{}, fmt.Errorf("oven %d: %w", delta.ovenID, ErrNoBaseline)
+	}
+
+	event.OvenID = delta.ovenID
+	mergeEventPayloadFields(&event, &delta.values, delta.fields)
+
+	d.last[delta.ovenID] = event
+	return event, nil
+}
+
+// deltaFramePayload checks the header and CRC of a delta frame and returns its payload
+func deltaFramePayload(frame []byte, msgType uint8) ([]byte, error) {
+	if len(frame) < 5 { // Minimum: msg_type(1) + size(2) + crc(2)
+		return nil, fmt.Errorf("frame too short: %d bytes", len(frame))
+	}
+
+	if frame[0] != msgType {
+		return nil, fmt.Errorf("invalid message type: expected 0x%02X, got 0x%02X", msgType, frame[0])
+	}
+
+	payloadSize := int(binary.LittleEndian.Uint16(frame[1:]))
+	if len(frame) < 3+payloadSize+2 {
+		return nil, fmt.Errorf("frame too short for payload size %d", payloadSize)
+	}
+
+	// Verify CRC
+	expectedCRC := binary.LittleEndian.Uint16(frame[3+payloadSize:])
+	calculatedCRC := calculateCRC(frame[:3+payloadSize])
+	if expectedCRC != calculatedCRC {
+		return nil, fmt.Errorf("CRC mismatch: expected 0x%04X, got 0x%04X", expectedCRC, calculatedCRC)
+	}
+
+	return frame[3 : 3+payloadSize], nil
+}
+
+// parseEventDelta reads a field mask and the fields it selects
+// Returns the number of bytes read
+func parseEventDelta(data []byte, delta *eventDelta) (int, error) {
+	if len(data) < 1 {
+		return 0, fmt.Errorf("missing field mask")
+	}
+
+	delta.fields = data[0]
+	if delta.fields&^FieldsAll != 0 {
+		return 0, fmt.Errorf("unknown fields in mask 0x%02X", delta.fields)
+	}
+
+	size := 1 + eventPayloadFieldsSize(delta.fields)
+	if len(data) < size {
+		return 0, fmt.Errorf("delta truncated: %d bytes, fields 0x%02X need %d", len(data), delta.fields, size)
+	}
+
+	return 1 + decodeEventPayloadFields(data[1:], delta.fields, &delta.values), nil
+}
@@ -0,0 +1,153 @@
+package protocol
+
+import (
+	"errors"
+	"testing"
+)
+
+// Delta frames as encoded by the emulator (koven/tests/test_protocol.c)
+var (
+	deltaRemainingTimeVector = []byte{0x04, 0x03, 0x00, 0x04, 0x37, 0x00, 0xED, 0x91}
+	deltaAllFieldsVector     = []byte{0x04, 0x0A, 0x00, 0x1F, 0x02, 0xB4, 0x00, 0x37, 0x00, 0x3C, 0x00, 0xB4, 0x00, 0xB7, 0xDD}
+	deltaBatchVector         = []byte{
+		0x05, 0x11, 0x00, 0x02, 0x00, // type, size = 17, count = 2
+		0x07, 0x00, 0x00, 0x00, 0x04, 0x37, 0x00, // oven 7: remaining time = 55
+		0x09, 0x00, 0x00, 0x00, 0x03, 0x03, 0x63, 0x00, // oven 9: COOLING_DOWN at 99°C
+		0xB4, 0x27, // CRC-16/USB
+	}
+)
+
+var bakingEvent = EventPayload{
+	State:                 StateBaking,
+	CurrentTemperature:    180,
+	RemainingTime:         55,
+	ProgrammedDuration:    60,
+	ProgrammedTemperature: 180,
+}
+
+// TestDeltaDecoderFullDelta tests that a delta with every field sets the baseline
+func TestDeltaDecoderFullDelta(t *testing.T) {
+	d := NewDeltaDecoder()
+
+	got, err := d.UnmarshallEventDeltaFrame(deltaAllFieldsVector, 0)
+	if err != nil {
+		t.Fatalf("UnmarshallEventDeltaFrame() unexpected error: %v", err)
+	}
+	if *got != bakingEvent {
+		t.Errorf("UnmarshallEventDeltaFrame() = %+v, want %+v", *got, bakingEvent)
+	}
+}
+
+// TestDeltaDecoderPartialDelta tests that partial deltas are applied over the last state
+func TestDeltaDecoderPartialDelta(t *testing.T) {
+	d := NewDeltaDecoder()
+
+	if _, err := d.UnmarshallEventDeltaFrame(deltaRemainingTimeVector, 3); !errors.Is(err, ErrNoBaseline) {
+		t.Fatalf("UnmarshallEventDeltaFrame() error = %v, want ErrNoBaseline", err)
+	}
+
+	baseline := bakingEvent
+	baseline.OvenID = 3
+	baseline.RemainingTime = 56
+	d.Record(&baseline)
+
+	got, err := d.UnmarshallEventDeltaFrame(deltaRemainingTimeVector, 3)
+	if err != nil {
+		t.Fatalf("UnmarshallEventDeltaFrame() unexpected error: %v", err)
+	}
+
+	want := bakingEvent
+	want.OvenID = 3
+	if *got != want {
+		t.Errorf("UnmarshallEventDeltaFrame() = %+v, want %+v", *got, want)
+	}
+
+	// The delta only applies to its own oven
+	if _, err := d.UnmarshallEventDeltaFrame(deltaRemainingTimeVector, 4); !errors.Is(err, ErrNoBaseline) {
+		t.Errorf("UnmarshallEventDeltaFrame() error = %v, want ErrNoBaseline", err)
+	}
+}
+
+// TestDeltaDecoderBatch tests delta batch frames, including ovens without a baseline
+func TestDeltaDecoderBatch(t *testing.T) {
+	d := NewDeltaDecoder()
+
+	baseline := bakingEvent
+	baseline.OvenID = 7
+	baseline.RemainingTime = 56
+	d.Record(&baseline)
+
+	events, err := d.UnmarshallEventDeltaBatchFrame(deltaBatchVector)
+	if !errors.Is(err, ErrNoBaseline) {
+		t.Fatalf("UnmarshallEventDeltaBatchFrame() error = %v, want ErrNoBaseline", err)
+	}
+	want := bakingEvent
+	want.OvenID = 7
+	if len(events) != 1 || events[0] != want {
+		t.Fatalf("UnmarshallEventDeltaBatchFrame() = %+v, want [%+v]", events, want)
+	}
+
+	cooling := EventPayload{OvenID: 9, State: StateBaking, CurrentTemperature: 100, RemainingTime: 0, ProgrammedDuration: 60, ProgrammedTemperature: 180}
+	d.Record(&cooling)
+
+	events, err = d.UnmarshallEventDeltaBatchFrame(deltaBatchVector)
+	if err != nil {
+		t.Fatalf("UnmarshallEventDeltaBatchFrame() unexpected error: %v", err)
+	}
+	cooling.State = StateCoolingDown
+	cooling.CurrentTemperature = 99
+	if len(events) != 2 || events[0] != want || events[1] != cooling {
+		t.Errorf("UnmarshallEventDeltaBatchFrame() = %+v, want [%+v %+v]", events, want, cooling)
+	}
+}
+
+// TestDeltaDecoderErrors tests that malformed delta frames are rejected without changing state
+func TestDeltaDecoderErrors(t *testing.T) {
+	withCRC := func(frame []byte) []byte {
+		crc := calculateCRC(frame[:len(frame)-2])
+		frame[len(frame)-2] = byte(crc)
+		frame[len(frame)-1] = byte(crc >> 8)
+		return frame
+	}
+
+	tests := []struct {
+		name  string
+		frame []byte
+		batch bool
+	}{
+		{"empty frame", []byte{}, false},
+		{"full event frame", withCRC([]byte{0x02, 0x01, 0x00, 0x04, 0x00, 0x00}), false},
+		{"bad CRC", []byte{0x04, 0x03, 0x00, 0x04, 0x37, 0x00, 0xED, 0x92}, false},
+		{"unknown field", withCRC([]byte{0x04, 0x03, 0x00, 0x24, 0x37, 0x00, 0x00, 0x00}), false},
+		{"missing field bytes", withCRC([]byte{0x04, 0x02, 0x00, 0x04, 0x37, 0x00, 0x00}), false},
+		{"extra payload bytes", withCRC([]byte{0x04, 0x04, 0x00, 0x04, 0x37, 0x00, 0x00, 0x00, 0x00}), false},
+		{"batch count too large", withCRC([]byte{0x05, 0x08, 0x00, 0x02, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}), true},
+		{"batch entry truncated", withCRC([]byte{0x05, 0x05, 0x00, 0x01, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00}), true},
+		{"batch trailing bytes", withCRC([]byte{0x05, 0x08, 0x00, 0x01, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00}), true},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			d := NewDeltaDecoder()
+			baseline := bakingEvent
+			baseline.OvenID = 7
+			d.Record(&baseline)
+
+			var err error
+			if tt.batch {
+				_, err = d.UnmarshallEventDeltaBatchFrame(tt.frame)
+			} else {
+				_, err = d.UnmarshallEventDeltaFrame(tt.frame, 7)
+			}
+			if err == nil {
+				t.Fatalf("expected error, got nil")
+			}
+			if errors.Is(err, ErrNoBaseline) {
+				t.Errorf("error = %v, want a parse error", err)
+			}
+			if d.last[7] != baseline {
+				t.Errorf("state changed to %+v by a rejected frame", d.last[7])
+			}
+		})
+	}
+}
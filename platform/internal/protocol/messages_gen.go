@@ -0,0 +1,263 @@
+// Code generated by koven-schemagen from koven/messages.def. DO NOT EDIT.
+
+package protocol
+
+import "encoding/binary"
+
+// Payload sizes on the wire
+const (
+	commandPayloadSize = 5
+	eventPayloadSize   = 9
+)
+
+// Field bits of CommandPayload masks, in wire order
+const (
+	commandPayloadFieldAction uint8 = 1 << iota
+	commandPayloadFieldTemperature
+	commandPayloadFieldDuration
+
+	commandPayloadFieldsAll uint8 = 1<<3 - 1
+)
+
+// encodeCommandPayload writes the 5 payload bytes of m to b
+func encodeCommandPayload(m *CommandPayload, b []byte) {
+	_ = b[4]
+	b[0] = m.Action
+	binary.LittleEndian.PutUint16(b[1:], uint16(m.Temperature))
+	binary.LittleEndian.PutUint16(b[3:], uint16(m.Duration))
+}
+
+// decodeCommandPayload reads the 5 payload bytes of b into m
+func decodeCommandPayload(b []byte, m *CommandPayload) {
+	_ = b[4]
+	m.Action = b[0]
+	m.Temperature = int16(binary.LittleEndian.Uint16(b[1:]))
+	m.Duration = int16(binary.LittleEndian.Uint16(b[3:]))
+}
+
+// commandPayloadFieldsSize returns the size of the fields selected by fields
+func commandPayloadFieldsSize(fields uint8) int {
+	size := 0
+	if fields&commandPayloadFieldAction != 0 {
+		size += 1
+	}
+	if fields&commandPayloadFieldTemperature != 0 {
+		size += 2
+	}
+	if fields&commandPayloadFieldDuration != 0 {
+		size += 2
+	}
+	return size
+}
+
+// encodeCommandPayloadFields writes the fields of m selected by fields to b, in wire order
+// Returns the number of bytes written
+func encodeCommandPayloadFields(m *CommandPayload, fields uint8, b []byte) int {
+	n := 0
+	if fields&commandPayloadFieldAction != 0 {
+		b[n] = m.Action
+		n += 1
+	}
+	if fields&commandPayloadFieldTemperature != 0 {
+		binary.LittleEndian.PutUint16(b[n:], uint16(m.Temperature))
+		n += 2
+	}
+	if fields&commandPayloadFieldDuration != 0 {
+		binary.LittleEndian.PutUint16(b[n:], uint16(m.Duration))
+		n += 2
+	}
+	return n
+}
+
+// decodeCommandPayloadFields reads the fields selected by fields from b into m, in wire order
+// b must hold commandPayloadFieldsSize(fields) bytes. Returns the number of bytes read
+func decodeCommandPayloadFields(b []byte, fields uint8, m *CommandPayload) int {
+	n := 0
+	if fields&commandPayloadFieldAction != 0 {
+		m.Action = b[n]
+		n += 1
+	}
+	if fields&commandPayloadFieldTemperature != 0 {
+		m.Temperature = int16(binary.LittleEndian.Uint16(b[n:]))
+		n += 2
+	}
+	if fields&commandPayloadFieldDuration != 0 {
+		m.Duration = int16(binary.LittleEndian.Uint16(b[n:]))
+		n += 2
+	}
+	return n
+}
+
+// mergeCommandPayloadFields copies the fields selected by fields from src to dst
+func mergeCommandPayloadFields(dst, src *CommandPayload, fields uint8) {
+	if fields&commandPayloadFieldAction != 0 {
+		dst.Action = src.Action
+	}
+	if fields&commandPayloadFieldTemperature != 0 {
+		dst.Temperature = src.Temperature
+	}
+	if fields&commandPayloadFieldDuration != 0 {
+		dst.Duration = src.Duration
+	}
+}
+
+// changedCommandPayloadFields returns the bits of the fields that differ between previous and current
+func changedCommandPayloadFields(previous, current *CommandPayload) uint8 {
+	fields := uint8(0)
+	if previous.Action != current.Action {
+		fields |= commandPayloadFieldAction
+	}
+	if previous.Temperature != current.Temperature {
+		fields |= commandPayloadFieldTemperature
+	}
+	if previous.Duration != current.Duration {
+		fields |= commandPayloadFieldDuration
+	}
+	return fields
+}
+
+// Field bits of EventPayload masks, in wire order
+const (
+	eventPayloadFieldState uint8 = 1 << iota
+	eventPayloadFieldCurrentTemperature
+	eventPayloadFieldRemainingTime
+	eventPayloadFieldProgrammedDuration
+	eventPayloadFieldProgrammedTemperature
+
+	eventPayloadFieldsAll uint8 = 1<<5 - 1
+)
+
+// encodeEventPayload writes the 9 payload bytes of m to b
+func encodeEventPayload(m *EventPayload, b []byte) {
+	_ = b[8]
+	b[0] = m.State
+	binary.LittleEndian.PutUint16(b[1:], uint16(m.CurrentTemperature))
+	binary.LittleEndian.PutUint16(b[3:], uint16(m.RemainingTime))
+	binary.LittleEndian.PutUint16(b[5:], uint16(m.ProgrammedDuration))
+	binary.LittleEndian.PutUint16(b[7:], uint16(m.ProgrammedTemperature))
+}
+
+// decodeEventPayload reads the 9 payload bytes of b into m
+func decodeEventPayload(b []byte, m *EventPayload) {
+	_ = b[8]
+	m.State = b[0]
+	m.CurrentTemperature = int16(binary.LittleEndian.Uint16(b[1:]))
+	m.RemainingTime = int16(binary.LittleEndian.Uint16(b[3:]))
+	m.ProgrammedDuration = int16(binary.LittleEndian.Uint16(b[5:]))
+	m.ProgrammedTemperature = int16(binary.LittleEndian.Uint16(b[7:]))
+}
+
+// eventPayloadFieldsSize returns the size of the fields selected by fields
+func eventPayloadFieldsSize(fields uint8) int {
+	size := 0
+	if fields&eventPayloadFieldState != 0 {
+		size += 1
+	}
+	if fields&eventPayloadFieldCurrentTemperature != 0 {
+		size += 2
+	}
+	if fields&eventPayloadFieldRemainingTime != 0 {
+		size += 2
+	}
+	if fields&eventPayloadFieldProgrammedDuration != 0 {
+		size += 2
+	}
+	if fields&eventPayloadFieldProgrammedTemperature != 0 {
+		size += 2
+	}
+	return size
+}
+
+// encodeEventPayloadFields writes the fields of m selected by fields to b, in wire order
+// Returns the number of bytes written
+func encodeEventPayloadFields(m *EventPayload, fields uint8, b []byte) int {
+	n := 0
+	if fields&eventPayloadFieldState != 0 {
+		b[n] = m.State
+		n += 1
+	}
+	if fields&eventPayloadFieldCurrentTemperature != 0 {
+		binary.LittleEndian.PutUint16(b[n:], uint16(m.CurrentTemperature))
+		n += 2
+	}
+	if fields&eventPayloadFieldRemainingTime != 0 {
+		binary.LittleEndian.PutUint16(b[n:], uint16(m.RemainingTime))
+		n += 2
+	}
+	if fields&eventPayloadFieldProgrammedDuration != 0 {
+		binary.LittleEndian.PutUint16(b[n:], uint16(m.ProgrammedDuration))
+		n += 2
+	}
+	if fields&eventPayloadFieldProgrammedTemperature != 0 {
+		binary.LittleEndian.PutUint16(b[n:], uint16(m.ProgrammedTemperature))
+		n += 2
+	}
+	return n
+}
+
+// decodeEventPayloadFields reads the fields selected by fields from b into m, in wire order
+// b must hold eventPayloadFieldsSize(fields) bytes. Returns the number of bytes read
+func decodeEventPayloadFields(b []byte, fields uint8, m *EventPayload) int {
+	n := 0
+	if fields&eventPayloadFieldState != 0 {
+		m.State = b[n]
+		n += 1
+	}
+	if fields&eventPayloadFieldCurrentTemperature != 0 {
+		m.CurrentTemperature = int16(binary.LittleEndian.Uint16(b[n:]))
+		n += 2
+	}
+	if fields&eventPayloadFieldRemainingTime != 0 {
+		m.RemainingTime = int16(binary.LittleEndian.Uint16(b[n:]))
+		n += 2
+	}
+	if fields&eventPayloadFieldProgrammedDuration != 0 {
+		m.ProgrammedDuration = int16(binary.LittleEndian.Uint16(b[n:]))
+		n += 2
+	}
+	if fields&eventPayloadFieldProgrammedTemperature != 0 {
+		m.ProgrammedTemperature = int16(binary.LittleEndian.Uint16(b[n:]))
+		n += 2
+	}
+	return n
+}
+
+// mergeEventPayloadFields copies the fields selected by fields from src to dst
+func mergeEventPayloadFields(dst, src *EventPayload, fields uint8) {
+	if fields&eventPayloadFieldState != 0 {
+		dst.State = src.State
+	}
+	if fields&eventPayloadFieldCurrentTemperature != 0 {
+		dst.CurrentTemperature = src.CurrentTemperature
+	}
+	if fields&eventPayloadFieldRemainingTime != 0 {
+		dst.RemainingTime = src.RemainingTime
+	}
+	if fields&eventPayloadFieldProgrammedDuration != 0 {
+		dst.ProgrammedDuration = src.ProgrammedDuration
+	}
+	if fields&eventPayloadFieldProgrammedTemperature != 0 {
+		dst.ProgrammedTemperature = src.ProgrammedTemperature
+	}
+}
+
+// changedEventPayloadFields returns the bits of the fields that differ between previous and current
+func changedEventPayloadFields(previous, current *EventPayload) uint8 {
+	fields := uint8(0)
+	if previous.State != current.State {
+		fields |= eventPayloadFieldState
+	}
+	if previous.CurrentTemperature != current.CurrentTemperature {
+		fields |= eventPayloadFieldCurrentTemperature
+	}
+	if previous.RemainingTime != current.RemainingTime {
+		fields |= eventPayloadFieldRemainingTime
+	}
+	if previous.ProgrammedDuration != current.ProgrammedDuration {
+		fields |= eventPayloadFieldProgrammedDuration
+	}
+	if previous.ProgrammedTemperature != current.ProgrammedTemperature {
+		fields |= eventPayloadFieldProgrammedTemperature
+	}
+	return fields
+}
@@ -1,14 +1,34 @@
 package protocol
 
+//go:generate go run ../../cmd/koven-schemagen -schema ../../../koven/messages.def -package protocol -out messages_gen.go
+
 import (
 	"encoding/binary"
 	"fmt"
+	"slices"
 )
 
 // Message types
 const (
-	MessageTypeCommand uint8 = 0x01
-	MessageTypeEvent   uint8 = 0x02
+	MessageTypeCommand    uint8 = 0x01
+	MessageTypeEvent      uint8 = 0x02
+	MessageTypeEventBatch uint8 = 0x03
+
+	MessageTypeCommandBatch uint8 = 0x06
+)
+
+// Event batch layout: a 2-byte count followed by one entry per oven, each a 4-byte oven id
+// and an event payload
+const (
+	EventBatchEntrySize = 4 + eventPayloadSize
+	MaxEventBatchEvents = 4096
+)
+
+// Command batch layout: a 2-byte count followed by one entry per oven, each a 4-byte oven id
+// and a command payload
+const (
+	CommandBatchEntrySize   = 4 + commandPayloadSize
+	MaxCommandBatchCommands = 4096
 )
 
 // Action codes
@@ -27,12 +47,34 @@ const (
 
 // CRC-16/USB parameters
 const (
-	crcPoly   uint16 = 0x8005
-	crcInit   uint16 = 0xFFFF
-	crcXorOut uint16 = 0xFFFF
+	crcPoly          uint16 = 0x8005
+	crcPolyReflected uint16 = 0xA001
+	crcInit          uint16 = 0xFFFF
+	crcXorOut        uint16 = 0xFFFF
 )
 
+// Command frame layout: msg_type + size + payload + crc
+const CommandFrameSize = 1 + 2 + commandPayloadSize + 2
+
+// crcTable is the reflected CRC-16/USB of every byte value, so that calculateCRC takes one
+// lookup per byte, as the emulator's crc16_usb_table does
+var crcTable = func() (table [256]uint16) {
+	for i := range table {
+		crc := uint16(i)
+		for j := 0; j < 8; j++ {
+			if crc&1 != 0 {
+				crc = crc>>1 ^ crcPolyReflected
+			} else {
+				crc >>= 1
+			}
+		}
+		table[i] = crc
+	}
+	return table
+}()
+
 // CommandPayload represents a command sent to the oven
+// Its wire layout is defined by koven/messages.def, from which messages_gen.go is generated
 type CommandPayload struct {
 	Action      uint8
 	Temperature int16
@@ -40,7 +82,11 @@ type CommandPayload struct {
 }
 
 // EventPayload represents an event sent from the oven
+// Its wire layout is defined by koven/messages.def, from which messages_gen.go is generated
+// OvenID is not part of the event payload itself: it comes from the event batch entry or the
+// topic the event was received on, and is 0 for the single oven on events/koven
 type EventPayload struct {
+	OvenID                uint32
 	State                 uint8
 	CurrentTemperature    int16
 	RemainingTime         int16
@@ -71,8 +117,19 @@ func reflectUint16(val uint16) uint16 {
 }
 
 // calculateCRC calculates CRC-16/USB checksum
+// The CRC is computed reflected, which spares the bit reversal of every byte and of the result
 func calculateCRC(data []byte) uint16 {
 	crc := crcInit
+	for _, b := range data {
+		crc = crc>>8 ^ crcTable[byte(crc)^b]
+	}
+	return crc ^ crcXorOut
+}
+
+// calculateCRCBitwise calculates CRC-16/USB checksum bit by bit, as the specification states it
+// It is the reference calculateCRC is tested against
+func calculateCRCBitwise(data []byte) uint16 {
+	crc := crcInit
 
 	for _, b := range data {
 		reflected := reflectByte(b)
@@ -95,29 +152,110 @@ func calculateCRC(data []byte) uint16 {
 
 // MarshallCommandFrame creates a binary command frame
 func MarshallCommandFrame(cmd *CommandPayload) ([]byte, error) {
-	payloadSize := uint16(5)                  // 1 byte action + 2 bytes temp + 2 bytes duration
-	frameSize := 1 + 2 + int(payloadSize) + 2 // msg_type + size + payload + crc
+	return AppendCommandFrame(make([]byte, 0, CommandFrameSize), cmd), nil
+}
 
-	frame := make([]byte, frameSize)
-	offset := 0
+// AppendCommandFrame appends the binary command frame of cmd to dst and returns the extended
+// slice; it does not allocate when dst has CommandFrameSize bytes of spare capacity
+func AppendCommandFrame(dst []byte, cmd *CommandPayload) []byte {
+	start := len(dst)
+	dst = append(dst, make([]byte, CommandFrameSize)...)
+	frame := dst[start:]
 
-	frame[offset] = MessageTypeCommand
-	offset++
+	frame[0] = MessageTypeCommand
+	binary.LittleEndian.PutUint16(frame[1:], commandPayloadSize)
+	encodeCommandPayload(cmd, frame[3:])
 
-	binary.LittleEndian.PutUint16(frame[offset:], payloadSize)
-	offset += 2
+	crc := calculateCRC(frame[:3+commandPayloadSize])
+	binary.LittleEndian.PutUint16(frame[3+commandPayloadSize:], crc)
 
-	frame[offset] = cmd.Action
-	offset++
-	binary.LittleEndian.PutUint16(frame[offset:], uint16(cmd.Temperature))
-	offset += 2
-	binary.LittleEndian.PutUint16(frame[offset:], uint16(cmd.Duration))
-	offset += 2
+	return dst
+}
+
+// AppendCommandBatchFrame appends a command batch frame sending cmd to every oven of ids to dst
+// and returns the extended slice; ids must not hold more than MaxCommandBatchCommands ovens
+func AppendCommandBatchFrame(dst []byte, ids []uint32, cmd *CommandPayload) ([]byte, error) {
+	return appendCommandBatchFrame(dst, ids, []CommandPayload{*cmd})
+}
+
+// AppendOvenCommandBatchFrame appends a command batch frame whose entry i sends cmds[i] to the
+// oven ids[i] to dst and returns the extended slice; the emulator applies the entries of an oven
+// in order. ids and cmds must have the same length, at most MaxCommandBatchCommands
+func AppendOvenCommandBatchFrame(dst []byte, ids []uint32, cmds []CommandPayload) ([]byte, error) {
+	if len(cmds) != len(ids) {
+		return dst, fmt.Errorf("%d commands for %d ovens", len(cmds), len(ids))
+	}
+	return appendCommandBatchFrame(dst, ids, cmds)
+}
+
+// appendCommandBatchFrame appends a command batch frame sending cmds[i] to the oven ids[i], or
+// cmds[0] to every oven when cmds holds a single command
+func appendCommandBatchFrame(dst []byte, ids []uint32, cmds []CommandPayload) ([]byte, error) {
+	if len(ids) > MaxCommandBatchCommands {
+		return dst, fmt.Errorf("too many commands in batch: %d (max %d)", len(ids), MaxCommandBatchCommands)
+	}
+
+	payloadSize := 2 + len(ids)*CommandBatchEntrySize
+	start := len(dst)
+	dst = slices.Grow(dst, 1+2+payloadSize+2)[:start+1+2+payloadSize+2]
+	frame := dst[start:]
+
+	frame[0] = MessageTypeCommandBatch
+	binary.LittleEndian.PutUint16(frame[1:], uint16(payloadSize))
+	binary.LittleEndian.PutUint16(frame[3:], uint16(len(ids)))
+
+	offset := 5
+	for i, id := range ids {
+		binary.LittleEndian.PutUint32(frame[offset:], id)
+		encodeCommandPayload(&cmds[min(i, len(cmds)-1)], frame[offset+4:])
+		offset += CommandBatchEntrySize
+	}
 
 	crc := calculateCRC(frame[:offset])
 	binary.LittleEndian.PutUint16(frame[offset:], crc)
 
-	return frame, nil
+	return dst, nil
+}
+
+// UnmarshallCommandBatchFrame parses a binary command batch frame into the oven ids and the
+// commands of its entries
+func UnmarshallCommandBatchFrame(frame []byte) ([]uint32, []CommandPayload, error) {
+	if len(frame) < 7 { // Minimum: msg_type(1) + size(2) + count(2) + crc(2)
+		return nil, nil, fmt.Errorf("frame too short: %d bytes", len(frame))
+	}
+
+	if frame[0] != MessageTypeCommandBatch {
+		return nil, nil, fmt.Errorf("invalid message type: expected 0x%02X, got 0x%02X", MessageTypeCommandBatch, frame[0])
+	}
+
+	payloadSize := int(binary.LittleEndian.Uint16(frame[1:]))
+	count := int(binary.LittleEndian.Uint16(frame[3:]))
+	if count > MaxCommandBatchCommands || payloadSize != 2+count*CommandBatchEntrySize {
+		return nil, nil, fmt.Errorf("invalid batch payload size %d for %d commands", payloadSize, count)
+	}
+
+	if len(frame) < 3+payloadSize+2 {
+		return nil, nil, fmt.Errorf("frame too short for payload size %d", payloadSize)
+	}
+
+	// Verify CRC
+	expectedCRC := binary.LittleEndian.Uint16(frame[3+payloadSize:])
+	calculatedCRC := calculateCRC(frame[:3+payloadSize])
+	if expectedCRC != calculatedCRC {
+		return nil, nil, fmt.Errorf("CRC mismatch: expected 0x%04X, got 0x%04X", expectedCRC, calculatedCRC)
+	}
+
+	// Parse entries
+	ids := make([]uint32, count)
+	cmds := make([]CommandPayload, count)
+	offset := 5
+	for i := range ids {
+		ids[i] = binary.LittleEndian.Uint32(frame[offset:])
+		decodeCommandPayload(frame[offset+4:], &cmds[i])
+		offset += CommandBatchEntrySize
+	}
+
+	return ids, cmds, nil
 }
 
 // UnmarshallEventFrame parses a binary event frame
@@ -150,18 +288,84 @@ func UnmarshallEventFrame(frame []byte) (*EventPayload, error) {
 		return nil, fmt.Errorf("CRC mismatch: expected 0x%04X, got 0x%04X", expectedCRC, calculatedCRC)
 	}
 
-	// Parse payload
-	event := &EventPayload{
-		State:                 frame[offset],
-		CurrentTemperature:    int16(binary.LittleEndian.Uint16(frame[offset+1:])),
-		RemainingTime:         int16(binary.LittleEndian.Uint16(frame[offset+3:])),
-		ProgrammedDuration:    int16(binary.LittleEndian.Uint16(frame[offset+5:])),
-		ProgrammedTemperature: int16(binary.LittleEndian.Uint16(frame[offset+7:])),
+	if payloadSize != eventPayloadSize {
+		return nil, fmt.Errorf("invalid event payload size %d (expected %d)", payloadSize, eventPayloadSize)
 	}
 
+	// Parse payload
+	event := &EventPayload{}
+	decodeEventPayload(frame[offset:], event)
+
 	return event, nil
 }
 
+// MarshallEventBatchFrame creates a binary event batch frame, one entry per event keyed by its
+// OvenID
+func MarshallEventBatchFrame(events []EventPayload) ([]byte, error) {
+	if len(events) > MaxEventBatchEvents {
+		return nil, fmt.Errorf("too many events in batch: %d (max %d)", len(events), MaxEventBatchEvents)
+	}
+
+	payloadSize := 2 + len(events)*EventBatchEntrySize
+	frame := make([]byte, 1+2+payloadSize+2)
+
+	frame[0] = MessageTypeEventBatch
+	binary.LittleEndian.PutUint16(frame[1:], uint16(payloadSize))
+	binary.LittleEndian.PutUint16(frame[3:], uint16(len(events)))
+
+	offset := 5
+	for i := range events {
+		binary.LittleEndian.PutUint32(frame[offset:], events[i].OvenID)
+		encodeEventPayload(&events[i], frame[offset+4:])
+		offset += EventBatchEntrySize
+	}
+
+	crc := calculateCRC(frame[:offset])
+	binary.LittleEndian.PutUint16(frame[offset:], crc)
+
+	return frame, nil
+}
+
+// UnmarshallEventBatchFrame parses a binary event batch frame
+// The OvenID of every returned event is set from its batch entry
+func UnmarshallEventBatchFrame(frame []byte) ([]EventPayload, error) {
+	if len(frame) < 7 { // Minimum: msg_type(1) + size(2) + count(2) + crc(2)
+		return nil, fmt.Errorf("frame too short: %d bytes", len(frame))
+	}
+
+	if frame[0] != MessageTypeEventBatch {
+		return nil, fmt.Errorf("invalid message type: expected 0x%02X, got 0x%02X", MessageTypeEventBatch, frame[0])
+	}
+
+	payloadSize := int(binary.LittleEndian.Uint16(frame[1:]))
+	count := int(binary.LittleEndian.Uint16(frame[3:]))
+	if count > MaxEventBatchEvents || payloadSize != 2+count*EventBatchEntrySize {
+		return nil, fmt.Errorf("invalid batch payload size %d for %d events", payloadSize, count)
+	}
+
+	if len(frame) < 3+payloadSize+2 {
+		return nil, fmt.Errorf("frame too short for payload size %d", payloadSize)
+	}
+
+	// Verify CRC
+	expectedCRC := binary.LittleEndian.Uint16(frame[3+payloadSize:])
+	calculatedCRC := calculateCRC(frame[:3+payloadSize])
+	if expectedCRC != calculatedCRC {
+		return nil, fmt.Errorf("CRC mismatch: expected 0x%04X, got 0x%04X", expectedCRC, calculatedCRC)
+	}
+
+	// Parse entries
+	events := make([]EventPayload, count)
+	offset := 5
+	for i := range events {
+		events[i].OvenID = binary.LittleEndian.Uint32(frame[offset:])
+		decodeEventPayload(frame[offset+4:], &events[i])
+		offset += EventBatchEntrySize
+	}
+
+	return events, nil
+}
+
 // StateToString converts a state code to a string
 func StateToString(state uint8) string {
 	switch state {
@@ -178,6 +382,16 @@ func StateToString(state uint8) string {
 	}
 }
 
+// StateFromString converts a state name, as returned by StateToString, to its code
+func StateFromString(name string) (uint8, bool) {
+	for _, state := range []uint8{StateIdle, StatePreheating, StateBaking, StateCoolingDown} {
+		if StateToString(state) == name {
+			return state, true
+		}
+	}
+	return 0, false
+}
+
 // ActionToString converts an action code to a string
 func ActionToString(action uint8) string {
 	switch action {
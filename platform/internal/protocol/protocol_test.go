@@ -3,6 +3,8 @@ package protocol
 import (
 	"bytes"
 	"encoding/binary"
+	"fmt"
+	"slices"
 	"testing"
 )
 
@@ -108,6 +110,44 @@ func TestCalculateCRC(t *testing.T) {
 	}
 }
 
+// TestCalculateCRCMatchesBitwise tests the table-driven CRC against the bitwise reference
+func TestCalculateCRCMatchesBitwise(t *testing.T) {
+	data := make([]byte, 1024)
+	for i := range data {
+		data[i] = byte(i*131 + i>>3)
+	}
+	for n := 0; n <= len(data); n += 37 {
+		if got, want := calculateCRC(data[:n]), calculateCRCBitwise(data[:n]); got != want {
+			t.Fatalf("calculateCRC(%d bytes) = 0x%04X, want 0x%04X", n, got, want)
+		}
+	}
+}
+
+// TestAppendCommandFrame tests that frames append to a buffer without allocating
+func TestAppendCommandFrame(t *testing.T) {
+	start := &CommandPayload{Action: ActionStart, Temperature: 200, Duration: 3600}
+	stop := &CommandPayload{Action: ActionStop}
+
+	buf := AppendCommandFrame(nil, start)
+	buf = AppendCommandFrame(buf, stop)
+	want := []byte{0x01, 0x05, 0x00, 0x01, 0xC8, 0x00, 0x10, 0x0E, 0xA4, 0x9C}
+	if len(buf) != 2*CommandFrameSize || string(buf[:CommandFrameSize]) != string(want) {
+		t.Fatalf("AppendCommandFrame() = %X", buf)
+	}
+	stopFrame, _ := MarshallCommandFrame(stop)
+	if string(buf[CommandFrameSize:]) != string(stopFrame) {
+		t.Errorf("Second frame = %X, want %X", buf[CommandFrameSize:], stopFrame)
+	}
+
+	scratch := make([]byte, 0, CommandFrameSize)
+	allocs := testing.AllocsPerRun(100, func() {
+		scratch = AppendCommandFrame(scratch[:0], start)
+	})
+	if allocs != 0 {
+		t.Errorf("AppendCommandFrame() allocates %.0f times, want 0", allocs)
+	}
+}
+
 // TestMarshallCommandFrame tests command frame creation
 func TestMarshallCommandFrame(t *testing.T) {
 	tests := []struct {
@@ -385,6 +425,13 @@ func TestUnmarshallEventFrame(t *testing.T) {
 			},
 			wantErr: false,
 		},
+		{
+			name: "payload shorter than an event",
+			// Valid CRC over a 4-byte payload
+			frame:   []byte{0x02, 0x04, 0x00, 0x00, 0x19, 0x00, 0x00, 0x17, 0x7C},
+			wantErr: true,
+			errMsg:  "invalid event payload size",
+		},
 	}
 
 	for _, tt := range tests {
@@ -420,6 +467,216 @@ func TestUnmarshallEventFrame(t *testing.T) {
 	}
 }
 
+// eventBatchVector is a batch of two ovens as encoded by the emulator (koven/tests/test_protocol.c)
+var eventBatchVector = []byte{
+	0x03, 0x1C, 0x00, 0x02, 0x00, // type, size = 28, count = 2
+	0x07, 0x00, 0x00, 0x00, 0x02, 0xB4, 0x00, 0x37, 0x00, 0x3C, 0x00, 0xB4, 0x00, // oven 7, BAKING
+	0x04, 0x03, 0x02, 0x01, 0x00, 0x19, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // oven 0x01020304, IDLE
+	0x3C, 0x38, // CRC-16/USB
+}
+
+var eventBatchVectorEvents = []EventPayload{
+	{OvenID: 7, State: StateBaking, CurrentTemperature: 180, RemainingTime: 55, ProgrammedDuration: 60, ProgrammedTemperature: 180},
+	{OvenID: 0x01020304, State: StateIdle, CurrentTemperature: 25, RemainingTime: -1, ProgrammedDuration: -1, ProgrammedTemperature: -1},
+}
+
+// TestUnmarshallEventBatchFrame tests event batch frame parsing
+func TestUnmarshallEventBatchFrame(t *testing.T) {
+	got, err := UnmarshallEventBatchFrame(eventBatchVector)
+	if err != nil {
+		t.Fatalf("UnmarshallEventBatchFrame() unexpected error: %v", err)
+	}
+	if len(got) != len(eventBatchVectorEvents) {
+		t.Fatalf("UnmarshallEventBatchFrame() returned %d events, want %d", len(got), len(eventBatchVectorEvents))
+	}
+	for i := range got {
+		if got[i] != eventBatchVectorEvents[i] {
+			t.Errorf("event %d = %+v, want %+v", i, got[i], eventBatchVectorEvents[i])
+		}
+	}
+}
+
+// TestUnmarshallEventBatchFrameErrors tests that invalid event batch frames are rejected
+func TestUnmarshallEventBatchFrameErrors(t *testing.T) {
+	corrupt := func(index int, value byte) []byte {
+		frame := bytes.Clone(eventBatchVector)
+		frame[index] = value
+		return frame
+	}
+
+	tests := []struct {
+		name  string
+		frame []byte
+	}{
+		{"empty frame", []byte{}},
+		{"truncated frame", eventBatchVector[:len(eventBatchVector)-1]},
+		{"single event frame", corrupt(0, MessageTypeEvent)},
+		{"count mismatch", corrupt(3, 0x03)},
+		{"corrupted entry", corrupt(10, 0xB5)},
+		{"corrupted CRC", corrupt(len(eventBatchVector)-1, 0x00)},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if _, err := UnmarshallEventBatchFrame(tt.frame); err == nil {
+				t.Errorf("UnmarshallEventBatchFrame() expected error, got nil")
+			}
+		})
+	}
+}
+
+// TestMarshallEventBatchFrame tests event batch frame creation
+func TestMarshallEventBatchFrame(t *testing.T) {
+	got, err := MarshallEventBatchFrame(eventBatchVectorEvents)
+	if err != nil {
+		t.Fatalf("MarshallEventBatchFrame() unexpected error: %v", err)
+	}
+	if !bytes.Equal(got, eventBatchVector) {
+		t.Errorf("MarshallEventBatchFrame() = %X, want %X", got, eventBatchVector)
+	}
+
+	// The largest batch round-trips
+	events := make([]EventPayload, MaxEventBatchEvents)
+	for i := range events {
+		events[i] = EventPayload{OvenID: uint32(i * 7), State: uint8(i % 4), CurrentTemperature: int16(i)}
+	}
+	frame, err := MarshallEventBatchFrame(events)
+	if err != nil {
+		t.Fatalf("MarshallEventBatchFrame() unexpected error: %v", err)
+	}
+	decoded, err := UnmarshallEventBatchFrame(frame)
+	if err != nil {
+		t.Fatalf("UnmarshallEventBatchFrame() unexpected error: %v", err)
+	}
+	for i := range events {
+		if decoded[i] != events[i] {
+			t.Fatalf("event %d = %+v, want %+v", i, decoded[i], events[i])
+		}
+	}
+
+	if _, err := MarshallEventBatchFrame(make([]EventPayload, MaxEventBatchEvents+1)); err == nil {
+		t.Errorf("MarshallEventBatchFrame() expected error for an oversized batch, got nil")
+	}
+}
+
+// commandBatchVector is the command batch frame of the emulator test vector
+// (koven/tests/test_protocol.c): START 180°C for 60s to oven 7, then STOP to oven 0x01020304
+var commandBatchVector = []byte{
+	0x06, 0x14, 0x00, 0x02, 0x00,
+	0x07, 0x00, 0x00, 0x00, 0x01, 0xB4, 0x00, 0x3C, 0x00,
+	0x04, 0x03, 0x02, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00,
+	0xDB, 0xC7,
+}
+
+// TestUnmarshallCommandBatchFrame tests command batch frame parsing against the emulator vector
+func TestUnmarshallCommandBatchFrame(t *testing.T) {
+	ids, cmds, err := UnmarshallCommandBatchFrame(commandBatchVector)
+	if err != nil {
+		t.Fatalf("UnmarshallCommandBatchFrame() unexpected error: %v", err)
+	}
+	wantIDs := []uint32{7, 0x01020304}
+	wantCmds := []CommandPayload{{Action: ActionStart, Temperature: 180, Duration: 60}, {Action: ActionStop}}
+	if len(ids) != len(wantIDs) || len(cmds) != len(wantCmds) {
+		t.Fatalf("UnmarshallCommandBatchFrame() returned %d ids and %d commands, want 2", len(ids), len(cmds))
+	}
+	for i := range ids {
+		if ids[i] != wantIDs[i] || cmds[i] != wantCmds[i] {
+			t.Errorf("entry %d = %d %+v, want %d %+v", i, ids[i], cmds[i], wantIDs[i], wantCmds[i])
+		}
+	}
+
+	corrupt := func(index int, value byte) []byte {
+		frame := bytes.Clone(commandBatchVector)
+		frame[index] = value
+		return frame
+	}
+	invalid := map[string][]byte{
+		"truncated frame": commandBatchVector[:len(commandBatchVector)-1],
+		"event batch":     corrupt(0, MessageTypeEventBatch),
+		"count mismatch":  corrupt(3, 0x03),
+		"corrupted entry": corrupt(10, 0xB5),
+		"corrupted CRC":   corrupt(len(commandBatchVector)-1, 0x00),
+	}
+	for name, frame := range invalid {
+		if _, _, err := UnmarshallCommandBatchFrame(frame); err == nil {
+			t.Errorf("UnmarshallCommandBatchFrame(%s) expected error, got nil", name)
+		}
+	}
+}
+
+// TestAppendCommandBatchFrame tests that a command batch frame sends one command to every oven
+func TestAppendCommandBatchFrame(t *testing.T) {
+	cmd := &CommandPayload{Action: ActionStart, Temperature: 180, Duration: 60}
+	ids := make([]uint32, MaxCommandBatchCommands)
+	for i := range ids {
+		ids[i] = uint32(i * 3)
+	}
+
+	prefix := []byte{0xAA}
+	frame, err := AppendCommandBatchFrame(prefix, ids, cmd)
+	if err != nil {
+		t.Fatalf("AppendCommandBatchFrame() unexpected error: %v", err)
+	}
+	if frame[0] != 0xAA || len(frame) != 1+7+len(ids)*CommandBatchEntrySize {
+		t.Fatalf("AppendCommandBatchFrame() returned %d bytes", len(frame))
+	}
+	decodedIDs, cmds, err := UnmarshallCommandBatchFrame(frame[1:])
+	if err != nil {
+		t.Fatalf("UnmarshallCommandBatchFrame() unexpected error: %v", err)
+	}
+	for i := range ids {
+		if decodedIDs[i] != ids[i] || cmds[i] != *cmd {
+			t.Fatalf("entry %d = %d %+v, want %d %+v", i, decodedIDs[i], cmds[i], ids[i], *cmd)
+		}
+	}
+
+	scratch := make([]byte, 0, len(frame))
+	allocs := testing.AllocsPerRun(100, func() {
+		scratch, _ = AppendCommandBatchFrame(scratch[:0], ids, cmd)
+	})
+	if allocs != 0 {
+		t.Errorf("AppendCommandBatchFrame() allocates %.0f times, want 0", allocs)
+	}
+
+	if _, err := AppendCommandBatchFrame(nil, make([]uint32, MaxCommandBatchCommands+1), cmd); err == nil {
+		t.Errorf("AppendCommandBatchFrame() expected error for an oversized batch, got nil")
+	}
+}
+
+// TestAppendOvenCommandBatchFrame tests that a command batch frame sends each oven its own command
+func TestAppendOvenCommandBatchFrame(t *testing.T) {
+	ids := []uint32{7, 7, 2}
+	cmds := []CommandPayload{
+		{Action: ActionStart, Temperature: 180, Duration: 60},
+		{Action: ActionStop},
+		{Action: ActionStart, Temperature: -5, Duration: 32767},
+	}
+
+	frame, err := AppendOvenCommandBatchFrame(nil, ids, cmds)
+	if err != nil {
+		t.Fatalf("AppendOvenCommandBatchFrame() unexpected error: %v", err)
+	}
+	decodedIDs, decoded, err := UnmarshallCommandBatchFrame(frame)
+	if err != nil {
+		t.Fatalf("UnmarshallCommandBatchFrame() unexpected error: %v", err)
+	}
+	if !slices.Equal(decodedIDs, ids) || !slices.Equal(decoded, cmds) {
+		t.Errorf("entries = %v %+v, want %v %+v", decodedIDs, decoded, ids, cmds)
+	}
+
+	scratch := make([]byte, 0, len(frame))
+	allocs := testing.AllocsPerRun(100, func() {
+		scratch, _ = AppendOvenCommandBatchFrame(scratch[:0], ids, cmds)
+	})
+	if allocs != 0 {
+		t.Errorf("AppendOvenCommandBatchFrame() allocates %.0f times, want 0", allocs)
+	}
+
+	if _, err := AppendOvenCommandBatchFrame(nil, ids, cmds[:2]); err == nil {
+		t.Errorf("AppendOvenCommandBatchFrame() expected error for missing commands, got nil")
+	}
+}
+
 // TestStateToString tests state code to string conversion
 func TestStateToString(t *testing.T) {
 	tests := []struct {
@@ -445,6 +702,20 @@ func TestStateToString(t *testing.T) {
 	}
 }
 
+// TestStateFromString tests that state names convert back to their codes
+func TestStateFromString(t *testing.T) {
+	for _, state := range []uint8{StateIdle, StatePreheating, StateBaking, StateCoolingDown} {
+		if got, ok := StateFromString(StateToString(state)); !ok || got != state {
+			t.Errorf("StateFromString(%s) = %d, %v", StateToString(state), got, ok)
+		}
+	}
+	for _, name := range []string{"UNKNOWN", "idle", ""} {
+		if _, ok := StateFromString(name); ok {
+			t.Errorf("StateFromString(%q) expected no state", name)
+		}
+	}
+}
+
 // TestActionToString tests action code to string conversion
 func TestActionToString(t *testing.T) {
 	tests := []struct {
@@ -468,3 +739,103 @@ func TestActionToString(t *testing.T) {
 		})
 	}
 }
+
+// Batch sizes of the benchmarks, as those of koven_microbench in the emulator
+var benchmarkBatchSizes = []int{1, 16, 256, 4096}
+
+// benchmarkEvents returns n events spread over every state, keyed by oven ids 0 to n-1
+func benchmarkEvents(n int) []EventPayload {
+	events := make([]EventPayload, n)
+	for i := range events {
+		events[i] = EventPayload{
+			OvenID:                uint32(i),
+			State:                 uint8(i % 4),
+			CurrentTemperature:    int16(25 + i%200),
+			RemainingTime:         int16(i % 3600),
+			ProgrammedDuration:    3600,
+			ProgrammedTemperature: int16(150 + i%100),
+		}
+	}
+	return events
+}
+
+// appendEventFrame appends the event frame of an event to dst, as the emulator encodes it
+func appendEventFrame(dst []byte, event *EventPayload) []byte {
+	start := len(dst)
+	dst = append(dst, MessageTypeEvent, eventPayloadSize, 0)
+	dst = append(dst, make([]byte, eventPayloadSize)...)
+	encodeEventPayload(event, dst[start+3:])
+	return binary.LittleEndian.AppendUint16(dst, calculateCRC(dst[start:]))
+}
+
+// crcSink keeps the result of the CRC benchmark live
+var crcSink uint16
+
+// BenchmarkCalculateCRC measures the CRC of one event frame and of event batch frames of each
+// batch size
+func BenchmarkCalculateCRC(b *testing.B) {
+	for _, n := range benchmarkBatchSizes {
+		length := 3 + eventPayloadSize
+		if n > 1 {
+			length = 5 + n*EventBatchEntrySize
+		}
+		data := make([]byte, length)
+		for i := range data {
+			data[i] = byte(i*131 + i>>3)
+		}
+		b.Run(fmt.Sprintf("events=%d", n), func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(length))
+			for i := 0; i < b.N; i++ {
+				crcSink ^= calculateCRC(data)
+			}
+		})
+	}
+}
+
+// BenchmarkUnmarshallEventFrame measures single event frames, with none, one in ten or every
+// frame corrupted
+func BenchmarkUnmarshallEventFrame(b *testing.B) {
+	events := benchmarkEvents(256)
+	for _, corruptEvery := range []int{0, 10, 1} {
+		frames := make([][]byte, len(events))
+		for i := range events {
+			frames[i] = appendEventFrame(nil, &events[i])
+			if corruptEvery > 0 && i%corruptEvery == 0 {
+				frames[i][len(frames[i])-1] ^= 0xFF
+			}
+		}
+		name := "mix=valid"
+		if corruptEvery > 0 {
+			name = fmt.Sprintf("mix=corrupt1in%d", corruptEvery)
+		}
+		b.Run(name, func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(len(frames[0])))
+			for i := 0; i < b.N; i++ {
+				UnmarshallEventFrame(frames[i%len(frames)])
+			}
+		})
+	}
+}
+
+// BenchmarkUnmarshallEventBatchFrame measures event batch frames of each batch size; ns/event
+// compares them with single frames
+func BenchmarkUnmarshallEventBatchFrame(b *testing.B) {
+	for _, n := range benchmarkBatchSizes {
+		frame, err := MarshallEventBatchFrame(benchmarkEvents(n))
+		if err != nil {
+			b.Fatalf("MarshallEventBatchFrame() unexpected error: %v", err)
+		}
+		b.Run(fmt.Sprintf("events=%d", n), func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(len(frame)))
+			for i := 0; i < b.N; i++ {
+				if _, err := UnmarshallEventBatchFrame(frame); err != nil {
+					b.Fatal(err)
+				}
+			}
+			b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*n), "ns/event")
+		})
+	}
+}
@@ -0,0 +1,297 @@
+// Package schema reads the message schema of the emulator (koven/messages.def) and generates
+// the Go codecs of its messages, so that the wire layout is defined once for both sides
+package schema
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"go/format"
+	"io"
+	"regexp"
+	"strings"
+)
+
+// WireType is the encoding of a field on the wire, always little-endian
+type WireType struct {
+	Size   int
+	GoType string
+	bits   int
+	signed bool
+}
+
+// WireTypes are the wire types a schema field may use, by name
+var WireTypes = map[string]WireType{
+	"U8":  {Size: 1, GoType: "uint8", bits: 8},
+	"U16": {Size: 2, GoType: "uint16", bits: 16},
+	"I16": {Size: 2, GoType: "int16", bits: 16, signed: true},
+	"U32": {Size: 4, GoType: "uint32", bits: 32},
+	"I32": {Size: 4, GoType: "int32", bits: 32, signed: true},
+}
+
+// maxFields is the number of fields a field mask holds
+const maxFields = 8
+
+// Field is one field of a message, in wire order
+type Field struct {
+	Name string
+	Wire string
+}
+
+// GoName returns the Go name of the field: current_temperature becomes CurrentTemperature
+func (f Field) GoName() string {
+	return goName(f.Name)
+}
+
+// Message is a fixed-size message of the schema
+type Message struct {
+	Type   string
+	Prefix string
+	Fields []Field
+}
+
+// Size returns the size of the message on the wire
+func (m *Message) Size() int {
+	size := 0
+	for _, field := range m.Fields {
+		size += WireTypes[field.Wire].Size
+	}
+	return size
+}
+
+var (
+	messagePattern    = regexp.MustCompile(`^MESSAGE\(\s*(\w+)\s*,\s*(\w+)\s*\)$`)
+	fieldPattern      = regexp.MustCompile(`^FIELD\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(\w+)\s*\)$`)
+	endMessagePattern = regexp.MustCompile(`^END_MESSAGE\(\s*(\w+)\s*,\s*(\w+)\s*\)$`)
+)
+
+// Parse reads a schema in the format of koven/messages.def
+// Blank lines and // comments are ignored; every other line is a MESSAGE, FIELD or END_MESSAGE
+// entry
+func Parse(r io.Reader) ([]Message, error) {
+	var messages []Message
+	var current *Message
+
+	scanner := bufio.NewScanner(r)
+	for line := 1; scanner.Scan(); line++ {
+		text := strings.TrimSpace(scanner.Text())
+		if text == "" || strings.HasPrefix(text, "//") {
+			continue
+		}
+
+		if match := messagePattern.FindStringSubmatch(text); match != nil {
+			if current != nil {
+				return nil, fmt.Errorf("line %d: message %s opened inside %s", line, match[1], current.Type)
+			}
+			current = &Message{Type: match[1], Prefix: match[2]}
+			continue
+		}
+
+		if match := fieldPattern.FindStringSubmatch(text); match != nil {
+			if current == nil || match[1] != current.Prefix {
+				return nil, fmt.Errorf("line %d: field %s outside of message %s", line, match[2], match[1])
+			}
+			if _, ok := WireTypes[match[3]]; !ok {
+				return nil, fmt.Errorf("line %d: unknown wire type %s", line, match[3])
+			}
+			for _, field := range current.Fields {
+				if field.Name == match[2] {
+					return nil, fmt.Errorf("line %d: duplicate field %s", line, match[2])
+				}
+			}
+			current.Fields = append(current.Fields, Field{Name: match[2], Wire: match[3]})
+			continue
+		}
+
+		if match := endMessagePattern.FindStringSubmatch(text); match != nil {
+			if current == nil || match[1] != current.Type || match[2] != current.Prefix {
+				return nil, fmt.Errorf("line %d: END_MESSAGE(%s, %s) does not close a message", line, match[1], match[2])
+			}
+			if len(current.Fields) == 0 || len(current.Fields) > maxFields {
+				return nil, fmt.Errorf("line %d: message %s has %d fields (1 to %d)", line, current.Type, len(current.Fields), maxFields)
+			}
+			messages = append(messages, *current)
+			current = nil
+			continue
+		}
+
+		return nil, fmt.Errorf("line %d: unexpected %q", line, text)
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, err
+	}
+	if current != nil {
+		return nil, fmt.Errorf("message %s is not closed", current.Type)
+	}
+
+	return messages, nil
+}
+
+// GenerateGo returns the formatted source of the Go codecs of messages, in package pkg
+// Each message must have a hand-written Go struct of the same type name, with an exported field
+// for every schema field (CurrentTemperature for current_temperature); other struct fields, such
+// as those that only exist on the platform side, are left alone
+func GenerateGo(pkg, source string, messages []Message) ([]byte, error) {
+	var b bytes.Buffer
+
+	fmt.Fprintf(&b, "// Code generated by koven-schemagen from %s. DO NOT EDIT.\n\n", source)
+	fmt.Fprintf(&b, "package %s\n\n", pkg)
+	fmt.Fprintf(&b, "import \"encoding/binary\"\n\n")
+
+	fmt.Fprintf(&b, "// Payload sizes on the wire\n")
+	fmt.Fprintf(&b, "const (\n")
+	for i := range messages {
+		fmt.Fprintf(&b, "\t%sSize = %d\n", lowerFirst(messages[i].Type), messages[i].Size())
+	}
+	fmt.Fprintf(&b, ")\n")
+
+	for i := range messages {
+		generateMessage(&b, &messages[i])
+	}
+
+	return format.Source(b.Bytes())
+}
+
+// generateMessage writes the field bits and the codecs of one message
+func generateMessage(b *bytes.Buffer, m *Message) {
+	name := lowerFirst(m.Type)
+
+	fmt.Fprintf(b, "\n// Field bits of %s masks, in wire order\n", m.Type)
+	fmt.Fprintf(b, "const (\n")
+	for i, field := range m.Fields {
+		if i == 0 {
+			fmt.Fprintf(b, "\t%sField%s uint8 = 1 << iota\n", name, field.GoName())
+		} else {
+			fmt.Fprintf(b, "\t%sField%s\n", name, field.GoName())
+		}
+	}
+	fmt.Fprintf(b, "\n\t%sFieldsAll uint8 = 1<<%d - 1\n", name, len(m.Fields))
+	fmt.Fprintf(b, ")\n")
+
+	fmt.Fprintf(b, "\n// encode%s writes the %d payload bytes of m to b\n", m.Type, m.Size())
+	fmt.Fprintf(b, "func encode%s(m *%s, b []byte) {\n", m.Type, m.Type)
+	fmt.Fprintf(b, "\t_ = b[%d]\n", m.Size()-1)
+	offset := 0
+	for _, field := range m.Fields {
+		fmt.Fprintf(b, "\t%s\n", store(field, fmt.Sprintf("b[%d:]", offset), "m."+field.GoName()))
+		offset += WireTypes[field.Wire].Size
+	}
+	fmt.Fprintf(b, "}\n")
+
+	fmt.Fprintf(b, "\n// decode%s reads the %d payload bytes of b into m\n", m.Type, m.Size())
+	fmt.Fprintf(b, "func decode%s(b []byte, m *%s) {\n", m.Type, m.Type)
+	fmt.Fprintf(b, "\t_ = b[%d]\n", m.Size()-1)
+	offset = 0
+	for _, field := range m.Fields {
+		fmt.Fprintf(b, "\tm.%s = %s\n", field.GoName(), load(field, fmt.Sprintf("b[%d:]", offset)))
+		offset += WireTypes[field.Wire].Size
+	}
+	fmt.Fprintf(b, "}\n")
+
+	fmt.Fprintf(b, "\n// %sFieldsSize returns the size of the fields selected by fields\n", name)
+	fmt.Fprintf(b, "func %sFieldsSize(fields uint8) int {\n", name)
+	fmt.Fprintf(b, "\tsize := 0\n")
+	for _, field := range m.Fields {
+		fmt.Fprintf(b, "\tif fields&%sField%s != 0 {\n", name, field.GoName())
+		fmt.Fprintf(b, "\t\tsize += %d\n", WireTypes[field.Wire].Size)
+		fmt.Fprintf(b, "\t}\n")
+	}
+	fmt.Fprintf(b, "\treturn size\n")
+	fmt.Fprintf(b, "}\n")
+
+	fmt.Fprintf(b, "\n// encode%sFields writes the fields of m selected by fields to b, in wire order\n", m.Type)
+	fmt.Fprintf(b, "// Returns the number of bytes written\n")
+	fmt.Fprintf(b, "func encode%sFields(m *%s, fields uint8, b []byte) int {\n", m.Type, m.Type)
+	fieldLoop(b, m, name, func(field Field) string { return store(field, "b[n:]", "m."+field.GoName()) })
+	fmt.Fprintf(b, "\treturn n\n")
+	fmt.Fprintf(b, "}\n")
+
+	fmt.Fprintf(b, "\n// decode%sFields reads the fields selected by fields from b into m, in wire order\n", m.Type)
+	fmt.Fprintf(b, "// b must hold %sFieldsSize(fields) bytes. Returns the number of bytes read\n", name)
+	fmt.Fprintf(b, "func decode%sFields(b []byte, fields uint8, m *%s) int {\n", m.Type, m.Type)
+	fieldLoop(b, m, name, func(field Field) string {
+		return fmt.Sprintf("m.%s = %s", field.GoName(), load(field, "b[n:]"))
+	})
+	fmt.Fprintf(b, "\treturn n\n")
+	fmt.Fprintf(b, "}\n")
+
+	fmt.Fprintf(b, "\n// merge%sFields copies the fields selected by fields from src to dst\n", m.Type)
+	fmt.Fprintf(b, "func merge%sFields(dst, src *%s, fields uint8) {\n", m.Type, m.Type)
+	for _, field := range m.Fields {
+		fmt.Fprintf(b, "\tif fields&%sField%s != 0 {\n", name, field.GoName())
+		fmt.Fprintf(b, "\t\tdst.%s = src.%s\n", field.GoName(), field.GoName())
+		fmt.Fprintf(b, "\t}\n")
+	}
+	fmt.Fprintf(b, "}\n")
+
+	fmt.Fprintf(b, "\n// changed%sFields returns the bits of the fields that differ between previous and current\n", m.Type)
+	fmt.Fprintf(b, "func changed%sFields(previous, current *%s) uint8 {\n", m.Type, m.Type)
+	fmt.Fprintf(b, "\tfields := uint8(0)\n")
+	for _, field := range m.Fields {
+		fmt.Fprintf(b, "\tif previous.%s != current.%s {\n", field.GoName(), field.GoName())
+		fmt.Fprintf(b, "\t\tfields |= %sField%s\n", name, field.GoName())
+		fmt.Fprintf(b, "\t}\n")
+	}
+	fmt.Fprintf(b, "\treturn fields\n")
+	fmt.Fprintf(b, "}\n")
+}
+
+// fieldLoop writes the body of a function that handles the fields selected by a mask one after
+// the other, keeping the offset in n
+func fieldLoop(b *bytes.Buffer, m *Message, name string, statement func(Field) string) {
+	fmt.Fprintf(b, "\tn := 0\n")
+	for _, field := range m.Fields {
+		fmt.Fprintf(b, "\tif fields&%sField%s != 0 {\n", name, field.GoName())
+		fmt.Fprintf(b, "\t\t%s\n", statement(field))
+		fmt.Fprintf(b, "\t\tn += %d\n", WireTypes[field.Wire].Size)
+		fmt.Fprintf(b, "\t}\n")
+	}
+}
+
+// store returns the statement that writes value to the slice expression dst
+func store(field Field, dst, value string) string {
+	wire := WireTypes[field.Wire]
+	if wire.bits == 8 {
+		return fmt.Sprintf("%s = %s", strings.TrimSuffix(dst, ":]")+"]", value)
+	}
+	if wire.signed {
+		value = fmt.Sprintf("uint%d(%s)", wire.bits, value)
+	}
+	return fmt.Sprintf("binary.LittleEndian.PutUint%d(%s, %s)", wire.bits, dst, value)
+}
+
+// load returns the expression that reads a field from the slice expression src
+func load(field Field, src string) string {
+	wire := WireTypes[field.Wire]
+	if wire.bits == 8 {
+		return strings.TrimSuffix(src, ":]") + "]"
+	}
+	value := fmt.Sprintf("binary.LittleEndian.Uint%d(%s)", wire.bits, src)
+	if wire.signed {
+		return fmt.Sprintf("%s(%s)", wire.GoType, value)
+	}
+	return value
+}
+
+// goName converts a snake_case schema name to an exported Go name
+func goName(name string) string {
+	var b strings.Builder
+	for _, part := range strings.Split(name, "_") {
+		if part == "" {
+			continue
+		}
+		if part == "id" {
+			b.WriteString("ID")
+			continue
+		}
+		b.WriteString(strings.ToUpper(part[:1]) + part[1:])
+	}
+	return b.String()
+}
+
+func lowerFirst(name string) string {
+	if name == "" {
+		return name
+	}
+	return strings.ToLower(name[:1]) + name[1:]
+}
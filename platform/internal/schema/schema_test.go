@@ -0,0 +1,178 @@
+package schema
+
+import (
+	"bytes"
+	"errors"
+	"io/fs"
+	"os"
+	"strings"
+	"testing"
+)
+
+// Paths of the emulator schema and of the code generated from it, from this package
+// They are missing when the platform is built on its own, as in its Docker image
+const (
+	kovenSchemaPath   = "../../../koven/messages.def"
+	generatedCodePath = "../protocol/messages_gen.go"
+)
+
+const testSchema = `
+// Comments and blank lines are ignored
+
+MESSAGE(SamplePayload, sample_payload)
+FIELD(sample_payload, kind, U8)
+FIELD(sample_payload, oven_id, U32)
+  FIELD(sample_payload, offset, I16)
+END_MESSAGE(SamplePayload, sample_payload)
+`
+
+// readKovenSchema opens the emulator schema, skipping the test when it is not available
+func readKovenSchema(t *testing.T) []byte {
+	t.Helper()
+	data, err := os.ReadFile(kovenSchemaPath)
+	if errors.Is(err, fs.ErrNotExist) {
+		t.Skipf("%s not available", kovenSchemaPath)
+	}
+	if err != nil {
+		t.Fatalf("Failed to read schema: %v", err)
+	}
+	return data
+}
+
+// TestParse tests that messages and fields are read in order
+func TestParse(t *testing.T) {
+	messages, err := Parse(strings.NewReader(testSchema))
+	if err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+
+	if len(messages) != 1 {
+		t.Fatalf("Expected 1 message, got %d", len(messages))
+	}
+	m := messages[0]
+	if m.Type != "SamplePayload" || m.Prefix != "sample_payload" {
+		t.Errorf("Unexpected message %s (%s)", m.Type, m.Prefix)
+	}
+	if m.Size() != 7 {
+		t.Errorf("Expected size 7, got %d", m.Size())
+	}
+
+	expected := []Field{{"kind", "U8"}, {"oven_id", "U32"}, {"offset", "I16"}}
+	if len(m.Fields) != len(expected) {
+		t.Fatalf("Expected %d fields, got %d", len(expected), len(m.Fields))
+	}
+	for i := range expected {
+		if m.Fields[i] != expected[i] {
+			t.Errorf("Field %d: expected %+v, got %+v", i, expected[i], m.Fields[i])
+		}
+	}
+}
+
+// TestParseErrors tests that malformed schemas are rejected
+func TestParseErrors(t *testing.T) {
+	tests := []struct {
+		name   string
+		schema string
+	}{
+		{"unknown wire type", "MESSAGE(A, a)\nFIELD(a, x, F32)\nEND_MESSAGE(A, a)\n"},
+		{"field outside message", "FIELD(a, x, U8)\n"},
+		{"field of another message", "MESSAGE(A, a)\nFIELD(b, x, U8)\nEND_MESSAGE(A, a)\n"},
+		{"duplicate field", "MESSAGE(A, a)\nFIELD(a, x, U8)\nFIELD(a, x, U8)\nEND_MESSAGE(A, a)\n"},
+		{"nested message", "MESSAGE(A, a)\nMESSAGE(B, b)\n"},
+		{"mismatched end", "MESSAGE(A, a)\nFIELD(a, x, U8)\nEND_MESSAGE(B, b)\n"},
+		{"unclosed message", "MESSAGE(A, a)\nFIELD(a, x, U8)\n"},
+		{"empty message", "MESSAGE(A, a)\nEND_MESSAGE(A, a)\n"},
+		{"too many fields", "MESSAGE(A, a)\n" +
+			"FIELD(a, f0, U8)\nFIELD(a, f1, U8)\nFIELD(a, f2, U8)\nFIELD(a, f3, U8)\n" +
+			"FIELD(a, f4, U8)\nFIELD(a, f5, U8)\nFIELD(a, f6, U8)\nFIELD(a, f7, U8)\n" +
+			"FIELD(a, f8, U8)\nEND_MESSAGE(A, a)\n"},
+		{"garbage", "typedef struct {\n"},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if _, err := Parse(strings.NewReader(tt.schema)); err == nil {
+				t.Error("Expected an error")
+			}
+		})
+	}
+}
+
+// TestGoName tests the conversion of schema names to Go names
+func TestGoName(t *testing.T) {
+	tests := map[string]string{
+		"state":               "State",
+		"current_temperature": "CurrentTemperature",
+		"oven_id":             "OvenID",
+	}
+	for name, expected := range tests {
+		if got := goName(name); got != expected {
+			t.Errorf("goName(%q): expected %q, got %q", name, expected, got)
+		}
+	}
+}
+
+// TestGenerateGo tests that the generated code is valid Go with the expected codecs
+func TestGenerateGo(t *testing.T) {
+	messages, err := Parse(strings.NewReader(testSchema))
+	if err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+
+	source, err := GenerateGo("sample", "sample.def", messages)
+	if err != nil {
+		t.Fatalf("GenerateGo failed: %v", err)
+	}
+
+	for _, expected := range []string{
+		"// Code generated by koven-schemagen from sample.def. DO NOT EDIT.",
+		"samplePayloadSize = 7",
+		"func encodeSamplePayload(m *SamplePayload, b []byte)",
+		"binary.LittleEndian.PutUint32(b[1:], m.OvenID)",
+		"m.Offset = int16(binary.LittleEndian.Uint16(b[5:]))",
+		"samplePayloadFieldsAll uint8 = 1<<3 - 1",
+	} {
+		if !bytes.Contains(source, []byte(expected)) {
+			t.Errorf("Generated code lacks %q", expected)
+		}
+	}
+}
+
+// TestKovenSchema tests the schema of the emulator against the sizes of its C structs
+func TestKovenSchema(t *testing.T) {
+	messages, err := Parse(bytes.NewReader(readKovenSchema(t)))
+	if err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+
+	sizes := map[string]int{"CommandPayload": 5, "EventPayload": 9}
+	if len(messages) != len(sizes) {
+		t.Fatalf("Expected %d messages, got %d", len(sizes), len(messages))
+	}
+	for i := range messages {
+		if messages[i].Size() != sizes[messages[i].Type] {
+			t.Errorf("%s: expected size %d, got %d", messages[i].Type, sizes[messages[i].Type], messages[i].Size())
+		}
+	}
+}
+
+// TestGeneratedCodeUpToDate tests that the committed protocol codecs match the schema
+func TestGeneratedCodeUpToDate(t *testing.T) {
+	messages, err := Parse(bytes.NewReader(readKovenSchema(t)))
+	if err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+
+	expected, err := GenerateGo("protocol", "koven/messages.def", messages)
+	if err != nil {
+		t.Fatalf("GenerateGo failed: %v", err)
+	}
+
+	actual, err := os.ReadFile(generatedCodePath)
+	if err != nil {
+		t.Fatalf("Failed to read generated code: %v", err)
+	}
+	if !bytes.Equal(expected, actual) {
+		t.Errorf("%s is out of date, run go generate ./internal/protocol", generatedCodePath)
+	}
+}
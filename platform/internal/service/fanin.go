@@ -0,0 +1,73 @@
+package service
+
+import (
+	"sync"
+	"time"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+const (
+	// Time events are gathered before the hub broadcasts them
+	flushInterval = 25 * time.Millisecond
+
+	// Events gathered before the fan-in keeps only the latest one of each oven
+	fanInLimit = 4096
+)
+
+// queuedEvent is an event waiting for the broadcast loop, with the time it was received
+type queuedEvent struct {
+	event    protocol.EventPayload
+	received time.Time
+}
+
+// fanIn gathers the events received between two flushes of the hub
+// Below fanInLimit every event is kept; past it, an event replaces the waiting one of its oven,
+// so that the batch is bounded by the number of ovens rather than by the event rate
+type fanIn struct {
+	mu      sync.Mutex
+	events  []queuedEvent
+	latest  map[uint32]int
+	spare   []queuedEvent
+	limit   int
+	pending bool
+}
+
+func newFanIn(limit int) *fanIn {
+	return &fanIn{
+		events: make([]queuedEvent, 0, 256),
+		latest: make(map[uint32]int),
+		limit:  limit,
+	}
+}
+
+// add adds an event to the batch
+// Returns whether it replaced a waiting event of its oven, and whether the batch was empty
+func (f *fanIn) add(event *protocol.EventPayload, received time.Time) (conflated, first bool) {
+	f.mu.Lock()
+	defer f.mu.Unlock()
+
+	first = !f.pending
+	f.pending = true
+	if i, ok := f.latest[event.OvenID]; ok && len(f.events) >= f.limit {
+		f.events[i].event = *event
+		return true, first
+	}
+	f.latest[event.OvenID] = len(f.events)
+	f.events = append(f.events, queuedEvent{event: *event, received: received})
+	return false, first
+}
+
+// drain returns the waiting events, in the order they were received, and starts a new batch
+// The returned slice is only valid until the next drain
+func (f *fanIn) drain() []queuedEvent {
+	f.mu.Lock()
+	defer f.mu.Unlock()
+
+	events := f.events
+	f.events = f.spare[:0]
+	f.spare = events
+	clear(f.latest)
+	f.pending = false
+	return events
+}
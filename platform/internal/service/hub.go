@@ -1,17 +1,21 @@
 package service
 
 import (
-	"encoding/json"
-	"fmt"
 	"log"
-	"sync"
+	"strconv"
+	"sync/atomic"
+	"time"
 
+	"github.com/dropkitchen/koven-platform/platform/internal/metrics"
 	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+	"github.com/gorilla/websocket"
 )
 
 // EventMessage represents a JSON-formatted event message sent to WebSocket clients
+// The hub serializes it with appendEventMessage, which produces the same JSON as json.Marshal
 type EventMessage struct {
 	Type                  string `json:"type"`
+	OvenID                uint32 `json:"oven_id"`
 	State                 string `json:"state"`
 	CurrentTemperature    string `json:"current_temperature"`
 	RemainingTime         string `json:"remaining_time"`
@@ -19,13 +23,56 @@ type EventMessage struct {
 	ProgrammedTemperature string `json:"programmed_temperature"`
 }
 
+// wireMessage is an event serialized once and shared by every client it is sent to
+// The prepared message caches the WebSocket frame, so that it is only built once too
+type wireMessage struct {
+	ovenID   uint32
+	data     []byte
+	prepared *websocket.PreparedMessage
+}
+
+// backlog holds the messages of a client whose send buffer is full, conflated to the latest
+// message of each oven: a lagging client catches up with a snapshot of its ovens rather than
+// with every event it missed
+type backlog struct {
+	order    []uint32
+	messages map[uint32]*wireMessage
+}
+
+// hubMetrics instruments the broadcast loop, with the same bucket layout as the emulator
+type hubMetrics struct {
+	received         *metrics.Counter
+	conflated        *metrics.Counter
+	broadcasts       *metrics.Counter
+	clientsConflated *metrics.Counter
+	queue            *metrics.Histogram
+	fanOut           *metrics.Histogram
+}
+
 // Hub maintains the set of active WebSocket clients and broadcasts messages to them
+// The client sets are only touched by the goroutine running Run, so they take no lock
 type Hub struct {
 	// Registered clients
 	clients map[*Client]bool
 
-	// Inbound messages from MQTT to broadcast to clients
-	broadcast chan *protocol.EventPayload
+	// Clients watching every oven, and those watching some ovens, by oven id
+	watchAll map[*Client]struct{}
+	watchers map[uint32]map[*Client]struct{}
+
+	// Clients whose send buffer is full, with the messages they are behind on
+	lagging map[*Client]*backlog
+
+	// Number of registered clients, readable from any goroutine
+	clientCount atomic.Int64
+
+	// Latest state of every oven, sent to new clients and served by the snapshot endpoint
+	states stateCache
+
+	// Inbound events from MQTT, gathered until the next flush
+	events *fanIn
+
+	// Signals the first event of a batch, which starts the flush interval
+	broadcast chan struct{}
 
 	// Register requests from clients
 	register chan *Client
@@ -39,93 +86,255 @@ type Hub struct {
 	// Done channel to signal shutdown completion
 	done chan struct{}
 
-	// Mutex for thread-safe operations
-	mu sync.RWMutex
+	// Serialization buffer, reused by every broadcast
+	scratch []byte
+
+	metrics hubMetrics
 }
 
-// NewHub creates a new WebSocket hub
+// NewHub creates a new WebSocket hub, with metrics of its own
 func NewHub() *Hub {
-	return &Hub{
+	return NewHubWithMetrics(metrics.NewRegistry())
+}
+
+// NewHubWithMetrics creates a new WebSocket hub whose metrics are added to registry
+func NewHubWithMetrics(registry *metrics.Registry) *Hub {
+	h := &Hub{
 		clients:    make(map[*Client]bool),
-		broadcast:  make(chan *protocol.EventPayload, 256),
+		watchAll:   make(map[*Client]struct{}),
+		watchers:   make(map[uint32]map[*Client]struct{}),
+		lagging:    make(map[*Client]*backlog),
+		events:     newFanIn(fanInLimit),
+		broadcast:  make(chan struct{}, 1),
 		register:   make(chan *Client),
 		unregister: make(chan *Client),
 		shutdown:   make(chan struct{}),
 		done:       make(chan struct{}),
+		scratch:    make([]byte, 0, 256),
+	}
+	h.metrics = hubMetrics{
+		received:         registry.NewCounter("koven_platform_events_received_total", "Events handed to the hub"),
+		conflated:        registry.NewCounter("koven_platform_events_conflated_total", "Events replaced by a later one of their oven before a flush"),
+		broadcasts:       registry.NewCounter("koven_platform_broadcasts_total", "Events broadcast to the WebSocket clients"),
+		clientsConflated: registry.NewCounter("koven_platform_websocket_messages_conflated_total", "Messages replaced by a later one of their oven for a lagging client"),
+		queue:            registry.NewHistogram("koven_platform_broadcast_queue_seconds", "From an event reaching the hub to its broadcast"),
+		fanOut:           registry.NewHistogram("koven_platform_broadcast_seconds", "Encoding and fan-out of the events of one flush"),
 	}
+	registry.NewGaugeFunc("koven_platform_websocket_clients", "Connected WebSocket clients", func() int64 {
+		return int64(h.GetClientCount())
+	})
+	registry.NewGaugeFunc("koven_platform_ovens", "Ovens whose latest state is known", func() int64 {
+		return int64(h.states.size())
+	})
+	return h
 }
 
 // Run starts the hub's main loop
 func (h *Hub) Run() {
 	defer close(h.done)
 
+	// Armed by the first event of a batch, and kept armed while clients are lagging
+	flush := time.NewTimer(flushInterval)
+	flush.Stop()
+	defer flush.Stop()
+	armed := false
+	arm := func() {
+		if !armed {
+			flush.Reset(flushInterval)
+			armed = true
+		}
+	}
+
 	for {
 		select {
 		case <-h.shutdown:
-			h.mu.Lock()
 			for client := range h.clients {
-				close(client.send)
-				delete(h.clients, client)
+				h.removeClient(client)
 			}
-			h.mu.Unlock()
 			log.Printf("WebSocket hub shut down, all clients disconnected")
 			return
 
 		case client := <-h.register:
-			h.mu.Lock()
-			h.clients[client] = true
-			h.mu.Unlock()
+			h.addClient(client)
+			h.sendSnapshot(client)
+			if len(h.lagging) > 0 {
+				arm()
+			}
 			log.Printf("WebSocket client connected (total: %d)", len(h.clients))
 
 		case client := <-h.unregister:
-			h.mu.Lock()
-			if _, ok := h.clients[client]; ok {
-				delete(h.clients, client)
-				close(client.send)
+			if h.clients[client] {
+				h.removeClient(client)
 				log.Printf("WebSocket client disconnected (total: %d)", len(h.clients))
 			}
-			h.mu.Unlock()
-
-		case event := <-h.broadcast:
-			// Convert protocol event to JSON message
-			message := &EventMessage{
-				Type:                  "event",
-				State:                 protocol.StateToString(event.State),
-				CurrentTemperature:    formatTemperature(event.CurrentTemperature),
-				RemainingTime:         formatTime(event.RemainingTime),
-				ProgrammedDuration:    formatProgrammedTime(event.ProgrammedDuration),
-				ProgrammedTemperature: formatProgrammedTemperature(event.ProgrammedTemperature),
-			}
 
-			jsonData, err := json.Marshal(message)
-			if err != nil {
-				log.Printf("Failed to marshal event to JSON: %v", err)
-				continue
+		case <-h.broadcast:
+			arm()
+
+		case <-flush.C:
+			armed = false
+			h.flush()
+			if len(h.lagging) > 0 {
+				arm()
 			}
+		}
+	}
+}
 
-			// Broadcast to all connected clients
-			h.mu.RLock()
-			for client := range h.clients {
-				select {
-				case client.send <- jsonData:
-				default:
-					// Client's send buffer is full, close it
-					close(client.send)
-					delete(h.clients, client)
-					log.Printf("WebSocket client buffer full, disconnecting")
-				}
+// flush catches lagging clients up, then broadcasts the events gathered since the last flush
+func (h *Hub) flush() {
+	for client, backlog := range h.lagging {
+		h.catchUp(client, backlog)
+	}
+
+	events := h.events.drain()
+	if len(events) == 0 {
+		return
+	}
+	start := time.Now()
+	for i := range events {
+		h.metrics.queue.Observe(start.Sub(events[i].received))
+		h.broadcastEvent(&events[i].event)
+	}
+	h.metrics.broadcasts.Add(uint64(len(events)))
+	h.metrics.fanOut.Since(start)
+}
+
+// addClient registers a client with the ovens it watches
+func (h *Hub) addClient(client *Client) {
+	h.clients[client] = true
+	h.clientCount.Add(1)
+	if client.ovens == nil {
+		h.watchAll[client] = struct{}{}
+		return
+	}
+	for _, id := range client.ovens {
+		watching := h.watchers[id]
+		if watching == nil {
+			watching = make(map[*Client]struct{})
+			h.watchers[id] = watching
+		}
+		watching[client] = struct{}{}
+	}
+}
+
+// sendSnapshot sends a new client the latest state of the ovens it watches, so that it does not
+// wait for their next event; the backlog takes what its buffer does not
+func (h *Hub) sendSnapshot(client *Client) {
+	for _, event := range h.states.snapshot(client.ovens) {
+		if message := h.newWireMessage(event); message != nil {
+			h.send(client, message)
+		}
+	}
+}
+
+// removeClient unregisters a client and closes its send channel
+func (h *Hub) removeClient(client *Client) {
+	delete(h.clients, client)
+	h.clientCount.Add(-1)
+	delete(h.watchAll, client)
+	delete(h.lagging, client)
+	for _, id := range client.ovens {
+		if watching := h.watchers[id]; watching != nil {
+			delete(watching, client)
+			if len(watching) == 0 {
+				delete(h.watchers, id)
 			}
-			h.mu.RUnlock()
 		}
 	}
+	close(client.send)
 }
 
-// BroadcastEvent sends an event to all connected WebSocket clients
-func (h *Hub) BroadcastEvent(event *protocol.EventPayload) {
+// broadcastEvent serializes an event once, if any client watches its oven, and sends the same
+// message to all of them
+func (h *Hub) broadcastEvent(event *protocol.EventPayload) {
+	watching := h.watchers[event.OvenID]
+	if len(h.watchAll) == 0 && len(watching) == 0 {
+		return
+	}
+
+	message := h.newWireMessage(event)
+	if message == nil {
+		return
+	}
+	for client := range h.watchAll {
+		h.send(client, message)
+	}
+	for client := range watching {
+		h.send(client, message)
+	}
+}
+
+// newWireMessage serializes an event, or returns nil when it cannot be prepared
+func (h *Hub) newWireMessage(event *protocol.EventPayload) *wireMessage {
+	h.scratch = appendEventMessage(h.scratch[:0], event)
+	// The prepared message keeps its data, so it gets a copy of the shared buffer
+	data := append([]byte(nil), h.scratch...)
+	prepared, err := websocket.NewPreparedMessage(websocket.TextMessage, data)
+	if err != nil {
+		log.Printf("Failed to prepare event message: %v", err)
+		return nil
+	}
+	return &wireMessage{ovenID: event.OvenID, data: data, prepared: prepared}
+}
+
+// send queues a message for a client, or adds it to the backlog of the client once its buffer
+// is full. Messages of a lagging client all go to its backlog, so that none of its ovens ever
+// gets an older state after a newer one
+func (h *Hub) send(client *Client, message *wireMessage) {
+	if backlog := h.lagging[client]; backlog != nil {
+		h.addToBacklog(backlog, message)
+		return
+	}
 	select {
-	case h.broadcast <- event:
+	case client.send <- message:
 	default:
-		log.Printf("Warning: broadcast channel full, dropping event")
+		backlog := &backlog{messages: make(map[uint32]*wireMessage)}
+		h.addToBacklog(backlog, message)
+		h.lagging[client] = backlog
+		log.Printf("WebSocket client buffer full, conflating its events")
+	}
+}
+
+// addToBacklog adds a message to a backlog, replacing the message of the same oven
+func (h *Hub) addToBacklog(backlog *backlog, message *wireMessage) {
+	if _, ok := backlog.messages[message.ovenID]; ok {
+		h.metrics.clientsConflated.Inc()
+	} else {
+		backlog.order = append(backlog.order, message.ovenID)
+	}
+	backlog.messages[message.ovenID] = message
+}
+
+// catchUp moves as much of the backlog of a client as its send buffer takes
+func (h *Hub) catchUp(client *Client, backlog *backlog) {
+	for sent, id := range backlog.order {
+		select {
+		case client.send <- backlog.messages[id]:
+			delete(backlog.messages, id)
+		default:
+			backlog.order = backlog.order[sent:]
+			return
+		}
+	}
+	delete(h.lagging, client)
+	log.Printf("WebSocket client caught up")
+}
+
+// BroadcastEvent queues an event for the connected WebSocket clients, to be sent with the next
+// flush; it never blocks
+func (h *Hub) BroadcastEvent(event *protocol.EventPayload) {
+	h.metrics.received.Inc()
+	h.states.update(event)
+	conflated, first := h.events.add(event, time.Now())
+	if conflated {
+		h.metrics.conflated.Inc()
+	}
+	if first {
+		select {
+		case h.broadcast <- struct{}{}:
+		default:
+		}
 	}
 }
 
@@ -134,43 +343,62 @@ func (h *Hub) RegisterClient(client *Client) {
 	h.register <- client
 }
 
+// Snapshot returns the latest event of the given ovens, or of every oven when ovens is nil, by
+// oven id; it is safe to call from any goroutine
+func (h *Hub) Snapshot(ovens []uint32) []*protocol.EventPayload {
+	return h.states.snapshot(ovens)
+}
+
 // GetClientCount returns the number of connected WebSocket clients
 func (h *Hub) GetClientCount() int {
-	h.mu.RLock()
-	defer h.mu.RUnlock()
-	return len(h.clients)
+	return int(h.clientCount.Load())
+}
+
+// appendEventMessage appends the JSON of the EventMessage of an event to buf
+// State names and units need no escaping, so the strings are written as they are
+func appendEventMessage(buf []byte, event *protocol.EventPayload) []byte {
+	buf = append(buf, `{"type":"event","oven_id":`...)
+	buf = strconv.AppendUint(buf, uint64(event.OvenID), 10)
+	buf = append(buf, `,"state":"`...)
+	buf = append(buf, protocol.StateToString(event.State)...)
+	buf = append(buf, `","current_temperature":"`...)
+	buf = appendValue(buf, event.CurrentTemperature, "--", "°C")
+	buf = append(buf, `","remaining_time":"`...)
+	buf = appendValue(buf, event.RemainingTime, "--", "s")
+	buf = append(buf, `","programmed_duration":"`...)
+	buf = appendValue(buf, event.ProgrammedDuration, "Not set", "s")
+	buf = append(buf, `","programmed_temperature":"`...)
+	buf = appendValue(buf, event.ProgrammedTemperature, "Not set", "°C")
+	return append(buf, `"}`...)
+}
+
+// appendValue appends a value with its unit, or unset for invalid (negative) values
+func appendValue(buf []byte, value int16, unset, unit string) []byte {
+	if value < 0 {
+		return append(buf, unset...)
+	}
+	buf = strconv.AppendInt(buf, int64(value), 10)
+	return append(buf, unit...)
 }
 
 // formatTemperature formats current temperature, showing "--" for invalid values
 func formatTemperature(temp int16) string {
-	if temp < 0 {
-		return "--"
-	}
-	return fmt.Sprintf("%d°C", temp)
+	return string(appendValue(nil, temp, "--", "°C"))
 }
 
 // formatTime formats remaining time, showing "--" for invalid values
 func formatTime(time int16) string {
-	if time < 0 {
-		return "--"
-	}
-	return fmt.Sprintf("%ds", time)
+	return string(appendValue(nil, time, "--", "s"))
 }
 
 // formatProgrammedTemperature formats programmed temperature, showing "Not set" for invalid values
 func formatProgrammedTemperature(temp int16) string {
-	if temp < 0 {
-		return "Not set"
-	}
-	return fmt.Sprintf("%d°C", temp)
+	return string(appendValue(nil, temp, "Not set", "°C"))
 }
 
 // formatProgrammedTime formats programmed duration, showing "Not set" for invalid values
 func formatProgrammedTime(time int16) string {
-	if time < 0 {
-		return "Not set"
-	}
-	return fmt.Sprintf("%ds", time)
+	return string(appendValue(nil, time, "Not set", "s"))
 }
 
 // Close gracefully shuts down the hub and all connected clients
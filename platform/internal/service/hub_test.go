@@ -1,7 +1,9 @@
 package service
 
 import (
+	"bytes"
 	"encoding/json"
+	"fmt"
 	"testing"
 	"time"
 
@@ -41,11 +43,11 @@ func TestHubBroadcastEvent(t *testing.T) {
 	// Create mock clients
 	client1 := &Client{
 		hub:  hub,
-		send: make(chan []byte, 256),
+		send: make(chan *wireMessage, 256),
 	}
 	client2 := &Client{
 		hub:  hub,
-		send: make(chan []byte, 256),
+		send: make(chan *wireMessage, 256),
 	}
 
 	// Register clients
@@ -102,7 +104,7 @@ func TestHubRegisterUnregisterClient(t *testing.T) {
 
 	client := &Client{
 		hub:  hub,
-		send: make(chan []byte, 256),
+		send: make(chan *wireMessage, 256),
 	}
 
 	// Register client
@@ -144,7 +146,7 @@ func TestHubMultipleClientsRegistration(t *testing.T) {
 	for i := 0; i < numClients; i++ {
 		clients[i] = &Client{
 			hub:  hub,
-			send: make(chan []byte, 256),
+			send: make(chan *wireMessage, 256),
 		}
 		hub.RegisterClient(clients[i])
 	}
@@ -179,7 +181,7 @@ func TestHubBroadcastToMultipleClients(t *testing.T) {
 	for i := 0; i < numClients; i++ {
 		clients[i] = &Client{
 			hub:  hub,
-			send: make(chan []byte, 256),
+			send: make(chan *wireMessage, 256),
 		}
 		hub.RegisterClient(clients[i])
 	}
@@ -226,40 +228,258 @@ func TestHubBroadcastToMultipleClients(t *testing.T) {
 	}
 }
 
-// TestHubClientBufferFull tests behavior when client buffer is full
+// TestHubClientBufferFull tests that a client with a full buffer catches up with the latest state
 func TestHubClientBufferFull(t *testing.T) {
 	hub := NewHub()
 	go hub.Run()
+	defer hub.Close()
 
 	// Create client with small buffer
 	client := &Client{
 		hub:  hub,
-		send: make(chan []byte, 1),
+		send: make(chan *wireMessage, 1),
 	}
 
 	hub.RegisterClient(client)
 	time.Sleep(10 * time.Millisecond)
 
-	// Fill the buffer
-	event := &protocol.EventPayload{
-		State:                 protocol.StateIdle,
-		CurrentTemperature:    25,
-		RemainingTime:         0,
-		ProgrammedDuration:    0,
-		ProgrammedTemperature: 0,
+	// Send enough events to overflow the buffer, in one flush and over several
+	for i := 0; i < 5; i++ {
+		hub.BroadcastEvent(&protocol.EventPayload{State: protocol.StateBaking, CurrentTemperature: int16(100 + i)})
+		if i >= 2 {
+			time.Sleep(2 * flushInterval)
+		}
 	}
+	time.Sleep(2 * flushInterval)
 
-	// Send enough events to overflow the buffer
-	for i := 0; i < 5; i++ {
-		hub.BroadcastEvent(event)
-		time.Sleep(5 * time.Millisecond)
+	// The client stays connected, with the first event, then the latest one
+	if hub.GetClientCount() != 1 {
+		t.Error("Client with full buffer should stay connected")
+	}
+	for _, want := range []string{"100°C", "104°C"} {
+		select {
+		case msg := <-client.send:
+			var got EventMessage
+			if err := json.Unmarshal(msg.data, &got); err != nil {
+				t.Fatalf("Failed to unmarshal event message: %v", err)
+			}
+			if got.CurrentTemperature != want {
+				t.Errorf("CurrentTemperature = %s, want %s", got.CurrentTemperature, want)
+			}
+		case <-time.After(10 * flushInterval):
+			t.Fatalf("Timeout waiting for %s", want)
+		}
 	}
 
-	time.Sleep(50 * time.Millisecond)
+	select {
+	case msg := <-client.send:
+		t.Errorf("Unexpected message after catching up: %s", msg.data)
+	case <-time.After(3 * flushInterval):
+	}
+
+	if got := hub.metrics.received.Value(); got != 5 {
+		t.Errorf("Events received = %d, want 5", got)
+	}
+	if got := hub.metrics.broadcasts.Value(); got != 5 {
+		t.Errorf("Events broadcast = %d, want 5", got)
+	}
+	if got := hub.metrics.clientsConflated.Value(); got != 3 {
+		t.Errorf("Messages conflated = %d, want 3", got)
+	}
+}
+
+// TestHubSendsLatestStateOnRegister tests that a new client gets the cached state of its ovens
+func TestHubSendsLatestStateOnRegister(t *testing.T) {
+	hub := NewHub()
+	go hub.Run()
+	defer hub.Close()
+
+	for oven := uint32(0); oven < 4; oven++ {
+		hub.BroadcastEvent(&protocol.EventPayload{OvenID: oven, State: protocol.StateBaking, CurrentTemperature: 150})
+		hub.BroadcastEvent(&protocol.EventPayload{OvenID: oven, State: protocol.StateBaking, CurrentTemperature: int16(160 + oven)})
+	}
+	time.Sleep(2 * flushInterval)
+
+	// A buffer of two takes part of the snapshot, the backlog the rest
+	client := &Client{hub: hub, send: make(chan *wireMessage, 2), ovens: []uint32{3, 1, 2}}
+	hub.RegisterClient(client)
+
+	want := []string{"161°C", "162°C", "163°C"}
+	for i := range want {
+		select {
+		case msg := <-client.send:
+			var got EventMessage
+			if err := json.Unmarshal(msg.data, &got); err != nil {
+				t.Fatalf("Failed to unmarshal event message: %v", err)
+			}
+			if got.CurrentTemperature != want[i] || got.OvenID != uint32(i+1) {
+				t.Errorf("Message %d = %+v, want oven %d at %s", i, got, i+1, want[i])
+			}
+		case <-time.After(10 * flushInterval):
+			t.Fatalf("Timeout waiting for the state of oven %d", i+1)
+		}
+	}
+
+	if events := hub.Snapshot(nil); len(events) != 4 || events[3].CurrentTemperature != 163 {
+		t.Errorf("Snapshot(nil) = %d events", len(events))
+	}
+}
+
+// TestFanInConflation tests that the fan-in keeps every event below its limit, and the latest
+// one of each oven past it
+func TestFanInConflation(t *testing.T) {
+	f := newFanIn(3)
+	now := time.Now()
+	add := func(oven uint32, temp int16) (bool, bool) {
+		return f.add(&protocol.EventPayload{OvenID: oven, CurrentTemperature: temp}, now)
+	}
+
+	if conflated, first := add(1, 10); conflated || !first {
+		t.Errorf("add() = %v, %v, want false, true", conflated, first)
+	}
+	add(1, 11)
+	add(2, 20)
+	if conflated, first := add(1, 12); !conflated || first {
+		t.Errorf("add() past the limit = %v, %v, want true, false", conflated, first)
+	}
+	if conflated, _ := add(3, 30); conflated {
+		t.Error("add() of a new oven should not conflate")
+	}
+
+	var temps []int16
+	for _, queued := range f.drain() {
+		temps = append(temps, queued.event.CurrentTemperature)
+	}
+	want := []int16{10, 12, 20, 30}
+	if len(temps) != len(want) {
+		t.Fatalf("drain() = %v, want %v", temps, want)
+	}
+	for i := range want {
+		if temps[i] != want[i] {
+			t.Errorf("drain() = %v, want %v", temps, want)
+			break
+		}
+	}
 
-	// Client should have been removed due to full buffer
-	if hub.GetClientCount() > 1 {
-		t.Error("Client with full buffer should have been removed")
+	if len(f.drain()) != 0 {
+		t.Error("drain() should start a new batch")
+	}
+	if _, first := add(1, 13); !first {
+		t.Error("add() after drain() should start a batch")
+	}
+}
+
+// TestWriteBatchMessage tests the batch message of coalesced frames
+func TestWriteBatchMessage(t *testing.T) {
+	batch := []*wireMessage{
+		{data: appendEventMessage(nil, &protocol.EventPayload{OvenID: 1, CurrentTemperature: 50})},
+		{data: appendEventMessage(nil, &protocol.EventPayload{OvenID: 2, CurrentTemperature: 60})},
+	}
+
+	var b bytes.Buffer
+	if err := writeBatchMessage(&b, batch); err != nil {
+		t.Fatalf("writeBatchMessage() error = %v", err)
+	}
+
+	var got struct {
+		Type   string         `json:"type"`
+		Events []EventMessage `json:"events"`
+	}
+	if err := json.Unmarshal(b.Bytes(), &got); err != nil {
+		t.Fatalf("Batch message is not JSON: %v (%s)", err, b.String())
+	}
+	if got.Type != "batch" || len(got.Events) != 2 || got.Events[1].OvenID != 2 ||
+		got.Events[1].CurrentTemperature != "60°C" {
+		t.Errorf("Batch message = %+v", got)
+	}
+}
+
+// TestHubOvenSubscriptions tests that clients only get the ovens they watch, all sharing one message
+func TestHubOvenSubscriptions(t *testing.T) {
+	hub := NewHub()
+	go hub.Run()
+	defer hub.Close()
+
+	all := &Client{hub: hub, send: make(chan *wireMessage, 256)}
+	seven := &Client{hub: hub, send: make(chan *wireMessage, 256), ovens: []uint32{7, 9}}
+	eight := &Client{hub: hub, send: make(chan *wireMessage, 256), ovens: []uint32{8}}
+	hub.RegisterClient(all)
+	hub.RegisterClient(seven)
+	hub.RegisterClient(eight)
+
+	hub.BroadcastEvent(&protocol.EventPayload{OvenID: 7, State: protocol.StateBaking, CurrentTemperature: 180})
+	hub.BroadcastEvent(&protocol.EventPayload{OvenID: 3, State: protocol.StateIdle, CurrentTemperature: 25})
+
+	var shared *wireMessage
+	for _, client := range []*Client{all, seven} {
+		select {
+		case msg := <-client.send:
+			verifyEventMessage(t, msg, &EventMessage{
+				Type:                  "event",
+				OvenID:                7,
+				State:                 "BAKING",
+				CurrentTemperature:    "180°C",
+				RemainingTime:         "0s",
+				ProgrammedDuration:    "0s",
+				ProgrammedTemperature: "0°C",
+			})
+			if shared != nil && msg != shared {
+				t.Error("Clients should share the serialized message")
+			}
+			shared = msg
+		case <-time.After(100 * time.Millisecond):
+			t.Fatal("Timeout waiting for message of oven 7")
+		}
+	}
+
+	select {
+	case msg := <-all.send:
+		verifyEventMessage(t, msg, &EventMessage{
+			Type:                  "event",
+			OvenID:                3,
+			State:                 "IDLE",
+			CurrentTemperature:    "25°C",
+			RemainingTime:         "0s",
+			ProgrammedDuration:    "0s",
+			ProgrammedTemperature: "0°C",
+		})
+	case <-time.After(100 * time.Millisecond):
+		t.Fatal("Timeout waiting for message of oven 3")
+	}
+
+	time.Sleep(10 * time.Millisecond)
+	if len(seven.send) != 0 || len(eight.send) != 0 {
+		t.Error("Clients should not get events of ovens they do not watch")
+	}
+}
+
+// TestAppendEventMessage tests that the hub serializes events as json.Marshal does
+func TestAppendEventMessage(t *testing.T) {
+	events := []protocol.EventPayload{
+		{State: protocol.StateIdle, CurrentTemperature: 25},
+		{OvenID: 4294967295, State: protocol.StateBaking, CurrentTemperature: 32767, RemainingTime: 1,
+			ProgrammedDuration: 3600, ProgrammedTemperature: 220},
+		{OvenID: 12, State: protocol.StateCoolingDown, CurrentTemperature: 80, RemainingTime: -1,
+			ProgrammedDuration: -1, ProgrammedTemperature: -1},
+		{State: 99, CurrentTemperature: -32768},
+	}
+
+	for _, event := range events {
+		want, err := json.Marshal(&EventMessage{
+			Type:                  "event",
+			OvenID:                event.OvenID,
+			State:                 protocol.StateToString(event.State),
+			CurrentTemperature:    formatTemperature(event.CurrentTemperature),
+			RemainingTime:         formatTime(event.RemainingTime),
+			ProgrammedDuration:    formatProgrammedTime(event.ProgrammedDuration),
+			ProgrammedTemperature: formatProgrammedTemperature(event.ProgrammedTemperature),
+		})
+		if err != nil {
+			t.Fatalf("json.Marshal() error = %v", err)
+		}
+		if got := appendEventMessage(nil, &event); string(got) != string(want) {
+			t.Errorf("appendEventMessage() = %s, want %s", got, want)
+		}
 	}
 }
 
@@ -366,7 +586,7 @@ func TestHubEventConversion(t *testing.T) {
 
 	client := &Client{
 		hub:  hub,
-		send: make(chan []byte, 256),
+		send: make(chan *wireMessage, 256),
 	}
 
 	hub.RegisterClient(client)
@@ -485,11 +705,11 @@ func TestHubEventConversion(t *testing.T) {
 }
 
 // Helper function to verify event message content
-func verifyEventMessage(t *testing.T, msgBytes []byte, expected *EventMessage) {
+func verifyEventMessage(t *testing.T, msg *wireMessage, expected *EventMessage) {
 	t.Helper()
 
 	var got EventMessage
-	if err := json.Unmarshal(msgBytes, &got); err != nil {
+	if err := json.Unmarshal(msg.data, &got); err != nil {
 		t.Fatalf("Failed to unmarshal event message: %v", err)
 	}
 
@@ -497,6 +717,10 @@ func verifyEventMessage(t *testing.T, msgBytes []byte, expected *EventMessage) {
 		t.Errorf("Type = %s, want %s", got.Type, expected.Type)
 	}
 
+	if got.OvenID != expected.OvenID {
+		t.Errorf("OvenID = %d, want %d", got.OvenID, expected.OvenID)
+	}
+
 	if got.State != expected.State {
 		t.Errorf("State = %s, want %s", got.State, expected.State)
 	}
@@ -517,3 +741,55 @@ func verifyEventMessage(t *testing.T, msgBytes []byte, expected *EventMessage) {
 		t.Errorf("ProgrammedTemperature = %s, want %s", got.ProgrammedTemperature, expected.ProgrammedTemperature)
 	}
 }
+
+// BenchmarkHubBroadcast measures a flush of the hub, from handing it the events to queueing
+// their messages for 10 clients, by batch size and by watch mix: every client watching every
+// oven, or each a tenth of them; ns/event is per event of the batch
+func BenchmarkHubBroadcast(b *testing.B) {
+	const clients = 10
+	for _, watch := range []string{"all", "tenth"} {
+		for _, n := range []int{1, 16, 256, 4096} {
+			b.Run(fmt.Sprintf("watch=%s/events=%d", watch, n), func(b *testing.B) {
+				hub := NewHub()
+				registered := make([]*Client, clients)
+				for c := range registered {
+					client := &Client{hub: hub, send: make(chan *wireMessage, n)}
+					if watch == "tenth" {
+						for id := c; id < n; id += clients {
+							client.ovens = append(client.ovens, uint32(id))
+						}
+					}
+					hub.addClient(client)
+					registered[c] = client
+				}
+
+				events := make([]protocol.EventPayload, n)
+				for i := range events {
+					events[i] = protocol.EventPayload{
+						OvenID:                uint32(i),
+						State:                 uint8(i % 4),
+						CurrentTemperature:    int16(25 + i%200),
+						RemainingTime:         int16(i % 3600),
+						ProgrammedDuration:    3600,
+						ProgrammedTemperature: int16(150 + i%100),
+					}
+				}
+
+				b.ReportAllocs()
+				b.ResetTimer()
+				for i := 0; i < b.N; i++ {
+					for j := range events {
+						hub.BroadcastEvent(&events[j])
+					}
+					hub.flush()
+					for _, client := range registered {
+						for len(client.send) > 0 {
+							<-client.send
+						}
+					}
+				}
+				b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*n), "ns/event")
+			})
+		}
+	}
+}
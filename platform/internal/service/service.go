@@ -1,14 +1,21 @@
 package service
 
 import (
+	"cmp"
 	"embed"
 	"encoding/json"
+	"fmt"
 	"io/fs"
 	"log"
+	"math"
 	"net/http"
+	"slices"
 	"strconv"
+	"strings"
 	"sync"
+	"time"
 
+	"github.com/dropkitchen/koven-platform/platform/internal/metrics"
 	"github.com/dropkitchen/koven-platform/platform/internal/mqtt"
 	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
 	"github.com/gorilla/websocket"
@@ -24,12 +31,49 @@ type MQTTClient interface {
 	SetEventCallback(callback mqtt.EventCallback)
 }
 
+// CommandBatchSender is implemented by the MQTT clients that send many commands at once, in as
+// few messages as they can; other clients get batches one SendCommand at a time
+type CommandBatchSender interface {
+	SendCommands(cmds []protocol.CommandPayload) error
+}
+
+// OvenCommandSender is implemented by the MQTT clients that send their own commands to many ovens
+// of emulator fleets at once, the commands of each oven in a row of ids; POST /commands needs it
+// for commands with an oven id
+type OvenCommandSender interface {
+	SendOvenCommands(ids []uint32, cmds []protocol.CommandPayload) error
+}
+
+// FleetCommandSender is implemented by the MQTT clients that send one command to many ovens of
+// emulator fleets at once; POST /fleet/commands needs it
+// ack is called with the acknowledgement latency of every message sent
+type FleetCommandSender interface {
+	SendFleetCommand(ids []uint32, cmd *protocol.CommandPayload, ack func(time.Duration)) (int, error)
+}
+
+// Most commands accepted by one POST /commands request
+const maxBatchCommands = 65536
+
+// Most commands of one oven in a POST /commands request: they all go in one command batch frame,
+// so that the emulator applies them in order
+const maxOvenCommands = protocol.MaxCommandBatchCommands
+
+// Most ovens selected by one POST /fleet/commands request
+const maxFleetOvens = 1 << 20
+
 // Service represents the API server
 type Service struct {
 	mqttClient MQTTClient
 	wsHub      *Hub
 	upgrader   websocket.Upgrader
 	closeOnce  sync.Once
+
+	registry       *metrics.Registry
+	commandsSent   *metrics.Counter
+	commandsFailed *metrics.Counter
+	commandSend    *metrics.Histogram
+	batchSend      *metrics.Histogram
+	fleetAck       *metrics.Histogram
 }
 
 // StartCommandRequest represents the payload for starting a command
@@ -38,9 +82,42 @@ type StartCommandRequest struct {
 	Duration    string `json:"duration"`
 }
 
+// CommandRequest is one command of a POST /commands request
+// OvenID addresses an oven of an emulator fleet; without it the command goes to the single oven
+// emulator. The command of a fleet command has none, its ovens are selected apart
+type CommandRequest struct {
+	OvenID      *int64 `json:"oven_id"`
+	Action      string `json:"action"`
+	Temperature int    `json:"temperature"`
+	Duration    int    `json:"duration"`
+}
+
+// CommandBatchRequest represents the payload of POST /commands
+type CommandBatchRequest struct {
+	Commands []CommandRequest `json:"commands"`
+}
+
+// OvenSelector selects the ovens of a fleet command; exactly one way of selecting them is set:
+// a list of ids, a range of ids from First to Last included, the ovens whose latest event is in
+// State, or every oven that sent an event
+type OvenSelector struct {
+	IDs   []uint32 `json:"ids"`
+	First *uint32  `json:"first"`
+	Last  *uint32  `json:"last"`
+	State string   `json:"state"`
+	All   bool     `json:"all"`
+}
+
+// FleetCommandRequest represents the payload of POST /fleet/commands
+type FleetCommandRequest struct {
+	Ovens   OvenSelector   `json:"ovens"`
+	Command CommandRequest `json:"command"`
+}
+
 // NewService creates a new API server
 func NewService(serverAddr string, mqttClient MQTTClient) *Service {
-	wsHub := NewHub()
+	registry := metrics.NewRegistry()
+	wsHub := NewHubWithMetrics(registry)
 	go wsHub.Run()
 
 	mqttClient.SetEventCallback(wsHub.BroadcastEvent)
@@ -55,6 +132,12 @@ func NewService(serverAddr string, mqttClient MQTTClient) *Service {
 				return true // Allow all connections
 			},
 		},
+		registry:       registry,
+		commandsSent:   registry.NewCounter("koven_platform_commands_sent_total", "Commands sent to the oven"),
+		commandsFailed: registry.NewCounter("koven_platform_commands_failed_total", "Commands that failed to send"),
+		commandSend:    registry.NewHistogram("koven_platform_command_send_seconds", "Encoding and publish of one command"),
+		batchSend:      registry.NewHistogram("koven_platform_command_batch_send_seconds", "Encoding and publish of one batch of commands"),
+		fleetAck:       registry.NewHistogram("koven_platform_fleet_command_ack_seconds", "Publish to acknowledgement of one fleet command message"),
 	}
 	return s
 }
@@ -65,7 +148,11 @@ func (s *Service) Routes() http.Handler {
 	mux.HandleFunc("/health", s.healthcheckHandler)
 	mux.HandleFunc("/start", s.startCommandHandler)
 	mux.HandleFunc("/stop", s.stopCommandHandler)
+	mux.HandleFunc("/commands", s.commandBatchHandler)
+	mux.HandleFunc("/fleet/commands", s.fleetCommandHandler)
 	mux.HandleFunc("/ws/events", s.websocketHandler)
+	mux.HandleFunc("/ovens", s.ovensHandler)
+	mux.Handle("/metrics", s.registry.Handler())
 
 	webRoot, err := fs.Sub(webFS, "web")
 	if err != nil {
@@ -118,7 +205,7 @@ func (s *Service) startCommandHandler(w http.ResponseWriter, r *http.Request) {
 		Duration:    int16(duration),
 	}
 
-	if err := s.mqttClient.SendCommand(cmd); err != nil {
+	if err := s.sendCommand(cmd); err != nil {
 		log.Printf("Failed to send command: %v", err)
 		http.Error(w, "Failed to send command", http.StatusInternalServerError)
 		return
@@ -141,7 +228,7 @@ func (s *Service) stopCommandHandler(w http.ResponseWriter, r *http.Request) {
 		Action: protocol.ActionStop,
 	}
 
-	if err := s.mqttClient.SendCommand(cmd); err != nil {
+	if err := s.sendCommand(cmd); err != nil {
 		log.Printf("Failed to send command: %v", err)
 		http.Error(w, "Failed to send command", http.StatusInternalServerError)
 		return
@@ -154,7 +241,356 @@ func (s *Service) stopCommandHandler(w http.ResponseWriter, r *http.Request) {
 	}
 }
 
+// commandBatchHandler sends many commands at once: to the single oven emulator on TopicCommands
+// when they have no oven id, or grouped per oven in command batch frames when they all have one,
+// as a bulk operation on emulator fleets
+func (s *Service) commandBatchHandler(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodPost {
+		http.Error(w, "Method not allowed", http.StatusMethodNotAllowed)
+		return
+	}
+
+	var req CommandBatchRequest
+	if err := json.NewDecoder(r.Body).Decode(&req); err != nil {
+		log.Printf("Failed to decode command batch request: %v", err)
+		http.Error(w, "Invalid request body", http.StatusBadRequest)
+		return
+	}
+	if len(req.Commands) == 0 || len(req.Commands) > maxBatchCommands {
+		http.Error(w, fmt.Sprintf("Expected 1 to %d commands", maxBatchCommands), http.StatusBadRequest)
+		return
+	}
+
+	cmds := make([]protocol.CommandPayload, len(req.Commands))
+	addressed := 0
+	for i, c := range req.Commands {
+		cmd, err := parseCommand(&c)
+		if err != nil {
+			http.Error(w, fmt.Sprintf("Invalid command %d: %v", i, err), http.StatusBadRequest)
+			return
+		}
+		cmds[i] = cmd
+		if c.OvenID != nil {
+			addressed++
+		}
+	}
+
+	ovens := 0
+	var err error
+	switch addressed {
+	case 0:
+		err = s.sendCommands(cmds)
+	case len(cmds):
+		var ids []uint32
+		ids, cmds, err = groupOvenCommands(req.Commands, cmds)
+		if err != nil {
+			http.Error(w, fmt.Sprintf("Invalid oven commands: %v", err), http.StatusBadRequest)
+			return
+		}
+		sender, ok := s.mqttClient.(OvenCommandSender)
+		if !ok {
+			http.Error(w, "Oven commands not supported by the transport", http.StatusNotImplemented)
+			return
+		}
+		ovens = countOvens(ids)
+		err = s.sendOvenCommands(sender, ids, cmds)
+	default:
+		http.Error(w, "Expected an oven_id on every command or on none", http.StatusBadRequest)
+		return
+	}
+	if err != nil {
+		log.Printf("Failed to send commands: %v", err)
+		http.Error(w, "Failed to send commands", http.StatusInternalServerError)
+		return
+	}
+
+	response := map[string]any{"status": "success", "sent": len(cmds)}
+	if addressed > 0 {
+		response["ovens"] = ovens
+	}
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(http.StatusOK)
+	if err := json.NewEncoder(w).Encode(response); err != nil {
+		log.Printf("Failed to write command batch response: %v", err)
+	}
+}
+
+// groupOvenCommands checks the oven ids of the commands of a batch and returns the ids and
+// commands grouped per oven, in increasing id order, each oven keeping the order of its commands
+func groupOvenCommands(reqs []CommandRequest, cmds []protocol.CommandPayload) ([]uint32, []protocol.CommandPayload, error) {
+	order := make([]int, len(reqs))
+	for i := range reqs {
+		if id := *reqs[i].OvenID; id < 0 || id > math.MaxUint32 {
+			return nil, nil, fmt.Errorf("command %d: oven id %d out of range", i, id)
+		}
+		order[i] = i
+	}
+	slices.SortStableFunc(order, func(a, b int) int {
+		return cmp.Compare(*reqs[a].OvenID, *reqs[b].OvenID)
+	})
+
+	ids := make([]uint32, len(order))
+	grouped := make([]protocol.CommandPayload, len(order))
+	run := 0
+	for i, k := range order {
+		ids[i] = uint32(*reqs[k].OvenID)
+		grouped[i] = cmds[k]
+		if i > 0 && ids[i] == ids[i-1] {
+			run++
+		} else {
+			run = 1
+		}
+		if run > maxOvenCommands {
+			return nil, nil, fmt.Errorf("over %d commands for oven %d", maxOvenCommands, ids[i])
+		}
+	}
+	return ids, grouped, nil
+}
+
+// countOvens returns the number of distinct ovens of ids, in which those of each oven are in a row
+func countOvens(ids []uint32) int {
+	ovens := 0
+	for i := range ids {
+		if i == 0 || ids[i] != ids[i-1] {
+			ovens++
+		}
+	}
+	return ovens
+}
+
+// fleetCommandHandler sends one command to many ovens, fanned out by the emulators: the platform
+// publishes a command batch frame per MaxCommandBatchCommands ovens rather than a message per
+// oven, and reports the acknowledgement latency of those messages
+func (s *Service) fleetCommandHandler(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodPost {
+		http.Error(w, "Method not allowed", http.StatusMethodNotAllowed)
+		return
+	}
+
+	sender, ok := s.mqttClient.(FleetCommandSender)
+	if !ok {
+		http.Error(w, "Fleet commands not supported by the transport", http.StatusNotImplemented)
+		return
+	}
+
+	var req FleetCommandRequest
+	if err := json.NewDecoder(r.Body).Decode(&req); err != nil {
+		log.Printf("Failed to decode fleet command request: %v", err)
+		http.Error(w, "Invalid request body", http.StatusBadRequest)
+		return
+	}
+	cmd, err := parseCommand(&req.Command)
+	if err == nil && req.Command.OvenID != nil {
+		err = fmt.Errorf("oven_id set, the ovens are selected by ovens")
+	}
+	if err != nil {
+		http.Error(w, fmt.Sprintf("Invalid command: %v", err), http.StatusBadRequest)
+		return
+	}
+	ids, err := s.selectOvens(&req.Ovens)
+	if err != nil {
+		http.Error(w, fmt.Sprintf("Invalid oven selection: %v", err), http.StatusBadRequest)
+		return
+	}
+
+	// The latencies of this request, next to those of every request
+	var acks metrics.Histogram
+	var slowest time.Duration
+	messages := 0
+	if len(ids) > 0 {
+		messages, err = sender.SendFleetCommand(ids, &cmd, func(latency time.Duration) {
+			acks.Observe(latency)
+			s.fleetAck.Observe(latency)
+			slowest = max(slowest, latency)
+		})
+		if err != nil {
+			s.commandsFailed.Add(uint64(len(ids)))
+			log.Printf("Failed to send fleet command to %d ovens: %v", len(ids), err)
+			http.Error(w, "Failed to send fleet command", http.StatusInternalServerError)
+			return
+		}
+		s.commandsSent.Add(uint64(len(ids)))
+	}
+
+	response := map[string]any{
+		"status":   "success",
+		"ovens":    len(ids),
+		"messages": messages,
+		"ack_seconds": map[string]float64{
+			"p50": acks.Quantile(0.5).Seconds(),
+			"p99": acks.Quantile(0.99).Seconds(),
+			"max": slowest.Seconds(),
+		},
+	}
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(http.StatusOK)
+	if err := json.NewEncoder(w).Encode(response); err != nil {
+		log.Printf("Failed to write fleet command response: %v", err)
+	}
+}
+
+// selectOvens returns the ids of the ovens a fleet command selects, in increasing order
+// The state and all selections are those of the latest oven states, as served on /ovens
+func (s *Service) selectOvens(sel *OvenSelector) ([]uint32, error) {
+	ways := 0
+	for _, set := range []bool{sel.IDs != nil, sel.First != nil || sel.Last != nil, sel.State != "", sel.All} {
+		if set {
+			ways++
+		}
+	}
+	if ways != 1 {
+		return nil, fmt.Errorf("expected one of ids, first and last, state or all")
+	}
+
+	var ids []uint32
+	switch {
+	case sel.IDs != nil:
+		if len(sel.IDs) == 0 || len(sel.IDs) > maxFleetOvens {
+			return nil, fmt.Errorf("expected 1 to %d ids", maxFleetOvens)
+		}
+		ids = slices.Clone(sel.IDs)
+		slices.Sort(ids)
+		ids = slices.Compact(ids)
+	case sel.First != nil || sel.Last != nil:
+		if sel.First == nil || sel.Last == nil || *sel.First > *sel.Last {
+			return nil, fmt.Errorf("expected first <= last")
+		}
+		if uint64(*sel.Last-*sel.First) >= maxFleetOvens {
+			return nil, fmt.Errorf("range over %d ovens", maxFleetOvens)
+		}
+		ids = make([]uint32, 0, *sel.Last-*sel.First+1)
+		for id := uint64(*sel.First); id <= uint64(*sel.Last); id++ {
+			ids = append(ids, uint32(id))
+		}
+	default:
+		state, ok := protocol.StateFromString(sel.State)
+		if !sel.All && !ok {
+			return nil, fmt.Errorf("unknown state %q", sel.State)
+		}
+		for _, event := range s.wsHub.Snapshot(nil) {
+			if sel.All || event.State == state {
+				ids = append(ids, event.OvenID)
+			}
+		}
+		if len(ids) > maxFleetOvens {
+			return nil, fmt.Errorf("%d ovens selected, over %d", len(ids), maxFleetOvens)
+		}
+	}
+	return ids, nil
+}
+
+// parseCommand checks one command of a batch
+func parseCommand(req *CommandRequest) (protocol.CommandPayload, error) {
+	switch req.Action {
+	case "start":
+		if req.Temperature < math.MinInt16 || req.Temperature > math.MaxInt16 {
+			return protocol.CommandPayload{}, fmt.Errorf("temperature %d out of range", req.Temperature)
+		}
+		if req.Duration < math.MinInt16 || req.Duration > math.MaxInt16 {
+			return protocol.CommandPayload{}, fmt.Errorf("duration %d out of range", req.Duration)
+		}
+		return protocol.CommandPayload{
+			Action:      protocol.ActionStart,
+			Temperature: int16(req.Temperature),
+			Duration:    int16(req.Duration),
+		}, nil
+	case "stop":
+		return protocol.CommandPayload{Action: protocol.ActionStop}, nil
+	default:
+		return protocol.CommandPayload{}, fmt.Errorf("unknown action %q", req.Action)
+	}
+}
+
+// sendCommands sends commands to the oven in order, in batches when the client supports them
+func (s *Service) sendCommands(cmds []protocol.CommandPayload) error {
+	start := time.Now()
+	defer s.batchSend.Since(start)
+
+	if sender, ok := s.mqttClient.(CommandBatchSender); ok {
+		if err := sender.SendCommands(cmds); err != nil {
+			s.commandsFailed.Add(uint64(len(cmds)))
+			return err
+		}
+		s.commandsSent.Add(uint64(len(cmds)))
+		return nil
+	}
+
+	for i := range cmds {
+		if err := s.sendCommand(&cmds[i]); err != nil {
+			s.commandsFailed.Add(uint64(len(cmds) - i - 1))
+			return err
+		}
+	}
+	return nil
+}
+
+// sendOvenCommands sends cmds[i] to the oven ids[i] through sender, as one batch
+func (s *Service) sendOvenCommands(sender OvenCommandSender, ids []uint32, cmds []protocol.CommandPayload) error {
+	start := time.Now()
+	defer s.batchSend.Since(start)
+
+	if err := sender.SendOvenCommands(ids, cmds); err != nil {
+		s.commandsFailed.Add(uint64(len(cmds)))
+		return err
+	}
+	s.commandsSent.Add(uint64(len(cmds)))
+	return nil
+}
+
+// sendCommand sends a command to the oven, counting and timing it
+func (s *Service) sendCommand(cmd *protocol.CommandPayload) error {
+	start := time.Now()
+	err := s.mqttClient.SendCommand(cmd)
+	s.commandSend.Since(start)
+	if err != nil {
+		s.commandsFailed.Inc()
+		return err
+	}
+	s.commandsSent.Inc()
+	return nil
+}
+
+// ovensHandler serves the latest state of every oven, or of the ?oven= ones, as a snapshot
+// message: {"type":"snapshot","events":[...]}, with the events of the WebSocket stream
+func (s *Service) ovensHandler(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodGet {
+		http.Error(w, "Method not allowed", http.StatusMethodNotAllowed)
+		return
+	}
+
+	ovens, err := parseOvenIDs(r.URL.Query()["oven"])
+	if err != nil {
+		log.Printf("Invalid oven selection: %v", err)
+		http.Error(w, "Invalid oven id", http.StatusBadRequest)
+		return
+	}
+
+	events := s.wsHub.Snapshot(ovens)
+	body := make([]byte, 0, 32+len(events)*192)
+	body = append(body, `{"type":"snapshot","events":[`...)
+	for i, event := range events {
+		if i > 0 {
+			body = append(body, ',')
+		}
+		body = appendEventMessage(body, event)
+	}
+	body = append(body, "]}"...)
+
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(http.StatusOK)
+	if _, err := w.Write(body); err != nil {
+		log.Printf("Failed to write ovens response: %v", err)
+	}
+}
+
 func (s *Service) websocketHandler(w http.ResponseWriter, r *http.Request) {
+	ovens, err := parseOvenIDs(r.URL.Query()["oven"])
+	if err != nil {
+		log.Printf("Invalid oven subscription: %v", err)
+		http.Error(w, "Invalid oven id", http.StatusBadRequest)
+		return
+	}
+
 	conn, err := s.upgrader.Upgrade(w, r, nil)
 	if err != nil {
 		log.Printf("Failed to upgrade connection to WebSocket: %v", err)
@@ -162,11 +598,35 @@ func (s *Service) websocketHandler(w http.ResponseWriter, r *http.Request) {
 	}
 
 	// Create new WebSocket client and register it with the hub
-	client := NewWebSocketClient(s.wsHub, conn)
+	client := NewWebSocketClient(s.wsHub, conn, ovens)
 	s.wsHub.RegisterClient(client)
 	client.Start()
 }
 
+// parseOvenIDs parses the oven query parameters, each holding one id or a comma-separated list
+// Returns nil, for every oven, when there is none
+func parseOvenIDs(values []string) ([]uint32, error) {
+	if len(values) == 0 {
+		return nil, nil
+	}
+
+	ovens := make([]uint32, 0, len(values))
+	seen := make(map[uint32]bool)
+	for _, value := range values {
+		for _, field := range strings.Split(value, ",") {
+			id, err := strconv.ParseUint(strings.TrimSpace(field), 10, 32)
+			if err != nil {
+				return nil, err
+			}
+			if !seen[uint32(id)] {
+				seen[uint32(id)] = true
+				ovens = append(ovens, uint32(id))
+			}
+		}
+	}
+	return ovens, nil
+}
+
 // Close gracefully shuts down the service
 func (s *Service) Close() error {
 	var closeErr error
@@ -4,8 +4,10 @@ import (
 	"encoding/json"
 	"net/http"
 	"net/http/httptest"
+	"slices"
 	"strings"
 	"testing"
+	"time"
 
 	"github.com/dropkitchen/koven-platform/platform/internal/mqtt"
 	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
@@ -433,3 +435,449 @@ func TestStartCommandHandlerEdgeCases(t *testing.T) {
 		})
 	}
 }
+
+// TestMetricsEndpoint tests that command and hub metrics are exported on /metrics
+func TestMetricsEndpoint(t *testing.T) {
+	mockClient := NewMockMQTTClient(true)
+	service := NewService("localhost:8080", mockClient)
+	defer service.Close()
+	routes := service.Routes()
+
+	req := httptest.NewRequest(http.MethodPost, "/stop", nil)
+	routes.ServeHTTP(httptest.NewRecorder(), req)
+	mockClient.sendError = http.ErrHandlerTimeout
+	routes.ServeHTTP(httptest.NewRecorder(), httptest.NewRequest(http.MethodPost, "/stop", nil))
+
+	w := httptest.NewRecorder()
+	routes.ServeHTTP(w, httptest.NewRequest(http.MethodGet, "/metrics", nil))
+	if w.Code != http.StatusOK {
+		t.Fatalf("Status code = %d, want %d", w.Code, http.StatusOK)
+	}
+
+	body := w.Body.String()
+	for _, want := range []string{
+		"koven_platform_commands_sent_total 1\n",
+		"koven_platform_commands_failed_total 1\n",
+		"koven_platform_command_send_seconds_count 2\n",
+		"koven_platform_websocket_clients 0\n",
+		"# TYPE koven_platform_broadcast_seconds histogram\n",
+	} {
+		if !strings.Contains(body, want) {
+			t.Errorf("Metrics missing %q", want)
+		}
+	}
+}
+
+// TestParseOvenIDs tests parsing of the oven subscriptions of /ws/events
+func TestParseOvenIDs(t *testing.T) {
+	tests := []struct {
+		name    string
+		values  []string
+		want    []uint32
+		wantErr bool
+	}{
+		{name: "every oven", values: nil, want: nil},
+		{name: "one oven", values: []string{"7"}, want: []uint32{7}},
+		{name: "list and repeats", values: []string{"1, 2", "3,1"}, want: []uint32{1, 2, 3}},
+		{name: "largest id", values: []string{"4294967295"}, want: []uint32{4294967295}},
+		{name: "not a number", values: []string{"x"}, wantErr: true},
+		{name: "empty entry", values: []string{"1,"}, wantErr: true},
+		{name: "out of range", values: []string{"4294967296"}, wantErr: true},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			got, err := parseOvenIDs(tt.values)
+			if (err != nil) != tt.wantErr {
+				t.Fatalf("parseOvenIDs() error = %v, wantErr %v", err, tt.wantErr)
+			}
+			if len(got) != len(tt.want) || (got == nil) != (tt.want == nil) {
+				t.Fatalf("parseOvenIDs() = %v, want %v", got, tt.want)
+			}
+			for i := range got {
+				if got[i] != tt.want[i] {
+					t.Errorf("parseOvenIDs()[%d] = %d, want %d", i, got[i], tt.want[i])
+				}
+			}
+		})
+	}
+
+	mockClient := NewMockMQTTClient(true)
+	service := NewService("localhost:8080", mockClient)
+	defer service.Close()
+	w := httptest.NewRecorder()
+	service.websocketHandler(w, httptest.NewRequest(http.MethodGet, "/ws/events?oven=abc", nil))
+	if w.Code != http.StatusBadRequest {
+		t.Errorf("Status code = %d, want %d", w.Code, http.StatusBadRequest)
+	}
+}
+
+// TestOvensHandler tests the snapshot of the latest oven states
+func TestOvensHandler(t *testing.T) {
+	mockClient := NewMockMQTTClient(true)
+	service := NewService("localhost:8080", mockClient)
+	defer service.Close()
+
+	mockClient.eventCallback(&protocol.EventPayload{OvenID: 9, State: protocol.StateIdle, CurrentTemperature: 25})
+	mockClient.eventCallback(&protocol.EventPayload{OvenID: 2, State: protocol.StatePreheating, CurrentTemperature: 40})
+	mockClient.eventCallback(&protocol.EventPayload{OvenID: 2, State: protocol.StatePreheating, CurrentTemperature: 41})
+
+	type snapshot struct {
+		Type   string         `json:"type"`
+		Events []EventMessage `json:"events"`
+	}
+	get := func(target string) (int, snapshot) {
+		w := httptest.NewRecorder()
+		service.ovensHandler(w, httptest.NewRequest(http.MethodGet, target, nil))
+		var body snapshot
+		if w.Code == http.StatusOK {
+			if err := json.Unmarshal(w.Body.Bytes(), &body); err != nil {
+				t.Fatalf("Invalid snapshot %q: %v", w.Body.String(), err)
+			}
+		}
+		return w.Code, body
+	}
+
+	code, body := get("/ovens")
+	if code != http.StatusOK || body.Type != "snapshot" || len(body.Events) != 2 {
+		t.Fatalf("GET /ovens = %d %+v", code, body)
+	}
+	if body.Events[0].OvenID != 2 || body.Events[0].CurrentTemperature != "41°C" || body.Events[1].OvenID != 9 {
+		t.Errorf("Snapshot should hold the latest state of each oven by id, got %+v", body.Events)
+	}
+
+	code, body = get("/ovens?oven=9,5")
+	if code != http.StatusOK || len(body.Events) != 1 || body.Events[0].State != "IDLE" {
+		t.Errorf("GET /ovens?oven=9,5 = %d %+v", code, body)
+	}
+
+	if code, _ := get("/ovens?oven=x"); code != http.StatusBadRequest {
+		t.Errorf("Status code = %d, want %d", code, http.StatusBadRequest)
+	}
+	w := httptest.NewRecorder()
+	service.ovensHandler(w, httptest.NewRequest(http.MethodPost, "/ovens", nil))
+	if w.Code != http.StatusMethodNotAllowed {
+		t.Errorf("Status code = %d, want %d", w.Code, http.StatusMethodNotAllowed)
+	}
+}
+
+// MockBatchMQTTClient is a MockMQTTClient that also sends batches of commands
+type MockBatchMQTTClient struct {
+	*MockMQTTClient
+	batches int
+}
+
+func (m *MockBatchMQTTClient) SendCommands(cmds []protocol.CommandPayload) error {
+	if m.sendError != nil {
+		return m.sendError
+	}
+	m.batches++
+	for i := range cmds {
+		m.sentCommands = append(m.sentCommands, &cmds[i])
+	}
+	return nil
+}
+
+// TestCommandBatchHandler tests POST /commands with and without batch support in the client
+func TestCommandBatchHandler(t *testing.T) {
+	body := `{"commands":[{"action":"start","temperature":200,"duration":60},{"action":"stop"},` +
+		`{"action":"start","temperature":-1,"duration":32767}]}`
+
+	single := NewMockMQTTClient(true)
+	batch := &MockBatchMQTTClient{MockMQTTClient: NewMockMQTTClient(true)}
+	for _, client := range []MQTTClient{single, batch} {
+		service := NewService("localhost:8080", client)
+		w := httptest.NewRecorder()
+		service.commandBatchHandler(w, httptest.NewRequest(http.MethodPost, "/commands", strings.NewReader(body)))
+		service.Close()
+
+		if w.Code != http.StatusOK || !strings.Contains(w.Body.String(), `"sent":3`) {
+			t.Fatalf("POST /commands = %d %q", w.Code, w.Body.String())
+		}
+		if got := service.commandsSent.Value(); got != 3 {
+			t.Errorf("Commands sent = %d, want 3", got)
+		}
+	}
+
+	for _, sent := range [][]*protocol.CommandPayload{single.GetSentCommands(), batch.GetSentCommands()} {
+		if len(sent) != 3 || sent[0].Temperature != 200 || sent[1].Action != protocol.ActionStop ||
+			sent[2].Temperature != -1 || sent[2].Duration != 32767 {
+			t.Errorf("Sent commands = %+v", sent)
+		}
+	}
+	if batch.batches != 1 {
+		t.Errorf("Batches = %d, want 1", batch.batches)
+	}
+}
+
+// TestCommandBatchHandlerErrors tests the rejected batches
+func TestCommandBatchHandlerErrors(t *testing.T) {
+	tests := []struct {
+		name           string
+		method         string
+		body           string
+		sendError      error
+		expectedStatus int
+	}{
+		{"GET", http.MethodGet, "", nil, http.StatusMethodNotAllowed},
+		{"invalid JSON", http.MethodPost, `{"commands":`, nil, http.StatusBadRequest},
+		{"no commands", http.MethodPost, `{"commands":[]}`, nil, http.StatusBadRequest},
+		{"unknown action", http.MethodPost, `{"commands":[{"action":"bake"}]}`, nil, http.StatusBadRequest},
+		{"temperature out of range", http.MethodPost,
+			`{"commands":[{"action":"start","temperature":40000,"duration":1}]}`, nil, http.StatusBadRequest},
+		{"send error", http.MethodPost, `{"commands":[{"action":"stop"}]}`, http.ErrHandlerTimeout,
+			http.StatusInternalServerError},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			mockClient := NewMockMQTTClient(true)
+			mockClient.sendError = tt.sendError
+			service := NewService("localhost:8080", mockClient)
+			defer service.Close()
+
+			w := httptest.NewRecorder()
+			service.commandBatchHandler(w, httptest.NewRequest(tt.method, "/commands", strings.NewReader(tt.body)))
+			if w.Code != tt.expectedStatus {
+				t.Errorf("Status code = %d, want %d", w.Code, tt.expectedStatus)
+			}
+			if len(mockClient.GetSentCommands()) != 0 {
+				t.Error("No command should have been sent")
+			}
+		})
+	}
+}
+
+// MockOvenMQTTClient is a MockMQTTClient that also sends commands to the ovens of fleets
+type MockOvenMQTTClient struct {
+	*MockMQTTClient
+	ids  []uint32
+	cmds []protocol.CommandPayload
+}
+
+func (m *MockOvenMQTTClient) SendOvenCommands(ids []uint32, cmds []protocol.CommandPayload) error {
+	if m.sendError != nil {
+		return m.sendError
+	}
+	m.ids = append(m.ids, ids...)
+	m.cmds = append(m.cmds, cmds...)
+	return nil
+}
+
+// TestCommandBatchHandlerOvenCommands tests that commands with an oven id are grouped per oven,
+// each oven keeping the order of its commands
+func TestCommandBatchHandlerOvenCommands(t *testing.T) {
+	client := &MockOvenMQTTClient{MockMQTTClient: NewMockMQTTClient(true)}
+	service := NewService("localhost:8080", client)
+	defer service.Close()
+
+	body := `{"commands":[{"oven_id":9,"action":"start","temperature":200,"duration":60},` +
+		`{"oven_id":3,"action":"stop"},{"oven_id":9,"action":"stop"},{"oven_id":4294967295,"action":"stop"}]}`
+	w := httptest.NewRecorder()
+	service.commandBatchHandler(w, httptest.NewRequest(http.MethodPost, "/commands", strings.NewReader(body)))
+	if w.Code != http.StatusOK || !strings.Contains(w.Body.String(), `"ovens":3`) ||
+		!strings.Contains(w.Body.String(), `"sent":4`) {
+		t.Fatalf("POST /commands = %d %q", w.Code, w.Body.String())
+	}
+
+	start := protocol.CommandPayload{Action: protocol.ActionStart, Temperature: 200, Duration: 60}
+	stop := protocol.CommandPayload{Action: protocol.ActionStop}
+	if !slices.Equal(client.ids, []uint32{3, 9, 9, 4294967295}) ||
+		!slices.Equal(client.cmds, []protocol.CommandPayload{stop, start, stop, stop}) {
+		t.Errorf("Sent %v %+v", client.ids, client.cmds)
+	}
+	if len(client.GetSentCommands()) != 0 {
+		t.Error("No command should have gone to the single oven emulator")
+	}
+	if got := service.commandsSent.Value(); got != 4 {
+		t.Errorf("Commands sent = %d, want 4", got)
+	}
+}
+
+// TestCommandBatchHandlerOvenCommandErrors tests the rejected batches of commands with oven ids
+func TestCommandBatchHandlerOvenCommandErrors(t *testing.T) {
+	tooMany := `{"commands":[` + strings.Repeat(`{"oven_id":1,"action":"stop"},`, maxOvenCommands) +
+		`{"oven_id":1,"action":"stop"}]}`
+	tests := []struct {
+		name           string
+		body           string
+		sendError      error
+		expectedStatus int
+	}{
+		{"some without oven id", `{"commands":[{"oven_id":1,"action":"stop"},{"action":"stop"}]}`, nil,
+			http.StatusBadRequest},
+		{"negative oven id", `{"commands":[{"oven_id":-1,"action":"stop"}]}`, nil, http.StatusBadRequest},
+		{"oven id out of range", `{"commands":[{"oven_id":4294967296,"action":"stop"}]}`, nil,
+			http.StatusBadRequest},
+		{"too many commands for an oven", tooMany, nil, http.StatusBadRequest},
+		{"send error", `{"commands":[{"oven_id":1,"action":"stop"}]}`, http.ErrHandlerTimeout,
+			http.StatusInternalServerError},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			client := &MockOvenMQTTClient{MockMQTTClient: NewMockMQTTClient(true)}
+			client.sendError = tt.sendError
+			service := NewService("localhost:8080", client)
+			defer service.Close()
+
+			w := httptest.NewRecorder()
+			service.commandBatchHandler(w, httptest.NewRequest(http.MethodPost, "/commands", strings.NewReader(tt.body)))
+			if w.Code != tt.expectedStatus {
+				t.Errorf("Status code = %d, want %d", w.Code, tt.expectedStatus)
+			}
+			if len(client.ids) != 0 || len(client.GetSentCommands()) != 0 {
+				t.Error("No command should have been sent")
+			}
+		})
+	}
+
+	// Clients without oven commands
+	service := NewService("localhost:8080", NewMockMQTTClient(true))
+	defer service.Close()
+	w := httptest.NewRecorder()
+	body := strings.NewReader(`{"commands":[{"oven_id":1,"action":"stop"}]}`)
+	service.commandBatchHandler(w, httptest.NewRequest(http.MethodPost, "/commands", body))
+	if w.Code != http.StatusNotImplemented {
+		t.Errorf("Status code = %d, want %d", w.Code, http.StatusNotImplemented)
+	}
+}
+
+// MockFleetMQTTClient is a MockMQTTClient that also sends fleet commands, in messages of
+// protocol.MaxCommandBatchCommands ovens acknowledged after a millisecond each
+type MockFleetMQTTClient struct {
+	*MockMQTTClient
+	ovens []uint32
+	cmd   protocol.CommandPayload
+}
+
+func (m *MockFleetMQTTClient) SendFleetCommand(ids []uint32, cmd *protocol.CommandPayload, ack func(time.Duration)) (int, error) {
+	if m.sendError != nil {
+		return 0, m.sendError
+	}
+	m.ovens = append(m.ovens, ids...)
+	m.cmd = *cmd
+	messages := (len(ids) + protocol.MaxCommandBatchCommands - 1) / protocol.MaxCommandBatchCommands
+	for i := 0; i < messages; i++ {
+		ack(time.Millisecond)
+	}
+	return messages, nil
+}
+
+// TestFleetCommandHandler tests POST /fleet/commands with every way of selecting ovens
+func TestFleetCommandHandler(t *testing.T) {
+	client := &MockFleetMQTTClient{MockMQTTClient: NewMockMQTTClient(true)}
+	service := NewService("localhost:8080", client)
+	defer service.Close()
+
+	client.eventCallback(&protocol.EventPayload{OvenID: 4, State: protocol.StateBaking})
+	client.eventCallback(&protocol.EventPayload{OvenID: 8, State: protocol.StateIdle})
+	client.eventCallback(&protocol.EventPayload{OvenID: 2, State: protocol.StateIdle})
+
+	type response struct {
+		Ovens      int                `json:"ovens"`
+		Messages   int                `json:"messages"`
+		AckSeconds map[string]float64 `json:"ack_seconds"`
+	}
+	tests := []struct {
+		name      string
+		ovens     string
+		wantOvens []uint32
+		messages  int
+	}{
+		{"ids", `{"ids":[9,3,9]}`, []uint32{3, 9}, 1},
+		{"range", `{"first":10,"last":5009}`, nil, 2},
+		{"state", `{"state":"IDLE"}`, []uint32{2, 8}, 1},
+		{"all", `{"all":true}`, []uint32{2, 4, 8}, 1},
+		{"no oven in state", `{"state":"PREHEATING"}`, []uint32{}, 0},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			client.ovens = client.ovens[:0]
+			body := `{"ovens":` + tt.ovens + `,"command":{"action":"start","temperature":180,"duration":600}}`
+			w := httptest.NewRecorder()
+			service.fleetCommandHandler(w, httptest.NewRequest(http.MethodPost, "/fleet/commands", strings.NewReader(body)))
+
+			var got response
+			if w.Code != http.StatusOK || json.Unmarshal(w.Body.Bytes(), &got) != nil {
+				t.Fatalf("POST /fleet/commands = %d %q", w.Code, w.Body.String())
+			}
+			if got.Ovens != len(client.ovens) || got.Messages != tt.messages {
+				t.Errorf("Response = %+v, sent to %d ovens", got, len(client.ovens))
+			}
+			if tt.wantOvens != nil && !slices.Equal(client.ovens, tt.wantOvens) {
+				t.Errorf("Sent to ovens %v, want %v", client.ovens, tt.wantOvens)
+			}
+			if tt.messages > 0 && (got.AckSeconds["max"] != 0.001 || got.AckSeconds["p50"] > 0.001 || got.AckSeconds["p50"] < 0.0008) {
+				t.Errorf("Ack latency = %v, want about 1ms", got.AckSeconds)
+			}
+		})
+	}
+
+	if client.cmd != (protocol.CommandPayload{Action: protocol.ActionStart, Temperature: 180, Duration: 600}) {
+		t.Errorf("Sent command %+v", client.cmd)
+	}
+	if got := service.commandsSent.Value(); got != 2+5000+2+3 {
+		t.Errorf("Commands sent = %d, want %d", got, 2+5000+2+3)
+	}
+	if got := service.fleetAck.Count(); got != 5 {
+		t.Errorf("Fleet acknowledgements = %d, want 5", got)
+	}
+}
+
+// TestFleetCommandHandlerErrors tests the rejected fleet commands
+func TestFleetCommandHandlerErrors(t *testing.T) {
+	const stop = `,"command":{"action":"stop"}}`
+	tests := []struct {
+		name           string
+		method         string
+		body           string
+		sendError      error
+		expectedStatus int
+	}{
+		{"GET", http.MethodGet, "", nil, http.StatusMethodNotAllowed},
+		{"invalid JSON", http.MethodPost, `{"ovens":`, nil, http.StatusBadRequest},
+		{"negative id", http.MethodPost, `{"ovens":{"ids":[-1]}` + stop, nil, http.StatusBadRequest},
+		{"no selection", http.MethodPost, `{"ovens":{}` + stop, nil, http.StatusBadRequest},
+		{"two selections", http.MethodPost, `{"ovens":{"ids":[1],"all":true}` + stop, nil, http.StatusBadRequest},
+		{"no ids", http.MethodPost, `{"ovens":{"ids":[]}` + stop, nil, http.StatusBadRequest},
+		{"open range", http.MethodPost, `{"ovens":{"first":3}` + stop, nil, http.StatusBadRequest},
+		{"reversed range", http.MethodPost, `{"ovens":{"first":3,"last":2}` + stop, nil, http.StatusBadRequest},
+		{"range too large", http.MethodPost, `{"ovens":{"first":0,"last":4294967295}` + stop, nil, http.StatusBadRequest},
+		{"unknown state", http.MethodPost, `{"ovens":{"state":"ON"}` + stop, nil, http.StatusBadRequest},
+		{"unknown action", http.MethodPost, `{"ovens":{"all":true},"command":{"action":"bake"}}`, nil, http.StatusBadRequest},
+		{"command with an oven id", http.MethodPost, `{"ovens":{"all":true},"command":{"oven_id":1,"action":"stop"}}`, nil,
+			http.StatusBadRequest},
+		{"send error", http.MethodPost, `{"ovens":{"ids":[1]}` + stop, http.ErrHandlerTimeout,
+			http.StatusInternalServerError},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			client := &MockFleetMQTTClient{MockMQTTClient: NewMockMQTTClient(true)}
+			client.sendError = tt.sendError
+			service := NewService("localhost:8080", client)
+			defer service.Close()
+
+			w := httptest.NewRecorder()
+			service.fleetCommandHandler(w, httptest.NewRequest(tt.method, "/fleet/commands", strings.NewReader(tt.body)))
+			if w.Code != tt.expectedStatus {
+				t.Errorf("Status code = %d, want %d", w.Code, tt.expectedStatus)
+			}
+			if len(client.ovens) != 0 {
+				t.Error("No command should have been sent")
+			}
+		})
+	}
+
+	// Clients without fleet commands
+	service := NewService("localhost:8080", NewMockMQTTClient(true))
+	defer service.Close()
+	w := httptest.NewRecorder()
+	body := strings.NewReader(`{"ovens":{"all":true}` + stop)
+	service.fleetCommandHandler(w, httptest.NewRequest(http.MethodPost, "/fleet/commands", body))
+	if w.Code != http.StatusNotImplemented {
+		t.Errorf("Status code = %d, want %d", w.Code, http.StatusNotImplemented)
+	}
+}
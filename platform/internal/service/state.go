@@ -0,0 +1,77 @@
+package service
+
+import (
+	"sort"
+	"sync"
+	"sync/atomic"
+
+	"github.com/dropkitchen/koven-platform/platform/internal/protocol"
+)
+
+// ovenState holds the latest event of one oven
+// Every update stores a new copy, so a reader never sees an event half written
+type ovenState struct {
+	event atomic.Pointer[protocol.EventPayload]
+}
+
+// stateCache is the latest state of every oven that sent an event, written from the event
+// callbacks and read without locks: ovens are added once to a sync.Map, which is lock-free for
+// the keys it already has, and their state is then replaced with an atomic store
+type stateCache struct {
+	ovens sync.Map
+	count atomic.Int64
+}
+
+// update records the latest event of its oven
+func (c *stateCache) update(event *protocol.EventPayload) {
+	latest := *event
+	if state, ok := c.ovens.Load(event.OvenID); ok {
+		state.(*ovenState).event.Store(&latest)
+		return
+	}
+
+	state := &ovenState{}
+	state.event.Store(&latest)
+	if existing, loaded := c.ovens.LoadOrStore(event.OvenID, state); loaded {
+		existing.(*ovenState).event.Store(&latest)
+		return
+	}
+	c.count.Add(1)
+}
+
+// get returns the latest event of an oven, and whether it sent one
+func (c *stateCache) get(id uint32) (*protocol.EventPayload, bool) {
+	state, ok := c.ovens.Load(id)
+	if !ok {
+		return nil, false
+	}
+	return state.(*ovenState).event.Load(), true
+}
+
+// snapshot returns the latest event of the given ovens, or of every oven when ovens is nil,
+// by oven id; ovens that never sent an event are left out
+func (c *stateCache) snapshot(ovens []uint32) []*protocol.EventPayload {
+	var events []*protocol.EventPayload
+	if ovens == nil {
+		events = make([]*protocol.EventPayload, 0, c.count.Load())
+		c.ovens.Range(func(_, state any) bool {
+			events = append(events, state.(*ovenState).event.Load())
+			return true
+		})
+	} else {
+		events = make([]*protocol.EventPayload, 0, len(ovens))
+		for _, id := range ovens {
+			if event, ok := c.get(id); ok {
+				events = append(events, event)
+			}
+		}
+	}
+
+	sort.Slice(events, func(i, j int) bool { return events[i].OvenID < events[j].OvenID })
+	return events
+}
+
+// size returns the number of ovens in the cache
+func (c *stateCache) size() int {
+	return int(c.count.Load())
+}
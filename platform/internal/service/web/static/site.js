@@ -24,33 +24,42 @@ function connectWebSocket() {
     }
   };
 
-  ws.onmessage = (event) => {
-    try {
-      const data = JSON.parse(event.data);
+  const showEvent = (data) => {
+    // Update device state with Mustache template
+    if (data.type === "event" && deviceStateContainer) {
+      updateDeviceState(data);
+    }
 
-      // Update device state with Mustache template
-      if (data.type === "event" && deviceStateContainer) {
-        updateDeviceState(data);
-      }
+    // Add event to stream
+    const eventElement = document.createElement("div");
+    eventElement.className = "event";
 
-      // Add event to stream
-      const eventElement = document.createElement("div");
-      eventElement.className = "event";
+    const now = new Date().toLocaleTimeString();
+    eventElement.innerHTML = `
+      <div class="event-time">${now}</div>
+      <div class="event-data">${JSON.stringify(data, null, 2)}</div>
+    `;
 
-      const now = new Date().toLocaleTimeString();
-      eventElement.innerHTML = `
-        <div class="event-time">${now}</div>
-        <div class="event-data">${JSON.stringify(data, null, 2)}</div>
-      `;
+    if (eventsContainer.querySelector('p[style*="italic"]')) {
+      eventsContainer.innerHTML = "";
+    }
 
-      if (eventsContainer.querySelector('p[style*="italic"]')) {
-        eventsContainer.innerHTML = "";
-      }
+    eventsContainer.insertBefore(eventElement, eventsContainer.firstChild);
 
-      eventsContainer.insertBefore(eventElement, eventsContainer.firstChild);
+    if (eventsContainer.children.length > 50) {
+      eventsContainer.removeChild(eventsContainer.lastChild);
+    }
+  };
+
+  ws.onmessage = (event) => {
+    try {
+      const data = JSON.parse(event.data);
 
-      if (eventsContainer.children.length > 50) {
-        eventsContainer.removeChild(eventsContainer.lastChild);
+      // Events queued together arrive as one batch message
+      if (data.type === "batch") {
+        data.events.forEach(showEvent);
+      } else {
+        showEvent(data);
       }
     } catch (e) {
       console.error("Failed to parse event:", e);
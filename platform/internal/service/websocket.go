@@ -1,6 +1,7 @@
 package service
 
 import (
+	"io"
 	"log"
 	"time"
 
@@ -13,6 +14,9 @@ const (
 
 	// Send pings to peer with this period to keep connection alive
 	pingPeriod = 54 * time.Second
+
+	// Most queued messages written together as one batch frame
+	maxCoalesced = 64
 )
 
 // Client represents a single WebSocket connection
@@ -23,16 +27,23 @@ type Client struct {
 	// The hub this client belongs to
 	hub *Hub
 
-	// Buffered channel of outbound messages
-	send chan []byte
+	// Buffered channel of outbound messages, shared with the other clients
+	send chan *wireMessage
+
+	// Ids of the ovens whose events the client gets, or nil for every oven
+	ovens []uint32
+
+	// Messages of the batch being written, reused by every write
+	batch []*wireMessage
 }
 
-// NewWebSocketClient creates a new WebSocket client
-func NewWebSocketClient(hub *Hub, conn *websocket.Conn) *Client {
+// NewWebSocketClient creates a new WebSocket client watching ovens, or every oven when nil
+func NewWebSocketClient(hub *Hub, conn *websocket.Conn, ovens []uint32) *Client {
 	return &Client{
-		hub:  hub,
-		conn: conn,
-		send: make(chan []byte, 256),
+		hub:   hub,
+		conn:  conn,
+		send:  make(chan *wireMessage, 256),
+		ovens: ovens,
 	}
 }
 
@@ -65,11 +76,18 @@ func (c *Client) writePump() {
 				return
 			}
 
-			// Write the message as JSON text
-			if err := c.conn.WriteMessage(websocket.TextMessage, message); err != nil {
+			// Write whatever else is queued along with it, in a single frame
+			batch, open := c.drain(message)
+			if err := c.writeBatch(batch); err != nil {
 				log.Printf("WebSocket write error: %v", err)
 				return
 			}
+			if !open {
+				if err := c.conn.WriteMessage(websocket.CloseMessage, []byte{}); err != nil {
+					log.Printf("WebSocket close message error: %v", err)
+				}
+				return
+			}
 
 		case <-ticker.C:
 			// Send periodic ping to keep connection alive and detect disconnections
@@ -85,6 +103,60 @@ func (c *Client) writePump() {
 	}
 }
 
+// drain returns first with the messages queued after it, up to maxCoalesced, and whether the
+// send channel is still open
+func (c *Client) drain(first *wireMessage) ([]*wireMessage, bool) {
+	c.batch = append(c.batch[:0], first)
+	for len(c.batch) < maxCoalesced {
+		select {
+		case message, ok := <-c.send:
+			if !ok {
+				return c.batch, false
+			}
+			c.batch = append(c.batch, message)
+		default:
+			return c.batch, true
+		}
+	}
+	return c.batch, true
+}
+
+// writeBatch writes one message as its prepared frame, and several as one batch message:
+// {"type":"batch","events":[...]}, made of the serialized events as they are
+func (c *Client) writeBatch(batch []*wireMessage) error {
+	if len(batch) == 1 {
+		return c.conn.WritePreparedMessage(batch[0].prepared)
+	}
+
+	w, err := c.conn.NextWriter(websocket.TextMessage)
+	if err != nil {
+		return err
+	}
+	if err := writeBatchMessage(w, batch); err != nil {
+		return err
+	}
+	return w.Close()
+}
+
+// writeBatchMessage writes the batch message of several messages
+func writeBatchMessage(w io.Writer, batch []*wireMessage) error {
+	if _, err := io.WriteString(w, `{"type":"batch","events":[`); err != nil {
+		return err
+	}
+	for i, message := range batch {
+		if i > 0 {
+			if _, err := io.WriteString(w, ","); err != nil {
+				return err
+			}
+		}
+		if _, err := w.Write(message.data); err != nil {
+			return err
+		}
+	}
+	_, err := io.WriteString(w, "]}")
+	return err
+}
+
 // Start begins the write pump for this client
 func (c *Client) Start() {
 	go c.writePump()
@@ -14,18 +14,32 @@ import (
 	"github.com/dropkitchen/koven-platform/platform/internal/service"
 )
 
+// transport carries commands and events between the platform and the emulators
+type transport interface {
+	service.MQTTClient
+	Connect() error
+	Disconnect()
+}
+
 func main() {
 	serverAddr := flag.String("addr", "localhost:8080", "HTTP server address")
 	mqttBroker := flag.String("mqtt-broker", "tcp://localhost:1883", "MQTT broker URL")
+	localSocket := flag.String("local-socket", "", "Unix socket to serve emulators on instead of using the MQTT broker")
 	flag.Parse()
 
-	mqttClient, err := mqtt.NewClient(*mqttBroker, "koven_platform")
-	if err != nil {
-		log.Fatalf("Failed to create MQTT client: %v", err)
+	var mqttClient transport
+	if *localSocket != "" {
+		mqttClient = mqtt.NewLocalClient(*localSocket)
+	} else {
+		client, err := mqtt.NewClient(*mqttBroker, "koven_platform")
+		if err != nil {
+			log.Fatalf("Failed to create MQTT client: %v", err)
+		}
+		mqttClient = client
 	}
 
 	if err := mqttClient.Connect(); err != nil {
-		log.Fatalf("Failed to connect to MQTT broker: %v", err)
+		log.Fatalf("Failed to connect: %v", err)
 	}
 
 	svc := service.NewService(*serverAddr, mqttClient)
@@ -50,7 +64,7 @@ func main() {
 
 // waitForShutdown blocks until receiving an interrupt signal or server error,
 // then performs graceful shutdown of all components
-func waitForShutdown(httpServer *http.Server, svc *service.Service, mqttClient *mqtt.Client, serverErrors <-chan error) {
+func waitForShutdown(httpServer *http.Server, svc *service.Service, mqttClient transport, serverErrors <-chan error) {
 	sigChan := make(chan os.Signal, 1)
 	signal.Notify(sigChan, os.Interrupt, syscall.SIGTERM)
 
@@ -66,7 +80,7 @@ func waitForShutdown(httpServer *http.Server, svc *service.Service, mqttClient *
 }
 
 // performShutdown executes the graceful shutdown sequence for all components
-func performShutdown(httpServer *http.Server, svc *service.Service, mqttClient *mqtt.Client) {
+func performShutdown(httpServer *http.Server, svc *service.Service, mqttClient transport) {
 	shutdownCtx, shutdownCancel := context.WithTimeout(context.Background(), 30*time.Second)
 	defer shutdownCancel()
 